@@ -57,6 +57,10 @@ public:
   void write_mem(const vm_ptr_t *dst_addrs, const vm_size_t *bufs_sizes,
                  const char **in_bufs, std::size_t nbuffs) override;
 
+  void read_mem_diff(vm_ptr_t addr, vm_size_t size, std::uint64_t &version,
+                     std::vector<vm_size_t> &out_pages,
+                     std::vector<char> &out_data) override;
+
   void get_symbols_by_ids(const vm_sym_t *ids, SymbolInfos *out_infos,
                           std::size_t nsyms) override;
 
@@ -66,16 +70,40 @@ public:
   void get_symbols_by_names(const char **names, SymbolInfos *out_infos,
                             std::size_t nsyms) override;
 
+  void get_symbols_table(SymbolsTable &out_table) override;
+
   void get_code_text(vm_ptr_t addr, std::size_t nins,
                      std::vector<std::string> &out_text,
                      std::vector<vm_size_t> &out_sizes) override;
 
+  void get_code_annotated(vm_ptr_t addr, std::size_t nins,
+                          CodeAnnotated &out_code) override;
+
+  void get_code_around(vm_ptr_t addr, std::size_t nbefore, std::size_t nafter,
+                       CodeAnnotated &out_code) override;
+
+  void get_stack_syms(CallStack &out_stack,
+                      std::vector<vm_sym_t> &out_frames_syms,
+                      std::vector<SymbolInfos> &out_syms) override;
+
+  void get_stack_frames(std::size_t beg, std::size_t end,
+                        CallStack &out_frames) override;
+
   void add_breakpoints(const vm_ptr_t *addrs, std::size_t size) override;
 
   void del_breakpoints(const vm_ptr_t *addrs, std::size_t size) override;
 
+  void get_breakpoints(std::vector<vm_ptr_t> &out_addrs) override;
+
+  /// Capabilities negotiated on connect
+  bool has_cap(std::uint32_t caps) const override;
+
   void resume(ResumeType type) override;
 
+  void set_prefetch(const PrefetchProfile &profile) override;
+
+  void get_stats(ServerStats &out_stats) override;
+
 private:
   std::unique_ptr<DBClientImplData_Internal> _impl;
 };
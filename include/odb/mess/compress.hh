@@ -0,0 +1,54 @@
+//===-- mess/compress.hh - Compression codec --------------------*- C++ -*-===//
+//
+// ODB Library
+// Author: Steven Lariau
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// Small LZ77 codec (similar to the LZ4 block format), used to compress big
+/// messages
+///
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace odb {
+
+// Format: a sequence of blocks, each made of:
+// - token (1 byte): literals length (high 4 bits), match length - 4 (low 4
+//   bits). A value of 15 is followed by extra bytes added to the length, until
+//   one is not 255
+// - literals: bytes copied as-is
+// - match offset (2 bytes, little endian): distance to the start of the
+//   match in the output. The match can overlap the output (used for runs)
+// The last block only have literals, and stops at the end of the input
+//
+// @EXTRA no checksum: it's only used over TCP
+
+/// Messages smaller than this are never compressed
+constexpr std::size_t COMPRESS_MIN_SIZE = 4096;
+
+/// Max size of the compressed data for an input of `size` bytes
+std::size_t lz_compress_bound(std::size_t size);
+
+/// Max size of the uncompressed data for `size` compressed bytes
+/// A match length byte adds at most 255 bytes to the output
+std::size_t lz_decompress_bound(std::size_t size);
+
+/// Compress the `size` bytes in `src`, and write them to `dst`
+/// `dst` is resized to the compressed size
+/// @returns the compressed size
+std::size_t lz_compress(const char *src, std::size_t size,
+                        std::vector<char> &dst);
+
+/// Decompress the `src_size` bytes in `src`, into `dst`
+/// `dst_size` must be the exact size of the uncompressed data
+/// @returns false if the data is invalid
+bool lz_decompress(const char *src, std::size_t src_size, char *dst,
+                   std::size_t dst_size);
+
+} // namespace odb
@@ -30,6 +30,10 @@ public:
   /// Fill udp with first update, or set stopped = false if not stopped
   virtual void connect(VMInfos &infos, DBClientUpdate &udp) = 0;
 
+  /// Returns true if the server supports all features of `caps` (ProtoCaps)
+  /// Only valid after connect
+  virtual bool has_cap(std::uint32_t caps) const = 0;
+
   virtual void stop() = 0;
 
   /// Fill udp with update, or set stopped = false if not stopped
@@ -53,6 +57,13 @@ public:
   virtual void write_mem(const vm_ptr_t *dst_addrs, const vm_size_t *bufs_sizes,
                          const char **in_bufs, std::size_t nbuffs) = 0;
 
+  // Only the pages of [addr, addr + size[ that changed since `version`
+  // See Debugger::read_mem_diff
+  virtual void read_mem_diff(vm_ptr_t addr, vm_size_t size,
+                             std::uint64_t &version,
+                             std::vector<vm_size_t> &out_pages,
+                             std::vector<char> &out_data) = 0;
+
   virtual void get_symbols_by_ids(const vm_sym_t *ids, SymbolInfos *out_infos,
                                   std::size_t nsyms) = 0;
 
@@ -62,15 +73,49 @@ public:
   virtual void get_symbols_by_names(const char **names, SymbolInfos *out_infos,
                                     std::size_t nsyms) = 0;
 
+  // Whole symbol table, see SymbolsTable
+  // Throws if not supported by the server
+  virtual void get_symbols_table(SymbolsTable &out_table) = 0;
+
   virtual void get_code_text(vm_ptr_t addr, std::size_t nins,
                              std::vector<std::string> &out_text,
 			     std::vector<vm_size_t>& out_sizes) = 0;
 
+  // Disassembly with the symbols resolved, see CodeAnnotated
+  virtual void get_code_annotated(vm_ptr_t addr, std::size_t nins,
+                                  CodeAnnotated &out_code) = 0;
+
+  // Up to `nbefore` instructions before `addr`, then `nafter` from `addr`
+  virtual void get_code_around(vm_ptr_t addr, std::size_t nbefore,
+                               std::size_t nafter, CodeAnnotated &out_code) = 0;
+
+  // Call stack, with the symbol containing the start of every frame
+  // `out_frames_syms[i]` is the symbol of frame i, or VM_SYM_NULL, and
+  // `out_syms` has the infos of all of them
+  virtual void get_stack_syms(CallStack &out_stack,
+                              std::vector<vm_sym_t> &out_frames_syms,
+                              std::vector<SymbolInfos> &out_syms) = 0;
+
+  // Frames [`beg`, `end`[ of the call stack, missing from an incremental
+  // update (see DBClientUpdate)
+  virtual void get_stack_frames(std::size_t beg, std::size_t end,
+                                CallStack &out_frames) = 0;
+
   virtual void add_breakpoints(const vm_ptr_t *addrs, std::size_t size) = 0;
 
   virtual void del_breakpoints(const vm_ptr_t *addrs, std::size_t size) = 0;
 
+  /// Addresses of all breakpoints, including the ones of other clients
+  virtual void get_breakpoints(std::vector<vm_ptr_t> &out_addrs) = 0;
+
   virtual void resume(ResumeType type) = 0;
+
+  /// Fill DBClientUpdate::prefetch according to `profile` everytime the VM
+  /// is stopped
+  virtual void set_prefetch(const PrefetchProfile &profile) = 0;
+
+  /// Metrics of the server, may be called while the VM is running
+  virtual void get_stats(ServerStats &out_stats) = 0;
 };
 
 } // namespace odb
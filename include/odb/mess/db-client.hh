@@ -12,21 +12,134 @@
 
 #pragma once
 
+#include <functional>
 #include <map>
 #include <memory>
+#include <set>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include "../server/fwd.hh"
+#include "../utils/range-map.hh"
 #include "fwd.hh"
 
 namespace odb {
 
+// Internal class to run asynchronous requests
+class DBClientAsync;
+
+/// What the server sends with every stop, to fill the DBClient caches
+struct PrefetchProfile {
+  /// Memory window [reg + offset, reg + offset + size[
+  struct MemWindow {
+    vm_reg_t base_reg; // usually SP or PC
+    vm_ssize_t offset;
+    vm_size_t size;
+  };
+
+  std::vector<vm_reg_t> regs;   // values of these registers
+  std::vector<MemWindow> mems;  // content of these memory windows
+  vm_size_t mem_align = 1;      // windows are extended to multiples of this
+  vm_size_t code_before = 0;    // code starts that many instructions before
+  std::uint32_t code_nins = 0;  // number of instructions, with their symbols
+  bool stack_syms = false;      // symbols of every function in the call stack
+
+  bool empty() const {
+    return regs.empty() && mems.empty() && !code_nins && !stack_syms;
+  }
+};
+
+/// Data read by the server following a PrefetchProfile
+/// Windows / registers that couldn't be read are missing
+struct StopPrefetch {
+  std::vector<vm_reg_t> reg_ids;
+  std::vector<std::vector<char>> reg_vals;
+  std::vector<vm_ptr_t> mem_addrs;
+  std::vector<std::vector<char>> mem_data;
+  vm_ptr_t code_addr = 0;
+  std::vector<std::string> code_text;
+  std::vector<vm_size_t> code_sizes;
+  // All symbols in every range [sym_addrs[i], sym_addrs[i] + sym_sizes[i][
+  std::vector<vm_ptr_t> sym_addrs;
+  std::vector<vm_size_t> sym_sizes;
+  std::vector<SymbolInfos> syms;
+};
+
+/// Whole symbol table, in a compact columnar format, sorted by address
+/// Symbol #i has id `ids[i]`, address `addrs[i]`, and its name is
+/// [names[names_offs[i]], names[names_offs[i + 1]][
+struct SymbolsTable {
+  std::vector<vm_ptr_t> addrs;
+  std::vector<vm_sym_t> ids;
+  std::vector<vm_size_t> names_offs; // size() + 1 items
+  std::vector<char> names;           // string pool
+
+  std::size_t size() const { return ids.size(); }
+
+  std::string_view name(std::size_t i) const {
+    return std::string_view(names.data() + names_offs[i],
+                            names_offs[i + 1] - names_offs[i]);
+  }
+
+  /// Add a symbol, must be after all the others
+  void push_back(const SymbolInfos &infos);
+};
+
+/// Disassembly of consecutive instructions, with symbols resolved
+/// Instruction #i is `text[i]`, at `addrs[i]`, with size `sizes[i]`
+/// Symbol references are written '{id}' (see VMApi::get_code_text)
+/// Reference #j is [text[refs_ins[j]][refs_beg[j]], refs_end[j][, for symbol
+/// `refs_ids[j]`
+/// `syms` has all symbols referenced or defined in the window once, sorted
+/// by address
+struct CodeAnnotated {
+  std::vector<vm_ptr_t> addrs;
+  std::vector<vm_size_t> sizes;
+  std::vector<std::string> text;
+  std::vector<vm_size_t> refs_ins;
+  std::vector<vm_size_t> refs_beg;
+  std::vector<vm_size_t> refs_end;
+  std::vector<vm_sym_t> refs_ids;
+  std::vector<SymbolInfos> syms;
+
+  std::size_t size() const { return addrs.size(); }
+
+  /// Add an instruction, must be right after all the others
+  /// Its symbol references are added to refs_*
+  void push_back(vm_ptr_t addr, vm_size_t size, const std::string &ins);
+
+  /// Add a symbol to `syms`, if not already there
+  void add_sym(const SymbolInfos &infos);
+
+  /// Returns null if `id` isn't in `syms`
+  const SymbolInfos *find_sym(vm_sym_t id) const;
+
+  /// Referenced symbols that aren't in `syms` yet, without duplicates
+  std::vector<vm_sym_t> missing_syms() const;
+
+  /// Text of instruction #i, with references replaced by the symbol names
+  std::string resolved_text(std::size_t i) const;
+};
+
 /// Internal data structure received after each block
+/// The call stack may be incremental: `stack` holds the frames
+/// [stack_depth - stack.size(), stack_depth[, and the first `stack_keep` frames
+/// are the same as in the previous update. Frames in between are missing, and
+/// must be requested with DBClientImpl::get_stack_frames
 struct DBClientUpdate {
   StoppedState vm_state;
   bool stopped;
   vm_ptr_t addr; // execution point
   CallStack stack;
+  std::uint64_t stack_keep = 0;
+  std::uint64_t stack_depth = 0;
+  // Version of the call stack known by the receiver, see
+  // Debugger::call_stack_diff. Not sent, only used on the VM side
+  std::uint64_t stack_version = 0;
+  StopPrefetch prefetch; // only filled if a profile was set
 };
 
 /// This is the main class used to communicate with a running debugguer
@@ -37,9 +150,28 @@ struct DBClientUpdate {
 /// differently In that situation, no serialization is done, and right calls are
 /// simply made
 ///
+/// Most results are cached to limit the number of requests:
+/// - static data (register infos, symbols, code text) is kept until
+///   `invalidate_static_cache` is called. Code text overlapped by a write_mem
+///   is also dropped
+/// - the whole symbol table is downloaded at once when it isn't too big, and
+///   again when the server returns a symbol missing from it
+/// - symbols and code text can also be kept on disk between sessions, see
+///   `set_disk_cache_dir`
+/// - VM state (register values, memory pages) is only valid for the current
+///   stop epoch, which advances everytime the VM resumes or stops. Pages
+///   covered by a write_mem are updated in place
+/// - the call stack only has the frames that changed at every stop, and at
+///   most ReqCheckStopped::STACK_MAX_FRAMES of them from a remote server.
+///   The other ones are requested the first time they are needed
+/// - breakpoints added / removed through this client are kept locally, with
+///   the ones of other clients fetched once per stop by `has_breakpoint`
 ///
-///
-/// @EXTRA for now only redirect calls, but caching to limit requests could help
+/// Some requests also have an asynchronous version (`*_async`)
+/// They are sent in order by a worker thread, and return right away an id
+/// Results are delivered in order by `poll`, which calls the callback of every
+/// completed request
+/// Blocking calls first wait for all asynchronous requests and deliver them
 class DBClient {
 public:
   /// The DB client can be on 4 states:
@@ -55,10 +187,100 @@ public:
     VM_RUNNING,
   };
 
+  /// Memory is cached by pages of this size
+  static constexpr vm_size_t MEM_CACHE_PAGE_SIZE = 256;
+
+  /// Max number of cached memory pages
+  static constexpr std::size_t MEM_CACHE_MAX_PAGES = 4096;
+
+  /// Reads bigger than that bypass the memory cache
+  static constexpr vm_size_t MEM_CACHE_MAX_READ = 1 << 16;
+
+  /// The whole symbol table is downloaded once, with the first symbol query,
+  /// if the VM doesn't have more symbols than that
+  /// All symbol queries are then answered locally
+  static constexpr vm_sym_t SYMS_TABLE_MAX_SIZE = 1 << 20;
+
+  /// Counters for one kind of cached data
+  /// Every item looked up (register, memory page, symbol, instruction) counts
+  /// as one hit or miss
+  struct CacheCounter {
+    std::size_t hits = 0;
+    std::size_t misses = 0;
+  };
+
+  struct CacheStats {
+    CacheCounter regs;
+    CacheCounter mem;
+    CacheCounter syms;
+    CacheCounter code;
+    CacheCounter stack;
+    std::size_t requests = 0; // number of calls made to DBClientImpl
+  };
+
+  /// Called once an asynchronous request is completed
+  /// `err` is empty on success, or the message of the error thrown
+  using AsyncCallback = std::function<void(const std::string &err)>;
+
   DBClient(std::unique_ptr<DBClientImpl> &&impl);
+  /// Not movable: asynchronous requests callbacks refer to the client
+  DBClient(const DBClient &) = delete;
+  DBClient &operator=(const DBClient &) = delete;
+  ~DBClient();
 
   State state() const { return _state; }
 
+  /// Number of times the VM resumed or stopped
+  /// All cached VM state is tied to the epoch it was read
+  std::uint64_t stop_epoch() const { return _stop_epoch; }
+
+  const CacheStats &cache_stats() const { return _stats; }
+  void reset_cache_stats() { _stats = CacheStats{}; }
+
+  /// Drop all cached static data (register infos, symbols, code text)
+  /// Must be called if the program of the VM changed
+  void invalidate_static_cache();
+
+  /// In write-back mode, set_regs and write_mem only update the cache
+  /// The writes are coalesced, and sent all at once by `flush`, which is
+  /// called automatically before resume, and before reads that overlap
+  /// Disabling write-back mode flushes all pending writes
+  void set_write_back(bool enabled);
+  bool write_back() const { return _write_back; }
+
+  /// Send all pending writes: one set_regs and one write_mem request
+  /// If it fails, the writes are sent one by one to find the one that failed,
+  /// and the error message starts with `flush: ` and identifies it
+  /// All pending writes are dropped, even on failure
+  void flush();
+
+  /// Returns true if there are writes not sent yet
+  bool has_pending_writes() const {
+    return !_pending_regs.empty() || !_pending_mem.empty();
+  }
+
+  /// Ask the server to send the data described by `profile` everytime the VM
+  /// stops, with the connect / check_stopped response, and fill the caches
+  /// with it
+  /// Can be called before connecting. Ignored by servers without support
+  /// Memory windows are aligned on cache pages
+  /// Registers values are only cached once their infos are known
+  void set_prefetch_profile(const PrefetchProfile &profile);
+
+  /// Keep the symbol table and code text in a persistent cache in `dir`,
+  /// shared by all sessions debugging the same program
+  /// Only used if the VM reports a program hash (see VMInfos::program_hash)
+  /// Must be called before connecting
+  void set_disk_cache_dir(const std::string &dir) { _disk_cache_dir = dir; }
+
+  /// Write the static data fetched during this session to the persistent
+  /// cache. Code text overlapping memory written by this client is skipped
+  /// For VMs with a binary opcode, the hash of the opcode bytes is saved with
+  /// every instruction, and checked when loaded. Their code text is only
+  /// saved when the VM is stopped
+  /// Does nothing without a cache. Throws VMApi::Error on failure
+  void save_disk_cache();
+
   /// Blocking calls
   /// All these calls may need to interact with the server
   /// If the request is invalid and Debugger throws, these methods rethrow the
@@ -136,6 +358,39 @@ public:
   void write_mem(const vm_ptr_t *dst_addrs, const vm_size_t *bufs_sizes,
                  const char **in_bufs, std::size_t nbuffs);
 
+  /// Read [addr, addr + size[, only transferring the pages that changed since
+  /// the last read of the same region
+  /// A shadow copy of every region read is kept, and patched with the changes
+  /// @param out_buf buffer of `size` bytes where the data will be written
+  /// @returns the number of pages received
+  std::size_t read_mem_diff(vm_ptr_t addr, vm_size_t size, char *out_buf);
+
+  /// Default size of the chunks used by `read_mem_stream` / `write_mem_stream`
+  static constexpr vm_size_t MEM_STREAM_CHUNK_SIZE = 1 << 20;
+
+  /// Called with every chunk read, returns false to cancel the stream
+  using MemStreamReader =
+      std::function<bool(vm_ptr_t addr, const char *data, vm_size_t size)>;
+
+  /// Called to fill every chunk to write, returns false to cancel the stream
+  using MemStreamWriter =
+      std::function<bool(vm_ptr_t addr, char *data, vm_size_t size)>;
+
+  /// Read [addr, addr + size[ as a sequence of requests of at most
+  /// `chunk_size` bytes, given in order to `on_chunk`
+  /// Only one chunk is in memory at once, whatever the size of the range
+  /// @returns the number of bytes read before the end or the cancellation
+  vm_size_t read_mem_stream(vm_ptr_t addr, vm_size_t size,
+                            const MemStreamReader &on_chunk,
+                            vm_size_t chunk_size = MEM_STREAM_CHUNK_SIZE);
+
+  /// Write [addr, addr + size[ as a sequence of requests of at most
+  /// `chunk_size` bytes, each one filled by `fill_chunk` right before
+  /// @returns the number of bytes written before the end or the cancellation
+  vm_size_t write_mem_stream(vm_ptr_t addr, vm_size_t size,
+                             const MemStreamWriter &fill_chunk,
+                             vm_size_t chunk_size = MEM_STREAM_CHUNK_SIZE);
+
   /// Get infos about all symbols located at [addr, addr + size[
   /// @param out_infos vector where data will be written
   void get_symbols_by_addr(vm_ptr_t addr, vm_size_t size,
@@ -166,6 +421,20 @@ public:
                      std::vector<std::string> &out_text,
                      std::vector<vm_size_t> &out_sizes);
 
+  /// Get `nins` instructions from `addr`, with all symbols referenced or
+  /// defined there, see CodeAnnotated
+  /// Only one request if the code isn't cached
+  void get_code_annotated(vm_ptr_t addr, std::size_t nins,
+                          CodeAnnotated &out_code);
+
+  /// Get up to `nbefore` instructions before `addr`, then `nafter` from
+  /// `addr`, with their symbols
+  /// The instructions before are found by the server, even if they have
+  /// different sizes, see Debugger::find_code_before
+  /// Only one request if the code isn't cached
+  void get_code_around(vm_ptr_t addr, std::size_t nbefore, std::size_t nafter,
+                       CodeAnnotated &out_code);
+
   /// Add many breakpoint at once
   /// @param addrs array of addresses
   /// @param size array size
@@ -176,11 +445,75 @@ public:
   /// @param size array size
   void del_breakpoints(const vm_ptr_t *addrs, std::size_t size);
 
-  /// @EXTRA had has_breakpoint used cache
+  /// Returns true if there is a breakpoint at `addr`
+  /// The list of breakpoints, with the ones of other clients, is fetched
+  /// once per stop. While the VM is running, or if the server doesn't
+  /// support it, only knows about the breakpoints added through this client
+  bool has_breakpoint(vm_ptr_t addr);
 
   /// Resume program execution
   void resume(ResumeType type);
 
+  /// Get the metrics of the server, see ServerStats
+  /// Can be called in VM_STOPPED or VM_RUNNING state
+  /// Throws if the server doesn't support it
+  void get_server_stats(ServerStats &out_stats);
+
+  // ===== Asynchronous calls =====
+  // Same arguments as the blocking versions, plus the callback
+  // Input arrays are copied, but output buffers must remain valid until the
+  // callback is called or the request is cancelled
+  // Results are not read from the cache, but are added to it
+  // State requirements are the same as the blocking versions, and are checked
+  // when the request is made
+
+  /// Can only be called in VM_RUNNING state
+  /// The state is updated right before calling `cb`
+  db_client_req_t check_stopped_async(const AsyncCallback &cb);
+
+  db_client_req_t get_regs_async(const vm_reg_t *ids, char **out_bufs,
+                                 const vm_size_t *regs_size, std::size_t nregs,
+                                 const AsyncCallback &cb);
+
+  db_client_req_t read_mem_async(const vm_ptr_t *src_addrs,
+                                 const vm_size_t *bufs_sizes, char **out_bufs,
+                                 std::size_t nbuffs, const AsyncCallback &cb);
+
+  db_client_req_t get_code_text_async(vm_ptr_t addr, std::size_t nins,
+                                      std::vector<std::string> &out_text,
+                                      std::vector<vm_size_t> &out_sizes,
+                                      const AsyncCallback &cb);
+
+  db_client_req_t get_symbols_by_addr_async(vm_ptr_t addr, vm_size_t size,
+                                            std::vector<SymbolInfos> &out_infos,
+                                            const AsyncCallback &cb);
+
+  db_client_req_t get_symbols_by_ids_async(const vm_sym_t *ids,
+                                           SymbolInfos *out_infos,
+                                           std::size_t nsyms,
+                                           const AsyncCallback &cb);
+
+  db_client_req_t get_symbols_by_names_async(const char **names,
+                                             SymbolInfos *out_infos,
+                                             std::size_t nsyms,
+                                             const AsyncCallback &cb);
+
+  /// Deliver all completed requests, in the order they were made
+  /// Never blocks
+  /// @returns the number of callbacks called
+  std::size_t poll();
+
+  /// Block until all asynchronous requests are completed, and deliver them
+  void wait_async();
+
+  /// Cancel a request: its callback will never be called
+  /// If the request is being sent, wait until it's done
+  /// @returns false if the request was already delivered or doesn't exist
+  bool cancel(db_client_req_t req);
+
+  /// Number of asynchronous requests not delivered yet
+  std::size_t async_pending() const;
+
   // ===== Always stored informations =====
   // These calls never block
 
@@ -194,8 +527,25 @@ public:
   /// @returns the reason why the program is stopped
   StoppedState get_stopped_state();
 
-  /// Get the current list of calls
-  CallStack get_call_stack();
+  /// Get the current list of calls, the first one is the program entry
+  /// All missing frames are requested
+  /// The reference is valid until the VM resumes
+  const CallStack &get_call_stack();
+
+  /// Number of frames of the call stack, doesn't send any request
+  std::size_t get_call_stack_depth();
+
+  /// Frames [`beg`, `end`[ of the call stack, only the missing ones among
+  /// them are requested
+  /// The pointer is valid until the VM resumes
+  const CallInfos *get_call_frames(std::size_t beg, std::size_t end);
+
+  /// Symbol containing the start of every frame of the call stack, see
+  /// Debugger::get_symbol_containing
+  /// `out_syms[i]` is the symbol of frame i, its idx is VM_SYM_NULL if none
+  /// Answered with the symbols table if loaded, otherwise with one request
+  /// per stop
+  void get_call_stack_syms(std::vector<SymbolInfos> &out_syms);
 
   // === Static VM informations ===
   // These informations are always valid
@@ -233,10 +583,35 @@ private:
   State _state;
   DBClientUpdate _udp;
   VMInfos _vm_infos;
+  std::uint64_t _stop_epoch;
+  CacheStats _stats;
+
+  // Returns the impl, and count one more request
+  // Wait for all asynchronous requests first
+  DBClientImpl &_req();
+
+  // Add an asynchronous request
+  // `work` is run on the worker thread, and `done` by poll
+  db_client_req_t _push_async(std::function<void()> &&work,
+                              std::function<void(const std::string &)> &&done);
+
+  std::unique_ptr<DBClientAsync> _async;
 
   // Discard all temporary infos (eg memory / reg values)
+  // Starts a new stop epoch
   void _discard_tmp_cache();
 
+  // Fill the caches with the data in _udp.prefetch
+  void _apply_prefetch();
+
+  // Merge the call stack frames of _udp into _stack
+  void _apply_stack();
+
+  // Call stack of the current stop, with default frames where they are missing
+  // `_stack_missing` has the missing [beg, end[ ranges, sorted
+  CallStack _stack;
+  std::vector<std::pair<std::size_t, std::size_t>> _stack_missing;
+
   // Caching: register infos + vals
   // infos static data always valid
   // value cleared after each instruction
@@ -255,6 +630,124 @@ private:
       _regi_idx_map; // map reg index => pos in _regi_arr
   std::map<std::string, std::size_t>
       _regi_name_map; // map reg name => pos in _regi_arr
+
+  // Caching: memory pages
+  // Only valid for the stop epoch they were read
+  struct MemPage {
+    std::uint64_t epoch;
+    std::vector<char> data;
+  };
+
+  // Read [addr, addr + size[ from cache, fetch all missing pages at once
+  void _read_mem_cached(vm_ptr_t addr, vm_size_t size, char *out_buf);
+
+  // Fetch all `pages` with one request
+  void _fetch_mem_pages(const std::set<vm_ptr_t> &pages);
+
+  // Update cached pages and code text after writing [addr, addr + size[
+  void _on_mem_written(vm_ptr_t addr, vm_size_t size, const char *data);
+
+  std::unordered_map<vm_ptr_t, MemPage> _mem_pages; // page index => page
+
+  // Caching: symbols
+  // _syms_ranges is 1 for all addresses whose symbols are all known
+
+  // Fetch symbols infos into cache
+  void _fetch_syms_by_id(const vm_sym_t *ids, std::size_t nsyms);
+  void _fetch_syms_by_name(const char **names, std::size_t nsyms);
+
+  void _add_sym(const SymbolInfos &infos);
+
+  std::map<vm_sym_t, SymbolInfos> _syms_map;
+  std::map<std::string, vm_sym_t> _syms_name_map;
+  std::map<vm_ptr_t, vm_sym_t> _syms_pos;
+  std::unique_ptr<RangeMap<int>> _syms_ranges;
+
+  // Mirror of the whole symbol table, used instead of the maps above once
+  // loaded. Names are views into `_syms_table->names`
+  // Returns true if the table can be used
+  bool _load_syms_table();
+  SymbolInfos _syms_table_infos(std::size_t i) const;
+  // Forget the table, loaded again by the next lookup
+  // If `stale`, the VM has symbols missing from it, and the one of the disk
+  // cache is also outdated
+  void _drop_syms_table(bool stale);
+
+  bool _syms_table_tried;
+  bool _syms_table_stale = false;
+  std::unique_ptr<SymbolsTable> _syms_table;
+  std::unordered_map<vm_sym_t, std::size_t> _syms_table_ids;
+  std::unordered_map<std::string_view, std::size_t> _syms_table_names;
+
+  // Result of get_call_stack_syms, for the stop `_stack_syms_epoch`
+  std::vector<SymbolInfos> _stack_syms;
+  std::uint64_t _stack_syms_epoch = NO_EPOCH;
+  static constexpr std::uint64_t NO_EPOCH = static_cast<std::uint64_t>(-1);
+
+  // Persistent cache, see set_disk_cache_dir
+  // _mem_written is 1 for all addresses written by this client: the code
+  // text stored on disk may be outdated there
+  bool _mem_was_written(vm_ptr_t addr, vm_size_t size) const;
+
+  // Open the persistent cache of the program, if enabled
+  void _open_disk_cache();
+
+  // Returns true if an instruction of the persistent cache can be used: not
+  // written by this client, and for VMs with a binary opcode, bytes with the
+  // same hash than when it was saved (the code may be patched, or be data)
+  bool _disk_code_valid(vm_ptr_t addr, vm_size_t size, std::uint64_t hash);
+
+  std::string _disk_cache_dir;
+  std::unique_ptr<DiskCache> _disk_cache;
+  std::unique_ptr<RangeMap<int>> _mem_written;
+
+  // Caching: code text, by instruction address
+  struct CodeIns {
+    std::string text;
+    vm_size_t size;
+  };
+  std::map<vm_ptr_t, CodeIns> _code_map;
+  vm_size_t _code_max_size; // biggest instruction in _code_map
+
+  // Read instructions from `addr` in the memory and disk caches, until the
+  // first missing one
+  // Returns the number of instructions found, doesn't update the stats
+  std::size_t _get_cached_code(vm_ptr_t addr, std::size_t nins,
+                               std::vector<std::string> &out_text,
+                               std::vector<vm_size_t> &out_sizes);
+
+  // Find the cached instruction ending right at `addr`
+  // Returns false if there is none
+  bool _cached_code_before(vm_ptr_t addr, vm_ptr_t &out_start);
+
+  // Add the code and symbols of `code` to the caches
+  // All symbols defined in the window must be there
+  void _cache_code_annotated(const CodeAnnotated &code);
+
+  // Breakpoints of the server, fetched at stop epoch `_bkps_epoch`, updated
+  // by the ones added / removed through this client
+  std::set<vm_ptr_t> _bkps;
+  std::uint64_t _bkps_epoch = NO_EPOCH;
+
+  // Write-back: pending writes
+  // Memory writes are coalesced: ranges never overlap nor touch
+
+  // Add [addr, addr + size[ to pending writes
+  void _queue_mem_write(vm_ptr_t addr, vm_size_t size, const char *data);
+
+  // Flush if any pending memory write overlaps [addr, addr + size[
+  void _flush_overlap(vm_ptr_t addr, vm_size_t size);
+
+  bool _write_back;
+  std::map<vm_reg_t, std::vector<char>> _pending_regs;
+  std::map<vm_ptr_t, std::vector<char>> _pending_mem; // addr => data
+
+  // Shadow copies of the regions read with read_mem_diff
+  struct MemShadow {
+    std::uint64_t version;
+    std::vector<char> data;
+  };
+  std::map<std::pair<vm_ptr_t, vm_size_t>, MemShadow> _mem_shadows;
 };
 
 } // namespace odb
@@ -0,0 +1,96 @@
+//===-- mess/disk-cache.hh - DiskCache class definition ---------*- C++ -*-===//
+//
+// ODB Library
+// Author: Steven Lariau
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// Persistent cache of the static data of a program, shared between sessions
+///
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "../server/fwd.hh"
+#include "fwd.hh"
+
+namespace odb {
+
+/// Symbol table and code text of one program, stored in
+/// `<dir>/<program hash>.odbc`
+/// The file is memory-mapped, and items are only decoded when looked up
+///
+/// Format (native endianness, all integers are uint64):
+/// - header: magic, version, program hash, flags, nsyms, names size, ncode,
+///   code text size
+/// - symbols table (if flags & FLAG_SYMS), see SymbolsTable: addrs[nsyms],
+///   ids[nsyms], names_offs[nsyms + 1], names (padded to 8 bytes)
+/// - code text, sorted by address: addrs[ncode], sizes[ncode],
+///   hashes[ncode], text_offs[ncode + 1], text (padded to 8 bytes)
+class DiskCache {
+public:
+  /// One instruction of the code text
+  struct CodeIns {
+    vm_ptr_t addr;
+    std::string_view text;
+    vm_size_t size;
+    std::uint64_t hash; // of the opcode bytes, to check they didn't change
+  };
+
+  static constexpr std::uint64_t VERSION = 2;
+
+  /// Map the cache file of `program_hash`, if there is a valid one
+  DiskCache(const std::string &dir, std::uint64_t program_hash);
+  ~DiskCache();
+
+  DiskCache(const DiskCache &) = delete;
+  DiskCache &operator=(const DiskCache &) = delete;
+
+  const std::string &path() const { return _path; }
+
+  /// Returns true if a valid file is mapped
+  bool loaded() const { return _data != nullptr; }
+
+  /// Copy the symbols table
+  /// Returns false if the file doesn't have one
+  bool get_symbols_table(SymbolsTable &out_table) const;
+
+  /// Returns false if the instruction at `addr` isn't in the file
+  bool get_code_ins(vm_ptr_t addr, CodeIns &out_ins) const;
+
+  /// Returns false if the instruction ending right at `addr` isn't in the
+  /// file
+  bool get_code_ins_before(vm_ptr_t addr, CodeIns &out_ins) const;
+
+  /// Write the cache file, then map it
+  /// Instructions of the current file are kept, unless also in `code`
+  /// Written to a temporary file first, readers never see a partial file
+  /// Throws VMApi::Error if the file can't be written
+  /// @param syms may be null, the current table is kept
+  /// @param code sorted by address
+  void save(const SymbolsTable *syms, const std::vector<CodeIns> &code);
+
+private:
+  std::string _path;
+  std::uint64_t _hash;
+
+  // Mapped file, null if not loaded
+  const char *_data;
+  std::size_t _size;
+
+  const std::uint64_t *_header() const;
+  // code addrs, sizes, hashes, text_offs
+  const std::uint64_t *_code_arrays() const;
+  const char *_code_text() const;
+
+  void _map();
+  void _unmap();
+};
+
+} // namespace odb
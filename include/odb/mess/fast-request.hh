@@ -0,0 +1,101 @@
+//===-- mess/fast-request.hh - Fixed-layout fast requests -------*- C++ -*-===//
+//
+// ODB Library
+// Author: Steven Lariau
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// Packed structs for the most frequent requests, sent as raw Message objects
+/// instead of going through RequestHandler
+///
+/// A fast request is framed as ReqType::FAST, followed by a Message
+/// The response is either ReqType::FAST followed by a Message, ReqType::ERR,
+/// or a generic response when the data doesn't fit in a fixed layout
+/// Only used when PROTO_CAP_FASTPATH was negotiated
+///
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include "message.hh"
+#include "request.hh"
+
+namespace odb {
+
+/// Max number of bytes of a fast READ_MEM / GET_REGS
+/// Bigger ones use the generic requests
+constexpr std::size_t FAST_DATA_MAX_SIZE = 1 << 15;
+
+#define ODB_FAST_TYPEID(Ty)                                                    \
+  static constexpr Message::typeid_t MESSAGE_TYPEID =                          \
+      static_cast<Message::typeid_t>(ReqType::Ty)
+
+ODB_MESSAGE_STRUCT FastReqStop {
+  ODB_FAST_TYPEID(STOP);
+  std::uint8_t tag;
+};
+
+ODB_MESSAGE_STRUCT FastResStop {
+  ODB_FAST_TYPEID(STOP);
+  std::uint8_t tag;
+};
+
+ODB_MESSAGE_STRUCT FastReqCheckStopped {
+  ODB_FAST_TYPEID(CHECK_STOPPED);
+  std::uint8_t tag;
+};
+
+// Only sent when the VM is still running
+// Otherwise the response is a generic ReqCheckStopped, with the VM state
+ODB_MESSAGE_STRUCT FastResCheckStopped {
+  ODB_FAST_TYPEID(CHECK_STOPPED);
+  std::uint8_t stopped;
+};
+
+ODB_MESSAGE_STRUCT FastReqResume {
+  ODB_FAST_TYPEID(RESUME);
+  std::uint8_t type;
+};
+
+ODB_MESSAGE_STRUCT FastResResume {
+  ODB_FAST_TYPEID(RESUME);
+  std::uint8_t tag;
+};
+
+// Get one register
+ODB_MESSAGE_STRUCT FastReqGetReg {
+  ODB_FAST_TYPEID(GET_REGS);
+  vm_reg_t id;
+  std::uint32_t size;
+};
+
+// Followed by the `size` bytes of the register
+ODB_MESSAGE_STRUCT FastResGetReg {
+  ODB_FAST_TYPEID(GET_REGS);
+  std::uint32_t size;
+};
+
+// Read one memory block
+ODB_MESSAGE_STRUCT FastReqReadMem {
+  ODB_FAST_TYPEID(READ_MEM);
+  vm_ptr_t addr;
+  std::uint32_t size;
+};
+
+// Followed by the `size` bytes read
+ODB_MESSAGE_STRUCT FastResReadMem {
+  ODB_FAST_TYPEID(READ_MEM);
+  std::uint32_t size;
+};
+
+#undef ODB_FAST_TYPEID
+
+/// Returns the type of the fast message stored in `data`
+inline Message::typeid_t fast_message_type(const char *data) {
+  Message::typeid_t res;
+  std::memcpy(&res, data, sizeof(res));
+  return res;
+}
+
+} // namespace odb
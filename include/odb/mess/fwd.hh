@@ -19,6 +19,13 @@ namespace odb {
 class DBClient;
 class DBClientImpl;
 struct DBClientUpdate;
+struct PrefetchProfile;
+struct StopPrefetch;
+struct SymbolsTable;
+struct CodeAnnotated;
+struct ServerStats;
+enum class ReqType;
+class DiskCache;
 class SerialInBuff;
 class SerialOutBuff;
 
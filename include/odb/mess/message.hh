@@ -39,6 +39,9 @@ public:
   static constexpr std::size_t DEFAULT_ALLOC = 1;
   static constexpr std::size_t HEADER_SIZE = sizeof(Header);
 
+  /// Max size of a message, without the header
+  static constexpr std::size_t MAX_SIZE = 0xFFFF;
+
 public:
   /// Create a message with no data (empty)
   Message()
@@ -102,6 +105,7 @@ public:
   template <class MessageType>
   MessageType &alloc_as(std::size_t extra_bytes = 0) {
     assert(empty());
+    assert(sizeof(MessageType) + extra_bytes <= MAX_SIZE);
     _resize(HEADER_SIZE + sizeof(MessageType) + extra_bytes);
 
     auto &header = _get_header_uncheck();
@@ -115,6 +119,30 @@ public:
     return *_get_as_uncheck<MessageType>();
   }
 
+  /// Returns pointer to the extra bytes allocated after the struct
+  template <class MessageType> char *extra_as() {
+    assert(get_type() == MessageType::MESSAGE_TYPEID);
+    return data() + HEADER_SIZE + sizeof(MessageType);
+  }
+
+  /// Read a message stored in an external buffer of `size` bytes, in place
+  /// @returns nullptr if it's not a valid message of type `MessageType`
+  /// Otherwise the struct is followed by `extra_bytes` bytes
+  template <class MessageType>
+  static const MessageType *view_as(const char *data, std::size_t size,
+                                    std::size_t &extra_bytes) {
+    if (size < HEADER_SIZE + sizeof(MessageType))
+      return nullptr;
+    Header header;
+    std::memcpy(&header, data, HEADER_SIZE);
+    if (header.type != MessageType::MESSAGE_TYPEID ||
+        header.size < sizeof(MessageType) || header.size > size - HEADER_SIZE)
+      return nullptr;
+
+    extra_bytes = header.size - sizeof(MessageType);
+    return reinterpret_cast<const MessageType *>(data + HEADER_SIZE);
+  }
+
 private:
   char _local_buff[DEFAULT_ALLOC];
   char *_alloc_buff; // pointer to optionally allocated buffer
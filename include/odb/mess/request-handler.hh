@@ -13,34 +13,191 @@
 
 #pragma once
 
+#include <algorithm>
+#include <cstddef>
 #include <memory>
+#include <new>
+#include <type_traits>
 #include <vector>
 
 #include "serial.hh"
 
 namespace odb {
 
-class TmpBuffHolder {
+namespace details {
+
+// Serialize `size` items from `ptr`
+// Bytes buffers are not copied, but referenced by `os`
+// Addresses / sizes arrays are delta-encoded with the compact format
+template <class T>
+void write_items(SerialOutBuff &os, const T *ptr, std::size_t size) {
+  if constexpr (std::is_same_v<T, char>)
+    os.write_ref(ptr, size);
+  else if constexpr (std::is_same_v<T, std::uint64_t>) {
+    if (os.compact()) {
+      SerialDeltaOut delta;
+      for (std::size_t i = 0; i < size; ++i)
+        delta.write(os, ptr[i]);
+    } else
+      for (std::size_t i = 0; i < size; ++i)
+        os << ptr[i];
+  } else
+    for (std::size_t i = 0; i < size; ++i)
+      os << ptr[i];
+}
+
+// Unserialize `size` items into `ptr`
+// Bytes buffers are copied all at once
+template <class T> void read_items(SerialInBuff &is, T *ptr, std::size_t size) {
+  if constexpr (std::is_same_v<T, char>)
+    is.read(ptr, size);
+  else if constexpr (std::is_same_v<T, std::uint64_t>) {
+    if (is.compact()) {
+      SerialDeltaIn delta;
+      for (std::size_t i = 0; i < size; ++i)
+        ptr[i] = delta.read(is);
+    } else
+      for (std::size_t i = 0; i < size; ++i)
+        is >> ptr[i];
+  } else
+    for (std::size_t i = 0; i < size; ++i)
+      is >> ptr[i];
+}
 
+} // namespace details
+
+/// Bump-pointer arena holding the temporary buffers of one request
+/// All buffers are released at once by `reset`, but the memory is kept for
+/// the next request
+/// A buffer that doesn't fit in the current chunk gets its own allocation. On
+/// reset, the chunk grows to hold everything the last request needed (up to
+/// MAX_CHUNK_SIZE), so a steady stream of requests doesn't allocate anymore
+class TmpBuffHolder {
 public:
-  void reset() { _bufs.clear(); }
+  static constexpr std::size_t MIN_CHUNK_SIZE = 4096;
+  static constexpr std::size_t MAX_CHUNK_SIZE = 1 << 20;
+
+  TmpBuffHolder() = default;
+  TmpBuffHolder(const TmpBuffHolder &) = delete;
+  TmpBuffHolder &operator=(const TmpBuffHolder &) = delete;
+  ~TmpBuffHolder() { _destroy_all(); }
+
+  void reset() {
+    _destroy_all();
+
+    if (!_extra.empty()) {
+      auto need = _pos + _extra_size +
+                  _extra.size() * alignof(std::max_align_t);
+      need = std::min(std::max(need, MIN_CHUNK_SIZE), MAX_CHUNK_SIZE);
+      if (need > _cap) {
+        // Not make_unique, it would zero-fill the memory
+        _chunk.reset(new char[need]);
+        _cap = need;
+        ++_heap_allocs;
+      }
+      _extra.clear();
+      _extra_size = 0;
+    }
+    _pos = 0;
+  }
 
   template <class T> T *add_buff(std::size_t size) {
+    static_assert(alignof(T) <= alignof(std::max_align_t),
+                  "Over-aligned types not supported");
     std::size_t buf_size = size * sizeof(T);
-    _bufs.push_back(std::make_unique<char[]>(buf_size));
-    char *buf = _bufs.back().get();
-    T *tbuf = reinterpret_cast<T *>(buf);
+    std::size_t pos = (_pos + alignof(T) - 1) & ~(alignof(T) - 1);
+    char *buf;
+    if (pos + buf_size <= _cap) {
+      buf = _chunk.get() + pos;
+      _pos = pos + buf_size;
+    } else
+      buf = _alloc_outlier(buf_size);
 
+    T *tbuf = reinterpret_cast<T *>(buf);
     for (std::size_t i = 0; i < size; ++i)
       new (&tbuf[i]) T{};
 
+    if constexpr (!std::is_trivially_destructible_v<T>)
+      _dtors.push_back(Dtor{tbuf, size, &_destroy<T>});
     return tbuf;
   }
 
+  /// Number of heap allocations done for buffers since creation
+  /// Stays the same once the arena is big enough for the requests received
+  std::size_t heap_allocs() const { return _heap_allocs; }
+
 private:
-  std::vector<std::unique_ptr<char[]>> _bufs;
+  struct Dtor {
+    void *ptr;
+    std::size_t size;
+    void (*fn)(void *, std::size_t);
+  };
+
+  std::unique_ptr<char[]> _chunk;
+  std::size_t _cap = 0;
+  std::size_t _pos = 0;
+  std::vector<std::unique_ptr<char[]>> _extra;
+  std::size_t _extra_size = 0;
+  std::vector<Dtor> _dtors;
+  std::size_t _heap_allocs = 0;
+
+  char *_alloc_outlier(std::size_t size) {
+    _extra.push_back(std::unique_ptr<char[]>(new char[size ? size : 1]));
+    _extra_size += size;
+    ++_heap_allocs;
+    return _extra.back().get();
+  }
+
+  void _destroy_all() {
+    for (auto it = _dtors.rbegin(); it != _dtors.rend(); ++it)
+      it->fn(it->ptr, it->size);
+    _dtors.clear();
+  }
+
+  template <class T> static void _destroy(void *ptr, std::size_t size) {
+    T *tbuf = static_cast<T *>(ptr);
+    for (std::size_t i = 0; i < size; ++i)
+      tbuf[i].~T();
+  }
 };
 
+/// Handlers
+/// `prepare_request` calls these methods for every field of a request:
+///
+/// object_in(item) / object_out(item)
+///   A data object that belongs to the input request / output response
+///   Can be any kind, as long as it can be serial / unserial
+///
+/// object_in_opt(item, def) / object_out_opt(item, def)
+///   An optional data object at the end of the request / response
+///   If the message doesn't have it (sent by an older peer), `item` is set
+///   to `def`. Used to extend requests while staying compatible
+///   The server must only send an optional output if the client is known to
+///   expect it
+///
+/// buffer_in(ptr, size)
+///   A buffer of size items of type T
+///   When request sent, the buffer content is serialized
+///   When the request is received, the buffer is unserialized into some
+///   temporary memory, and `ptr` is set to point to this memory
+///   The memory is valid until the response is sent
+///
+/// buffer_2d_in(ptr, size1, size2)
+///   A buffer T[size1][size2], with indirection pointer
+///   When the request is received, the buffer is unserialized into some
+///   temporary memory, and `ptr` is set to a temporary indirection buffer
+///
+/// buffer_2dvar_in(ptr, size1, sizes2)
+///   Similar to buffer_2d_in, but the size of each T[i] is sizes2[i]
+///
+/// buffer_out(ptr, size) / buffer_2d_out / buffer_2dvar_out
+///   When request is received, a buffer is allocated to hold these items
+///   When response send, this buffer content is serialized
+///   When response received, content unserialized into `ptr`
+///
+/// buffer_2d_in_cstr(ptr, size)
+///   Like buffer_2d_in, for zero-terminated strings of varying size
+
 class HandlerCliRecv {
 public:
   HandlerCliRecv() : _in(nullptr) {}
@@ -51,6 +208,15 @@ public:
 
   template <class T> void object_out(T &item) { *_in >> item; }
 
+  template <class T> void object_in_opt(const T &, const T &) {}
+
+  template <class T> void object_out_opt(T &item, const T &def) {
+    if (_in->is_eof())
+      item = def;
+    else
+      *_in >> item;
+  }
+
   template <class T> void buffer_in(T *, std::size_t) {}
 
   template <class T> void buffer_2d_in(T **&, std::size_t, std::size_t) {}
@@ -59,22 +225,19 @@ public:
   void buffer_2dvar_in(T **&, std::size_t, Sizes *) {}
 
   template <class T> void buffer_out(T *&ptr, std::size_t size) {
-    for (std::size_t i = 0; i < size; ++i)
-      *_in >> ptr[i];
+    details::read_items(*_in, ptr, size);
   }
 
   template <class T>
   void buffer_2d_out(T **&ptr, std::size_t size1, std::size_t size2) {
     for (std::size_t i = 0; i < size1; ++i)
-      for (std::size_t j = 0; j < size2; ++j)
-        *_in >> ptr[i][j];
+      details::read_items(*_in, ptr[i], size2);
   }
 
   template <class T, class Sizes>
   void buffer_2dvar_out(T **&ptr, std::size_t size1, Sizes *sizes2) {
     for (std::size_t i = 0; i < size1; ++i)
-      for (Sizes j = 0; j < sizes2[i]; ++j)
-        *_in >> ptr[i][j];
+      details::read_items(*_in, ptr[i], sizes2[i]);
   }
 
   void buffer_2d_in_cstr(char **&, std::size_t) {}
@@ -93,23 +256,26 @@ public:
 
   template <class T> void object_out(const T &) {}
 
+  template <class T> void object_in_opt(const T &item, const T &) {
+    *_out << item;
+  }
+
+  template <class T> void object_out_opt(const T &, const T &) {}
+
   template <class T> void buffer_in(T *&ptr, std::size_t size) {
-    for (std::size_t i = 0; i < size; ++i)
-      *_out << ptr[i];
+    details::write_items(*_out, ptr, size);
   }
 
   template <class T>
   void buffer_2d_in(T **&ptr, std::size_t size1, std::size_t size2) {
     for (std::size_t i = 0; i < size1; ++i)
-      for (std::size_t j = 0; j < size2; ++j)
-        *_out << ptr[i][j];
+      details::write_items(*_out, ptr[i], size2);
   }
 
   template <class T, class Sizes>
   void buffer_2dvar_in(T **&ptr, std::size_t size1, Sizes *sizes2) {
     for (std::size_t i = 0; i < size1; ++i)
-      for (Sizes j = 0; j < sizes2[i]; ++j)
-        *_out << ptr[i][j];
+      details::write_items(*_out, ptr[i], sizes2[i]);
   }
 
   template <class T> void buffer_out(T *&, std::size_t) {}
@@ -151,19 +317,23 @@ public:
 
   template <class T> void object_out(T &) {}
 
+  template <class T> void object_in_opt(T &item, const T &def) {
+    if (_in->is_eof())
+      item = def;
+    else
+      *_in >> item;
+  }
+
+  template <class T> void object_out_opt(T &, const T &) {}
+
   template <class T> void buffer_in(T *&ptr, std::size_t size) {
-    auto tbuf = _tb.add_buff<T>(size);
-    for (std::size_t i = 0; i < size; ++i)
-      *_in >> tbuf[i];
-    ptr = tbuf;
+    ptr = _load_items<T>(size);
   }
 
   template <class T>
   void buffer_2d_in(T **&ptr, std::size_t size1, std::size_t size2) {
     // Create big buffer and store all content inside
-    T *all_buf = _tb.add_buff<T>(size1 * size2);
-    for (std::size_t i = 0; i < size1 * size2; ++i)
-      *_in >> all_buf[i];
+    T *all_buf = _load_items<T>(size1 * size2);
 
     // Create indirections buffer pointing to all_buf
     T **dir_buf = _tb.add_buff<T *>(size1);
@@ -181,9 +351,7 @@ public:
       all_size += sizes2[i];
 
     // Create big buffer and store all content inside
-    T *all_buf = _tb.add_buff<T>(all_size);
-    for (Sizes i = 0; i < all_size; ++i)
-      *_in >> all_buf[i];
+    T *all_buf = _load_items<T>(all_size);
 
     // Create indirections buffer pointing to all_buf
     T **dir_buf = _tb.add_buff<T *>(size1);
@@ -252,9 +420,24 @@ public:
     ptr = dir_buf;
   }
 
+  /// Heap allocations done for the temporary buffers of requests
+  std::size_t heap_allocs() const { return _tb.heap_allocs(); }
+
 private:
   SerialInBuff *_in;
   TmpBuffHolder _tb;
+
+  // Unserialize `size` items into a temporary buffer
+  // Bytes are not copied, the buffer directly points to the input data
+  template <class T> T *_load_items(std::size_t size) {
+    if constexpr (std::is_same_v<T, char>)
+      return _in->read_ref(size);
+    else {
+      T *res = _tb.add_buff<T>(size);
+      details::read_items(*_in, res, size);
+      return res;
+    }
+  }
 };
 
 class HandlerServSend {
@@ -267,6 +450,12 @@ public:
 
   template <class T> void object_out(const T &item) { *_out << item; }
 
+  template <class T> void object_in_opt(const T &, const T &) {}
+
+  template <class T> void object_out_opt(const T &item, const T &) {
+    *_out << item;
+  }
+
   template <class T> void buffer_in(T *&, std::size_t) {}
 
   template <class T> void buffer_2d_in(T **&, std::size_t, std::size_t) {}
@@ -275,22 +464,19 @@ public:
   void buffer_2dvar_in(T **&, std::size_t, Sizes *) {}
 
   template <class T> void buffer_out(T *&ptr, std::size_t size) {
-    for (std::size_t i = 0; i < size; ++i)
-      *_out << ptr[i];
+    details::write_items(*_out, ptr, size);
   }
 
   template <class T>
   void buffer_2d_out(T **&ptr, std::size_t size1, std::size_t size2) {
     for (std::size_t i = 0; i < size1; ++i)
-      for (std::size_t j = 0; j < size2; ++j)
-        *_out << ptr[i][j];
+      details::write_items(*_out, ptr[i], size2);
   }
 
   template <class T, class Sizes>
   void buffer_2dvar_out(T **&ptr, std::size_t size1, Sizes *sizes2) {
     for (std::size_t i = 0; i < size1; ++i)
-      for (Sizes j = 0; j < sizes2[i]; ++j)
-        *_out << ptr[i][j];
+      details::write_items(*_out, ptr[i], sizes2[i]);
   }
 
   void buffer_2d_in_cstr(char **&, std::size_t) {}
@@ -299,169 +485,42 @@ private:
   SerialOutBuff *_out;
 };
 
-#define HANDLER_DISPATCH1(Meth, V0)                                            \
-  switch (_mode) {                                                             \
-  case Mode::CLI_RECV:                                                         \
-    _h_cli_recv.Meth(V0);                                                      \
-    break;                                                                     \
-  case Mode::CLI_SEND:                                                         \
-    _h_cli_send.Meth(V0);                                                      \
-    break;                                                                     \
-  case Mode::SERV_RECV:                                                        \
-    _h_serv_recv.Meth(V0);                                                     \
-    break;                                                                     \
-  case Mode::SERV_SEND:                                                        \
-    _h_serv_send.Meth(V0);                                                     \
-    break;                                                                     \
-  };
-
-#define HANDLER_DISPATCH2(Meth, V0, V1)                                        \
-  switch (_mode) {                                                             \
-  case Mode::CLI_RECV:                                                         \
-    _h_cli_recv.Meth(V0, V1);                                                  \
-    break;                                                                     \
-  case Mode::CLI_SEND:                                                         \
-    _h_cli_send.Meth(V0, V1);                                                  \
-    break;                                                                     \
-  case Mode::SERV_RECV:                                                        \
-    _h_serv_recv.Meth(V0, V1);                                                 \
-    break;                                                                     \
-  case Mode::SERV_SEND:                                                        \
-    _h_serv_send.Meth(V0, V1);                                                 \
-    break;                                                                     \
-  };
-
-#define HANDLER_DISPATCH3(Meth, V0, V1, V2)                                    \
-  switch (_mode) {                                                             \
-  case Mode::CLI_RECV:                                                         \
-    _h_cli_recv.Meth(V0, V1, V2);                                              \
-    break;                                                                     \
-  case Mode::CLI_SEND:                                                         \
-    _h_cli_send.Meth(V0, V1, V2);                                              \
-    break;                                                                     \
-  case Mode::SERV_RECV:                                                        \
-    _h_serv_recv.Meth(V0, V1, V2);                                             \
-    break;                                                                     \
-  case Mode::SERV_SEND:                                                        \
-    _h_serv_send.Meth(V0, V1, V2);                                             \
-    break;                                                                     \
-  };
-
-class RequestHandler;
-
-template <class T> void prepare_request(RequestHandler &h, T &data);
-
+/// Serialize / unserialize requests
+/// The layout of every request is described once by `prepare_request`, which
+/// is instantiated for each of the 4 handlers (one per side and direction),
+/// so there is no runtime dispatch per field
 class RequestHandler {
-
-  enum class Mode {
-    CLI_RECV,
-    CLI_SEND,
-    SERV_RECV,
-    SERV_SEND,
-  };
-
 public:
   RequestHandler(bool is_server) : _server(is_server) {}
 
   /// Write client data request
   template <class T> void client_write_request(SerialOutBuff &out, T &data) {
     assert(!_server);
-    _mode = Mode::CLI_SEND;
     _h_cli_send.reset(&out);
-    prepare_request(*this, data);
+    prepare_request(_h_cli_send, data);
   }
 
   /// Read client data response
   template <class T> void client_read_response(SerialInBuff &in, T &data) {
     assert(!_server);
-    _mode = Mode::CLI_RECV;
     _h_cli_recv.reset(&in);
-    prepare_request(*this, data);
+    prepare_request(_h_cli_recv, data);
   }
 
   template <class T> void server_read_request(SerialInBuff &in, T &data) {
     assert(_server);
-    _mode = Mode::SERV_RECV;
     _h_serv_recv.reset(&in);
-    prepare_request(*this, data);
+    prepare_request(_h_serv_recv, data);
   }
 
   template <class T> void server_write_response(SerialOutBuff &out, T &data) {
     assert(_server);
-    _mode = Mode::SERV_SEND;
     _h_serv_send.reset(&out);
-    prepare_request(*this, data);
-  }
-
-  /// Add a data object that belong to the input request
-  /// Can be any kind, as long as it can be serial / unserial
-  template <class T> void object_in(T &item) {
-    HANDLER_DISPATCH1(object_in, item);
-  }
-
-  /// Add a data object that belong to the output request
-  /// Can be any kind, as long as it can be serial / unserial
-  template <class T> void object_out(T &item) {
-    HANDLER_DISPATCH1(object_out, item);
-  }
-
-  /// Add a buffer of size items of type T
-  /// When request sent, the buffer content is serialized
-  /// When the request is received, the buffer is unserialized into some
-  /// temporary memory
-  /// And `ptr` is set to point to this memory
-  /// The memory is valid until the response is sent
-  template <class T> void buffer_in(T *&ptr, std::size_t size) {
-    HANDLER_DISPATCH2(buffer_in, ptr, size);
+    prepare_request(_h_serv_send, data);
   }
 
-  /// Add a buffer T[size1][size2], with indirection pointer
-  /// When request sent, the whole 2d content is serialized
-  /// When the request is received, the buffer is unserialized into some
-  /// temporary memory, and a temporary indirection buffer with right pointer
-  /// is set And `ptr` is set to point to this temporary indirection buffer
-  /// The memory is valid until the response is sent
-  template <class T>
-  void buffer_2d_in(T **&ptr, std::size_t size1, std::size_t size2) {
-    HANDLER_DISPATCH3(buffer_2d_in, ptr, size1, size2);
-  }
-
-  /// Similar to buffer_2d_in, but second dimension varies
-  /// the size of each T[i] is sizes2[i]
-  template <class T, class Sizes>
-  void buffer_2dvar_in(T **&ptr, std::size_t size1, Sizes *sizes2) {
-    HANDLER_DISPATCH3(buffer_2dvar_in, ptr, size1, sizes2);
-  }
-
-  /// Add a buffer of size items of type T
-  /// When request is received, a buffer is allocated to hold these items
-  /// When response send, this buffer content is serialized
-  /// When response received, content unserialized into `ptr`
-  template <class T> void buffer_out(T *&ptr, std::size_t size) {
-    HANDLER_DISPATCH2(buffer_out, ptr, size);
-  }
-
-  /// Add a buffer T[size1][size2], with indirection pointer
-  /// When request is received, a buffer is allocated to hold these items
-  /// When response send, this buffer content is serialized
-  /// When response received, content unserialized into `ptr`
-  template <class T>
-  void buffer_2d_out(T **&ptr, std::size_t size1, std::size_t size2) {
-    HANDLER_DISPATCH3(buffer_2d_out, ptr, size1, size2);
-  }
-
-  /// Similar to buffer_2d_out, but second dimension varies
-  /// the size of each T[i] is sizes2[i]
-  template <class T, class Sizes>
-  void buffer_2dvar_out(T **&ptr, std::size_t size1, Sizes *sizes2) {
-    HANDLER_DISPATCH3(buffer_2dvar_out, ptr, size1, sizes2);
-  }
-
-  /// Like buffer_2d_in, but this a special version to handle zero-terminated
-  /// strings of varying size
-  void buffer_2d_in_cstr(char **&ptr, std::size_t size) {
-    HANDLER_DISPATCH2(buffer_2d_in_cstr, ptr, size);
-  }
+  /// Heap allocations done for the temporary buffers of received requests
+  std::size_t heap_allocs() const { return _h_serv_recv.heap_allocs(); }
 
 private:
   bool _server;
@@ -469,7 +528,6 @@ private:
   HandlerCliSend _h_cli_send;
   HandlerServRecv _h_serv_recv;
   HandlerServSend _h_serv_send;
-  Mode _mode;
 };
 
 } // namespace odb
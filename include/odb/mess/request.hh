@@ -15,39 +15,124 @@
 #include "../server/fwd.hh"
 #include "db-client.hh"
 #include "fwd.hh"
+#include "server-stats.hh"
 
 namespace odb {
 
+/// Protocol versions
+/// v1: every integer is written with its full size
+/// v2: compact format, with varints and delta-encoded addresses arrays
+///     Negotiated during CONNECT
+constexpr std::uint32_t PROTO_VERSION_1 = 1;
+constexpr std::uint32_t PROTO_VERSION_2 = 2;
+constexpr std::uint32_t PROTO_VERSION = PROTO_VERSION_2;
+
+/// Optional features of the protocol, negotiated during CONNECT
+/// The client sends the ones it wants, the server answers with the ones
+/// enabled for the connection
+enum ProtoCaps : std::uint32_t {
+  PROTO_CAP_COMPACT = 1 << 0,
+  PROTO_CAP_COMPRESS = 1 << 1,
+  PROTO_CAP_MEM_DIFF = 1 << 2,
+  PROTO_CAP_FASTPATH = 1 << 3,
+  PROTO_CAP_PREFETCH = 1 << 4,
+  PROTO_CAP_SYMS_TABLE = 1 << 5,
+  PROTO_CAP_PROGRAM_HASH = 1 << 6,
+  PROTO_CAP_CODE_ANNOTATED = 1 << 7,
+  PROTO_CAP_CODE_AROUND = 1 << 8,
+  PROTO_CAP_STACK_SYMS = 1 << 9,
+  PROTO_CAP_STACK_DELTA = 1 << 10,
+  PROTO_CAP_STATS = 1 << 11,
+  PROTO_CAP_GET_BKPS = 1 << 12,
+};
+
+/// All capabilities implemented by this version
+constexpr std::uint32_t PROTO_CAPS_ALL =
+    PROTO_CAP_COMPACT | PROTO_CAP_COMPRESS | PROTO_CAP_MEM_DIFF |
+    PROTO_CAP_FASTPATH | PROTO_CAP_PREFETCH | PROTO_CAP_SYMS_TABLE |
+    PROTO_CAP_PROGRAM_HASH | PROTO_CAP_CODE_ANNOTATED |
+    PROTO_CAP_CODE_AROUND | PROTO_CAP_STACK_SYMS | PROTO_CAP_STACK_DELTA |
+    PROTO_CAP_STATS | PROTO_CAP_GET_BKPS;
+
+/// List of all requests: X(<ReqType value>, <request struct>)
+/// This is the only place where a request needs to be registered
+/// The ReqType values, serialization code instantiations and server dispatch
+/// table are generated from it
+/// New requests must be added at the end, the values are part of the protocol
+#define ODB_REQUESTS(X)                                                        \
+  X(CONNECT, ReqConnect)                                                       \
+  X(STOP, ReqStop)                                                             \
+  X(CHECK_STOPPED, ReqCheckStopped)                                            \
+  X(GET_REGS, ReqGetRegs)                                                      \
+  X(GET_REGS_VAR, ReqGetRegsVar)                                               \
+  X(SET_REGS, ReqSetRegs)                                                      \
+  X(SET_REGS_VAR, ReqSetRegsVar)                                               \
+  X(GET_REGS_INFOS, ReqGetRegsInfos)                                           \
+  X(FIND_REGS_IDS, ReqFindRegsIds)                                             \
+  X(READ_MEM, ReqReadMem)                                                      \
+  X(READ_MEM_VAR, ReqReadMemVar)                                               \
+  X(WRITE_MEM, ReqWriteMem)                                                    \
+  X(WRITE_MEM_VAR, ReqWriteMemVar)                                             \
+  X(GET_SYMS_BY_IDS, ReqGetSymsByIds)                                          \
+  X(GET_SYMS_BY_ADDR, ReqGetSymsByAddr)                                        \
+  X(GET_SYMS_BY_NAMES, ReqGetSymsByNames)                                      \
+  X(GET_CODE_TEXT, ReqGetCodeText)                                             \
+  X(ADD_BKPS, ReqAddBkps)                                                      \
+  X(DEL_BKPS, ReqDelBkps)                                                      \
+  X(RESUME, ReqResume)                                                         \
+  X(READ_MEM_DIFF, ReqReadMemDiff)                                             \
+  X(SET_PREFETCH, ReqSetPrefetch)                                              \
+  X(GET_SYMS_TABLE, ReqGetSymsTable)                                           \
+  X(GET_CODE_ANNOTATED, ReqGetCodeAnnotated)                                   \
+  X(GET_CODE_AROUND, ReqGetCodeAround)                                         \
+  X(GET_STACK_SYMS, ReqGetStackSyms)                                           \
+  X(GET_STACK_FRAMES, ReqGetStackFrames)                                       \
+  X(GET_STATS, ReqGetStats)                                                    \
+  X(GET_BKPS, ReqGetBkps)
+
 enum class ReqType {
-  CONNECT = 0,
-  STOP,
-  CHECK_STOPPED,
-  GET_REGS,
-  GET_REGS_VAR,
-  SET_REGS,
-  SET_REGS_VAR,
-  GET_REGS_INFOS,
-  FIND_REGS_IDS,
-  READ_MEM,
-  READ_MEM_VAR,
-  WRITE_MEM,
-  WRITE_MEM_VAR,
-  GET_SYMS_BY_IDS,
-  GET_SYMS_BY_ADDR,
-  GET_SYMS_BY_NAMES,
-  GET_CODE_TEXT,
-  ADD_BKPS,
-  DEL_BKPS,
-  RESUME,
+#define ODB_REQ_ENUM(Ty, Req) Ty,
+  ODB_REQUESTS(ODB_REQ_ENUM)
+#undef ODB_REQ_ENUM
 
   ERR = 100,
+  FAST, // fixed-layout message, see fast-request.hh
 };
 
+/// Number of requests in ODB_REQUESTS, with values [0, REQ_COUNT[
+#define ODB_REQ_COUNT(Ty, Req) +1
+constexpr std::size_t REQ_COUNT = 0 ODB_REQUESTS(ODB_REQ_COUNT);
+#undef ODB_REQ_COUNT
+
+/// Name of the ReqType value, eg "READ_MEM"
+const char *req_name(ReqType ty);
+
+/// Returns true if messages of requests with type `ty` may be big, and should
+/// be compressed if the connection supports it
+/// Requests for writes, and responses for reads, are the ones with big data
+constexpr bool req_compressible(ReqType ty) {
+  return ty == ReqType::READ_MEM || ty == ReqType::READ_MEM_VAR ||
+         ty == ReqType::WRITE_MEM || ty == ReqType::WRITE_MEM_VAR ||
+         ty == ReqType::READ_MEM_DIFF || ty == ReqType::GET_SYMS_TABLE ||
+         ty == ReqType::GET_CODE_ANNOTATED ||
+         ty == ReqType::GET_CODE_AROUND || ty == ReqType::GET_STACK_FRAMES;
+}
+
+// Version and caps are optional: a v1 client sends none, and a v1 server
+// doesn't answer them
+// The program hash is only sent if PROTO_CAP_PROGRAM_HASH is enabled
+// The prefetch data is only sent if the client sent a profile
+// Always encoded with the v1 format
 struct ReqConnect {
   static constexpr ReqType REQ_TYPE = ReqType::CONNECT;
 
+  std::uint32_t in_version;
+  std::uint32_t in_caps;
+  PrefetchProfile in_prefetch;
   VMInfos out_infos;
   DBClientUpdate out_udp;
+  std::uint32_t out_version;
+  std::uint32_t out_caps;
 };
 
 struct ReqStop {
@@ -56,9 +141,17 @@ struct ReqStop {
   int tag;
 };
 
+// The prefetch data is only sent if `in_prefetch` is set
+// With `in_stack_delta` (only set when PROTO_CAP_STACK_DELTA was negotiated),
+// the call stack is incremental: see DBClientUpdate
 struct ReqCheckStopped {
   static constexpr ReqType REQ_TYPE = ReqType::CHECK_STOPPED;
 
+  /// Max number of new frames sent in an incremental update
+  static constexpr std::size_t STACK_MAX_FRAMES = 256;
+
+  std::uint8_t in_prefetch = 0;
+  std::uint8_t in_stack_delta = 0;
   DBClientUpdate out_udp;
 };
 
@@ -211,10 +304,109 @@ struct ReqResume {
   ResumeType type;
 };
 
+// Read the pages of a memory region that changed since the last read
+// Only sent when PROTO_CAP_MEM_DIFF was negotiated
+struct ReqReadMemDiff {
+  static constexpr ReqType REQ_TYPE = ReqType::READ_MEM_DIFF;
+
+  vm_ptr_t addr;
+  vm_size_t size;
+  std::uint64_t in_version;
+  std::uint64_t out_version;
+  std::vector<vm_size_t> out_pages;
+  std::vector<char> out_data;
+};
+
+// Set the prefetch profile of the connection
+// Only sent when PROTO_CAP_PREFETCH was negotiated
+// Can be sent while the VM is running
+struct ReqSetPrefetch {
+  static constexpr ReqType REQ_TYPE = ReqType::SET_PREFETCH;
+
+  PrefetchProfile in_profile;
+};
+
+// Get the whole symbol table
+// Only sent when PROTO_CAP_SYMS_TABLE was negotiated
+struct ReqGetSymsTable {
+  static constexpr ReqType REQ_TYPE = ReqType::GET_SYMS_TABLE;
+
+  SymbolsTable out_table;
+};
+
+// Get code text with its symbols, see CodeAnnotated
+// Only sent when PROTO_CAP_CODE_ANNOTATED was negotiated
+struct ReqGetCodeAnnotated {
+  static constexpr ReqType REQ_TYPE = ReqType::GET_CODE_ANNOTATED;
+
+  vm_ptr_t addr;
+  vm_size_t nins;
+  CodeAnnotated out_code;
+};
+
+// Get up to `nbefore` instructions before `addr`, then `nafter` from `addr`
+// The server finds the instructions before, even if they have different
+// sizes. Only sent when PROTO_CAP_CODE_AROUND was negotiated
+struct ReqGetCodeAround {
+  static constexpr ReqType REQ_TYPE = ReqType::GET_CODE_AROUND;
+
+  vm_ptr_t addr;
+  vm_size_t nbefore;
+  vm_size_t nafter;
+  CodeAnnotated out_code;
+};
+
+// Get the call stack, with the symbol containing the start of every frame
+// (see Debugger::get_symbol_containing)
+// Only sent when PROTO_CAP_STACK_SYMS was negotiated
+struct ReqGetStackSyms {
+  static constexpr ReqType REQ_TYPE = ReqType::GET_STACK_SYMS;
+
+  CallStack out_stack;
+  std::vector<vm_sym_t> out_frames_syms; // one per frame, VM_SYM_NULL if none
+  std::vector<SymbolInfos> out_syms;     // all symbols of out_frames_syms
+};
+
+// Get the frames [beg, end[ of the call stack, missing from incremental
+// updates. Only sent when PROTO_CAP_STACK_DELTA was negotiated
+struct ReqGetStackFrames {
+  static constexpr ReqType REQ_TYPE = ReqType::GET_STACK_FRAMES;
+
+  std::uint64_t beg;
+  std::uint64_t end;
+  CallStack out_frames;
+};
+
+// Get the metrics of the server, see ServerStats
+// Only sent when PROTO_CAP_STATS was negotiated
+// Can be sent while the VM is running
+struct ReqGetStats {
+  static constexpr ReqType REQ_TYPE = ReqType::GET_STATS;
+
+  ServerStats out_stats;
+};
+
+// Get the addresses of all breakpoints, including the ones of other clients
+// Only sent when PROTO_CAP_GET_BKPS was negotiated
+struct ReqGetBkps {
+  static constexpr ReqType REQ_TYPE = ReqType::GET_BKPS;
+
+  std::vector<vm_ptr_t> out_addrs;
+};
+
 struct ReqErr {
   static constexpr ReqType REQ_TYPE = ReqType::ERR;
 
   std::string msg;
 };
 
+/// Describe the layout of a request, with calls to `h` methods (see
+/// RequestHandler)
+/// Instantiated for every handler class in request.cc
+#define ODB_REQ_PREPARE(Ty, Req)                                               \
+  template <class Handler> void prepare_request(Handler &h, Req &r);
+ODB_REQUESTS(ODB_REQ_PREPARE)
+ODB_REQ_PREPARE(ERR, ReqErr)
+#undef ODB_REQ_PREPARE
+
 } // namespace odb
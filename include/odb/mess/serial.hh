@@ -13,7 +13,9 @@
 #pragma once
 
 #include <cassert>
+#include <cstdint>
 #include <cstring>
+#include <memory>
 #include <vector>
 
 #include "fwd.hh"
@@ -26,29 +28,124 @@ template <class T> void sb_unserialize(SerialInBuff &is, T &item);
 
 /// Output stream with a bytes array
 /// Serialized object are written to this array
+///
+/// The content may also reference external memory (see `write_ref`): the
+/// serialized data is then made of several segments, alternating between the
+/// owned array and the referenced buffers
+/// These segments are sent as-is by the transfer layer (scatter-gather)
 class SerialOutBuff {
 public:
+  /// Buffers smaller than this are always copied by `write_ref`
+  /// Referencing them would cost more than the copy
+  static constexpr std::size_t REF_MIN_SIZE = 512;
+
+  /// One contiguous part of the serialized data
+  struct Segment {
+    const char *data;
+    std::size_t size;
+  };
+
   /// Create an empty buffer
   SerialOutBuff() = default;
 
   /// Reset to empty buffer
-  void reset() { _data.clear(); }
+  /// The memory of the owned array is kept for the next use
+  void reset() {
+    _data.clear();
+    _refs.clear();
+    _refs_size = 0;
+    _compressible = false;
+  }
 
   /// Write len bytes in data to output buffer
   void write(const char *data, std::size_t len) {
     _data.insert(_data.end(), data, data + len);
   }
 
+  /// Append len bytes in data to output buffer, without copying them
+  /// `data` must stay valid and unchanged until the buffer is sent or reset
+  void write_ref(const char *data, std::size_t len) {
+    if (len < REF_MIN_SIZE) {
+      write(data, len);
+      return;
+    }
+    _refs_size += len;
+
+    // Merge with the previous reference when contiguous
+    if (!_refs.empty()) {
+      auto &last = _refs.back();
+      if (last.pos == _data.size() && last.data + last.size == data) {
+        last.size += len;
+        return;
+      }
+    }
+    _refs.push_back(Ref{_data.size(), data, len});
+  }
+
   /// Methods used once the serialization is complete to access the data
-  const char *get_data() const { return &_data[0]; }
-  std::size_t get_size() const { return _data.size(); }
+  /// `get_data` can only be used when there is no external reference
+  const char *get_data() const {
+    assert(_refs.empty());
+    return _data.data();
+  }
+  std::size_t get_size() const { return _data.size() + _refs_size; }
+
+  /// Number of bytes copied into the owned array
+  std::size_t get_copied_size() const { return _data.size(); }
+
+  /// Enable the compact encoding of integers (protocol v2)
+  /// Not changed by reset
+  void set_compact(bool compact) { _compact = compact; }
+  bool compact() const { return _compact; }
+
+  /// Minimum size to compress messages when sent, 0 if disabled
+  /// Not changed by reset
+  void set_compress_min(std::size_t size) { _compress_min = size; }
+  std::size_t compress_min() const { return _compress_min; }
+
+  /// Mark the current message as a good candidate for compression
+  /// Reset to false by reset
+  void set_compressible(bool compressible) { _compressible = compressible; }
+
+  /// Returns true if the current message should be compressed when sent
+  bool should_compress() const {
+    return _compressible && _compress_min && get_size() >= _compress_min;
+  }
+
+  /// Call `f(const Segment &)` on every non-empty segment, in order
+  template <class F> void for_each_segment(F f) const {
+    std::size_t pos = 0;
+    for (const auto &ref : _refs) {
+      if (ref.pos > pos)
+        f(Segment{_data.data() + pos, ref.pos - pos});
+      f(Segment{ref.data, ref.size});
+      pos = ref.pos;
+    }
+    if (_data.size() > pos)
+      f(Segment{_data.data() + pos, _data.size() - pos});
+  }
 
 private:
+  // External buffer inserted at offset `pos` of `_data`
+  struct Ref {
+    std::size_t pos;
+    const char *data;
+    std::size_t size;
+  };
+
   std::vector<char> _data;
+  std::vector<Ref> _refs;
+  std::size_t _refs_size = 0;
+  bool _compact = false;
+  std::size_t _compress_min = 0;
+  bool _compressible = false;
 };
 
 /// Input stream with a bytes array
 /// Objects are unserialized from this array
+///
+/// The array memory is kept between resets, and never initialized: receiving
+/// a new message doesn't cost any allocation once the buffer is big enough
 class SerialInBuff {
 public:
   /// Unitialized empty inbuff
@@ -64,36 +161,64 @@ public:
   /// Reset binary content to a new unitialized buffer of `len` bytes
   /// Also reset read position to 0
   void reset(std::size_t len) {
-    _data.resize(len);
+    if (len > _cap) {
+      // Not make_unique, it would zero-fill the memory
+      _data.reset(new char[len]);
+      _cap = len;
+    }
+    _size = len;
     _pos = 0;
   }
 
   /// Reset binary content to buffer with `bytes` from `data`
   /// Also reset read position to 0
   void reset(const char *data, std::size_t len) {
-    _data.assign(data, data + len);
-    _pos = 0;
+    reset(len);
+    if (len)
+      std::memcpy(_data.get(), data, len);
   }
 
   /// Read len bytes from buffer to out_data
   /// Panic if there is less than len available bytes
   void read(char *out_data, std::size_t len) {
-    assert(_pos + len <= _data.size());
-    std::memcpy(out_data, &_data[_pos], len);
+    std::memcpy(out_data, read_ref(len), len);
+  }
+
+  /// Skip len bytes of the buffer, and returns a pointer to them
+  /// The pointer is valid until the next reset
+  /// Panic if there is less than len available bytes
+  char *read_ref(std::size_t len) {
+    assert(_pos + len <= _size);
+    char *res = _data.get() + _pos;
     _pos += len;
+    return res;
   }
 
+  /// Returns true if all bytes were read
+  bool is_eof() const { return _pos == _size; }
+
+  /// Number of bytes not read yet
+  std::size_t remaining() const { return _size - _pos; }
+
   /// Should be called after the unserialization is complete
   /// Panic if there is some bytes left unread
-  void check_eof() { assert(_pos == _data.size()); }
+  void check_eof() { assert(_pos == _size); }
 
   /// Methods used before the serialization is complete to set the data
-  char *get_data() { return &_data[0]; }
-  std::size_t get_size() const { return _data.size(); }
+  char *get_data() { return _data.get(); }
+  std::size_t get_size() const { return _size; }
+
+  /// Enable the compact encoding of integers (protocol v2)
+  /// Not changed by reset
+  void set_compact(bool compact) { _compact = compact; }
+  bool compact() const { return _compact; }
 
 private:
-  std::vector<char> _data;
+  std::unique_ptr<char[]> _data;
+  std::size_t _size = 0;
+  std::size_t _cap = 0;
   std::size_t _pos;
+  bool _compact = false;
 };
 
 template <class T> SerialOutBuff &operator<<(SerialOutBuff &os, const T &item) {
@@ -116,4 +241,74 @@ template <class T> T sb_unserial_raw(SerialInBuff &is) {
   return res;
 }
 
+/// Write `x` as a LEB128 varint (7 bits per byte, small values first)
+inline void sb_serial_varint(SerialOutBuff &os, std::uint64_t x) {
+  char buf[10];
+  std::size_t len = 0;
+  while (x >= 0x80) {
+    buf[len++] = static_cast<char>((x & 0x7F) | 0x80);
+    x >>= 7;
+  }
+  buf[len++] = static_cast<char>(x);
+  os.write(buf, len);
+}
+
+/// Read a LEB128 varint
+inline std::uint64_t sb_unserial_varint(SerialInBuff &is) {
+  std::uint64_t res = 0;
+  for (unsigned shift = 0; shift < 64; shift += 7) {
+    char c;
+    is.read(&c, 1);
+    auto byte = static_cast<std::uint8_t>(c);
+    res |= static_cast<std::uint64_t>(byte & 0x7F) << shift;
+    if (!(byte & 0x80))
+      break;
+  }
+  return res;
+}
+
+/// Write a size / count
+/// Encoded as an uint64_t, or a varint with the compact format
+inline void sb_serial_size(SerialOutBuff &os, std::uint64_t size) {
+  if (os.compact())
+    sb_serial_varint(os, size);
+  else
+    sb_serial_raw<std::uint64_t>(os, size);
+}
+
+inline std::uint64_t sb_unserial_size(SerialInBuff &is) {
+  return is.compact() ? sb_unserial_varint(is)
+                      : sb_unserial_raw<std::uint64_t>(is);
+}
+
+/// Encode a sequence of 64 bits values as differences with the previous one
+/// Used by the compact format for addresses arrays, that are usually close
+/// Each difference is written as a zigzag varint
+class SerialDeltaOut {
+public:
+  void write(SerialOutBuff &os, std::uint64_t x) {
+    auto diff = static_cast<std::int64_t>(x - _prev);
+    auto zz = (static_cast<std::uint64_t>(diff) << 1) ^
+              static_cast<std::uint64_t>(diff >> 63);
+    sb_serial_varint(os, zz);
+    _prev = x;
+  }
+
+private:
+  std::uint64_t _prev = 0;
+};
+
+class SerialDeltaIn {
+public:
+  std::uint64_t read(SerialInBuff &is) {
+    auto zz = sb_unserial_varint(is);
+    auto diff = (zz >> 1) ^ (~(zz & 1) + 1);
+    _prev += diff;
+    return _prev;
+  }
+
+private:
+  std::uint64_t _prev = 0;
+};
+
 } // namespace odb
@@ -0,0 +1,82 @@
+//===-- mess/server-stats.hh - ServerStats struct definition ----*- C++ -*-===//
+//
+// ODB Library
+// Author: Steven Lariau
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// Metrics collected by the debugger server
+///
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <cstdint>
+#include <iosfwd>
+#include <map>
+#include <vector>
+
+#include "../server/fwd.hh"
+#include "../utils/histogram.hh"
+#include "fwd.hh"
+
+namespace odb {
+
+/// Metrics of the server since the debugger started
+/// Always collected, each one costs a few counters updates at most
+/// Sent to clients with the GET_STATS request
+struct ServerStats {
+  /// Metrics for one kind of request
+  /// Sizes are of the messages before compression
+  struct Request {
+    std::uint64_t count = 0;
+    std::uint64_t errors = 0;
+    std::uint64_t bytes_in = 0;
+    std::uint64_t bytes_out = 0;
+    Histogram latency; // time to answer, in ns
+  };
+
+  /// Profile of one VMApi method, collected by InstrumentedVMApi
+  /// The number of calls is in `vm_calls`
+  struct VMCall {
+    Histogram time;           // duration of every call, in ns
+    Histogram sizes;          // size of the arguments (eg bytes read), if any
+    std::uint64_t errors = 0; // calls that threw
+  };
+
+  /// Indexed by ReqType, the last one is for fast requests (ReqType::FAST)
+  /// May be smaller than the number of requests, for older servers
+  std::vector<Request> requests;
+
+  /// Calls to ServerApp::loop, one per instruction
+  std::uint64_t loop_calls = 0;
+
+  /// Time (ns) inside ServerApp::loop while the VM is running, and spent by
+  /// the VM between the calls
+  /// Only some calls are timed, these are estimations
+  std::uint64_t loop_ns = 0;
+  std::uint64_t vm_ns = 0;
+
+  /// Time (ns) the VM was stopped, waiting for or running client commands
+  std::uint64_t stopped_ns = 0;
+
+  /// Calls made by the debugger to the VM, indexed by VMApiCall
+  std::vector<std::uint64_t> vm_calls;
+
+  /// Timings of the calls counted in `vm_calls`, indexed by VMApiCall
+  /// Empty unless the VM is instrumented (ServerConfig::vm_profile)
+  std::vector<VMCall> vm_profile;
+
+  /// Number of times every breakpoint was hit, by address
+  /// Breakpoints deleted are still there
+  std::map<vm_ptr_t, std::uint64_t> bkp_hits;
+
+  /// Returns the metrics of request `ty`, resizing `requests` if needed
+  Request &request(ReqType ty);
+
+  /// Print all metrics in a human-readable format
+  void dump(std::ostream &os) const;
+};
+
+} // namespace odb
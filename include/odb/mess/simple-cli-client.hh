@@ -44,6 +44,9 @@ namespace odb {
 /// Write memory
 /// smem <type> <val> (addr) <val>+
 ///
+/// Dump memory to a file, read in chunks
+/// dump <val> (addr) <int> (size) <path>
+///
 /// Print symbol informations
 /// psym <symbol>
 ///
@@ -71,6 +74,10 @@ namespace odb {
 /// Print VM informations
 /// vm
 ///
+/// Print server metrics (requests, time in VM / debugger, VM calls,
+/// breakpoints hits)
+/// stats
+///
 ///
 /// Usual arguments:
 ///   <type>: u8, i8, u16, i16, u32, i32, u64, i64, f32, f64
@@ -102,6 +109,7 @@ private:
   std::string _cmd_pmem();
 
   std::string _cmd_smem();
+  std::string _cmd_dump();
 
   std::string _cmd_psym();
 
@@ -124,6 +132,8 @@ private:
   std::string _cmd_bt();
 
   std::string _cmd_vm();
+
+  std::string _cmd_stats();
 };
 
 } // namespace odb
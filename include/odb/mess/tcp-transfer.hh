@@ -12,6 +12,8 @@
 
 #pragma once
 
+#include <cstddef>
+
 #include "fwd.hh"
 
 namespace odb {
@@ -20,13 +22,25 @@ namespace odb {
 //
 // Send SerialOutBuff: header + SerialOutBuff binary array content
 //   header: binary array size in bytes, as std::uint32_t
+//   The header and all segments of `os` are sent with a single syscall
+//   (unless the socket buffer is full)
+//   If the message is marked compressible (and compression enabled for `os`),
+//   the content is compressed, and the highest bit of header is set:
+//   header | uncompressed size (std::uint32_t) + compressed data
+//   Messages of TCP_FRAME_MAX_SIZE bytes or more can't be sent
 //
 // Recv SerialInbuff: header + SerialInbuff binary array content
 //   header: binary array size in bytes, as std::uint32_t
+//   Compressed messages are always accepted, and uncompressed into `is`
+
+/// Messages sizes must be smaller, the highest bit of the header is the
+/// compressed flag
+constexpr std::size_t TCP_FRAME_MAX_SIZE = std::size_t(1) << 31;
 
 /// Write `os` content to file descriptor `fd`
 /// Blocking call
-/// @returns true if write everything successfully
+/// @returns true if write everything successfully, false if it failed or
+/// `os` is too big (nothing is written)
 bool send_data_tcp(const SerialOutBuff &os, int fd);
 
 // Read `is` content from file descriptor `fd`
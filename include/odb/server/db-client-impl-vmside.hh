@@ -16,6 +16,8 @@
 #include "../mess/db-client-impl.hh"
 #include "fwd.hh"
 
+#include <memory>
+
 namespace odb {
 
 /// Implementation for the DBClient
@@ -24,6 +26,7 @@ namespace odb {
 class DBClientImplVMSide : public DBClientImpl {
 public:
   DBClientImplVMSide(Debugger &db);
+  ~DBClientImplVMSide() override;
 
   void connect(VMInfos &infos, DBClientUpdate &udp) override;
 
@@ -31,6 +34,10 @@ public:
 
   void check_stopped(DBClientUpdate &udp) override;
 
+  /// Only send the frames that changed since `udp.stack_version`, and at most
+  /// `max_frames` of them (0 for no limit)
+  void check_stopped(DBClientUpdate &udp, std::size_t max_frames);
+
   void get_regs(const vm_reg_t *ids, char **out_bufs,
                 const vm_size_t *regs_size, std::size_t nregs) override;
 
@@ -49,6 +56,10 @@ public:
   void write_mem(const vm_ptr_t *dst_addrs, const vm_size_t *bufs_sizes,
                  const char **in_bufs, std::size_t nbuffs) override;
 
+  void read_mem_diff(vm_ptr_t addr, vm_size_t size, std::uint64_t &version,
+                     std::vector<vm_size_t> &out_pages,
+                     std::vector<char> &out_data) override;
+
   void get_symbols_by_ids(const vm_sym_t *ids, SymbolInfos *out_infos,
                           std::size_t nsyms) override;
 
@@ -58,18 +69,47 @@ public:
   void get_symbols_by_names(const char **names, SymbolInfos *out_infos,
                             std::size_t nsyms) override;
 
+  void get_symbols_table(SymbolsTable &out_table) override;
+
   void get_code_text(vm_ptr_t addr, std::size_t nins,
                      std::vector<std::string> &out_text,
                      std::vector<vm_size_t> &out_sizes) override;
 
+  void get_code_annotated(vm_ptr_t addr, std::size_t nins,
+                          CodeAnnotated &out_code) override;
+
+  void get_code_around(vm_ptr_t addr, std::size_t nbefore, std::size_t nafter,
+                       CodeAnnotated &out_code) override;
+
+  void get_stack_syms(CallStack &out_stack,
+                      std::vector<vm_sym_t> &out_frames_syms,
+                      std::vector<SymbolInfos> &out_syms) override;
+
+  void get_stack_frames(std::size_t beg, std::size_t end,
+                        CallStack &out_frames) override;
+
   void add_breakpoints(const vm_ptr_t *addrs, std::size_t size) override;
 
   void del_breakpoints(const vm_ptr_t *addrs, std::size_t size) override;
 
+  void get_breakpoints(std::vector<vm_ptr_t> &out_addrs) override;
+
+  /// Always true, all requests are implemented by the Debugger
+  bool has_cap(std::uint32_t caps) const override;
+
   void resume(ResumeType type) override;
 
+  void set_prefetch(const PrefetchProfile &profile) override;
+
+  void get_stats(ServerStats &out_stats) override;
+
+  /// Read everything described by `profile` into `out`, VM must be stopped
+  /// Never throws: items that can't be read are skipped
+  void prefetch(const PrefetchProfile &profile, StopPrefetch &out);
+
 private:
   Debugger &_db;
+  std::unique_ptr<PrefetchProfile> _prefetch;
 };
 
 } // namespace odb
@@ -12,8 +12,10 @@
 
 #pragma once
 
+#include "../mess/server-stats.hh"
 #include "../utils/range-map.hh"
 #include "fwd.hh"
+#include "symbol-store.hh"
 #include "vm-api.hh"
 #include <map>
 #include <memory>
@@ -81,6 +83,7 @@ public:
   /// Read the content of register with index `idx`
   /// Value will be written in `val`
   /// Must be big enough to hold the value
+  /// Values are cached until the next instruction is executed
   void get_reg(vm_reg_t idx, std::uint8_t *val);
 
   /// Change the content of register with index `idx`
@@ -88,6 +91,18 @@ public:
   /// Must be big enough
   void set_reg(vm_reg_t idx, const std::uint8_t *new_val);
 
+  /// Enable / disable the register values cache, enabled by default
+  /// Must be disabled for VMs where registers can change without executing
+  /// an instruction (eg: updated by another thread)
+  void set_regs_cache(bool enabled) { _regs_cache = enabled; }
+
+  /// Infos of all registers are loaded by `on_init` if the VM doesn't have
+  /// more than that
+  static constexpr vm_reg_t REGS_PRELOAD_MAX = 256;
+
+  /// All symbols are loaded by `on_init` if the VM doesn't have more than that
+  static constexpr vm_sym_t SYMS_PRELOAD_MAX = 1 << 16;
+
   /// Get informations about a specific register
   RegInfos get_reg_infos(vm_reg_t idx);
 
@@ -112,6 +127,26 @@ public:
   /// Write `size` bytes of data to `addr` from `buf` src
   void write_mem(vm_ptr_t addr, vm_size_t size, const std::uint8_t *buf);
 
+  /// Size of the pages compared by `read_mem_diff`
+  static constexpr vm_size_t MEM_DIFF_PAGE_SIZE = 256;
+
+  /// Max number of regions tracked by `read_mem_diff`
+  /// The least recently used one is dropped when there is too many
+  static constexpr std::size_t MEM_DIFF_MAX_REGIONS = 32;
+
+  /// Read only the pages of [`addr`, `addr` + `size`[ that changed since the
+  /// last call with the same region
+  /// A hash of every page is kept for each region
+  /// @param version the version of the region known by the client (0 for
+  /// none). Set to the new version. If it's not the last one sent, all pages
+  /// are read
+  /// @param out_pages indices of all changed pages. Page i starts at
+  /// `addr` + i * MEM_DIFF_PAGE_SIZE, the last one may be smaller
+  /// @param out_data content of all changed pages, one after another
+  void read_mem_diff(vm_ptr_t addr, vm_size_t size, std::uint64_t &version,
+                     std::vector<vm_size_t> &out_pages,
+                     std::vector<char> &out_data);
+
   /// Get full memory size
   vm_size_t get_memory_size();
 
@@ -119,6 +154,15 @@ public:
   /// Returns VM_SYM_NULL if no symbol found
   vm_sym_t get_symbol_at(vm_ptr_t addr);
 
+  /// Max distance between an address and the symbol containing it
+  static constexpr vm_size_t SYM_CONTAINING_MAX_DIST = 1 << 20;
+
+  /// @returns the symbol with the highest address <= `addr` (eg: the function
+  /// containing `addr`), and stores `addr` - its address in `out_off`
+  /// Returns VM_SYM_NULL if there is none in the SYM_CONTAINING_MAX_DIST bytes
+  /// before `addr`
+  vm_sym_t get_symbol_containing(vm_ptr_t addr, vm_size_t &out_off);
+
   /// Returns all symbols defined in [`addr`, `addr` + `size`[
   std::vector<vm_sym_t> get_symbols(vm_ptr_t addr, vm_size_t size);
 
@@ -132,14 +176,72 @@ public:
   /// Returns a symbol id given its name
   vm_sym_t find_sym_id(const std::string &name);
 
+  /// Symbols are loaded by windows of addresses around the lookups
+  /// The window starts at SYM_WINDOW_MIN, doubles when lookups move forward
+  /// sequentially, and halves on random lookups
+  /// It doesn't grow if that would load more than SYM_WINDOW_BUDGET symbols
+  /// in one VMApi::get_symbols call
+  static constexpr vm_size_t SYM_WINDOW_MIN = 256;
+  static constexpr vm_size_t SYM_WINDOW_MAX = 1 << 20;
+  static constexpr std::size_t SYM_WINDOW_BUDGET = 4096;
+
+  /// Disable to always load SYM_WINDOW_MIN around lookups
+  void set_syms_window_adaptive(bool enabled) { _syms_adaptive = enabled; }
+
+  vm_size_t syms_window() const { return _syms_window; }
+
+  /// Number of symbols queries, and VM calls needed to answer them
+  struct SymsStats {
+    std::size_t queries = 0;
+    std::size_t vm_get_symbols = 0;
+    std::size_t vm_get_symb_infos = 0;
+    std::size_t vm_find_sym_id = 0;
+  };
+
+  const SymsStats &syms_stats() const { return _syms_stats; }
+
+  /// Log the debugger events and the calls to the VM to `log`, or nothing if
+  /// null. `log` must outlive the debugger
+  void set_event_log(EventLog *log) { _log = log; }
+
+  /// Metrics of the whole server. The debugger counts the VM calls and the
+  /// breakpoints hits, the other parts of the server update the rest
+  ServerStats &stats() { return _stats; }
+
+  /// Wrap the VM in an InstrumentedVMApi, to profile all calls to the VM in
+  /// `stats().vm_profile`. Must be called before `on_init`
+  void enable_vm_profile();
+
   /// Get the text format of the instruction or data directive at address `addr`
   /// Store in `addr_dist` the number of opcode bytes read
   /// This may be used to read instruction, but also data directives (eg .byte,
   /// .word)
   /// If the code contains a reference to a symbol, it's written '{symbol_idx}'
   /// Returns an empty string if there is no code or the opcode is invalid
+  /// Decoded instructions are cached, the code is considered static: only
+  /// writes with `write_mem` invalidate them
   std::string get_code_text(vm_ptr_t addr, vm_size_t &addr_dist);
 
+  /// Max number of instructions cached by `get_code_text`
+  /// The cache is emptied when full
+  static constexpr std::size_t CODE_CACHE_MAX_SIZE = 1 << 16;
+
+  /// Find the start of up to `nins` instructions right before `addr`
+  /// Works with variable-length instructions: code is decoded forward from
+  /// known instruction boundaries (symbols, call stack, execution point), and
+  /// the boundaries found are kept in an index
+  /// Returns the address of the first instruction found, `addr` if none
+  /// @param out_nins number of instructions found
+  vm_ptr_t find_code_before(vm_ptr_t addr, vm_size_t nins,
+                            vm_size_t &out_nins);
+
+  /// Max number of bytes decoded to reach an address from a known boundary
+  static constexpr vm_size_t CODE_INDEX_MAX_SCAN = 4096;
+
+  /// Max instruction size tried when there is no known boundary before an
+  /// address
+  static constexpr vm_size_t CODE_PROBE_MAX_SIZE = 16;
+
   /// Returns the address of the next instruction to be executed
   /// This may differ from PC on some VMs that have different fetch, decode,
   /// exec cycles
@@ -163,6 +265,9 @@ public:
   /// Throws an error if `adddr` outside of memory space
   bool has_breakpoint(vm_ptr_t addr);
 
+  /// Addresses of all breakpoints
+  const std::set<vm_ptr_t> &breakpoints() const { return _breakpts; }
+
   /// Delete the breakpoint at `addr` if there is one
   /// Throws an error if `adddr` outside of memory space or if there is no
   /// breakpoint
@@ -187,41 +292,108 @@ public:
   // garbage data
   const CallStack &get_call_stack() const { return _call_stack; }
 
+  /// Number of frames at the start of the call stack that didn't change since
+  /// `version` (0 for none). Set `version` to the new one
+  /// Only the last version returned is tracked, older ones have no frames in
+  /// common with the current stack
+  std::size_t call_stack_diff(std::uint64_t &version);
+
 private:
   std::unique_ptr<VMApi> _vm;
+
+  // Returns the VM, and counts one more call to `call`
+  VMApi &_vm_call(VMApiCall call) {
+    ++_stats.vm_calls[static_cast<std::size_t>(call)];
+    return *_vm;
+  }
+
+  EventLog *_log = nullptr;
+  ServerStats _stats;
   VMInfos _infos;
   State _state;
   CallStack _call_stack;
+  // Frames below _call_stack_low didn't change since _call_stack_version
+  std::uint64_t _call_stack_version = 0;
+  std::size_t _call_stack_low = 0;
   vm_ptr_t _ins_addr;
 
-  std::map<vm_reg_t, RegInfos> _map_regs;
+  // Register infos, with the generation of the value in infos.val
+  // Values read before the last instruction have an older generation
+  struct RegEntry {
+    RegInfos infos;
+    std::uint64_t val_gen; // 0 if not read
+  };
+  std::map<vm_reg_t, RegEntry> _map_regs;
   std::map<std::string, vm_reg_t> _smap_regs;
-
-  // @TIP Implem based on the fact that all symbols have different names
-  // May not be always true for all VMs ?
-  std::map<vm_sym_t, SymbolInfos> _map_syms;
-  std::map<std::string, vm_sym_t> _smap_syms;
-  std::unique_ptr<RangeMap<int>> _syms_ranges;
-  std::map<vm_ptr_t, vm_sym_t> _syms_pos;
+  std::uint64_t _regs_gen = 1; // incremented after every instruction
+  bool _regs_cache = true;
+
+  // @TIP Lookup by name based on the fact that all symbols have different
+  // names. May not be always true for all VMs ?
+  SymbolStore _syms;
+  std::unique_ptr<RangeMap<int>> _syms_ranges; // memory ranges loaded in _syms
+  bool _syms_adaptive = true;
+  vm_size_t _syms_window = SYM_WINDOW_MIN;
+  // Last window loaded by a lookup [low, high], and its number of symbols
+  vm_ptr_t _syms_last_low = 0;
+  vm_ptr_t _syms_last_high = 0;
+  std::size_t _syms_last_count = 0;
+  SymsStats _syms_stats;
 
   std::set<vm_ptr_t> _breakpts;
+
+  // Instructions decoded by get_code_text, by address
+  struct CodeCacheIns {
+    std::string text;
+    vm_size_t size;
+  };
+  std::map<vm_ptr_t, CodeCacheIns> _code_cache;
+  vm_size_t _code_cache_max_ins = 0; // biggest instruction in _code_cache
+
+  // Instruction boundaries: size of the instruction at each known start
+  // Only filled by decoding forward from other boundaries, never from an
+  // address sent by a client, that may be in the middle of an instruction
+  std::map<vm_ptr_t, vm_size_t> _ins_index;
+  vm_size_t _ins_index_max = 0; // biggest instruction in _ins_index
+
+  // Regions tracked by read_mem_diff
+  struct MemDiffRegion {
+    std::uint64_t version;
+    std::uint64_t last_use;
+    std::vector<std::uint64_t> hashes;
+  };
+  std::map<std::pair<vm_ptr_t, vm_size_t>, MemDiffRegion> _mem_diff_regions;
+  std::uint64_t _mem_diff_version = 0;
+  std::uint64_t _mem_diff_tick = 0;
+  std::vector<std::uint8_t> _mem_diff_buf;
   std::size_t
       _step_over_depth; // to be able to stop a the right subroutine return
 
   // Load all informations concerning a register in the data members
   // Does nothing if already loaded
-  void _load_reg(vm_reg_t id);
+  RegEntry &_load_reg(vm_reg_t id);
 
-  // Make sure all symbols in [addr, addr + size[ are in _map_syms
+  // Make sure all symbols in [addr, addr + size[ are in _syms
   // Use a range-based map to known which part of the memory need to be loaded
-  void _preload_symbols(vm_ptr_t addr, vm_size_t size);
+  // Returns the number of symbols loaded
+  std::size_t _preload_symbols(vm_ptr_t addr, vm_size_t size);
 
-  // Call preload_symbols, but with `addr` in the middle range
+  // Call preload_symbols with the symbols window around `addr`, and adapt its
+  // size to the lookups
   void _preload_symbols(vm_ptr_t addr);
 
   /// Load all informations concerning a symbol in the data members
   /// Does nothing is already loaded
-  void _load_symbol(vm_sym_t id);
+  /// Returns its index in _syms
+  std::size_t _load_symbol(vm_sym_t id);
+
+  // Find the start of the instruction ending right at `addr`
+  // Returns false if there is none
+  bool _find_ins_before(vm_ptr_t addr, vm_ptr_t &out_start);
+
+  // Closest known instruction boundary before `addr`
+  // Returns false if there is none
+  bool _find_code_anchor(vm_ptr_t addr, vm_ptr_t &out_anchor);
 };
 
 } // namespace odb
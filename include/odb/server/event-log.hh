@@ -0,0 +1,161 @@
+//===-- server/event-log.hh - EventLog class definition ---------*- C++ -*-===//
+//
+// ODB Library
+// Author: Steven Lariau
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// Binary log of the Debugger events, written by a background thread
+///
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iosfwd>
+#include <string>
+#include <thread>
+
+#include "../utils/spsc-ring.hh"
+#include "fwd.hh"
+
+namespace odb {
+
+/// List of all events: X(<LogEvent value>, <LogLevel>)
+/// The arguments of every event are described in EventLog::print
+/// New events must be added at the end, the values are stored in log files
+#define ODB_LOG_EVENTS(X)                                                      \
+  X(DROPPED, ERROR)                                                            \
+  X(VM_ERROR, ERROR)                                                           \
+  X(INIT, INFO)                                                                \
+  X(VM_INFOS, INFO)                                                            \
+  X(STOP, INFO)                                                                \
+  X(EXIT, INFO)                                                                \
+  X(RESUME, INFO)                                                              \
+  X(STOP_REQUEST, INFO)                                                        \
+  X(ADD_BKP, INFO)                                                             \
+  X(DEL_BKP, INFO)                                                             \
+  X(VM_GET_REG, DEBUG)                                                         \
+  X(VM_SET_REG, DEBUG)                                                         \
+  X(VM_FIND_REG, DEBUG)                                                        \
+  X(VM_READ_MEM, DEBUG)                                                        \
+  X(VM_WRITE_MEM, DEBUG)                                                       \
+  X(VM_GET_SYMBOLS, DEBUG)                                                     \
+  X(VM_GET_SYMB_INFOS, DEBUG)                                                  \
+  X(VM_FIND_SYM, DEBUG)                                                        \
+  X(VM_GET_CODE_TEXT, DEBUG)                                                   \
+  X(UPDATE, TRACE)
+
+/// Events of a level are logged with all the ones of lower levels
+enum class LogLevel : std::uint32_t {
+  NONE,
+  ERROR, // lost events, VM errors
+  INFO,  // init, stops, resumes, breakpoints
+  DEBUG, // calls to the VM API
+  TRACE, // every instruction
+};
+
+enum class LogEvent : std::uint32_t {
+#define ODB_LOG_ENUM(Ev, Level) Ev,
+  ODB_LOG_EVENTS(ODB_LOG_ENUM)
+#undef ODB_LOG_ENUM
+};
+
+/// Why the debugger stopped, argument of LogEvent::STOP
+enum class LogStopReason : std::uint32_t {
+  STEP,
+  STEP_OVER,
+  STEP_OUT,
+  BREAKPOINT,
+};
+
+/// Structured log with fixed-size records, made to stay enabled on a running
+/// VM: logging an event only copies it to a lock-free ring buffer, and a
+/// background thread writes them to the file
+/// Events can only be logged by one thread
+/// The file is read with `odb-log-dump`
+class EventLog {
+public:
+  /// One event, as stored in the file, in host byte order
+  struct Record {
+    std::uint64_t time; // ns since the log was opened
+    LogEvent event;
+    std::uint32_t arg0;
+    std::uint64_t arg1;
+    std::uint64_t arg2;
+  };
+
+  /// Number of events in the ring buffer
+  static constexpr std::size_t DEFAULT_CAPACITY = 1 << 16;
+
+  /// Create `path` and start the writer thread
+  /// Events of `level` and below are logged, and also the ones in `events`
+  /// (bitmask of 1 << LogEvent)
+  EventLog(const std::string &path, LogLevel level, std::uint64_t events = 0,
+           std::size_t capacity = DEFAULT_CAPACITY);
+
+  EventLog(const EventLog &) = delete;
+  EventLog &operator=(const EventLog &) = delete;
+
+  /// Write all events left and stop the writer thread
+  ~EventLog();
+
+  bool enabled(LogEvent ev) const {
+    return _events >> static_cast<unsigned>(ev) & 1;
+  }
+
+  /// Never blocks: if the buffer is full the event is lost, and a DROPPED
+  /// event is logged once there is room again
+  void log(LogEvent ev, std::uint32_t arg0 = 0, std::uint64_t arg1 = 0,
+           std::uint64_t arg2 = 0);
+
+  /// Block until all events logged are written to the file
+  void flush();
+
+  /// Number of events lost because the buffer was full
+  std::uint64_t dropped() const { return _dropped_total; }
+
+  static LogLevel event_level(LogEvent ev);
+
+  static const char *event_name(LogEvent ev);
+
+  /// Bitmask of the events of `level` and below
+  static std::uint64_t level_events(LogLevel level);
+
+  /// Bitmask of a comma-separated list of event names, case-insensitive
+  /// (eg "stop,vm_read_mem"). Throws VMApi::Error for unknown names
+  static std::uint64_t parse_events(const std::string &names);
+
+  /// Text form of one event, without end of line
+  static void print(std::ostream &os, const Record &rec);
+
+  /// Print all events of a log file, one per line
+  /// Throws VMApi::Error if `is` isn't a valid log file
+  static void dump(std::istream &is, std::ostream &os);
+
+private:
+  std::uint64_t _events;
+  std::chrono::steady_clock::time_point _start;
+  SPSCRing<Record> _ring;
+
+  // Producer state
+  std::uint64_t _nlogged = 0;   // records pushed in _ring
+  std::uint64_t _ndropped = 0;  // lost since the last DROPPED event
+  std::uint64_t _dropped_total = 0;
+
+  // Writer thread
+  std::ofstream _os;
+  std::thread _th;
+  std::atomic<bool> _stop{false};
+  std::atomic<std::uint64_t> _nflushed{0}; // records written and flushed
+
+  bool _push(LogEvent ev, std::uint32_t arg0, std::uint64_t arg1,
+             std::uint64_t arg2);
+  void _run();
+};
+
+} // namespace odb
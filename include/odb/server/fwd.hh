@@ -111,6 +111,11 @@ struct VMInfos {
   // Some VM have just a text format for the instructions, but no standard
   // binary code
   bool use_opcode;
+
+  // Hash of the program code and symbols, 0 if unknown
+  // Must change if any of them changes. Used by clients to keep a persistent
+  // cache of them
+  std::uint64_t program_hash = 0;
 };
 
 class ClientHandler;
@@ -121,6 +126,7 @@ class AbstractDataServer;
 class TCPDataServer;
 class CLIClientHandler;
 class DataClientHandler;
+class EventLog;
 
 struct ServerConfig;
 
@@ -0,0 +1,63 @@
+//===-- server/instrumented-vm-api.hh - InstrumentedVMApi class -*- C++ -*-===//
+//
+// ODB Library
+// Author: Steven Lariau
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// VMApi decorator profiling the calls to another VMApi
+///
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "../mess/server-stats.hh"
+#include "fwd.hh"
+#include "vm-api.hh"
+
+namespace odb {
+
+/// Forward every call to the wrapped VMApi, and record for every method the
+/// duration of the calls, the errors, and the size of the arguments:
+/// - get_reg: size of the register
+/// - find_reg_id / find_sym_id: length of the name
+/// - read_mem / write_mem / get_symbols: size of the range
+/// - get_code_text: number of opcode bytes read
+/// The calls are already counted by the Debugger (ServerStats::vm_calls)
+/// Works with any VMApi, eg the one of make_cpp_vm_api
+/// Each call costs 2 clock reads, it's only enabled on demand
+/// (ServerConfig::vm_profile)
+class InstrumentedVMApi : public VMApi {
+public:
+  /// The profile is written to `out`, indexed by VMApiCall, that must outlive
+  /// the object
+  InstrumentedVMApi(std::unique_ptr<VMApi> &&vm,
+                    std::vector<ServerStats::VMCall> &out);
+
+  VMInfos get_vm_infos() override;
+  UpdateInfos get_update_infos() override;
+  void get_reg(vm_reg_t idx, RegInfos &infos, bool val_only) override;
+  void set_reg(vm_reg_t idx, const std::uint8_t *new_val) override;
+  vm_reg_t find_reg_id(const std::string &name) override;
+  void read_mem(vm_ptr_t addr, vm_size_t size, std::uint8_t *out_buf) override;
+  void write_mem(vm_ptr_t addr, vm_size_t size,
+                 const std::uint8_t *buf) override;
+  std::vector<vm_sym_t> get_symbols(vm_ptr_t addr, vm_size_t size) override;
+  SymbolInfos get_symb_infos(vm_sym_t idx) override;
+  vm_sym_t find_sym_id(const std::string &name) override;
+  std::string get_code_text(vm_ptr_t addr, vm_size_t &addr_dist) override;
+
+private:
+  std::unique_ptr<VMApi> _vm;
+  std::vector<ServerStats::VMCall> &_out;
+
+  ServerStats::VMCall &_prof(VMApiCall call) {
+    return _out[static_cast<std::size_t>(call)];
+  }
+};
+
+} // namespace odb
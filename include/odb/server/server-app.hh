@@ -13,11 +13,14 @@
 
 #pragma once
 
+#include <chrono>
 #include <functional>
 #include <memory>
+#include <string>
 
 #include "client-handler.hh"
 #include "debugger.hh"
+#include "event-log.hh"
 #include "fwd.hh"
 
 namespace odb {
@@ -59,6 +62,44 @@ struct ServerConfig {
   // default is 12644
   // env: ODB_CONF_TCP_PORT=<int>
   int tcp_port;
+
+  // If true, register values are cached by the debugger until the next
+  // instruction. Must be false if registers may change without executing an
+  // instruction
+  // default is true
+  // env: ODB_CONF_REGS_CACHE=0/1
+  bool regs_cache;
+
+  // Level of the events written to the binary log (see LogLevel)
+  // 0 (none) to 4 (every instruction). 0 disables the log, unless
+  // `log_events` isn't empty
+  // default is 0
+  // env: ODB_CONF_LOG_LEVEL=<int>
+  int log_level;
+
+  // Comma-separated list of events logged in addition to `log_level` (see
+  // LogEvent), eg "stop,vm_read_mem"
+  // default is empty
+  // env: ODB_CONF_LOG_EVENTS=<names>
+  std::string log_events;
+
+  // File of the binary log, decoded with `odb-log-dump`
+  // default is ./odb_server_db.logs
+  // env: ODB_CONF_LOG_PATH=<path>
+  std::string log_path;
+
+  // File where the server metrics (see ServerStats) are written when the
+  // ServerApp is destroyed. Empty for none
+  // default is empty
+  // env: ODB_CONF_STATS_PATH=<path>
+  std::string stats_path;
+
+  // If true, every call to the VM API is timed, and the sizes of their
+  // arguments are recorded (see InstrumentedVMApi). The profile is part of
+  // the server metrics
+  // default is false
+  // env: ODB_CONF_VM_PROFILE=0/1
+  bool vm_profile;
 };
 
 /// To setup a DB Server, an instance of this class must be created
@@ -82,17 +123,31 @@ public:
 
   ServerApp(const ServerApp &) = delete;
 
+  /// Write the metrics if `stats_path` is set
+  ~ServerApp();
+
   /// Enter the debugger loop
   /// Must be called right before executing each instruction
   /// More infos in `docs/design.txt`
   void loop();
 
+  /// Only 1 in STATS_SAMPLE_RATE calls to loop() while the VM is running is
+  /// timed, to not slow down every instruction
+  static constexpr std::uint64_t STATS_SAMPLE_RATE = 64;
+
 private:
   ServerConfig _conf;
   api_builder_f _api_builder;
+  std::unique_ptr<EventLog> _log; // outlives _db
   std::unique_ptr<Debugger> _db;
   std::unique_ptr<ClientHandler> _client;
 
+  std::uint64_t _loop_calls = 0;
+  std::chrono::steady_clock::time_point _loop_end; // end of the last call
+
+  // Body of loop(), returns true if the VM stopped
+  bool _loop();
+
   // init debugger
   void _init();
 
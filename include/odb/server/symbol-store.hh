@@ -0,0 +1,109 @@
+//===-- server/symbol-store.hh - SymbolStore class definition ---*- C++ -*-===//
+//
+// ODB Library
+// Author: Steven Lariau
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// Compact storage for the symbols loaded by the Debugger
+///
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "fwd.hh"
+
+namespace odb {
+
+/// Flat symbol table, made to hold millions of symbols
+/// All names are interned in a single string pool
+/// Symbols can be found by id or by name with open-addressing hash tables, and
+/// by address with a sorted array of indices
+/// Symbols are refered to by their index in the store, that never changes
+/// There is no deletion
+class SymbolStore {
+public:
+  static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+  std::size_t size() const { return _entries.size(); }
+
+  /// Prepare room for `nsyms` symbols
+  void reserve(std::size_t nsyms);
+
+  /// Returns false and does nothing if the id is already in the store
+  /// If many symbols have the same name, find_name() returns the first one
+  bool insert(const SymbolInfos &infos);
+
+  /// Index of the symbol, or npos if not in the store
+  std::size_t find_id(vm_sym_t id) const;
+  std::size_t find_name(std::string_view name) const;
+
+  /// Index of the first symbol at an address >= `addr`, or npos
+  /// Non-const: sort the symbols inserted since the last address query
+  std::size_t lower_bound(vm_ptr_t addr);
+
+  /// Index of the last symbol at an address < `addr`, or npos
+  std::size_t find_before(vm_ptr_t addr);
+
+  /// Append the ids of all symbols in [addr, addr + size[, sorted by address
+  void find_range(vm_ptr_t addr, vm_size_t size, std::vector<vm_sym_t> &out);
+
+  vm_sym_t id(std::size_t idx) const { return _entries[idx].id; }
+  vm_ptr_t addr(std::size_t idx) const { return _entries[idx].addr; }
+  std::string_view name(std::size_t idx) const;
+  SymbolInfos infos(std::size_t idx) const;
+
+  /// Bytes allocated by the store
+  std::size_t memory_usage() const;
+
+private:
+  struct Entry {
+    vm_ptr_t addr;
+    vm_sym_t id;
+    std::uint32_t name_len;
+    std::size_t name_off; // in _names
+  };
+
+  // Position of an entry in the sorted address array
+  struct AddrPos {
+    vm_ptr_t addr;
+    std::uint32_t idx;
+
+    bool operator<(const AddrPos &o) const {
+      return addr < o.addr || (addr == o.addr && idx < o.idx);
+    }
+  };
+
+  std::vector<Entry> _entries;
+  std::vector<char> _names;
+
+  // Made of sorted runs, each at most half the size of the previous one
+  // [0, _addrs_sorted[ is sorted in a new run on the next query, then the last
+  // runs are merged to keep their sizes decreasing: the whole array isn't
+  // moved for lookups between small insertions
+  std::vector<AddrPos> _addrs;
+  std::vector<std::size_t> _addrs_runs; // end of each run
+  std::size_t _addrs_sorted = 0;
+  std::vector<AddrPos> _range_buf;
+
+  // Hash tables of entry index + 1, 0 for empty slots
+  // Power of 2 size, at most half full
+  std::vector<std::uint32_t> _ids_table;
+  std::vector<std::uint32_t> _names_table;
+
+  void _sort_addrs();
+
+  // Call `f(begin, end)` with first position >= `addr` in every run, and the
+  // end of the run
+  template <class F> void _addrs_lower_bound(vm_ptr_t addr, F f);
+  void _grow_tables(std::size_t nsyms);
+  void _insert_id(std::uint32_t idx);
+  void _insert_name(std::uint32_t idx);
+};
+
+} // namespace odb
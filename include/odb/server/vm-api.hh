@@ -13,6 +13,7 @@
 
 #pragma once
 
+#include <cstddef>
 #include <exception>
 #include <vector>
 
@@ -97,6 +98,42 @@ public:
   virtual std::string get_code_text(vm_ptr_t addr, vm_size_t &addr_dist) = 0;
 };
 
+/// List of all VMApi methods: X(<VMApiCall value>, <method name>)
+#define ODB_VM_API_CALLS(X)                                                    \
+  X(GET_VM_INFOS, get_vm_infos)                                                \
+  X(GET_UPDATE_INFOS, get_update_infos)                                        \
+  X(GET_REG, get_reg)                                                          \
+  X(SET_REG, set_reg)                                                          \
+  X(FIND_REG_ID, find_reg_id)                                                  \
+  X(READ_MEM, read_mem)                                                        \
+  X(WRITE_MEM, write_mem)                                                      \
+  X(GET_SYMBOLS, get_symbols)                                                  \
+  X(GET_SYMB_INFOS, get_symb_infos)                                            \
+  X(FIND_SYM_ID, find_sym_id)                                                  \
+  X(GET_CODE_TEXT, get_code_text)
+
+/// Identifies a VMApi method, eg to count the calls
+enum class VMApiCall {
+#define ODB_VM_API_ENUM(Call, Method) Call,
+  ODB_VM_API_CALLS(ODB_VM_API_ENUM)
+#undef ODB_VM_API_ENUM
+};
+
+#define ODB_VM_API_COUNT(Call, Method) +1
+constexpr std::size_t VM_API_CALLS_COUNT =
+    0 ODB_VM_API_CALLS(ODB_VM_API_COUNT);
+#undef ODB_VM_API_COUNT
+
+/// Name of the VMApi method
+constexpr const char *vm_api_call_name(VMApiCall call) {
+  constexpr const char *names[] = {
+#define ODB_VM_API_NAME(Call, Method) #Method,
+      ODB_VM_API_CALLS(ODB_VM_API_NAME)
+#undef ODB_VM_API_NAME
+  };
+  return names[static_cast<std::size_t>(call)];
+}
+
 } // namespace odb
 
 #pragma once
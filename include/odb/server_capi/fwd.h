@@ -18,6 +18,8 @@
 #include <stdint.h>
 
 #ifdef __cplusplus
+#include <exception>
+
 #include "../server/fwd.hh"
 #endif
 
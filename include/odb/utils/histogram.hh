@@ -0,0 +1,102 @@
+//===-- utils/histogram.hh - Histogram struct definition --------*- C++ -*-===//
+//
+// ODB Library
+// Author: Steven Lariau
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// Histogram of integer values with log-linear buckets
+///
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace odb {
+
+/// Distribution of positive integers (eg latencies in ns), with a bounded
+/// relative error, as HDR histograms
+/// Every power of 2 range is split in SUB_BUCKETS buckets of the same size,
+/// values < SUB_BUCKETS have their own bucket
+/// Adding a value is a few integer operations, buckets are only allocated up
+/// to the biggest value
+struct Histogram {
+  static constexpr unsigned SUB_BITS = 3;
+  static constexpr std::size_t SUB_BUCKETS = std::size_t(1) << SUB_BITS;
+
+  std::vector<std::uint64_t> buckets; // number of values in every bucket
+  std::uint64_t count = 0;
+  std::uint64_t sum = 0;
+  std::uint64_t max = 0;
+
+  /// Index of the bucket of `val`
+  static std::size_t bucket(std::uint64_t val) {
+    if (val < SUB_BUCKETS)
+      return val;
+    unsigned exp = 63 - __builtin_clzll(val); // >= SUB_BITS
+    auto sub = (val >> (exp - SUB_BITS)) & (SUB_BUCKETS - 1);
+    return (exp - SUB_BITS + 1) * SUB_BUCKETS + sub;
+  }
+
+  /// Smallest value of bucket `idx`
+  static std::uint64_t bucket_low(std::size_t idx) {
+    if (idx < SUB_BUCKETS)
+      return idx;
+    unsigned exp = idx / SUB_BUCKETS + SUB_BITS - 1;
+    auto sub = idx % SUB_BUCKETS;
+    return (SUB_BUCKETS + sub) << (exp - SUB_BITS);
+  }
+
+  /// Biggest value of bucket `idx`
+  static std::uint64_t bucket_high(std::size_t idx) {
+    if (idx < SUB_BUCKETS)
+      return idx;
+    unsigned exp = idx / SUB_BUCKETS + SUB_BITS - 1;
+    return bucket_low(idx) + (std::uint64_t(1) << (exp - SUB_BITS)) - 1;
+  }
+
+  void add(std::uint64_t val) {
+    auto idx = bucket(val);
+    if (idx >= buckets.size())
+      buckets.resize(idx + 1);
+    ++buckets[idx];
+    ++count;
+    sum += val;
+    max = std::max(max, val);
+  }
+
+  void merge(const Histogram &h) {
+    if (h.buckets.size() > buckets.size())
+      buckets.resize(h.buckets.size());
+    for (std::size_t i = 0; i < h.buckets.size(); ++i)
+      buckets[i] += h.buckets[i];
+    count += h.count;
+    sum += h.sum;
+    max = std::max(max, h.max);
+  }
+
+  std::uint64_t mean() const { return count ? sum / count : 0; }
+
+  /// Value under which are `p`% of the values (0 <= p <= 100), at most the
+  /// biggest value of its bucket. Returns 0 if empty
+  std::uint64_t percentile(double p) const {
+    if (!count)
+      return 0;
+    auto rank = static_cast<std::uint64_t>(p / 100 * count + 0.5);
+    rank = std::clamp<std::uint64_t>(rank, 1, count);
+    std::uint64_t seen = 0;
+    for (std::size_t i = 0; i < buckets.size(); ++i) {
+      seen += buckets[i];
+      if (seen >= rank)
+        return std::min(bucket_high(i), max);
+    }
+    return max;
+  }
+};
+
+} // namespace odb
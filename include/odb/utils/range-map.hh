@@ -13,8 +13,9 @@
 #pragma once
 
 #include <cassert>
+#include <iterator>
+#include <map>
 #include <utility>
-#include <vector>
 
 namespace odb {
 
@@ -23,6 +24,9 @@ namespace odb {
 /// the full range of keys.
 /// It's then possible to change the value of any range of keys
 /// Impl only store ranges, and not the vals for every element
+/// Ranges are in a balanced tree, and contiguous ranges always have different
+/// values: lookups are O(log n), set is O(log n + k) with k the number of
+/// ranges replaced
 template <class T> class RangeMap {
 
 public:
@@ -57,37 +61,35 @@ public:
   Range range_of(std::size_t key) const;
 
   /// @returns the `i`-th range in key order
+  /// O(i), prefer for_each to iterate over ranges
   Range operator[](std::size_t i) const;
 
-private:
-  struct Node {
-    std::size_t beg_key;
-    T val;
-    Node(std::size_t beg_key, const T &val) : beg_key(beg_key), val(val) {}
-  };
+  /// Call `f(Range)` for all ranges overlapping [low...high], in key order
+  /// Ranges are not clipped to [low...high]
+  template <class F>
+  void for_each(std::size_t low, std::size_t high, F f) const;
 
+private:
   const std::size_t _min_key;
   const std::size_t _max_key;
-  std::vector<Node> _ranges;
+  std::map<std::size_t, T> _ranges; // first key of the range => val
 
-  using _range_iter_t = typename std::vector<Node>::iterator;
-  using _const_range_iter_t = typename std::vector<Node>::const_iterator;
+  using _const_range_iter_t = typename std::map<std::size_t, T>::const_iterator;
 
-  _range_iter_t _find_node(std::size_t key);
   _const_range_iter_t _find_node(std::size_t key) const;
-  void _fix();
+  Range _range_at(_const_range_iter_t it) const;
 };
 
 template <class T>
 RangeMap<T>::RangeMap(std::size_t min_key, std::size_t max_key, const T &val)
     : _min_key(min_key), _max_key(max_key) {
-  _ranges.emplace_back(min_key, val);
+  _ranges.emplace(min_key, val);
 }
 
 template <class T> const T &RangeMap<T>::get(std::size_t key) const {
   assert(key >= _min_key);
   assert(key <= _max_key);
-  return _find_node(key)->val;
+  return _find_node(key)->second;
 }
 
 template <class T>
@@ -96,83 +98,64 @@ void RangeMap<T>::set(std::size_t low, std::size_t high, const T &val) {
   assert(high <= _max_key);
   assert(low <= high);
 
-  auto low_it = _find_node(low);
-  if (low_it->beg_key != low) {
-    // If low in the middle of a node, we cut in in half
-    low_it = _ranges.emplace(low_it + 1, low, low_it->val);
-  }
-
-  auto high_it = _ranges.end();
-  if (high != _max_key) { // special case for max value
-    high_it = _find_node(high + 1);
-    if (high_it->beg_key != high + 1) {
-      // If high in the middle of a node, we cut in in half
-      high_it = _ranges.emplace(high_it + 1, high + 1, high_it->val);
-    }
-  }
-
-  // Need to find it again if array was reallocated
-  low_it = _find_node(low);
-  for (auto it = low_it; it != high_it; ++it)
-    it->val = val;
-
-  _fix();
+  // All ranges starting in [low...high + 1] are replaced by at most 2 ranges:
+  // {low, val}, unless the previous range already has `val`
+  // {high + 1, old val at high + 1}, unless it's `val`
+  auto first = _ranges.lower_bound(low);
+  bool has_next = high != _max_key; // special case for max value
+  auto last = has_next ? _ranges.upper_bound(high + 1) : _ranges.end();
+  // last - 1 exists because the first range starts at _min_key <= high + 1
+  T next_val = has_next ? std::prev(last)->second : val;
+
+  bool put_low =
+      first == _ranges.begin() || !(std::prev(first)->second == val);
+  bool put_next = has_next && !(next_val == val);
+
+  last = _ranges.erase(first, last);
+  if (put_low)
+    _ranges.emplace_hint(last, low, val);
+  if (put_next)
+    _ranges.emplace_hint(last, high + 1, next_val);
 }
 
 template <class T>
 typename RangeMap<T>::Range RangeMap<T>::range_of(std::size_t key) const {
   assert(key >= _min_key);
   assert(key <= _max_key);
-  auto it = _find_node(key);
-  auto next = it + 1;
-  auto end_key = next == _ranges.cend() ? _max_key : next->beg_key - 1;
-  return Range(it->beg_key, end_key, it->val);
+  return _range_at(_find_node(key));
 }
 
 template <class T>
 typename RangeMap<T>::Range RangeMap<T>::operator[](std::size_t i) const {
   assert(i < _ranges.size());
-  auto it = _ranges.cbegin() + i;
-  auto next = it + 1;
-  auto end_key = next == _ranges.cend() ? _max_key : next->beg_key - 1;
-  return Range(it->beg_key, end_key, it->val);
+  return _range_at(std::next(_ranges.cbegin(), i));
 }
 
 template <class T>
-typename RangeMap<T>::_const_range_iter_t
-RangeMap<T>::_find_node(std::size_t key) const {
-  auto it = _ranges.cbegin();
-  auto next = it + 1;
-  auto end = _ranges.cend();
-  while (next != end && key >= next->beg_key) {
-    it = next;
-    ++next;
-  }
-
-  return it;
+template <class F>
+void RangeMap<T>::for_each(std::size_t low, std::size_t high, F f) const {
+  assert(low >= _min_key);
+  assert(high <= _max_key);
+  assert(low <= high);
+  for (auto it = _find_node(low); it != _ranges.cend() && it->first <= high;
+       ++it)
+    f(_range_at(it));
 }
 
 template <class T>
-typename RangeMap<T>::_range_iter_t RangeMap<T>::_find_node(std::size_t key) {
-  auto it = _ranges.begin();
-  auto next = it + 1;
-  auto end = _ranges.end();
-  while (next != end && key >= next->beg_key) {
-    it = next;
-    ++next;
-  }
-
-  return it;
+typename RangeMap<T>::_const_range_iter_t
+RangeMap<T>::_find_node(std::size_t key) const {
+  auto it = _ranges.upper_bound(key);
+  assert(it != _ranges.cbegin());
+  return std::prev(it);
 }
 
-template <class T> void RangeMap<T>::_fix() {
-  std::size_t idx = 0;
-  while (idx + 1 < _ranges.size()) {
-    if (_ranges[idx].val == _ranges[idx + 1].val)
-      _ranges.erase(_ranges.begin() + idx + 1);
-    else
-      ++idx;
-  }
+template <class T>
+typename RangeMap<T>::Range
+RangeMap<T>::_range_at(_const_range_iter_t it) const {
+  auto next = std::next(it);
+  auto end_key = next == _ranges.cend() ? _max_key : next->first - 1;
+  return Range(it->first, end_key, it->second);
 }
 
 } // namespace odb
@@ -0,0 +1,90 @@
+//===-- utils/spsc-ring.hh - SPSCRing class definition ----------*- C++ -*-===//
+//
+// ODB Library
+// Author: Steven Lariau
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// Lock-free ring buffer for one producer thread and one consumer thread
+///
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+
+namespace odb {
+
+/// Fixed-capacity FIFO queue, without locks nor allocations after creation
+/// Only one thread may call push(), and only one other thread may call pop()
+/// The producer never waits: push() fails when the queue is full
+template <class T> class SPSCRing {
+  static_assert(std::is_trivially_copyable_v<T>,
+                "SPSCRing items must be trivially copyable");
+
+public:
+  /// `capacity` must be a power of 2
+  explicit SPSCRing(std::size_t capacity)
+      : _buf(capacity), _mask(capacity - 1) {
+    assert(capacity > 0 && (capacity & _mask) == 0);
+  }
+
+  SPSCRing(const SPSCRing &) = delete;
+  SPSCRing &operator=(const SPSCRing &) = delete;
+
+  std::size_t capacity() const { return _buf.size(); }
+
+  /// Number of items in the queue
+  /// Only exact when called by one of the 2 threads while the other is idle
+  std::size_t size() const {
+    return _tail.load(std::memory_order_acquire) -
+           _head.load(std::memory_order_acquire);
+  }
+
+  /// Producer only
+  /// Returns false if the queue is full
+  bool push(const T &item) {
+    auto tail = _tail.load(std::memory_order_relaxed);
+    if (tail - _head_cache == _buf.size()) {
+      _head_cache = _head.load(std::memory_order_acquire);
+      if (tail - _head_cache == _buf.size())
+        return false;
+    }
+    _buf[tail & _mask] = item;
+    _tail.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  /// Consumer only
+  /// Move up to `n` items to `out`, returns the number of items moved
+  std::size_t pop(T *out, std::size_t n) {
+    auto head = _head.load(std::memory_order_relaxed);
+    if (_tail_cache - head < n)
+      _tail_cache = _tail.load(std::memory_order_acquire);
+    if (_tail_cache - head < n)
+      n = _tail_cache - head;
+    for (std::size_t i = 0; i < n; ++i)
+      out[i] = _buf[(head + i) & _mask];
+    _head.store(head + n, std::memory_order_release);
+    return n;
+  }
+
+private:
+  std::vector<T> _buf;
+  std::size_t _mask;
+
+  // Positions never wrap, only their index in _buf does
+  // Each one is written by one thread, and cached by the other one to not
+  // share cache lines on every operation
+  alignas(64) std::atomic<std::size_t> _head{0}; // next item to pop
+  std::size_t _tail_cache = 0;                   // consumer copy of _tail
+  alignas(64) std::atomic<std::size_t> _tail{0}; // next free slot
+  std::size_t _head_cache = 0;                   // producer copy of _head
+};
+
+} // namespace odb
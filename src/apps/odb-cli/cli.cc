@@ -7,6 +7,7 @@
 #include <memory>
 #include <signal.h>
 #include <string>
+#include <sys/stat.h>
 #include <thread>
 #include <unistd.h>
 
@@ -27,14 +28,28 @@ void prepare_sigint() {
   sigaction(SIGINT, &sigint_handler, nullptr);
 }
 
-odb::DBClient build_client(int argc, char **argv) {
+// $ODB_CACHE_DIR, or ~/.cache/odb
+// Returns an empty string if there is none
+std::string cache_dir() {
+  if (auto dir = std::getenv("ODB_CACHE_DIR"))
+    return dir;
+  auto home = std::getenv("HOME");
+  if (!home)
+    return "";
+
+  std::string dir = std::string(home) + "/.cache";
+  ::mkdir(dir.c_str(), 0755);
+  dir += "/odb";
+  ::mkdir(dir.c_str(), 0755);
+  return dir;
+}
+
+std::unique_ptr<odb::DBClientImpl> build_client(int argc, char **argv) {
   auto hostname = argc >= 2 ? argv[1] : "0.0.0.0";
   auto port = argc >= 3 ? std::atoi(argv[2]) : 12644;
 
   auto tcp_cli = std::make_unique<odb::TCPDataClient>(hostname, port);
-  auto tcp_impl = std::make_unique<odb::DBClientImplData>(std::move(tcp_cli));
-  odb::DBClient db_client(std::move(tcp_impl));
-  return db_client;
+  return std::make_unique<odb::DBClientImplData>(std::move(tcp_cli));
 }
 
 } // namespace
@@ -69,8 +84,31 @@ bool CLI::next() {
 
 std::string CLI::exec(const std::string &cmd) { return _cli.exec(cmd); }
 
+void CLI::prefetch_code(std::size_t n) {
+  const auto &infos = _db_client.get_vm_infos();
+  odb::PrefetchProfile pf;
+  pf.regs = infos.regs_program_counter;
+  pf.regs.insert(pf.regs.end(), infos.regs_stack_pointer.begin(),
+                 infos.regs_stack_pointer.end());
+  for (auto sp : infos.regs_stack_pointer)
+    pf.mems.push_back({sp, -64, 128});
+  pf.code_before = n;
+  pf.code_nins = 2 * n + 1;
+  pf.stack_syms = true;
+  _db_client.set_prefetch_profile(pf);
+}
+
+void CLI::save_cache() {
+  try {
+    _db_client.save_disk_cache();
+  } catch (odb::VMApi::Error &e) {
+    std::cerr << e.what() << std::endl;
+  }
+}
+
 void CLI::_setup() {
   prepare_sigint();
+  _db_client.set_disk_cache_dir(cache_dir());
   _db_client.connect();
   _state_switch = true;
 }
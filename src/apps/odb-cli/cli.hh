@@ -31,6 +31,13 @@ public:
   /// Exec command with SimpleCLIClient
   std::string exec(const std::string &cmd);
 
+  /// Receive everything needed by `code <n>`, `state` and `bt` with each
+  /// stop, so that they don't need any other request
+  void prefetch_code(std::size_t n);
+
+  /// Keep symbols and code text on disk for the next sessions
+  void save_cache();
+
 private:
   odb::DBClient _db_client;
   odb::SimpleCLIClient _cli;
@@ -99,6 +99,7 @@ int main(int argc, char **argv) {
                                        /*sift_lines=*/true);
   vcode = std::make_unique<ViewCommand>(2, vcmd->col0(), vcmd->row0() - 2 - 2,
                                         vcmd->width(), /*sift_lines=*/false);
+  cli->prefetch_code(vcode->height() + 1);
 
   render_all();
 
@@ -122,5 +123,6 @@ int main(int argc, char **argv) {
   }
 
   clicodes::clear();
+  cli->save_cache();
   return 0;
 }
@@ -0,0 +1,27 @@
+#include <fstream>
+#include <iostream>
+
+#include "odb/server/event-log.hh"
+#include "odb/server/vm-api.hh"
+
+// Print the text form of a binary log written by the debugger server
+int main(int argc, char **argv) {
+  if (argc != 2) {
+    std::cerr << "Usage: " << argv[0] << " <log-file>" << std::endl;
+    return 1;
+  }
+
+  std::ifstream is(argv[1], std::ios::binary);
+  if (!is) {
+    std::cerr << "Error: cannot open " << argv[1] << std::endl;
+    return 1;
+  }
+
+  try {
+    odb::EventLog::dump(is, std::cout);
+  } catch (odb::VMApi::Error &e) {
+    std::cerr << "Error: " << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
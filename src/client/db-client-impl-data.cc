@@ -1,8 +1,12 @@
 #include "odb/client/db-client-impl-data.hh"
 
+#include <algorithm>
 #include <cassert>
+#include <cstring>
 
 #include "odb/client/abstract-data-client.hh"
+#include "odb/mess/compress.hh"
+#include "odb/mess/fast-request.hh"
 #include "odb/mess/request-handler.hh"
 #include "odb/mess/request.hh"
 #include "odb/mess/serial.hh"
@@ -18,6 +22,19 @@ public:
   void connect() {
     if (!_dc->connect())
       throw VMApi::Error("Failed to connect to DB server");
+    _set_caps(0);
+  }
+
+  // Enable the features negotiated with the server
+  void set_caps(std::uint32_t caps) { _set_caps(caps); }
+  std::uint32_t caps() const { return _caps; }
+
+  // Profile sent at connection, and everytime it changes
+  PrefetchProfile &prefetch() { return _prefetch; }
+
+  // True if the server sends the prefetch data with check_stopped
+  bool use_prefetch() const {
+    return (_caps & PROTO_CAP_PREFETCH) && !_prefetch.empty();
   }
 
   void handle_err() {
@@ -28,8 +45,67 @@ public:
 
   template <class T> void send_req(T &req) {
     _os.reset();
+    _os.set_compressible(req_compressible(T::REQ_TYPE));
     _os << T::REQ_TYPE;
     _rh.client_write_request(_os, req);
+    auto res_ty = _transfer();
+    assert(res_ty == T::REQ_TYPE);
+    (void)res_ty;
+    _rh.client_read_response(_is, req);
+  }
+
+  // Message to write a fast request into, before calling `send_fast`
+  Message &fast_req() {
+    _fast_req.reset();
+    return _fast_req;
+  }
+
+  // Send the fast request, and returns the type of the response
+  // FAST: use read_fast. Otherwise use read_res with the generic request
+  ReqType send_fast() {
+    _os.reset();
+    _os << ReqType::FAST;
+    _os.write(_fast_req.data(), _fast_req.data_size());
+    return _transfer();
+  }
+
+  // Read the fast response in place, followed by `extra` bytes
+  template <class T> const T &read_fast(std::size_t &extra) {
+    auto size = _is.remaining();
+    auto res = Message::view_as<T>(_is.read_ref(size), size, extra);
+    if (!res)
+      throw VMApi::Error("Invalid fast response from DB server");
+    return *res;
+  }
+
+  template <class T> void read_res(T &req) {
+    _rh.client_read_response(_is, req);
+  }
+
+  // Check the response of a fast request without data
+  template <class T> void check_fast_res(ReqType res_ty) {
+    std::size_t extra;
+    if (res_ty != ReqType::FAST)
+      throw VMApi::Error("Invalid response from DB server");
+    read_fast<T>(extra);
+  }
+
+  // Send the fast request, and copy the `size` bytes of the response
+  template <class T> void read_fast_data(char *out_buf, vm_size_t size) {
+    std::size_t extra;
+    if (send_fast() != ReqType::FAST)
+      throw VMApi::Error("Invalid response from DB server");
+    auto &res = read_fast<T>(extra);
+    if (res.size != size || extra != size)
+      throw VMApi::Error("Invalid fast response from DB server");
+    std::memcpy(out_buf, &res + 1, size);
+  }
+
+private:
+  std::unique_ptr<AbstractDataClient> _dc;
+
+  // Send `_os`, and receive the response in `_is`
+  ReqType _transfer() {
     if (!_dc->send_data(_os))
       throw VMApi::Error("Failed to send request to DB server");
 
@@ -39,15 +115,23 @@ public:
     _is >> res_ty;
     if (res_ty == ReqType::ERR)
       handle_err();
-    assert(res_ty == T::REQ_TYPE);
-    _rh.client_read_response(_is, req);
+    return res_ty;
   }
 
-private:
-  std::unique_ptr<AbstractDataClient> _dc;
+  void _set_caps(std::uint32_t caps) {
+    _caps = caps;
+    bool compact = caps & PROTO_CAP_COMPACT;
+    _is.set_compact(compact);
+    _os.set_compact(compact);
+    _os.set_compress_min(caps & PROTO_CAP_COMPRESS ? COMPRESS_MIN_SIZE : 0);
+  }
+
+  std::uint32_t _caps = 0;
+  PrefetchProfile _prefetch;
   RequestHandler _rh;
   SerialInBuff _is;
   SerialOutBuff _os;
+  Message _fast_req;
 };
 
 DBClientImplData::DBClientImplData(std::unique_ptr<AbstractDataClient> &&dc)
@@ -59,20 +143,54 @@ void DBClientImplData::connect(VMInfos &infos, DBClientUpdate &udp) {
   _impl->connect();
 
   ReqConnect req;
+  req.in_version = PROTO_VERSION;
+  req.in_caps = PROTO_CAPS_ALL;
+  req.in_prefetch = _impl->prefetch();
   _impl->send_req(req);
   infos = req.out_infos;
-  udp = req.out_udp;
+  udp = std::move(req.out_udp);
+  udp.stack_keep = 0;
+  udp.stack_depth = udp.stack.size();
+  _impl->set_caps(req.out_caps);
 }
 
 void DBClientImplData::stop() {
+  if (_impl->caps() & PROTO_CAP_FASTPATH) {
+    _impl->fast_req().alloc_as<FastReqStop>().tag = 0;
+    _impl->check_fast_res<FastResStop>(_impl->send_fast());
+    return;
+  }
+
   ReqStop req;
   _impl->send_req(req);
 }
 
 void DBClientImplData::check_stopped(DBClientUpdate &udp) {
   ReqCheckStopped req;
-  _impl->send_req(req);
-  udp = req.out_udp;
+  req.in_prefetch = _impl->use_prefetch();
+  req.in_stack_delta = (_impl->caps() & PROTO_CAP_STACK_DELTA) != 0;
+  if (_impl->caps() & PROTO_CAP_FASTPATH) {
+    _impl->fast_req().alloc_as<FastReqCheckStopped>().tag = 0;
+    auto res_ty = _impl->send_fast();
+    if (res_ty == ReqType::FAST) {
+      _impl->check_fast_res<FastResCheckStopped>(res_ty);
+      udp.stopped = false;
+      return;
+    }
+
+    // VM stopped: generic response
+    if (res_ty != ReqType::CHECK_STOPPED)
+      throw VMApi::Error("Invalid response from DB server");
+    _impl->read_res(req);
+  } else
+    _impl->send_req(req);
+
+  udp = std::move(req.out_udp);
+  // Old server: always the whole call stack
+  if (!req.in_stack_delta) {
+    udp.stack_keep = 0;
+    udp.stack_depth = udp.stack.size();
+  }
 }
 
 void DBClientImplData::get_regs(const vm_reg_t *ids, char **out_bufs,
@@ -80,6 +198,15 @@ void DBClientImplData::get_regs(const vm_reg_t *ids, char **out_bufs,
   if (nregs == 0)
     return;
 
+  if (nregs == 1 && regs_size[0] <= FAST_DATA_MAX_SIZE &&
+      (_impl->caps() & PROTO_CAP_FASTPATH)) {
+    auto &req = _impl->fast_req().alloc_as<FastReqGetReg>();
+    req.id = ids[0];
+    req.size = regs_size[0];
+    _impl->read_fast_data<FastResGetReg>(out_bufs[0], regs_size[0]);
+    return;
+  }
+
   if (nregs < 2 || regs_size[1] == 0) {
     ReqGetRegs req;
     req.nregs = nregs;
@@ -147,6 +274,15 @@ void DBClientImplData::read_mem(const vm_ptr_t *src_addrs,
   if (nbuffs == 0)
     return;
 
+  if (nbuffs == 1 && bufs_sizes[0] <= FAST_DATA_MAX_SIZE &&
+      (_impl->caps() & PROTO_CAP_FASTPATH)) {
+    auto &req = _impl->fast_req().alloc_as<FastReqReadMem>();
+    req.addr = src_addrs[0];
+    req.size = bufs_sizes[0];
+    _impl->read_fast_data<FastResReadMem>(out_bufs[0], bufs_sizes[0]);
+    return;
+  }
+
   ReqReadMemVar req;
   req.nbufs = nbuffs;
   req.in_addrs = const_cast<vm_ptr_t *>(src_addrs);
@@ -169,6 +305,33 @@ void DBClientImplData::write_mem(const vm_ptr_t *dst_addrs,
   _impl->send_req(req);
 }
 
+void DBClientImplData::read_mem_diff(vm_ptr_t addr, vm_size_t size,
+                                     std::uint64_t &version,
+                                     std::vector<vm_size_t> &out_pages,
+                                     std::vector<char> &out_data) {
+  if (_impl->caps() & PROTO_CAP_MEM_DIFF) {
+    ReqReadMemDiff req;
+    req.addr = addr;
+    req.size = size;
+    req.in_version = version;
+    _impl->send_req(req);
+    version = req.out_version;
+    out_pages = std::move(req.out_pages);
+    out_data = std::move(req.out_data);
+    return;
+  }
+
+  // Old server: read everything, reported as a full update
+  out_data.resize(size);
+  char *buf = out_data.data();
+  read_mem(&addr, &size, &buf, 1);
+  out_pages.resize((size + Debugger::MEM_DIFF_PAGE_SIZE - 1) /
+                   Debugger::MEM_DIFF_PAGE_SIZE);
+  for (std::size_t i = 0; i < out_pages.size(); ++i)
+    out_pages[i] = i;
+  version = 0;
+}
+
 void DBClientImplData::get_symbols_by_ids(const vm_sym_t *ids,
                                           SymbolInfos *out_infos,
                                           std::size_t nsyms) {
@@ -198,6 +361,15 @@ void DBClientImplData::get_symbols_by_names(const char **names,
   _impl->send_req(req);
 }
 
+void DBClientImplData::get_symbols_table(SymbolsTable &out_table) {
+  if (!(_impl->caps() & PROTO_CAP_SYMS_TABLE))
+    throw VMApi::Error("Symbols table not supported by DB server");
+
+  ReqGetSymsTable req;
+  _impl->send_req(req);
+  out_table = std::move(req.out_table);
+}
+
 void DBClientImplData::get_code_text(vm_ptr_t addr, std::size_t nins,
                                      std::vector<std::string> &out_text,
                                      std::vector<vm_size_t> &out_sizes) {
@@ -209,6 +381,111 @@ void DBClientImplData::get_code_text(vm_ptr_t addr, std::size_t nins,
   out_sizes = req.out_sizes;
 }
 
+void DBClientImplData::get_code_annotated(vm_ptr_t addr, std::size_t nins,
+                                          CodeAnnotated &out_code) {
+  if (_impl->caps() & PROTO_CAP_CODE_ANNOTATED) {
+    ReqGetCodeAnnotated req;
+    req.addr = addr;
+    req.nins = nins;
+    _impl->send_req(req);
+    out_code = std::move(req.out_code);
+    return;
+  }
+
+  // Old server: code, then symbols defined and referenced
+  std::vector<std::string> text;
+  std::vector<vm_size_t> sizes;
+  get_code_text(addr, nins, text, sizes);
+  out_code = CodeAnnotated{};
+  for (std::size_t i = 0; i < text.size(); ++i) {
+    out_code.push_back(addr, sizes[i], text[i]);
+    addr += sizes[i];
+  }
+  if (!out_code.size())
+    return;
+
+  std::vector<SymbolInfos> syms;
+  auto first = out_code.addrs.front();
+  get_symbols_by_addr(first, out_code.addrs.back() - first + 1, syms);
+  for (const auto &s : syms)
+    out_code.add_sym(s);
+  auto refs = out_code.missing_syms();
+  syms.resize(refs.size());
+  if (!refs.empty())
+    get_symbols_by_ids(&refs[0], &syms[0], refs.size());
+  for (const auto &s : syms)
+    out_code.add_sym(s);
+}
+
+void DBClientImplData::get_code_around(vm_ptr_t addr, std::size_t nbefore,
+                                       std::size_t nafter,
+                                       CodeAnnotated &out_code) {
+  if (_impl->caps() & PROTO_CAP_CODE_AROUND) {
+    ReqGetCodeAround req;
+    req.addr = addr;
+    req.nbefore = nbefore;
+    req.nafter = nafter;
+    _impl->send_req(req);
+    out_code = std::move(req.out_code);
+    return;
+  }
+
+  // Old server: only right with 1-byte instructions
+  auto start = addr < nbefore ? 0 : addr - nbefore;
+  get_code_annotated(start, addr - start + nafter, out_code);
+}
+
+void DBClientImplData::get_stack_syms(CallStack &out_stack,
+                                      std::vector<vm_sym_t> &out_frames_syms,
+                                      std::vector<SymbolInfos> &out_syms) {
+  if (_impl->caps() & PROTO_CAP_STACK_SYMS) {
+    ReqGetStackSyms req;
+    _impl->send_req(req);
+    out_stack = std::move(req.out_stack);
+    out_frames_syms = std::move(req.out_frames_syms);
+    out_syms = std::move(req.out_syms);
+    return;
+  }
+
+  // Old server: only symbols defined right at the start of the frames
+  DBClientUpdate udp;
+  check_stopped(udp);
+  out_stack = udp.stack;
+  out_frames_syms.clear();
+  out_syms.clear();
+  std::vector<SymbolInfos> syms;
+  for (const auto &frame : out_stack) {
+    auto it = std::find_if(
+        out_syms.begin(), out_syms.end(),
+        [&](const auto &s) { return s.addr == frame.caller_start_addr; });
+    if (it == out_syms.end()) {
+      get_symbols_by_addr(frame.caller_start_addr, 1, syms);
+      if (!syms.empty())
+        it = out_syms.insert(out_syms.end(), syms.front());
+    }
+    out_frames_syms.push_back(it == out_syms.end() ? VM_SYM_NULL : it->idx);
+  }
+}
+
+void DBClientImplData::get_stack_frames(std::size_t beg, std::size_t end,
+                                        CallStack &out_frames) {
+  if (_impl->caps() & PROTO_CAP_STACK_DELTA) {
+    ReqGetStackFrames req;
+    req.beg = beg;
+    req.end = end;
+    _impl->send_req(req);
+    out_frames = std::move(req.out_frames);
+    return;
+  }
+
+  // Old server: the updates always have the whole call stack
+  DBClientUpdate udp;
+  check_stopped(udp);
+  if (beg > end || end > udp.stack.size())
+    throw VMApi::Error("get_stack_frames: invalid range");
+  out_frames.assign(udp.stack.begin() + beg, udp.stack.begin() + end);
+}
+
 void DBClientImplData::add_breakpoints(const vm_ptr_t *addrs,
                                        std::size_t size) {
   ReqAddBkps req;
@@ -226,9 +503,48 @@ void DBClientImplData::del_breakpoints(const vm_ptr_t *addrs,
 }
 
 void DBClientImplData::resume(ResumeType type) {
+  if (_impl->caps() & PROTO_CAP_FASTPATH) {
+    _impl->fast_req().alloc_as<FastReqResume>().type =
+        static_cast<std::uint8_t>(type);
+    _impl->check_fast_res<FastResResume>(_impl->send_fast());
+    return;
+  }
+
   ReqResume req;
   req.type = type;
   _impl->send_req(req);
 }
 
+void DBClientImplData::set_prefetch(const PrefetchProfile &profile) {
+  _impl->prefetch() = profile;
+  if (!(_impl->caps() & PROTO_CAP_PREFETCH))
+    return;
+
+  ReqSetPrefetch req;
+  req.in_profile = profile;
+  _impl->send_req(req);
+}
+
+void DBClientImplData::get_breakpoints(std::vector<vm_ptr_t> &out_addrs) {
+  if (!(_impl->caps() & PROTO_CAP_GET_BKPS))
+    throw VMApi::Error("Breakpoints list not supported by DB server");
+
+  ReqGetBkps req;
+  _impl->send_req(req);
+  out_addrs = std::move(req.out_addrs);
+}
+
+bool DBClientImplData::has_cap(std::uint32_t caps) const {
+  return (_impl->caps() & caps) == caps;
+}
+
+void DBClientImplData::get_stats(ServerStats &out_stats) {
+  if (!(_impl->caps() & PROTO_CAP_STATS))
+    throw VMApi::Error("Stats not supported by DB server");
+
+  ReqGetStats req;
+  _impl->send_req(req);
+  out_stats = std::move(req.out_stats);
+}
+
 } // namespace odb
@@ -0,0 +1,186 @@
+#include "odb/mess/compress.hh"
+
+#include <cstdint>
+#include <cstring>
+
+namespace odb {
+
+namespace {
+
+constexpr std::size_t MIN_MATCH = 4;
+constexpr std::size_t MAX_OFFSET = 65535;
+// Last bytes are always literals, and a match can't start too close to the
+// end, it keeps the matching loop simple
+constexpr std::size_t LAST_LITERALS = 5;
+constexpr std::size_t MATCH_MARGIN = 12;
+
+constexpr unsigned HASH_BITS = 12;
+
+using byte_t = std::uint8_t;
+
+std::uint32_t read32(const byte_t *p) {
+  std::uint32_t res;
+  std::memcpy(&res, p, sizeof(res));
+  return res;
+}
+
+std::uint32_t hash32(std::uint32_t x) {
+  return (x * 2654435761U) >> (32 - HASH_BITS);
+}
+
+byte_t *write_len(byte_t *op, std::size_t len) {
+  while (len >= 255) {
+    *op++ = 255;
+    len -= 255;
+  }
+  *op++ = static_cast<byte_t>(len);
+  return op;
+}
+
+bool read_len(const byte_t *&ip, const byte_t *iend, std::size_t &len) {
+  byte_t b;
+  do {
+    if (ip == iend)
+      return false;
+    b = *ip++;
+    len += b;
+  } while (b == 255);
+  return true;
+}
+
+// Write a block with literals [lit, lit + lit_len), followed by a match if
+// match_len != 0
+byte_t *write_block(byte_t *op, const byte_t *lit, std::size_t lit_len,
+                    std::size_t offset, std::size_t match_len) {
+  byte_t *token = op++;
+  std::size_t mcode = match_len ? match_len - MIN_MATCH : 0;
+  *token = static_cast<byte_t>(((lit_len < 15 ? lit_len : 15) << 4) |
+                               (mcode < 15 ? mcode : 15));
+
+  if (lit_len >= 15)
+    op = write_len(op, lit_len - 15);
+  std::memcpy(op, lit, lit_len);
+  op += lit_len;
+
+  if (match_len) {
+    *op++ = static_cast<byte_t>(offset & 0xFF);
+    *op++ = static_cast<byte_t>(offset >> 8);
+    if (mcode >= 15)
+      op = write_len(op, mcode - 15);
+  }
+  return op;
+}
+
+} // namespace
+
+std::size_t lz_compress_bound(std::size_t size) {
+  return size + size / 255 + 16;
+}
+
+std::size_t lz_decompress_bound(std::size_t size) { return size * 255; }
+
+std::size_t lz_compress(const char *src, std::size_t size,
+                        std::vector<char> &dst) {
+  dst.resize(lz_compress_bound(size));
+  auto beg = reinterpret_cast<const byte_t *>(src);
+  auto end = beg + size;
+  auto op = reinterpret_cast<byte_t *>(dst.data());
+  auto out_beg = op;
+
+  // Positions (from beg) of the last sequence with every hash
+  std::uint32_t table[1 << HASH_BITS];
+  std::memset(table, 0, sizeof(table));
+
+  const byte_t *ip = beg;
+  const byte_t *anchor = beg;
+  if (size > MATCH_MARGIN) {
+    const byte_t *mflimit = end - MATCH_MARGIN;
+    const byte_t *matchlimit = end - LAST_LITERALS;
+    std::size_t misses = 0;
+
+    while (ip < mflimit) {
+      auto seq = read32(ip);
+      auto h = hash32(seq);
+      const byte_t *ref = beg + table[h];
+      table[h] = static_cast<std::uint32_t>(ip - beg);
+
+      if (ref >= ip || static_cast<std::size_t>(ip - ref) > MAX_OFFSET ||
+          read32(ref) != seq) {
+        // Skip faster on uncompressible data
+        ip += 1 + (misses++ >> 6);
+        continue;
+      }
+
+      const byte_t *mp = ip + MIN_MATCH;
+      const byte_t *rp = ref + MIN_MATCH;
+      while (mp < matchlimit && *mp == *rp) {
+        ++mp;
+        ++rp;
+      }
+
+      op = write_block(op, anchor, ip - anchor, ip - ref, mp - ip);
+      ip = mp;
+      anchor = ip;
+      misses = 0;
+    }
+  }
+
+  op = write_block(op, anchor, end - anchor, 0, 0);
+  std::size_t res = op - out_beg;
+  dst.resize(res);
+  return res;
+}
+
+bool lz_decompress(const char *src, std::size_t src_size, char *dst,
+                   std::size_t dst_size) {
+  auto ip = reinterpret_cast<const byte_t *>(src);
+  auto iend = ip + src_size;
+  auto op = reinterpret_cast<byte_t *>(dst);
+  auto obeg = op;
+  auto oend = op + dst_size;
+
+  while (ip < iend) {
+    byte_t token = *ip++;
+
+    std::size_t lit_len = token >> 4;
+    if (lit_len == 15 && !read_len(ip, iend, lit_len))
+      return false;
+    if (lit_len > static_cast<std::size_t>(iend - ip) ||
+        lit_len > static_cast<std::size_t>(oend - op))
+      return false;
+    std::memcpy(op, ip, lit_len);
+    ip += lit_len;
+    op += lit_len;
+
+    // Last block
+    if (ip == iend)
+      break;
+
+    if (iend - ip < 2)
+      return false;
+    std::size_t offset = ip[0] | (std::size_t(ip[1]) << 8);
+    ip += 2;
+    if (offset == 0 || offset > static_cast<std::size_t>(op - obeg))
+      return false;
+
+    std::size_t match_len = token & 0xF;
+    if (match_len == 15 && !read_len(ip, iend, match_len))
+      return false;
+    match_len += MIN_MATCH;
+    if (match_len > static_cast<std::size_t>(oend - op))
+      return false;
+
+    // The match may overlap the output, then it's copied byte per byte
+    const byte_t *mp = op - offset;
+    if (offset >= match_len)
+      std::memcpy(op, mp, match_len);
+    else
+      for (std::size_t i = 0; i < match_len; ++i)
+        op[i] = mp[i];
+    op += match_len;
+  }
+
+  return op == oend;
+}
+
+} // namespace odb
@@ -1,46 +1,438 @@
 #include "odb/mess/db-client.hh"
 
+#include <algorithm>
 #include <cassert>
+#include <condition_variable>
 #include <cstring>
+#include <deque>
+#include <iterator>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <thread>
 
 #include <iostream>
 
 #include "odb/mess/db-client-impl.hh"
+#include "odb/mess/disk-cache.hh"
+#include "odb/mess/request.hh"
+#include "odb/server/debugger.hh"
 #include "odb/server/vm-api.hh"
 
 namespace odb {
 
+/// Run requests in order on a worker thread
+/// Completed requests are kept until delivered with `poll`
+class DBClientAsync {
+public:
+  using Work = std::function<void()>;
+  using Done = std::function<void(const std::string &)>;
+
+  DBClientAsync() : _next_id(0), _running_id(-1), _exit(false) {
+    _worker = std::thread([this]() { _run(); });
+  }
+
+  ~DBClientAsync() {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _exit = true;
+      _todo.clear();
+    }
+    _cv.notify_all();
+    _worker.join();
+  }
+
+  db_client_req_t push(Work &&work, Done &&done) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto id = _next_id++;
+    _todo.push_back(Item{id, std::move(work), std::move(done), ""});
+    _cv.notify_all();
+    return id;
+  }
+
+  // Deliver the oldest completed request
+  // Returns false if there is none
+  bool deliver_one() {
+    Item item;
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      if (_done.empty())
+        return false;
+      item = std::move(_done.front());
+      _done.pop_front();
+    }
+    item.done(item.err);
+    return true;
+  }
+
+  void wait_idle() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _cv.wait(lock, [this]() { return _todo.empty() && _running_id == -1; });
+  }
+
+  bool cancel(db_client_req_t id) {
+    std::unique_lock<std::mutex> lock(_mutex);
+    for (auto it = _todo.begin(); it != _todo.end(); ++it)
+      if (it->id == id) {
+        _todo.erase(it);
+        return true;
+      }
+
+    // Being sent: wait until it's completed
+    if (_running_id == id)
+      _cv.wait(lock, [this, id]() { return _running_id != id; });
+
+    for (auto it = _done.begin(); it != _done.end(); ++it)
+      if (it->id == id) {
+        _done.erase(it);
+        return true;
+      }
+    return false;
+  }
+
+  std::size_t pending() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _todo.size() + _done.size() + (_running_id != -1);
+  }
+
+private:
+  struct Item {
+    db_client_req_t id;
+    Work work;
+    Done done;
+    std::string err;
+  };
+
+  db_client_req_t _next_id;
+  db_client_req_t _running_id;
+  bool _exit;
+  std::deque<Item> _todo;
+  std::deque<Item> _done;
+  mutable std::mutex _mutex;
+  std::condition_variable _cv;
+  std::thread _worker;
+
+  void _run() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    for (;;) {
+      _cv.wait(lock, [this]() { return _exit || !_todo.empty(); });
+      if (_exit)
+        return;
+
+      auto item = std::move(_todo.front());
+      _todo.pop_front();
+      _running_id = item.id;
+      lock.unlock();
+
+      try {
+        item.work();
+      } catch (const std::exception &e) {
+        item.err = e.what();
+      }
+
+      lock.lock();
+      _done.push_back(std::move(item));
+      _running_id = -1;
+      _cv.notify_all();
+    }
+  }
+};
+
+void SymbolsTable::push_back(const SymbolInfos &infos) {
+  assert(addrs.empty() || addrs.back() <= infos.addr);
+  if (names_offs.empty())
+    names_offs.push_back(0);
+  addrs.push_back(infos.addr);
+  ids.push_back(infos.idx);
+  names.insert(names.end(), infos.name.begin(), infos.name.end());
+  names_offs.push_back(names.size());
+}
+
+void CodeAnnotated::push_back(vm_ptr_t addr, vm_size_t size,
+                              const std::string &ins) {
+  assert(addrs.empty() || addrs.back() + sizes.back() == addr);
+  std::size_t pos = 0;
+  while ((pos = ins.find('{', pos)) != std::string::npos) {
+    std::size_t beg = pos++;
+    if (pos == ins.size() || ins[pos] < '0' || ins[pos] > '9')
+      continue;
+    vm_sym_t id = 0;
+    while (pos < ins.size() && ins[pos] >= '0' && ins[pos] <= '9')
+      id = 10 * id + (ins[pos++] - '0');
+    if (pos == ins.size() || ins[pos] != '}')
+      continue;
+
+    ++pos;
+    refs_ins.push_back(addrs.size());
+    refs_beg.push_back(beg);
+    refs_end.push_back(pos);
+    refs_ids.push_back(id);
+  }
+
+  addrs.push_back(addr);
+  sizes.push_back(size);
+  text.push_back(ins);
+}
+
+void CodeAnnotated::add_sym(const SymbolInfos &infos) {
+  if (find_sym(infos.idx))
+    return;
+  auto it = std::upper_bound(
+      syms.begin(), syms.end(), infos.addr,
+      [](vm_ptr_t addr, const SymbolInfos &s) { return addr < s.addr; });
+  syms.insert(it, infos);
+}
+
+const SymbolInfos *CodeAnnotated::find_sym(vm_sym_t id) const {
+  for (const auto &s : syms)
+    if (s.idx == id)
+      return &s;
+  return nullptr;
+}
+
+std::vector<vm_sym_t> CodeAnnotated::missing_syms() const {
+  std::vector<vm_sym_t> res;
+  for (auto id : refs_ids)
+    if (!find_sym(id) && std::find(res.begin(), res.end(), id) == res.end())
+      res.push_back(id);
+  return res;
+}
+
+std::string CodeAnnotated::resolved_text(std::size_t i) const {
+  const auto &ins = text[i];
+  auto it = std::lower_bound(refs_ins.begin(), refs_ins.end(), i);
+  std::string res;
+  std::size_t off = 0;
+  for (; it != refs_ins.end() && *it == i; ++it) {
+    auto j = it - refs_ins.begin();
+    auto sym = find_sym(refs_ids[j]);
+    res.append(ins, off, refs_beg[j] - off);
+    if (sym)
+      res += sym->name;
+    else
+      res.append(ins, refs_beg[j], refs_end[j] - refs_beg[j]);
+    off = refs_end[j];
+  }
+  res.append(ins, off, std::string::npos);
+  return res;
+}
+
+namespace {
+
+// FNV-1a of the opcode bytes of an instruction, for the persistent cache
+std::uint64_t code_hash(const char *data, std::size_t size) {
+  std::uint64_t res = 0xcbf29ce484222325;
+  for (std::size_t i = 0; i < size; ++i) {
+    res ^= static_cast<std::uint8_t>(data[i]);
+    res *= 0x100000001b3;
+  }
+  return res;
+}
+
+} // namespace
+
 DBClient::DBClient(std::unique_ptr<DBClientImpl> &&impl)
-    : _impl(std::move(impl)), _state(State::NOT_CONNECTED) {}
+    : _impl(std::move(impl)), _state(State::NOT_CONNECTED), _stop_epoch(0),
+      _syms_table_tried(false), _code_max_size(0), _write_back(false) {}
+
+DBClient::~DBClient() = default;
+
+void DBClient::invalidate_static_cache() {
+  _regi_arr.clear();
+  _regi_idx_map.clear();
+  _regi_name_map.clear();
+
+  _syms_map.clear();
+  _syms_name_map.clear();
+  _syms_pos.clear();
+  if (_syms_ranges)
+    _syms_ranges->set(_syms_ranges->min_key(), _syms_ranges->max_key(), 0);
+  _drop_syms_table(false);
+  _stack_syms_epoch = NO_EPOCH;
+  _open_disk_cache(); // reload the file, only the in-memory copy is dropped
+
+  _code_map.clear();
+  _code_max_size = 0;
+}
+
+void DBClient::set_write_back(bool enabled) {
+  if (!enabled)
+    flush();
+  _write_back = enabled;
+}
+
+void DBClient::save_disk_cache() {
+  if (!_disk_cache)
+    return;
+
+  std::vector<DiskCache::CodeIns> code;
+  for (const auto &ins : _code_map)
+    if (!_mem_was_written(ins.first, ins.second.size))
+      code.push_back({ins.first, ins.second.text, ins.second.size, 0});
+
+  // Hash the opcode bytes, read by contiguous ranges
+  // They can't be checked later if they can't be read now
+  if (_vm_infos.use_opcode && _state != State::VM_STOPPED)
+    code.clear();
+  if (_vm_infos.use_opcode && !code.empty()) {
+    // `code` is sorted by address
+    std::vector<vm_ptr_t> addrs;
+    std::vector<vm_size_t> sizes;
+    std::size_t total = 0;
+    for (const auto &ins : code) {
+      if (!addrs.empty() && ins.addr <= addrs.back() + sizes.back()) {
+        auto end = std::max(addrs.back() + sizes.back(), ins.addr + ins.size);
+        total += end - addrs.back() - sizes.back();
+        sizes.back() = end - addrs.back();
+      } else {
+        addrs.push_back(ins.addr);
+        sizes.push_back(ins.size);
+        total += ins.size;
+      }
+    }
+    std::vector<char> bytes(total);
+    std::vector<char *> bufs;
+    for (std::size_t i = 0, off = 0; i < addrs.size(); off += sizes[i++])
+      bufs.push_back(bytes.data() + off);
+
+    // Requests have at most UINT16_MAX buffers
+    constexpr std::size_t max_bufs = std::numeric_limits<std::uint16_t>::max();
+    try {
+      for (std::size_t i = 0; i < addrs.size(); i += max_bufs)
+        read_mem(&addrs[i], &sizes[i], &bufs[i],
+                 std::min(addrs.size() - i, max_bufs));
+      std::size_t r = 0;
+      for (auto &ins : code) {
+        while (r + 1 < addrs.size() && ins.addr >= addrs[r] + sizes[r])
+          ++r;
+        ins.hash = code_hash(bufs[r] + (ins.addr - addrs[r]), ins.size);
+      }
+    } catch (VMApi::Error &) {
+      code.clear();
+    }
+  }
+  _disk_cache->save(_syms_table.get(), code);
+}
+
+void DBClient::set_prefetch_profile(const PrefetchProfile &profile) {
+  auto pf = profile;
+  pf.mem_align = MEM_CACHE_PAGE_SIZE;
+  _req().set_prefetch(pf);
+
+  // Registers values can only be cached with their infos
+  if (_state == State::VM_STOPPED && !pf.regs.empty())
+    _fetch_reg_infos_by_id(&pf.regs[0], pf.regs.size());
+}
+
+void DBClient::flush() {
+  if (!has_pending_writes())
+    return;
+  auto regs = std::move(_pending_regs);
+  auto mem = std::move(_pending_mem);
+  _pending_regs.clear();
+  _pending_mem.clear();
+
+  std::vector<vm_reg_t> reg_ids;
+  std::vector<const char *> reg_bufs;
+  std::vector<vm_size_t> reg_sizes;
+  for (const auto &r : regs) {
+    reg_ids.push_back(r.first);
+    reg_bufs.push_back(r.second.data());
+    reg_sizes.push_back(r.second.size());
+  }
+
+  std::vector<vm_ptr_t> mem_addrs;
+  std::vector<const char *> mem_bufs;
+  std::vector<vm_size_t> mem_sizes;
+  for (const auto &m : mem) {
+    mem_addrs.push_back(m.first);
+    mem_bufs.push_back(m.second.data());
+    mem_sizes.push_back(m.second.size());
+  }
+
+  try {
+    if (!reg_ids.empty())
+      _req().set_regs(&reg_ids[0], &reg_bufs[0], &reg_sizes[0],
+                      reg_ids.size());
+    if (!mem_addrs.empty())
+      _req().write_mem(&mem_addrs[0], &mem_sizes[0], &mem_bufs[0],
+                       mem_addrs.size());
+    return;
+  } catch (const VMApi::Error &) {
+    // The cache has values that may not be on the VM
+    for (auto &inf : _regi_arr)
+      inf.val.clear();
+    _mem_pages.clear();
+    _code_map.clear();
+  }
+
+  // Find the write that failed
+  for (std::size_t i = 0; i < reg_ids.size(); ++i) {
+    try {
+      _req().set_regs(&reg_ids[i], &reg_bufs[i], &reg_sizes[i], 1);
+    } catch (const VMApi::Error &e) {
+      throw VMApi::Error("flush: set_regs of register #" +
+                         std::to_string(reg_ids[i]) + " failed: " + e.what());
+    }
+  }
+
+  for (std::size_t i = 0; i < mem_addrs.size(); ++i) {
+    try {
+      _req().write_mem(&mem_addrs[i], &mem_sizes[i], &mem_bufs[i], 1);
+    } catch (const VMApi::Error &e) {
+      throw VMApi::Error("flush: write_mem of " + std::to_string(mem_sizes[i]) +
+                         " bytes at " + std::to_string(mem_addrs[i]) +
+                         " failed: " + e.what());
+    }
+  }
+}
 
 void DBClient::connect() {
   assert(_state == State::NOT_CONNECTED);
-  _impl->connect(_vm_infos, _udp);
+  _req().connect(_vm_infos, _udp);
+  if (_vm_infos.memory_size) {
+    _syms_ranges =
+        std::make_unique<RangeMap<int>>(0, _vm_infos.memory_size - 1, 0);
+    _mem_written =
+        std::make_unique<RangeMap<int>>(0, _vm_infos.memory_size - 1, 0);
+  }
+  _open_disk_cache();
 
   // no throws means successfull connection
-  if (_udp.stopped)
+  if (_udp.stopped) {
     _state = State::VM_STOPPED;
-  else
+    _apply_stack();
+    _apply_prefetch();
+  } else
     _state = State::VM_RUNNING;
 }
 
 void DBClient::stop() {
   assert(_state == State::VM_RUNNING);
-  _impl->stop();
+  auto &req = _req();
+  // A pending check_stopped_async may have seen the VM stop
+  if (_state == State::VM_STOPPED)
+    return;
+  req.stop();
   _state = State::VM_STOPPED;
+  _discard_tmp_cache();
 
   // need to do another call get current state infos
-  _impl->check_stopped(_udp);
+  _req().check_stopped(_udp);
   assert(_udp.stopped);
+  _apply_stack();
+  _apply_prefetch();
 }
 
 void DBClient::check_stopped() {
   assert(_state == State::VM_RUNNING);
-  _impl->check_stopped(_udp);
+  _req().check_stopped(_udp);
 
   if (_udp.stopped) {
     _state = State::VM_STOPPED;
     _discard_tmp_cache();
+    _apply_stack();
+    _apply_prefetch();
   } else
     _state = State::VM_RUNNING;
 }
@@ -68,7 +460,8 @@ void DBClient::set_regs(const vm_reg_t *ids, const char **in_bufs,
   assert(_state == State::VM_STOPPED);
   _fetch_reg_infos_by_id(ids, nregs);
 
-  _impl->set_regs(ids, in_bufs, regs_size, nregs);
+  if (!_write_back)
+    _req().set_regs(ids, in_bufs, regs_size, nregs);
 
   // Also update cache value
   for (std::size_t i = 0; i < nregs; ++i) {
@@ -80,6 +473,8 @@ void DBClient::set_regs(const vm_reg_t *ids, const char **in_bufs,
     assert(reg_size == reg.size);
     reg.val.resize(reg_size);
     std::memcpy(&reg.val[0], in_bufs[i], reg_size);
+    if (_write_back)
+      _pending_regs[ids[i]].assign(in_bufs[i], in_bufs[i] + reg_size);
   }
 }
 
@@ -110,54 +505,558 @@ void DBClient::find_regs_ids(const char **reg_names, vm_reg_t *out_ids,
 void DBClient::read_mem(const vm_ptr_t *src_addrs, const vm_size_t *bufs_sizes,
                         char **out_bufs, std::size_t nbuffs) {
   assert(_state == State::VM_STOPPED);
-  _impl->read_mem(src_addrs, bufs_sizes, out_bufs, nbuffs);
+
+  // Invalid or big reads go directly to the server
+  constexpr auto page_size = MEM_CACHE_PAGE_SIZE;
+  auto mem_size = _vm_infos.memory_size;
+  for (std::size_t i = 0; i < nbuffs; ++i)
+    _flush_overlap(src_addrs[i], bufs_sizes[i]);
+
+  std::set<vm_ptr_t> miss;
+  for (std::size_t i = 0; i < nbuffs; ++i) {
+    auto addr = src_addrs[i];
+    auto size = bufs_sizes[i];
+    if (size > MEM_CACHE_MAX_READ || addr > mem_size ||
+        size > mem_size - addr) {
+      _req().read_mem(src_addrs, bufs_sizes, out_bufs, nbuffs);
+      return;
+    }
+
+    if (!size)
+      continue;
+    for (vm_ptr_t p = addr / page_size; p <= (addr + size - 1) / page_size;
+         ++p) {
+      auto it = _mem_pages.find(p);
+      if (it != _mem_pages.end() && it->second.epoch == _stop_epoch)
+        ++_stats.mem.hits;
+      else if (miss.insert(p).second)
+        ++_stats.mem.misses;
+    }
+  }
+
+  if (miss.size() > MEM_CACHE_MAX_PAGES) {
+    _req().read_mem(src_addrs, bufs_sizes, out_bufs, nbuffs);
+    return;
+  }
+  if (!miss.empty())
+    _fetch_mem_pages(miss);
+
+  for (std::size_t i = 0; i < nbuffs; ++i)
+    _read_mem_cached(src_addrs[i], bufs_sizes[i], out_bufs[i]);
 }
 
 void DBClient::write_mem(const vm_ptr_t *dst_addrs, const vm_size_t *bufs_sizes,
                          const char **in_bufs, std::size_t nbuffs) {
   assert(_state == State::VM_STOPPED);
-  _impl->write_mem(dst_addrs, bufs_sizes, in_bufs, nbuffs);
+  if (_write_back) {
+    for (std::size_t i = 0; i < nbuffs; ++i) {
+      _queue_mem_write(dst_addrs[i], bufs_sizes[i], in_bufs[i]);
+      _on_mem_written(dst_addrs[i], bufs_sizes[i], in_bufs[i]);
+    }
+    return;
+  }
+
+  try {
+    _req().write_mem(dst_addrs, bufs_sizes, in_bufs, nbuffs);
+  } catch (...) {
+    // Don't know which writes succeeded
+    _mem_pages.clear();
+    _code_map.clear();
+    throw;
+  }
+
+  for (std::size_t i = 0; i < nbuffs; ++i)
+    _on_mem_written(dst_addrs[i], bufs_sizes[i], in_bufs[i]);
+}
+
+std::size_t DBClient::read_mem_diff(vm_ptr_t addr, vm_size_t size,
+                                    char *out_buf) {
+  assert(_state == State::VM_STOPPED);
+  _flush_overlap(addr, size);
+  auto &shadow = _mem_shadows[std::make_pair(addr, size)];
+  if (shadow.data.size() != size) {
+    shadow.version = 0;
+    shadow.data.resize(size);
+  }
+
+  std::vector<vm_size_t> pages;
+  std::vector<char> data;
+  _req().read_mem_diff(addr, size, shadow.version, pages, data);
+
+  constexpr auto page_size = Debugger::MEM_DIFF_PAGE_SIZE;
+  std::size_t data_pos = 0;
+  for (auto page : pages) {
+    auto page_addr = page * page_size;
+    auto len = std::min(page_size, size - page_addr);
+    assert(data_pos + len <= data.size());
+    std::copy_n(&data[data_pos], len, &shadow.data[page_addr]);
+    data_pos += len;
+  }
+
+  std::copy(shadow.data.begin(), shadow.data.end(), out_buf);
+  return pages.size();
+}
+
+vm_size_t DBClient::read_mem_stream(vm_ptr_t addr, vm_size_t size,
+                                    const MemStreamReader &on_chunk,
+                                    vm_size_t chunk_size) {
+  assert(_state == State::VM_STOPPED);
+  assert(chunk_size > 0);
+  _flush_overlap(addr, size);
+  std::vector<char> buf(std::min(size, chunk_size));
+  char *buf_ptr = buf.data();
+
+  vm_size_t done = 0;
+  while (done < size) {
+    vm_ptr_t chunk_addr = addr + done;
+    vm_size_t len = std::min(chunk_size, size - done);
+    _req().read_mem(&chunk_addr, &len, &buf_ptr, 1);
+    done += len;
+    if (!on_chunk(chunk_addr, buf_ptr, len))
+      break;
+  }
+  return done;
+}
+
+vm_size_t DBClient::write_mem_stream(vm_ptr_t addr, vm_size_t size,
+                                     const MemStreamWriter &fill_chunk,
+                                     vm_size_t chunk_size) {
+  assert(_state == State::VM_STOPPED);
+  assert(chunk_size > 0);
+  flush(); // keep the writes ordered
+  std::vector<char> buf(std::min(size, chunk_size));
+  char *buf_ptr = buf.data();
+
+  vm_size_t done = 0;
+  while (done < size) {
+    vm_ptr_t chunk_addr = addr + done;
+    vm_size_t len = std::min(chunk_size, size - done);
+    if (!fill_chunk(chunk_addr, buf_ptr, len))
+      break;
+    const char *in_ptr = buf_ptr;
+    _req().write_mem(&chunk_addr, &len, &in_ptr, 1);
+    _on_mem_written(chunk_addr, len, in_ptr);
+    done += len;
+  }
+  return done;
 }
 
 void DBClient::get_symbols_by_addr(vm_ptr_t addr, vm_size_t size,
                                    std::vector<SymbolInfos> &out_infos) {
   assert(_state == State::VM_STOPPED);
-  _impl->get_symbols_by_addr(addr, size, out_infos);
+  auto mem_size = _vm_infos.memory_size;
+  if (!size || addr >= mem_size) {
+    _req().get_symbols_by_addr(addr, size, out_infos);
+    return;
+  }
+
+  vm_ptr_t end = size > mem_size - addr ? mem_size - 1 : addr + size - 1;
+  if (_load_syms_table()) {
+    ++_stats.syms.hits;
+    const auto &addrs = _syms_table->addrs;
+    auto first = std::lower_bound(addrs.begin(), addrs.end(), addr);
+    auto last = std::upper_bound(first, addrs.end(), end);
+    out_infos.clear();
+    for (auto it = first; it != last; ++it)
+      out_infos.push_back(_syms_table_infos(it - addrs.begin()));
+    return;
+  }
+
+  auto range = _syms_ranges->range_of(addr);
+  if (range.val == 1 && range.high >= end)
+    ++_stats.syms.hits;
+  else {
+    ++_stats.syms.misses;
+    std::vector<SymbolInfos> syms;
+    _req().get_symbols_by_addr(addr, end - addr + 1, syms);
+    for (const auto &s : syms)
+      _add_sym(s);
+    _syms_ranges->set(addr, end, 1);
+  }
+
+  out_infos.clear();
+  for (auto it = _syms_pos.lower_bound(addr);
+       it != _syms_pos.end() && it->first <= end; ++it)
+    out_infos.push_back(_syms_map.find(it->second)->second);
 }
 
 void DBClient::get_symbols_by_ids(const vm_sym_t *ids, SymbolInfos *out_infos,
                                   std::size_t nsyms) {
   assert(_state == State::VM_STOPPED);
-  _impl->get_symbols_by_ids(ids, out_infos, nsyms);
+  if (_load_syms_table()) {
+    // Unknown ids are sent to the server, that reports the error
+    std::size_t nmiss = 0;
+    for (std::size_t i = 0; i < nsyms; ++i) {
+      auto it = _syms_table_ids.find(ids[i]);
+      if (it == _syms_table_ids.end())
+        ++nmiss;
+      else
+        out_infos[i] = _syms_table_infos(it->second);
+    }
+    _stats.syms.hits += nsyms - nmiss;
+    if (!nmiss)
+      return;
+  }
+  _fetch_syms_by_id(ids, nsyms);
+
+  for (std::size_t i = 0; i < nsyms; ++i) {
+    auto it = _syms_map.find(ids[i]);
+    assert(it != _syms_map.end());
+    out_infos[i] = it->second;
+  }
 }
 
 void DBClient::get_symbols_by_names(const char **names, SymbolInfos *out_infos,
                                     std::size_t nsyms) {
   assert(_state == State::VM_STOPPED);
-  _impl->get_symbols_by_names(names, out_infos, nsyms);
+  if (_load_syms_table()) {
+    std::size_t nmiss = 0;
+    for (std::size_t i = 0; i < nsyms; ++i) {
+      auto it = _syms_table_names.find(names[i]);
+      if (it == _syms_table_names.end())
+        ++nmiss;
+      else
+        out_infos[i] = _syms_table_infos(it->second);
+    }
+    _stats.syms.hits += nsyms - nmiss;
+    if (!nmiss)
+      return;
+  }
+  _fetch_syms_by_name(names, nsyms);
+
+  for (std::size_t i = 0; i < nsyms; ++i) {
+    auto it = _syms_name_map.find(names[i]);
+    assert(it != _syms_name_map.end());
+    out_infos[i] = _syms_map.find(it->second)->second;
+  }
 }
 
 void DBClient::get_code_text(vm_ptr_t addr, std::size_t nins,
                              std::vector<std::string> &out_text,
                              std::vector<vm_size_t> &out_sizes) {
   assert(_state == State::VM_STOPPED);
-  _impl->get_code_text(addr, nins, out_text, out_sizes);
+  out_text.resize(nins);
+  out_sizes.resize(nins);
+  std::size_t i = _get_cached_code(addr, nins, out_text, out_sizes);
+  for (std::size_t j = 0; j < i; ++j)
+    addr += out_sizes[j];
+
+  _stats.code.hits += i;
+  if (i == nins)
+    return;
+
+  // Fetch everything after the first missing one
+  // The code may have been patched by pending writes
+  _stats.code.misses += nins - i;
+  if (!_pending_mem.empty())
+    flush();
+  std::vector<std::string> text;
+  std::vector<vm_size_t> sizes;
+  _req().get_code_text(addr, nins - i, text, sizes);
+  for (std::size_t j = 0; j < text.size(); ++j, ++i) {
+    _code_map[addr] = CodeIns{text[j], sizes[j]};
+    _code_max_size = std::max(_code_max_size, sizes[j]);
+    out_text[i] = std::move(text[j]);
+    out_sizes[i] = sizes[j];
+    addr += sizes[j];
+  }
+}
+
+void DBClient::get_code_annotated(vm_ptr_t addr, std::size_t nins,
+                                  CodeAnnotated &out_code) {
+  assert(_state == State::VM_STOPPED);
+  out_code = CodeAnnotated{};
+  if (!nins)
+    return;
+
+  // Everything cached: the symbols are usually too
+  std::vector<std::string> text(nins);
+  std::vector<vm_size_t> sizes(nins);
+  if (_get_cached_code(addr, nins, text, sizes) == nins) {
+    _stats.code.hits += nins;
+    for (std::size_t i = 0; i < nins; ++i) {
+      out_code.push_back(addr, sizes[i], text[i]);
+      addr += sizes[i];
+    }
+
+    std::vector<SymbolInfos> defs;
+    auto first = out_code.addrs.front();
+    get_symbols_by_addr(first, out_code.addrs.back() - first + 1, defs);
+    for (const auto &s : defs)
+      out_code.add_sym(s);
+    auto refs = out_code.missing_syms();
+    std::vector<SymbolInfos> refs_infos(refs.size());
+    if (!refs.empty())
+      get_symbols_by_ids(&refs[0], &refs_infos[0], refs.size());
+    for (const auto &s : refs_infos)
+      out_code.add_sym(s);
+    return;
+  }
+
+  // Code and symbols in one request
+  // The code may have been patched by pending writes
+  _stats.code.misses += nins;
+  if (!_pending_mem.empty())
+    flush();
+  _req().get_code_annotated(addr, nins, out_code);
+  _cache_code_annotated(out_code);
+}
+
+void DBClient::get_code_around(vm_ptr_t addr, std::size_t nbefore,
+                               std::size_t nafter, CodeAnnotated &out_code) {
+  assert(_state == State::VM_STOPPED);
+
+  // Everything cached: same as get_code_annotated
+  // The cache only has instructions from windows found by the server, or
+  // from addresses asked by the user
+  vm_ptr_t start = addr;
+  std::size_t nfound = 0;
+  vm_ptr_t prev;
+  while (nfound < nbefore && _cached_code_before(start, prev)) {
+    start = prev;
+    ++nfound;
+  }
+  std::vector<std::string> text(nafter);
+  std::vector<vm_size_t> sizes(nafter);
+  if ((nfound == nbefore || start == 0) &&
+      _get_cached_code(addr, nafter, text, sizes) == nafter) {
+    get_code_annotated(start, nfound + nafter, out_code);
+    return;
+  }
+
+  _stats.code.misses += nbefore + nafter;
+  if (!_pending_mem.empty())
+    flush();
+  _req().get_code_around(addr, nbefore, nafter, out_code);
+  _cache_code_annotated(out_code);
 }
 
 void DBClient::add_breakpoints(const vm_ptr_t *addrs, std::size_t size) {
   assert(_state == State::VM_STOPPED);
-  _impl->add_breakpoints(addrs, size);
+  _req().add_breakpoints(addrs, size);
+  _bkps.insert(addrs, addrs + size);
 }
 
 void DBClient::del_breakpoints(const vm_ptr_t *addrs, std::size_t size) {
   assert(_state == State::VM_STOPPED);
-  _impl->del_breakpoints(addrs, size);
+  _req().del_breakpoints(addrs, size);
+  for (std::size_t i = 0; i < size; ++i)
+    _bkps.erase(addrs[i]);
+}
+
+db_client_req_t DBClient::check_stopped_async(const AsyncCallback &cb) {
+  assert(_state == State::VM_RUNNING);
+  auto impl = _impl.get();
+  auto udp = std::make_shared<DBClientUpdate>();
+  udp->stack_version = _udp.stack_version;
+  return _push_async([impl, udp]() { impl->check_stopped(*udp); },
+                     [this, udp, cb](const std::string &err) {
+                       if (err.empty() && udp->stopped) {
+                         _udp = std::move(*udp);
+                         _state = State::VM_STOPPED;
+                         _discard_tmp_cache();
+                         _apply_stack();
+                         _apply_prefetch();
+                       }
+                       cb(err);
+                     });
+}
+
+db_client_req_t DBClient::get_regs_async(const vm_reg_t *ids, char **out_bufs,
+                                         const vm_size_t *regs_size,
+                                         std::size_t nregs,
+                                         const AsyncCallback &cb) {
+  assert(_state == State::VM_STOPPED);
+  // The server must see the cached values, they are copied back in `done`
+  if (!_pending_regs.empty())
+    flush();
+
+  std::vector<vm_reg_t> in_ids(ids, ids + nregs);
+  std::vector<char *> bufs(out_bufs, out_bufs + nregs);
+  std::vector<vm_size_t> sizes(nregs);
+  for (std::size_t i = 0; i < nregs; ++i)
+    sizes[i] = nregs > 1 && regs_size[1] == 0 ? regs_size[0] : regs_size[i];
+  if (nregs > 1 && regs_size[1] == 0)
+    sizes[1] = 0;
+
+  auto impl = _impl.get();
+  auto work = [impl, in_ids, bufs, sizes]() {
+    if (!in_ids.empty())
+      impl->get_regs(&in_ids[0], const_cast<char **>(&bufs[0]), &sizes[0],
+                     in_ids.size());
+  };
+
+  auto done = [this, in_ids, bufs, cb](const std::string &err) {
+    // Update values of cached registers
+    for (std::size_t i = 0; err.empty() && i < in_ids.size(); ++i) {
+      auto it = _regi_idx_map.find(in_ids[i]);
+      if (it == _regi_idx_map.end())
+        continue;
+      auto &reg = _regi_arr[it->second];
+      reg.val.resize(reg.size);
+      std::memcpy(&reg.val[0], bufs[i], reg.size);
+    }
+    cb(err);
+  };
+
+  return _push_async(std::move(work), std::move(done));
+}
+
+db_client_req_t DBClient::read_mem_async(const vm_ptr_t *src_addrs,
+                                         const vm_size_t *bufs_sizes,
+                                         char **out_bufs, std::size_t nbuffs,
+                                         const AsyncCallback &cb) {
+  assert(_state == State::VM_STOPPED);
+  for (std::size_t i = 0; i < nbuffs; ++i)
+    _flush_overlap(src_addrs[i], bufs_sizes[i]);
+
+  std::vector<vm_ptr_t> addrs(src_addrs, src_addrs + nbuffs);
+  std::vector<vm_size_t> sizes(bufs_sizes, bufs_sizes + nbuffs);
+  std::vector<char *> bufs(out_bufs, out_bufs + nbuffs);
+  auto impl = _impl.get();
+  return _push_async(
+      [impl, addrs, sizes, bufs]() {
+        if (!addrs.empty())
+          impl->read_mem(&addrs[0], &sizes[0], const_cast<char **>(&bufs[0]),
+                         addrs.size());
+      },
+      [cb](const std::string &err) { cb(err); });
+}
+
+db_client_req_t DBClient::get_code_text_async(
+    vm_ptr_t addr, std::size_t nins, std::vector<std::string> &out_text,
+    std::vector<vm_size_t> &out_sizes, const AsyncCallback &cb) {
+  assert(_state == State::VM_STOPPED);
+  if (!_pending_mem.empty())
+    flush();
+
+  auto impl = _impl.get();
+  auto text = &out_text;
+  auto sizes = &out_sizes;
+  return _push_async(
+      [impl, addr, nins, text, sizes]() {
+        impl->get_code_text(addr, nins, *text, *sizes);
+      },
+      [this, addr, text, sizes, cb](const std::string &err) {
+        auto pos = addr;
+        for (std::size_t i = 0; err.empty() && i < text->size(); ++i) {
+          _code_map[pos] = CodeIns{(*text)[i], (*sizes)[i]};
+          _code_max_size = std::max(_code_max_size, (*sizes)[i]);
+          pos += (*sizes)[i];
+        }
+        cb(err);
+      });
+}
+
+db_client_req_t DBClient::get_symbols_by_addr_async(
+    vm_ptr_t addr, vm_size_t size, std::vector<SymbolInfos> &out_infos,
+    const AsyncCallback &cb) {
+  assert(_state == State::VM_STOPPED);
+  auto impl = _impl.get();
+  auto infos = &out_infos;
+  return _push_async(
+      [impl, addr, size, infos]() {
+        impl->get_symbols_by_addr(addr, size, *infos);
+      },
+      [this, addr, size, infos, cb](const std::string &err) {
+        auto mem_size = _vm_infos.memory_size;
+        if (err.empty() && size && addr < mem_size) {
+          for (const auto &s : *infos)
+            _add_sym(s);
+          vm_ptr_t end =
+              size > mem_size - addr ? mem_size - 1 : addr + size - 1;
+          _syms_ranges->set(addr, end, 1);
+        }
+        cb(err);
+      });
+}
+
+db_client_req_t DBClient::get_symbols_by_ids_async(const vm_sym_t *ids,
+                                                   SymbolInfos *out_infos,
+                                                   std::size_t nsyms,
+                                                   const AsyncCallback &cb) {
+  assert(_state == State::VM_STOPPED);
+  std::vector<vm_sym_t> in_ids(ids, ids + nsyms);
+  auto impl = _impl.get();
+  return _push_async(
+      [impl, in_ids, out_infos]() {
+        if (!in_ids.empty())
+          impl->get_symbols_by_ids(&in_ids[0], out_infos, in_ids.size());
+      },
+      [this, out_infos, nsyms, cb](const std::string &err) {
+        for (std::size_t i = 0; err.empty() && i < nsyms; ++i)
+          _add_sym(out_infos[i]);
+        cb(err);
+      });
+}
+
+db_client_req_t DBClient::get_symbols_by_names_async(const char **names,
+                                                     SymbolInfos *out_infos,
+                                                     std::size_t nsyms,
+                                                     const AsyncCallback &cb) {
+  assert(_state == State::VM_STOPPED);
+  std::vector<std::string> in_names(names, names + nsyms);
+  auto impl = _impl.get();
+  return _push_async(
+      [impl, in_names, out_infos]() {
+        std::vector<const char *> ptrs;
+        for (const auto &n : in_names)
+          ptrs.push_back(n.c_str());
+        if (!ptrs.empty())
+          impl->get_symbols_by_names(&ptrs[0], out_infos, ptrs.size());
+      },
+      [this, out_infos, nsyms, cb](const std::string &err) {
+        for (std::size_t i = 0; err.empty() && i < nsyms; ++i)
+          _add_sym(out_infos[i]);
+        cb(err);
+      });
+}
+
+std::size_t DBClient::poll() {
+  std::size_t res = 0;
+  while (_async && _async->deliver_one())
+    ++res;
+  return res;
+}
+
+void DBClient::wait_async() {
+  if (!_async)
+    return;
+  _async->wait_idle();
+  poll();
+}
+
+bool DBClient::cancel(db_client_req_t req) {
+  return _async && _async->cancel(req);
+}
+
+std::size_t DBClient::async_pending() const {
+  return _async ? _async->pending() : 0;
+}
+
+bool DBClient::has_breakpoint(vm_ptr_t addr) {
+  // Without PROTO_CAP_GET_BKPS, only knows the local ones
+  if (_state == State::VM_STOPPED && _bkps_epoch != _stop_epoch &&
+      _impl->has_cap(PROTO_CAP_GET_BKPS)) {
+    std::vector<vm_ptr_t> addrs;
+    _req().get_breakpoints(addrs);
+    _bkps = std::set<vm_ptr_t>(addrs.begin(), addrs.end());
+    _bkps_epoch = _stop_epoch;
+  }
+  return _bkps.find(addr) != _bkps.end();
 }
 
 void DBClient::resume(ResumeType type) {
   assert(_state == State::VM_STOPPED);
-  _impl->resume(type);
+  flush();
+  _req().resume(type);
   _state = State::VM_RUNNING;
+  _discard_tmp_cache();
+}
+
+void DBClient::get_server_stats(ServerStats &out_stats) {
+  assert(_state == State::VM_STOPPED || _state == State::VM_RUNNING);
+  _req().get_stats(out_stats);
 }
 
 vm_ptr_t DBClient::get_execution_point() {
@@ -170,9 +1069,91 @@ StoppedState DBClient::get_stopped_state() {
   return _udp.vm_state;
 }
 
-CallStack DBClient::get_call_stack() {
+const CallStack &DBClient::get_call_stack() {
+  assert(_state == State::VM_STOPPED);
+  get_call_frames(0, _stack.size());
+  return _stack;
+}
+
+std::size_t DBClient::get_call_stack_depth() {
+  assert(_state == State::VM_STOPPED);
+  return _stack.size();
+}
+
+const CallInfos *DBClient::get_call_frames(std::size_t beg, std::size_t end) {
+  assert(_state == State::VM_STOPPED);
+  if (beg > end || end > _stack.size())
+    throw VMApi::Error("get_call_frames: invalid range");
+
+  std::size_t nmiss = 0;
+  if (!_stack_missing.empty()) {
+    std::vector<std::pair<std::size_t, std::size_t>> still_missing;
+    CallStack frames;
+    for (auto miss : _stack_missing) {
+      auto lo = std::max(miss.first, beg);
+      auto hi = std::min(miss.second, end);
+      if (lo >= hi) {
+        still_missing.push_back(miss);
+        continue;
+      }
+
+      _req().get_stack_frames(lo, hi, frames);
+      if (frames.size() != hi - lo)
+        throw VMApi::Error("get_call_frames: invalid response");
+      std::copy(frames.begin(), frames.end(), _stack.begin() + lo);
+      nmiss += hi - lo;
+      if (miss.first < lo)
+        still_missing.emplace_back(miss.first, lo);
+      if (hi < miss.second)
+        still_missing.emplace_back(hi, miss.second);
+    }
+    _stack_missing = std::move(still_missing);
+  }
+
+  _stats.stack.hits += end - beg - nmiss;
+  _stats.stack.misses += nmiss;
+  return _stack.data() + beg;
+}
+
+void DBClient::get_call_stack_syms(std::vector<SymbolInfos> &out_syms) {
   assert(_state == State::VM_STOPPED);
-  return _udp.stack;
+  if (_load_syms_table()) {
+    ++_stats.syms.hits;
+    const auto &stack = get_call_stack();
+    const auto &addrs = _syms_table->addrs;
+    out_syms.assign(stack.size(), SymbolInfos{VM_SYM_NULL, "", 0});
+    for (std::size_t i = 0; i < stack.size(); ++i) {
+      auto addr = stack[i].caller_start_addr;
+      auto it = std::upper_bound(addrs.begin(), addrs.end(), addr);
+      if (it != addrs.begin() &&
+          addr - *std::prev(it) <= Debugger::SYM_CONTAINING_MAX_DIST)
+        out_syms[i] = _syms_table_infos(std::prev(it) - addrs.begin());
+    }
+    return;
+  }
+
+  if (_stack_syms_epoch == _stop_epoch)
+    ++_stats.syms.hits;
+  else {
+    ++_stats.syms.misses;
+    CallStack srv_stack;
+    std::vector<vm_sym_t> frames_syms;
+    std::vector<SymbolInfos> syms;
+    _req().get_stack_syms(srv_stack, frames_syms, syms);
+    // Also has the missing frames
+    if (srv_stack.size() == _stack.size()) {
+      _stack = std::move(srv_stack);
+      _stack_missing.clear();
+    }
+    for (const auto &s : syms)
+      _add_sym(s);
+    _stack_syms.assign(frames_syms.size(), SymbolInfos{VM_SYM_NULL, "", 0});
+    for (std::size_t i = 0; i < frames_syms.size(); ++i)
+      if (frames_syms[i] != VM_SYM_NULL)
+        _stack_syms[i] = _syms_map.at(frames_syms[i]);
+    _stack_syms_epoch = _stop_epoch;
+  }
+  out_syms = _stack_syms;
 }
 
 vm_reg_t DBClient::registers_count() const {
@@ -221,13 +1202,104 @@ bool DBClient::use_opcode() const {
   return _vm_infos.use_opcode;
 }
 
+DBClientImpl &DBClient::_req() {
+  wait_async();
+  ++_stats.requests;
+  return *_impl;
+}
+
+db_client_req_t
+DBClient::_push_async(std::function<void()> &&work,
+                      std::function<void(const std::string &)> &&done) {
+  if (!_async)
+    _async = std::make_unique<DBClientAsync>();
+  ++_stats.requests;
+  return _async->push(std::move(work), std::move(done));
+}
+
 // Caching
 
 void DBClient::_discard_tmp_cache() {
+  ++_stop_epoch;
   for (auto &inf : _regi_arr)
     inf.val.clear();
 }
 
+void DBClient::_apply_stack() {
+  auto keep = static_cast<std::size_t>(_udp.stack_keep);
+  auto depth = static_cast<std::size_t>(_udp.stack_depth);
+  const auto &tail = _udp.stack;
+  if (keep > _stack.size() || tail.size() > depth ||
+      keep > depth - tail.size())
+    throw VMApi::Error("Invalid call stack update");
+
+  // Frames kept may still be missing, the others are between keep and tail
+  while (!_stack_missing.empty() && _stack_missing.back().first >= keep)
+    _stack_missing.pop_back();
+  if (!_stack_missing.empty())
+    _stack_missing.back().second =
+        std::min(_stack_missing.back().second, keep);
+  if (keep < depth - tail.size())
+    _stack_missing.emplace_back(keep, depth - tail.size());
+
+  _stack.resize(depth - tail.size());
+  _stack.insert(_stack.end(), tail.begin(), tail.end());
+}
+
+void DBClient::_apply_prefetch() {
+  auto &pf = _udp.prefetch;
+  constexpr auto page_size = MEM_CACHE_PAGE_SIZE;
+  auto mem_size = _vm_infos.memory_size;
+
+  // Only registers with known infos, applying it must not send requests
+  for (std::size_t i = 0; i < pf.reg_ids.size(); ++i) {
+    auto it = _regi_idx_map.find(pf.reg_ids[i]);
+    if (it == _regi_idx_map.end())
+      continue;
+    auto &reg = _regi_arr[it->second];
+    if (reg.size == pf.reg_vals[i].size())
+      reg.val.assign(pf.reg_vals[i].begin(), pf.reg_vals[i].end());
+  }
+
+  // Only full pages
+  for (std::size_t i = 0; i < pf.mem_addrs.size(); ++i) {
+    auto addr = pf.mem_addrs[i];
+    const auto &data = pf.mem_data[i];
+    auto end = addr + data.size();
+    for (vm_ptr_t p = (addr + page_size - 1) / page_size;
+         p * page_size < end && _mem_pages.size() < MEM_CACHE_MAX_PAGES;
+         ++p) {
+      auto beg = p * page_size;
+      auto len = std::min(page_size, mem_size - beg);
+      if (beg + len > end)
+        break;
+      auto &page = _mem_pages[p];
+      page.epoch = _stop_epoch;
+      page.data.assign(&data[beg - addr], &data[beg - addr] + len);
+    }
+  }
+
+  auto pos = pf.code_addr;
+  for (std::size_t i = 0; i < pf.code_text.size(); ++i) {
+    _code_map[pos] = CodeIns{pf.code_text[i], pf.code_sizes[i]};
+    _code_max_size = std::max(_code_max_size, pf.code_sizes[i]);
+    pos += pf.code_sizes[i];
+  }
+
+  for (const auto &inf : pf.syms)
+    _add_sym(inf);
+  for (std::size_t i = 0; i < pf.sym_addrs.size() && _syms_ranges; ++i) {
+    auto addr = pf.sym_addrs[i];
+    auto size = pf.sym_sizes[i];
+    if (!size || addr >= mem_size)
+      continue;
+    vm_ptr_t end = size > mem_size - addr ? mem_size - 1 : addr + size - 1;
+    _syms_ranges->set(addr, end, 1);
+  }
+
+  pf = StopPrefetch{};
+}
+
 void DBClient::_fetch_reg_infos_by_id(const vm_reg_t *idxs, std::size_t nregs) {
 
   // Make list of all mising regs
@@ -241,7 +1313,7 @@ void DBClient::_fetch_reg_infos_by_id(const vm_reg_t *idxs, std::size_t nregs) {
   // Get missing regs
   nregs = miss.size();
   std::vector<RegInfos> infos(nregs);
-  _impl->get_regs_infos(&miss[0], &infos[0], nregs);
+  _req().get_regs_infos(&miss[0], &infos[0], nregs);
   for (auto &inf : infos) // value not expected to be correct
     inf.val.clear();
 
@@ -268,7 +1340,7 @@ void DBClient::_fetch_reg_infos_by_name(const char **names, std::size_t nregs) {
   // Load indices of missing regs
   nregs = miss.size();
   std::vector<vm_reg_t> idxs(nregs);
-  _impl->find_regs_ids(&miss[0], &idxs[0], nregs);
+  _req().find_regs_ids(&miss[0], &idxs[0], nregs);
 
   // Add to cache
   _fetch_reg_infos_by_id(&idxs[0], nregs);
@@ -292,6 +1364,8 @@ void DBClient::_fetch_reg_vals_by_id(const vm_reg_t *idxs, std::size_t nregs) {
       total_size += reg.size;
     }
   }
+  _stats.regs.hits += nregs - miss.size();
+  _stats.regs.misses += miss.size();
   if (miss.empty())
     return;
 
@@ -305,7 +1379,7 @@ void DBClient::_fetch_reg_vals_by_id(const vm_reg_t *idxs, std::size_t nregs) {
 
   // Load data
   nregs = miss.size();
-  _impl->get_regs(&miss[0], &miss_bufs[0], &miss_size[0], nregs);
+  _req().get_regs(&miss[0], &miss_bufs[0], &miss_size[0], nregs);
 
   // Add data to cache
   buf_pos = &full_buff[0];
@@ -319,4 +1393,328 @@ void DBClient::_fetch_reg_vals_by_id(const vm_reg_t *idxs, std::size_t nregs) {
   }
 }
 
+void DBClient::_read_mem_cached(vm_ptr_t addr, vm_size_t size, char *out_buf) {
+  constexpr auto page_size = MEM_CACHE_PAGE_SIZE;
+  while (size) {
+    auto it = _mem_pages.find(addr / page_size);
+    assert(it != _mem_pages.end() && it->second.epoch == _stop_epoch);
+    const auto &page = it->second.data;
+    auto off = addr % page_size;
+    auto len = std::min(size, vm_size_t(page.size() - off));
+    std::memcpy(out_buf, &page[off], len);
+    out_buf += len;
+    addr += len;
+    size -= len;
+  }
+}
+
+void DBClient::_fetch_mem_pages(const std::set<vm_ptr_t> &pages) {
+  constexpr auto page_size = MEM_CACHE_PAGE_SIZE;
+  auto mem_size = _vm_infos.memory_size;
+
+  // Make some room: first drop the old pages, then everything
+  if (_mem_pages.size() + pages.size() > MEM_CACHE_MAX_PAGES) {
+    for (auto it = _mem_pages.begin(); it != _mem_pages.end();)
+      if (it->second.epoch != _stop_epoch)
+        it = _mem_pages.erase(it);
+      else
+        ++it;
+  }
+  if (_mem_pages.size() + pages.size() > MEM_CACHE_MAX_PAGES)
+    _mem_pages.clear();
+
+  // One read per run of consecutive pages
+  std::vector<vm_ptr_t> addrs;
+  std::vector<vm_size_t> sizes;
+  vm_size_t total_size = 0;
+  for (auto p : pages) {
+    auto beg = p * page_size;
+    auto len = std::min(page_size, mem_size - beg);
+    if (!addrs.empty() && addrs.back() + sizes.back() == beg)
+      sizes.back() += len;
+    else {
+      addrs.push_back(beg);
+      sizes.push_back(len);
+    }
+    total_size += len;
+  }
+
+  std::vector<char> buff(total_size);
+  std::vector<char *> bufs;
+  char *buf_pos = &buff[0];
+  for (auto len : sizes) {
+    bufs.push_back(buf_pos);
+    buf_pos += len;
+  }
+  _req().read_mem(&addrs[0], &sizes[0], &bufs[0], addrs.size());
+
+  // Split into pages
+  buf_pos = &buff[0];
+  for (auto p : pages) {
+    auto len = std::min(page_size, mem_size - p * page_size);
+    auto &page = _mem_pages[p];
+    page.epoch = _stop_epoch;
+    page.data.assign(buf_pos, buf_pos + len);
+    buf_pos += len;
+  }
+}
+
+void DBClient::_on_mem_written(vm_ptr_t addr, vm_size_t size,
+                               const char *data) {
+  if (!size)
+    return;
+  constexpr auto page_size = MEM_CACHE_PAGE_SIZE;
+  auto end = addr + size;
+  auto mem_size = _vm_infos.memory_size;
+  if (_mem_written && addr < mem_size)
+    _mem_written->set(addr, std::min(end, mem_size) - 1, 1);
+
+  // Update pages in place
+  for (vm_ptr_t p = addr / page_size; p <= (end - 1) / page_size; ++p) {
+    auto it = _mem_pages.find(p);
+    if (it == _mem_pages.end() || it->second.epoch != _stop_epoch)
+      continue;
+    auto &page = it->second.data;
+    auto beg = std::max(addr, p * page_size);
+    auto page_end = std::min(end, vm_ptr_t(p * page_size + page.size()));
+    if (beg < page_end)
+      std::memcpy(&page[beg - p * page_size], data + (beg - addr),
+                  page_end - beg);
+  }
+
+  // Drop all instructions overlapping the write
+  auto first = addr < _code_max_size ? 0 : addr - _code_max_size;
+  auto it = _code_map.lower_bound(first);
+  while (it != _code_map.end() && it->first < end) {
+    if (it->first + it->second.size > addr)
+      it = _code_map.erase(it);
+    else
+      ++it;
+  }
+}
+
+void DBClient::_fetch_syms_by_id(const vm_sym_t *ids, std::size_t nsyms) {
+  std::vector<vm_sym_t> miss;
+  for (std::size_t i = 0; i < nsyms; ++i)
+    if (_syms_map.find(ids[i]) == _syms_map.end())
+      miss.push_back(ids[i]);
+  _stats.syms.hits += nsyms - miss.size();
+  _stats.syms.misses += miss.size();
+  if (miss.empty())
+    return;
+
+  std::vector<SymbolInfos> infos(miss.size());
+  _req().get_symbols_by_ids(&miss[0], &infos[0], miss.size());
+  for (const auto &inf : infos)
+    _add_sym(inf);
+}
+
+void DBClient::_fetch_syms_by_name(const char **names, std::size_t nsyms) {
+  std::vector<const char *> miss;
+  for (std::size_t i = 0; i < nsyms; ++i)
+    if (_syms_name_map.find(names[i]) == _syms_name_map.end())
+      miss.push_back(names[i]);
+  _stats.syms.hits += nsyms - miss.size();
+  _stats.syms.misses += miss.size();
+  if (miss.empty())
+    return;
+
+  std::vector<SymbolInfos> infos(miss.size());
+  _req().get_symbols_by_names(&miss[0], &infos[0], miss.size());
+  for (const auto &inf : infos)
+    _add_sym(inf);
+}
+
+std::size_t DBClient::_get_cached_code(vm_ptr_t addr, std::size_t nins,
+                                       std::vector<std::string> &out_text,
+                                       std::vector<vm_size_t> &out_sizes) {
+  std::size_t i = 0;
+  for (; i < nins; ++i) {
+    auto it = _code_map.find(addr);
+    if (it == _code_map.end())
+      break;
+    out_text[i] = it->second.text;
+    out_sizes[i] = it->second.size;
+    addr += it->second.size;
+  }
+
+  // Then the persistent cache, where the code wasn't patched
+  while (i < nins && _disk_cache) {
+    DiskCache::CodeIns ins;
+    if (!_disk_cache->get_code_ins(addr, ins) ||
+        !_disk_code_valid(addr, ins.size, ins.hash))
+      break;
+    _code_map[addr] = CodeIns{std::string(ins.text), ins.size};
+    _code_max_size = std::max(_code_max_size, ins.size);
+    out_text[i] = ins.text;
+    out_sizes[i] = ins.size;
+    addr += ins.size;
+    ++i;
+  }
+  return i;
+}
+
+bool DBClient::_cached_code_before(vm_ptr_t addr, vm_ptr_t &out_start) {
+  auto first = addr < _code_max_size ? 0 : addr - _code_max_size;
+  for (auto it = _code_map.lower_bound(first);
+       it != _code_map.end() && it->first < addr; ++it)
+    if (it->first + it->second.size == addr) {
+      out_start = it->first;
+      return true;
+    }
+
+  DiskCache::CodeIns ins;
+  if (!_disk_cache || !_disk_cache->get_code_ins_before(addr, ins) ||
+      !_disk_code_valid(ins.addr, ins.size, ins.hash))
+    return false;
+  _code_map[ins.addr] = CodeIns{std::string(ins.text), ins.size};
+  _code_max_size = std::max(_code_max_size, ins.size);
+  out_start = ins.addr;
+  return true;
+}
+
+void DBClient::_cache_code_annotated(const CodeAnnotated &code) {
+  for (std::size_t i = 0; i < code.size(); ++i) {
+    _code_map[code.addrs[i]] = CodeIns{code.text[i], code.sizes[i]};
+    _code_max_size = std::max(_code_max_size, code.sizes[i]);
+  }
+  for (const auto &s : code.syms)
+    _add_sym(s);
+
+  auto mem_size = _vm_infos.memory_size;
+  if (code.size() && code.addrs.front() < mem_size)
+    _syms_ranges->set(code.addrs.front(),
+                      std::min(code.addrs.back(), mem_size - 1), 1);
+}
+
+bool DBClient::_load_syms_table() {
+  if (_syms_table)
+    return true;
+  if (_syms_table_tried || _vm_infos.symbols_count > SYMS_TABLE_MAX_SIZE)
+    return false;
+
+  auto table = std::make_unique<SymbolsTable>();
+  if (_disk_cache && !_syms_table_stale &&
+      _disk_cache->get_symbols_table(*table))
+    ++_stats.syms.hits;
+  else if (!_impl->has_cap(PROTO_CAP_SYMS_TABLE)) {
+    _syms_table_tried = true;
+    return false;
+  } else {
+    // Errors are thrown, and the next lookup tries again
+    _req().get_symbols_table(*table);
+    ++_stats.syms.misses;
+  }
+  _syms_table_tried = true;
+  if (table->names_offs.empty())
+    table->names_offs.push_back(0);
+  if (table->addrs.size() != table->size() ||
+      table->names_offs.size() != table->size() + 1 ||
+      table->names_offs.back() != table->names.size())
+    return false;
+
+  _syms_table = std::move(table);
+  for (std::size_t i = 0; i < _syms_table->size(); ++i) {
+    _syms_table_ids.emplace(_syms_table->ids[i], i);
+    _syms_table_names.emplace(_syms_table->name(i), i);
+  }
+  return true;
+}
+
+void DBClient::_drop_syms_table(bool stale) {
+  _syms_table_tried = false;
+  _syms_table_stale = stale;
+  _syms_table.reset();
+  _syms_table_ids.clear();
+  _syms_table_names.clear();
+}
+
+SymbolInfos DBClient::_syms_table_infos(std::size_t i) const {
+  SymbolInfos res;
+  res.idx = _syms_table->ids[i];
+  res.name = _syms_table->name(i);
+  res.addr = _syms_table->addrs[i];
+  return res;
+}
+
+bool DBClient::_mem_was_written(vm_ptr_t addr, vm_size_t size) const {
+  auto mem_size = _vm_infos.memory_size;
+  if (!_mem_written || !size || addr >= mem_size)
+    return false;
+  vm_ptr_t end = size > mem_size - addr ? mem_size - 1 : addr + size - 1;
+  auto range = _mem_written->range_of(addr);
+  return range.val || range.high < end;
+}
+
+void DBClient::_open_disk_cache() {
+  _disk_cache.reset();
+  if (!_disk_cache_dir.empty() && _vm_infos.program_hash)
+    _disk_cache =
+        std::make_unique<DiskCache>(_disk_cache_dir, _vm_infos.program_hash);
+}
+
+bool DBClient::_disk_code_valid(vm_ptr_t addr, vm_size_t size,
+                                std::uint64_t hash) {
+  if (_mem_was_written(addr, size))
+    return false;
+  if (!_vm_infos.use_opcode)
+    return true;
+
+  std::vector<char> bytes(size);
+  auto buf = bytes.data();
+  try {
+    read_mem(&addr, &size, &buf, 1);
+  } catch (VMApi::Error &) {
+    return false;
+  }
+  return code_hash(bytes.data(), bytes.size()) == hash;
+}
+
+void DBClient::_add_sym(const SymbolInfos &infos) {
+  // Loaded by the VM after the table was fetched
+  if (_syms_table && _syms_table_ids.find(infos.idx) == _syms_table_ids.end())
+    _drop_syms_table(true);
+  _syms_map[infos.idx] = infos;
+  _syms_name_map[infos.name] = infos.idx;
+  _syms_pos[infos.addr] = infos.idx;
+}
+
+void DBClient::_queue_mem_write(vm_ptr_t addr, vm_size_t size,
+                                const char *data) {
+  if (!size)
+    return;
+  auto beg = addr;
+  auto end = addr + size;
+
+  // Merge with all pending writes overlapping or touching [beg, end]
+  auto it = _pending_mem.lower_bound(beg);
+  if (it != _pending_mem.begin() &&
+      std::prev(it)->first + std::prev(it)->second.size() >= beg)
+    --it;
+  auto first = it;
+  for (; it != _pending_mem.end() && it->first <= end; ++it) {
+    beg = std::min(beg, it->first);
+    end = std::max(end, vm_ptr_t(it->first + it->second.size()));
+  }
+
+  std::vector<char> merged(end - beg);
+  for (auto m = first; m != it; ++m)
+    std::copy(m->second.begin(), m->second.end(), &merged[m->first - beg]);
+  std::copy_n(data, size, &merged[addr - beg]);
+
+  _pending_mem.erase(first, it);
+  _pending_mem.emplace(beg, std::move(merged));
+}
+
+void DBClient::_flush_overlap(vm_ptr_t addr, vm_size_t size) {
+  if (_pending_mem.empty() || !size)
+    return;
+  auto it = _pending_mem.lower_bound(addr + size);
+  if (it == _pending_mem.begin())
+    return;
+  --it;
+  if (it->first + it->second.size() > addr)
+    flush();
+}
+
 } // namespace odb
@@ -0,0 +1,248 @@
+#include "odb/mess/disk-cache.hh"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "odb/mess/db-client.hh"
+#include "odb/server/vm-api.hh"
+
+namespace odb {
+
+namespace {
+
+constexpr std::uint64_t MAGIC = 0x454843414342444F; // "ODBCACHE"
+constexpr std::uint64_t FLAG_SYMS = 1;
+
+enum HeaderField {
+  H_MAGIC,
+  H_VERSION,
+  H_HASH,
+  H_FLAGS,
+  H_NSYMS,
+  H_NAMES_SIZE,
+  H_NCODE,
+  H_TEXT_SIZE,
+  HEADER_WORDS,
+};
+
+// Number of words needed for a string pool of `size` bytes
+std::uint64_t pool_words(std::uint64_t size) { return (size + 7) / 8; }
+
+void write_words(std::ofstream &os, const std::uint64_t *data,
+                 std::size_t size) {
+  os.write(reinterpret_cast<const char *>(data), size * 8);
+}
+
+void write_pool(std::ofstream &os, const char *data, std::size_t size) {
+  static const char zeros[8] = {0};
+  os.write(data, size);
+  os.write(zeros, pool_words(size) * 8 - size);
+}
+
+} // namespace
+
+DiskCache::DiskCache(const std::string &dir, std::uint64_t program_hash)
+    : _hash(program_hash), _data(nullptr), _size(0) {
+  std::ostringstream os;
+  os << dir << "/" << std::hex << program_hash << ".odbc";
+  _path = os.str();
+  _map();
+}
+
+DiskCache::~DiskCache() { _unmap(); }
+
+bool DiskCache::get_symbols_table(SymbolsTable &out_table) const {
+  if (!_data || !(_header()[H_FLAGS] & FLAG_SYMS))
+    return false;
+
+  auto nsyms = _header()[H_NSYMS];
+  auto names_size = _header()[H_NAMES_SIZE];
+  auto addrs = _header() + HEADER_WORDS;
+  auto ids = addrs + nsyms;
+  auto offs = ids + nsyms;
+  auto names = reinterpret_cast<const char *>(offs + nsyms + 1);
+  for (std::size_t i = 0; i < nsyms; ++i)
+    if (offs[i] > offs[i + 1])
+      return false;
+
+  out_table.addrs.assign(addrs, addrs + nsyms);
+  out_table.ids.assign(ids, ids + nsyms);
+  out_table.names_offs.assign(offs, offs + nsyms + 1);
+  out_table.names.assign(names, names + names_size);
+  return true;
+}
+
+bool DiskCache::get_code_ins(vm_ptr_t addr, CodeIns &out_ins) const {
+  if (!_data)
+    return false;
+
+  auto ncode = _header()[H_NCODE];
+  auto addrs = _code_arrays();
+  auto sizes = addrs + ncode;
+  auto hashes = sizes + ncode;
+  auto offs = hashes + ncode;
+  auto it = std::lower_bound(addrs, addrs + ncode, addr);
+  if (it == addrs + ncode || *it != addr)
+    return false;
+
+  auto i = it - addrs;
+  if (offs[i] > offs[i + 1] || offs[i + 1] > _header()[H_TEXT_SIZE])
+    return false;
+  out_ins.addr = addr;
+  out_ins.text =
+      std::string_view(_code_text() + offs[i], offs[i + 1] - offs[i]);
+  out_ins.size = sizes[i];
+  out_ins.hash = hashes[i];
+  return true;
+}
+
+bool DiskCache::get_code_ins_before(vm_ptr_t addr, CodeIns &out_ins) const {
+  if (!_data)
+    return false;
+
+  auto ncode = _header()[H_NCODE];
+  auto addrs = _code_arrays();
+  auto it = std::lower_bound(addrs, addrs + ncode, addr);
+  if (it == addrs)
+    return false;
+  return get_code_ins(*(it - 1), out_ins) &&
+         out_ins.addr + out_ins.size == addr;
+}
+
+void DiskCache::save(const SymbolsTable *syms,
+                     const std::vector<CodeIns> &code) {
+  SymbolsTable old_syms;
+  if (!syms && get_symbols_table(old_syms))
+    syms = &old_syms;
+
+  // Merge with the instructions of the file, the new ones win
+  std::vector<CodeIns> all_code;
+  std::size_t old_ncode = _data ? _header()[H_NCODE] : 0;
+  auto old_addrs = _data ? _code_arrays() : nullptr;
+  auto it = code.begin();
+  for (std::size_t i = 0; i < old_ncode; ++i) {
+    CodeIns ins;
+    if (!get_code_ins(old_addrs[i], ins))
+      continue;
+    while (it != code.end() && it->addr < ins.addr)
+      all_code.push_back(*it++);
+    if (it == code.end() || it->addr != ins.addr)
+      all_code.push_back(ins);
+  }
+  all_code.insert(all_code.end(), it, code.end());
+
+  std::uint64_t header[HEADER_WORDS] = {};
+  header[H_MAGIC] = MAGIC;
+  header[H_VERSION] = VERSION;
+  header[H_HASH] = _hash;
+  header[H_FLAGS] = syms ? FLAG_SYMS : 0;
+  header[H_NSYMS] = syms ? syms->size() : 0;
+  header[H_NAMES_SIZE] = syms ? syms->names.size() : 0;
+  header[H_NCODE] = all_code.size();
+
+  std::vector<std::uint64_t> code_arrays(4 * all_code.size() + 1);
+  std::string text;
+  for (std::size_t i = 0; i < all_code.size(); ++i) {
+    code_arrays[i] = all_code[i].addr;
+    code_arrays[all_code.size() + i] = all_code[i].size;
+    code_arrays[2 * all_code.size() + i] = all_code[i].hash;
+    code_arrays[3 * all_code.size() + i] = text.size();
+    text.append(all_code[i].text.data(), all_code[i].text.size());
+  }
+  code_arrays.back() = text.size();
+  header[H_TEXT_SIZE] = text.size();
+
+  auto tmp_path = _path + ".tmp";
+  std::ofstream os(tmp_path, std::ios::binary | std::ios::trunc);
+  write_words(os, header, HEADER_WORDS);
+  if (syms) {
+    std::vector<std::uint64_t> ids(syms->ids.begin(), syms->ids.end());
+    write_words(os, syms->addrs.data(), syms->size());
+    write_words(os, ids.data(), ids.size());
+    std::vector<std::uint64_t> offs(syms->names_offs.begin(),
+                                    syms->names_offs.end());
+    offs.resize(syms->size() + 1, syms->names.size());
+    write_words(os, offs.data(), offs.size());
+    write_pool(os, syms->names.data(), syms->names.size());
+  }
+  write_words(os, code_arrays.data(), code_arrays.size());
+  write_pool(os, text.data(), text.size());
+  os.close();
+  if (!os || std::rename(tmp_path.c_str(), _path.c_str()) != 0) {
+    std::remove(tmp_path.c_str());
+    throw VMApi::Error("Failed to write cache file " + _path);
+  }
+
+  _unmap();
+  _map();
+}
+
+const std::uint64_t *DiskCache::_header() const {
+  return reinterpret_cast<const std::uint64_t *>(_data);
+}
+
+const std::uint64_t *DiskCache::_code_arrays() const {
+  auto h = _header();
+  auto res = h + HEADER_WORDS;
+  if (h[H_FLAGS] & FLAG_SYMS)
+    res += 3 * h[H_NSYMS] + 1 + pool_words(h[H_NAMES_SIZE]);
+  return res;
+}
+
+const char *DiskCache::_code_text() const {
+  return reinterpret_cast<const char *>(_code_arrays() +
+                                        4 * _header()[H_NCODE] + 1);
+}
+
+void DiskCache::_map() {
+  int fd = ::open(_path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return;
+  struct stat st;
+  void *data = MAP_FAILED;
+  if (::fstat(fd, &st) == 0 && std::size_t(st.st_size) >= HEADER_WORDS * 8)
+    data = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (data == MAP_FAILED)
+    return;
+  _data = static_cast<const char *>(data);
+  _size = st.st_size;
+
+  // Check the header, and that all arrays fit exactly in the file
+  auto h = _header();
+  auto words = _size / 8;
+  bool valid = _size % 8 == 0 && h[H_MAGIC] == MAGIC &&
+               h[H_VERSION] == VERSION && h[H_HASH] == _hash &&
+               h[H_NSYMS] < words && h[H_NAMES_SIZE] < _size &&
+               h[H_NCODE] < words && h[H_TEXT_SIZE] < _size;
+  if (valid) {
+    std::uint64_t expected = HEADER_WORDS + 4 * h[H_NCODE] + 1 +
+                             pool_words(h[H_TEXT_SIZE]);
+    if (h[H_FLAGS] & FLAG_SYMS)
+      expected += 3 * h[H_NSYMS] + 1 + pool_words(h[H_NAMES_SIZE]);
+    valid = expected == words;
+  }
+  if (valid && (h[H_FLAGS] & FLAG_SYMS))
+    valid = h[HEADER_WORDS + 3 * h[H_NSYMS]] == h[H_NAMES_SIZE];
+  if (valid)
+    valid = _code_arrays()[4 * h[H_NCODE]] == h[H_TEXT_SIZE];
+  if (!valid)
+    _unmap();
+}
+
+void DiskCache::_unmap() {
+  if (_data)
+    ::munmap(const_cast<char *>(_data), _size);
+  _data = nullptr;
+  _size = 0;
+}
+
+} // namespace odb
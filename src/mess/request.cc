@@ -19,6 +19,22 @@
     x = sb_unserial_raw<Ty>(is);                                               \
   }
 
+// Unsigned integers are written as varints with the compact format
+#define COMPACT_SERIAL(Ty)                                                     \
+  template <> void sb_serialize(SerialOutBuff &os, const Ty &x) {              \
+    if (os.compact())                                                          \
+      sb_serial_varint(os, x);                                                 \
+    else                                                                       \
+      sb_serial_raw<Ty>(os, x);                                                \
+  }                                                                            \
+                                                                               \
+  template <> void sb_unserialize(SerialInBuff &is, Ty &x) {                   \
+    if (is.compact())                                                          \
+      x = static_cast<Ty>(sb_unserial_varint(is));                             \
+    else                                                                       \
+      x = sb_unserial_raw<Ty>(is);                                             \
+  }
+
 #if 0
 template <class T>
 std::enable_if_t<std::is_integral_v<T>> sb_serialize(SerialOutBuff &os,
@@ -34,133 +50,222 @@ std::enable_if_t<std::is_integral_v<T>> sb_unserialize(SerialInBuff &is, T &x) {
 
 namespace odb {
 
-template <> void prepare_request(RequestHandler &h, ReqConnect &r) {
+const char *req_name(ReqType ty) {
+  constexpr const char *names[] = {
+#define ODB_REQ_NAME(Ty, Req) #Ty,
+      ODB_REQUESTS(ODB_REQ_NAME)
+#undef ODB_REQ_NAME
+  };
+  auto idx = static_cast<std::size_t>(ty);
+  if (idx < REQ_COUNT)
+    return names[idx];
+  if (ty == ReqType::ERR)
+    return "ERR";
+  if (ty == ReqType::FAST)
+    return "FAST";
+  return "?";
+}
+
+template <class Handler> void prepare_request(Handler &h, ReqConnect &r) {
+  h.object_in_opt(r.in_version, PROTO_VERSION_1);
+  h.object_in_opt(r.in_caps, std::uint32_t(0));
+  h.object_in_opt(r.in_prefetch, PrefetchProfile{});
   h.object_out(r.out_infos);
   h.object_out(r.out_udp);
+
+  // Only answered to clients that sent their version
+  if (r.in_version >= PROTO_VERSION_2) {
+    h.object_out_opt(r.out_version, PROTO_VERSION_1);
+    h.object_out_opt(r.out_caps, std::uint32_t(0));
+    if (r.out_caps & PROTO_CAP_PROGRAM_HASH)
+      h.object_out_opt(r.out_infos.program_hash, std::uint64_t(0));
+    if (!r.in_prefetch.empty())
+      h.object_out_opt(r.out_udp.prefetch, StopPrefetch{});
+  }
 }
 
-template <> void prepare_request(RequestHandler &, ReqStop &) {}
+template <class Handler> void prepare_request(Handler &, ReqStop &) {}
 
-template <> void prepare_request(RequestHandler &h, ReqCheckStopped &r) {
+template <class Handler> void prepare_request(Handler &h, ReqCheckStopped &r) {
+  h.object_in_opt(r.in_prefetch, std::uint8_t(0));
+  h.object_in_opt(r.in_stack_delta, std::uint8_t(0));
   h.object_out(r.out_udp);
+  if (r.in_prefetch)
+    h.object_out_opt(r.out_udp.prefetch, StopPrefetch{});
+  if (r.in_stack_delta) {
+    h.object_out_opt(r.out_udp.stack_keep, std::uint64_t(0));
+    h.object_out_opt(r.out_udp.stack_depth, std::uint64_t(0));
+  }
 }
 
-template <> void prepare_request(RequestHandler &h, ReqGetRegs &r) {
+template <class Handler> void prepare_request(Handler &h, ReqGetRegs &r) {
   h.object_in(r.nregs);
   h.object_in(r.reg_size);
   h.buffer_in(r.ids, r.nregs);
   h.buffer_2d_out(r.out_bufs, r.nregs, r.reg_size);
 }
 
-template <> void prepare_request(RequestHandler &h, ReqGetRegsVar &r) {
+template <class Handler> void prepare_request(Handler &h, ReqGetRegsVar &r) {
   h.object_in(r.nregs);
   h.buffer_in(r.in_ids, r.nregs);
   h.buffer_in(r.in_regs_size, r.nregs);
   h.buffer_2dvar_out(r.out_bufs, r.nregs, r.in_regs_size);
 }
 
-template <> void prepare_request(RequestHandler &h, ReqSetRegs &r) {
+template <class Handler> void prepare_request(Handler &h, ReqSetRegs &r) {
   h.object_in(r.nregs);
   h.object_in(r.reg_size);
   h.buffer_in(r.in_ids, r.nregs);
   h.buffer_2d_in(r.in_bufs, r.nregs, r.reg_size);
 }
 
-template <> void prepare_request(RequestHandler &h, ReqSetRegsVar &r) {
+template <class Handler> void prepare_request(Handler &h, ReqSetRegsVar &r) {
   h.object_in(r.nregs);
   h.buffer_in(r.in_ids, r.nregs);
   h.buffer_in(r.in_regs_size, r.nregs);
   h.buffer_2dvar_in(r.in_bufs, r.nregs, r.in_regs_size);
 }
 
-template <> void prepare_request(RequestHandler &h, ReqGetRegsInfos &r) {
+template <class Handler> void prepare_request(Handler &h, ReqGetRegsInfos &r) {
   h.object_in(r.nregs);
   h.buffer_in(r.ids, r.nregs);
   h.buffer_out(r.out_infos, r.nregs);
 }
 
-template <> void prepare_request(RequestHandler &h, ReqFindRegsIds &r) {
+template <class Handler> void prepare_request(Handler &h, ReqFindRegsIds &r) {
   h.object_in(r.nregs);
   h.buffer_2d_in_cstr(r.in_bufs, r.nregs);
   h.buffer_out(r.out_ids, r.nregs);
 }
 
-template <> void prepare_request(RequestHandler &h, ReqReadMem &r) {
+template <class Handler> void prepare_request(Handler &h, ReqReadMem &r) {
   h.object_in(r.nbufs);
   h.object_in(r.buf_size);
   h.buffer_in(r.in_addrs, r.nbufs);
   h.buffer_2d_out(r.out_bufs, r.nbufs, r.buf_size);
 }
 
-template <> void prepare_request(RequestHandler &h, ReqReadMemVar &r) {
+template <class Handler> void prepare_request(Handler &h, ReqReadMemVar &r) {
   h.object_in(r.nbufs);
   h.buffer_in(r.in_addrs, r.nbufs);
   h.buffer_in(r.in_bufs_size, r.nbufs);
   h.buffer_2dvar_out(r.out_bufs, r.nbufs, r.in_bufs_size);
 }
 
-template <> void prepare_request(RequestHandler &h, ReqWriteMem &r) {
+template <class Handler> void prepare_request(Handler &h, ReqWriteMem &r) {
   h.object_in(r.nbufs);
   h.object_in(r.buf_size);
   h.buffer_in(r.in_addrs, r.nbufs);
   h.buffer_2d_in(r.in_bufs, r.nbufs, r.buf_size);
 }
 
-template <> void prepare_request(RequestHandler &h, ReqWriteMemVar &r) {
+template <class Handler> void prepare_request(Handler &h, ReqWriteMemVar &r) {
   h.object_in(r.nbufs);
   h.buffer_in(r.in_addrs, r.nbufs);
   h.buffer_in(r.in_bufs_size, r.nbufs);
   h.buffer_2dvar_in(r.in_bufs, r.nbufs, r.in_bufs_size);
 }
 
-template <> void prepare_request(RequestHandler &h, ReqGetSymsByIds &r) {
+template <class Handler> void prepare_request(Handler &h, ReqGetSymsByIds &r) {
   h.object_in(r.nsyms);
   h.buffer_in(r.in_ids, r.nsyms);
   h.buffer_out(r.out_infos, r.nsyms);
 }
 
-template <> void prepare_request(RequestHandler &h, ReqGetSymsByAddr &r) {
+template <class Handler> void prepare_request(Handler &h, ReqGetSymsByAddr &r) {
   h.object_in(r.addr);
   h.object_in(r.size);
   h.object_out(r.out_infos);
 }
 
-template <> void prepare_request(RequestHandler &h, ReqGetSymsByNames &r) {
+template <class Handler> void prepare_request(Handler &h, ReqGetSymsByNames &r) {
   h.object_in(r.nsyms);
   h.buffer_2d_in_cstr(r.in_names, r.nsyms);
   h.buffer_out(r.out_infos, r.nsyms);
 }
 
-template <> void prepare_request(RequestHandler &h, ReqGetCodeText &r) {
+template <class Handler> void prepare_request(Handler &h, ReqGetCodeText &r) {
   h.object_in(r.addr);
   h.object_in(r.nins);
   h.object_out(r.out_text);
   h.object_out(r.out_sizes);
 }
 
-template <> void prepare_request(RequestHandler &h, ReqAddBkps &r) {
+template <class Handler> void prepare_request(Handler &h, ReqAddBkps &r) {
   h.object_in(r.size);
   h.buffer_in(r.in_addrs, r.size);
 }
 
-template <> void prepare_request(RequestHandler &h, ReqDelBkps &r) {
+template <class Handler> void prepare_request(Handler &h, ReqDelBkps &r) {
   h.object_in(r.size);
   h.buffer_in(r.in_addrs, r.size);
 }
 
-template <> void prepare_request(RequestHandler &h, ReqResume &r) {
+template <class Handler> void prepare_request(Handler &h, ReqResume &r) {
   h.object_in(r.type);
 }
 
-template <> void prepare_request(RequestHandler &h, ReqErr &r) {
+template <class Handler> void prepare_request(Handler &h, ReqReadMemDiff &r) {
+  h.object_in(r.addr);
+  h.object_in(r.size);
+  h.object_in(r.in_version);
+  h.object_out(r.out_version);
+  h.object_out(r.out_pages);
+  h.object_out(r.out_data);
+}
+
+template <class Handler> void prepare_request(Handler &h, ReqSetPrefetch &r) {
+  h.object_in(r.in_profile);
+}
+
+template <class Handler> void prepare_request(Handler &h, ReqGetSymsTable &r) {
+  h.object_out(r.out_table);
+}
+
+template <class Handler>
+void prepare_request(Handler &h, ReqGetCodeAnnotated &r) {
+  h.object_in(r.addr);
+  h.object_in(r.nins);
+  h.object_out(r.out_code);
+}
+
+template <class Handler> void prepare_request(Handler &h, ReqGetCodeAround &r) {
+  h.object_in(r.addr);
+  h.object_in(r.nbefore);
+  h.object_in(r.nafter);
+  h.object_out(r.out_code);
+}
+
+template <class Handler> void prepare_request(Handler &h, ReqGetStackSyms &r) {
+  h.object_out(r.out_stack);
+  h.object_out(r.out_frames_syms);
+  h.object_out(r.out_syms);
+}
+
+template <class Handler>
+void prepare_request(Handler &h, ReqGetStackFrames &r) {
+  h.object_in(r.beg);
+  h.object_in(r.end);
+  h.object_out(r.out_frames);
+}
+
+template <class Handler> void prepare_request(Handler &h, ReqGetStats &r) {
+  h.object_out(r.out_stats);
+}
+
+template <class Handler> void prepare_request(Handler &h, ReqGetBkps &r) {
+  h.object_out(r.out_addrs);
+}
+
+template <class Handler> void prepare_request(Handler &h, ReqErr &r) {
   h.object_out(r.msg);
 }
 
 RAW_SERIAL(char)
 RAW_SERIAL(std::uint8_t)
-RAW_SERIAL(std::uint16_t)
-RAW_SERIAL(std::uint32_t)
-RAW_SERIAL(std::uint64_t)
+COMPACT_SERIAL(std::uint16_t)
+COMPACT_SERIAL(std::uint32_t)
+COMPACT_SERIAL(std::uint64_t)
 RAW_SERIAL(std::int8_t)
 RAW_SERIAL(std::int16_t)
 RAW_SERIAL(std::int32_t)
@@ -175,27 +280,81 @@ template <> void sb_unserialize(SerialInBuff &is, ReqType &ty) {
 }
 
 template <> void sb_serialize(SerialOutBuff &os, const std::string &s) {
-  sb_serial_raw<std::uint64_t>(os, s.size());
+  sb_serial_size(os, s.size());
   os.write(s.c_str(), s.size());
 }
 
 template <> void sb_unserialize(SerialInBuff &is, std::string &s) {
-  auto size = sb_unserial_raw<std::uint64_t>(is);
+  auto size = sb_unserial_size(is);
   s.resize(size);
   is.read(&s[0], size);
 }
 
 template <class T>
 void sb_serialize(SerialOutBuff &os, const std::vector<T> &v) {
-  sb_serial_raw<std::uint64_t>(os, v.size());
+  sb_serial_size(os, v.size());
+
+  // Raw bytes are copied at once
+  if constexpr (std::is_same_v<T, char>) {
+    os.write(v.data(), v.size());
+    return;
+  }
+
+  // Compact format: addresses / sizes arrays are delta-encoded
+  if constexpr (std::is_same_v<T, std::uint64_t>) {
+    if (os.compact()) {
+      SerialDeltaOut delta;
+      for (auto x : v)
+        delta.write(os, x);
+      return;
+    }
+  }
+  if constexpr (std::is_same_v<T, CallInfos>) {
+    if (os.compact()) {
+      SerialDeltaOut delta_start;
+      SerialDeltaOut delta_call;
+      for (const auto &ci : v) {
+        delta_start.write(os, ci.caller_start_addr);
+        delta_call.write(os, ci.call_addr);
+      }
+      return;
+    }
+  }
+
   for (std::size_t i = 0; i < v.size(); ++i)
     os << v[i];
 }
 
 // @extra doesn't work if T have no default constructor
 template <class T> void sb_unserialize(SerialInBuff &is, std::vector<T> &v) {
-  auto size = sb_unserial_raw<std::uint64_t>(is);
+  auto size = sb_unserial_size(is);
   v.resize(size);
+
+  if constexpr (std::is_same_v<T, char>) {
+    is.read(v.data(), v.size());
+    return;
+  }
+
+  if constexpr (std::is_same_v<T, std::uint64_t>) {
+    if (is.compact()) {
+      SerialDeltaIn delta;
+      for (auto &x : v)
+        x = delta.read(is);
+      return;
+    }
+  }
+  if constexpr (std::is_same_v<T, CallInfos>) {
+    if (is.compact()) {
+      SerialDeltaIn delta_start;
+      SerialDeltaIn delta_call;
+      for (auto &ci : v) {
+        ci.caller_start_addr = delta_start.read(is);
+        ci.call_addr = delta_call.read(is);
+      }
+      return;
+    }
+  }
+
   for (std::size_t i = 0; i < v.size(); ++i)
     is >> v[i];
 }
@@ -272,6 +431,101 @@ template <> void sb_unserialize(SerialInBuff &is, SymbolInfos &sym) {
   is >> sym.idx >> sym.name >> sym.addr;
 }
 
+template <>
+void sb_serialize(SerialOutBuff &os, const PrefetchProfile::MemWindow &w) {
+  os << w.base_reg << w.offset << w.size;
+}
+
+template <>
+void sb_unserialize(SerialInBuff &is, PrefetchProfile::MemWindow &w) {
+  is >> w.base_reg >> w.offset >> w.size;
+}
+
+template <> void sb_serialize(SerialOutBuff &os, const PrefetchProfile &p) {
+  os << p.regs << p.mems << p.mem_align << p.code_before << p.code_nins;
+  sb_serial_raw<std::uint8_t>(os, p.stack_syms);
+}
+
+template <> void sb_unserialize(SerialInBuff &is, PrefetchProfile &p) {
+  is >> p.regs >> p.mems >> p.mem_align >> p.code_before >> p.code_nins;
+  p.stack_syms = sb_unserial_raw<std::uint8_t>(is);
+}
+
+template <> void sb_serialize(SerialOutBuff &os, const StopPrefetch &p) {
+  os << p.reg_ids << p.reg_vals << p.mem_addrs << p.mem_data << p.code_addr
+     << p.code_text << p.code_sizes << p.sym_addrs << p.sym_sizes << p.syms;
+}
+
+template <> void sb_unserialize(SerialInBuff &is, StopPrefetch &p) {
+  is >> p.reg_ids >> p.reg_vals >> p.mem_addrs >> p.mem_data >> p.code_addr >>
+      p.code_text >> p.code_sizes >> p.sym_addrs >> p.sym_sizes >> p.syms;
+}
+
+template <> void sb_serialize(SerialOutBuff &os, const SymbolsTable &t) {
+  os << t.addrs << t.ids << t.names_offs << t.names;
+}
+
+template <> void sb_unserialize(SerialInBuff &is, SymbolsTable &t) {
+  is >> t.addrs >> t.ids >> t.names_offs >> t.names;
+}
+
+template <> void sb_serialize(SerialOutBuff &os, const CodeAnnotated &c) {
+  os << c.addrs << c.sizes << c.text << c.refs_ins << c.refs_beg << c.refs_end
+     << c.refs_ids << c.syms;
+}
+
+template <> void sb_unserialize(SerialInBuff &is, CodeAnnotated &c) {
+  is >> c.addrs >> c.sizes >> c.text >> c.refs_ins >> c.refs_beg >>
+      c.refs_end >> c.refs_ids >> c.syms;
+}
+
+template <> void sb_serialize(SerialOutBuff &os, const Histogram &h) {
+  os << h.buckets << h.count << h.sum << h.max;
+}
+
+template <> void sb_unserialize(SerialInBuff &is, Histogram &h) {
+  is >> h.buckets >> h.count >> h.sum >> h.max;
+}
+
+template <>
+void sb_serialize(SerialOutBuff &os, const ServerStats::Request &r) {
+  os << r.count << r.errors << r.bytes_in << r.bytes_out << r.latency;
+}
+
+template <> void sb_unserialize(SerialInBuff &is, ServerStats::Request &r) {
+  is >> r.count >> r.errors >> r.bytes_in >> r.bytes_out >> r.latency;
+}
+
+template <>
+void sb_serialize(SerialOutBuff &os, const ServerStats::VMCall &c) {
+  os << c.time << c.sizes << c.errors;
+}
+
+template <> void sb_unserialize(SerialInBuff &is, ServerStats::VMCall &c) {
+  is >> c.time >> c.sizes >> c.errors;
+}
+
+template <> void sb_serialize(SerialOutBuff &os, const ServerStats &s) {
+  os << s.requests << s.loop_calls << s.loop_ns << s.vm_ns << s.stopped_ns
+     << s.vm_calls << s.vm_profile;
+  sb_serial_size(os, s.bkp_hits.size());
+  for (const auto &[addr, hits] : s.bkp_hits)
+    os << addr << hits;
+}
+
+template <> void sb_unserialize(SerialInBuff &is, ServerStats &s) {
+  is >> s.requests >> s.loop_calls >> s.loop_ns >> s.vm_ns >> s.stopped_ns >>
+      s.vm_calls >> s.vm_profile;
+  auto nbkps = sb_unserial_size(is);
+  s.bkp_hits.clear();
+  for (std::size_t i = 0; i < nbkps; ++i) {
+    vm_ptr_t addr;
+    std::uint64_t hits;
+    is >> addr >> hits;
+    s.bkp_hits.emplace(addr, hits);
+  }
+}
+
 template <> void sb_serialize(SerialOutBuff &os, const ResumeType &e) {
   sb_serial_raw(os, static_cast<std::int8_t>(e));
 }
@@ -280,4 +534,14 @@ template <> void sb_unserialize(SerialInBuff &is, ResumeType &e) {
   e = static_cast<ResumeType>(sb_unserial_raw<std::int8_t>(is));
 }
 
+// One instantiation per request and handler
+#define ODB_REQ_INSTANTIATE(Ty, Req)                                           \
+  template void prepare_request(HandlerCliRecv &, Req &);                      \
+  template void prepare_request(HandlerCliSend &, Req &);                      \
+  template void prepare_request(HandlerServRecv &, Req &);                     \
+  template void prepare_request(HandlerServSend &, Req &);
+ODB_REQUESTS(ODB_REQ_INSTANTIATE)
+ODB_REQ_INSTANTIATE(ERR, ReqErr)
+#undef ODB_REQ_INSTANTIATE
+
 } // namespace odb
@@ -0,0 +1,82 @@
+#include "odb/mess/server-stats.hh"
+
+#include <iomanip>
+#include <ostream>
+
+#include "odb/mess/request.hh"
+#include "odb/server/vm-api.hh"
+
+namespace odb {
+
+namespace {
+
+// Print a duration in ns with a readable unit
+struct Duration {
+  std::uint64_t ns;
+};
+
+std::ostream &operator<<(std::ostream &os, Duration d) {
+  if (d.ns < 10000)
+    return os << d.ns << "ns";
+  if (d.ns < 10000000)
+    return os << d.ns / 1000 << "us";
+  if (d.ns < 10000000000)
+    return os << d.ns / 1000000 << "ms";
+  return os << d.ns / 1000000000 << "s";
+}
+
+} // namespace
+
+ServerStats::Request &ServerStats::request(ReqType ty) {
+  auto idx = ty == ReqType::FAST ? REQ_COUNT : static_cast<std::size_t>(ty);
+  if (requests.size() <= REQ_COUNT)
+    requests.resize(REQ_COUNT + 1);
+  return requests[idx];
+}
+
+void ServerStats::dump(std::ostream &os) const {
+  os << "Requests:\n";
+  for (std::size_t i = 0; i < requests.size(); ++i) {
+    const auto &r = requests[i];
+    if (!r.count)
+      continue;
+    auto ty = i == REQ_COUNT ? ReqType::FAST : static_cast<ReqType>(i);
+    os << "  " << std::left << std::setw(20) << req_name(ty) << std::right
+       << " count: " << r.count << ", errors: " << r.errors
+       << ", in: " << r.bytes_in << "B, out: " << r.bytes_out
+       << "B, latency mean: " << Duration{r.latency.mean()}
+       << ", p50: " << Duration{r.latency.percentile(50)}
+       << ", p99: " << Duration{r.latency.percentile(99)}
+       << ", max: " << Duration{r.latency.max} << "\n";
+  }
+
+  os << "Loop: " << loop_calls << " calls, debugger: " << Duration{loop_ns}
+     << ", VM: " << Duration{vm_ns} << ", stopped: " << Duration{stopped_ns}
+     << "\n";
+
+  // Timings next to the counts, when the VM is instrumented
+  os << "VM calls:\n";
+  for (std::size_t i = 0; i < vm_calls.size() && i < VM_API_CALLS_COUNT; ++i) {
+    if (!vm_calls[i])
+      continue;
+    os << "  " << vm_api_call_name(static_cast<VMApiCall>(i)) << ": "
+       << vm_calls[i];
+    if (i < vm_profile.size() && vm_profile[i].time.count) {
+      const auto &c = vm_profile[i];
+      os << ", errors: " << c.errors << ", total: " << Duration{c.time.sum}
+         << ", mean: " << Duration{c.time.mean()}
+         << ", p99: " << Duration{c.time.percentile(99)}
+         << ", max: " << Duration{c.time.max};
+      if (c.sizes.count)
+        os << ", size mean: " << c.sizes.mean()
+           << ", p99: " << c.sizes.percentile(99) << ", max: " << c.sizes.max;
+    }
+    os << "\n";
+  }
+
+  os << "Breakpoints hits:\n";
+  for (const auto &[addr, hits] : bkp_hits)
+    os << "  0x" << std::hex << addr << std::dec << ": " << hits << "\n";
+}
+
+} // namespace odb
@@ -3,9 +3,11 @@
 #include <cassert>
 #include <cstddef>
 #include <cstdint>
+#include <fstream>
 #include <sstream>
 
 #include "odb/mess/db-client.hh"
+#include "odb/mess/server-stats.hh"
 #include "odb/server/vm-api.hh"
 
 namespace odb {
@@ -347,6 +349,8 @@ std::string SimpleCLIClient::exec(const std::string &cmd) {
       return _cmd_pmem();
     else if (name == "smem")
       return _cmd_smem();
+    else if (name == "dump")
+      return _cmd_dump();
     else if (name == "psym")
       return _cmd_psym();
     else if (name == "code")
@@ -369,6 +373,8 @@ std::string SimpleCLIClient::exec(const std::string &cmd) {
       return _cmd_bt();
     else if (name == "vm")
       return _cmd_vm();
+    else if (name == "stats")
+      return _cmd_stats();
     else
       throw VMApi::Error("Unknown command `" + name + "'");
 
@@ -546,6 +552,34 @@ std::string SimpleCLIClient::_cmd_smem() {
   return "";
 }
 
+std::string SimpleCLIClient::_cmd_dump() {
+  if (_cmd.size() != 4)
+    throw VMApi::Error("dump: missing arguments");
+
+  std::vector<ValueVariant> vals = {r_value(_cmd[1])};
+  resolve_vals(_env, vals);
+  if (vals[0].type != VALUE_IVAL || vals[0].ival < 0)
+    throw VMApi::Error("dump: invalid address `" + _cmd[1] + "'");
+  vm_ptr_t addr = vals[0].ival;
+  vm_size_t size = parse_int(_cmd[2], false);
+
+  std::ofstream ofs(_cmd[3], std::ios::binary);
+  if (!ofs.good())
+    throw VMApi::Error("dump: cannot open file `" + _cmd[3] + "'");
+
+  auto written = _env.read_mem_stream(
+      addr, size, [&ofs](vm_ptr_t, const char *data, vm_size_t len) {
+        ofs.write(data, len);
+        return ofs.good();
+      });
+  if (!ofs.good())
+    throw VMApi::Error("dump: failed to write file `" + _cmd[3] + "'");
+
+  std::ostringstream os;
+  os << written << " bytes written to " << _cmd[3];
+  return os.str();
+}
+
 std::string SimpleCLIClient::_cmd_psym() {
   if (_cmd.size() != 2)
     throw VMApi::Error("psym: missing arguments");
@@ -567,98 +601,41 @@ std::string SimpleCLIClient::_cmd_psym() {
 }
 
 std::string SimpleCLIClient::_cmd_code() {
-  // Get raw code
   vm_ptr_t act_addr = _env.get_execution_point();
-  vm_ptr_t addr = act_addr;
   std::size_t n = _cmd.size() < 2 ? 3 : parse_int(_cmd[1], false);
-  addr = addr < n ? 0 : addr - n;
-  std::size_t nins = 2 * n + 1;
-
-  std::vector<std::string> raw_code;
-  std::vector<vm_size_t> code_sizes;
-
-  _env.get_code_text(addr, nins, raw_code, code_sizes);
-  std::vector<vm_ptr_t> code_addrs;
-  vm_ptr_t next_addr = addr;
-  for (size_t i = 0; i < code_sizes.size(); ++i) {
-    code_addrs.push_back(next_addr);
-    next_addr += code_sizes[i];
-  }
-
-  // Load symbol definitions
-  std::vector<SymbolInfos> sym_defs;
-  _env.get_symbols_by_addr(
-      code_addrs.front(), code_addrs.back() - code_addrs.front() + 1, sym_defs);
-
-  // Find and load references
-  std::vector<vm_sym_t> refs;
-  std::vector<std::array<std::size_t, 3>> ref_pos;
-  for (std::size_t i = 0; i < raw_code.size(); ++i) {
-    const auto &l = raw_code[i];
-    std::size_t pos = 0;
-    while (pos < l.size()) {
-
-      pos = l.find('{', pos);
-      if (pos == std::string::npos)
-        break;
-      std::size_t beg_pos = pos;
-      ++pos;
-      if (l[pos] < '0' || l[pos] > '9')
-        continue;
-      vm_sym_t id = 0;
-      while (l[pos] >= '0' && l[pos] <= '9')
-        id = 10 * id + (l[pos++] - '0');
-      if (l[pos] != '}')
-        continue;
-
-      ++pos;
-      refs.push_back(id);
-      ref_pos.push_back({i, beg_pos, pos});
-    }
-  }
 
-  std::vector<SymbolInfos> syms_infos(refs.size());
-  _env.get_symbols_by_ids(&refs[0], &syms_infos[0], refs.size());
+  // Code, with symbol definitions and references
+  CodeAnnotated code;
+  _env.get_code_around(act_addr, n, n + 1, code);
 
   // Create string code
   std::ostringstream os;
-  std::size_t ref_i = 0;
   std::size_t def_i = 0;
   bool first = true;
-  for (std::size_t i = 0; i < raw_code.size(); ++i) {
-    const auto &l = raw_code[i];
-    std::size_t off = 0;
-
-    if (def_i < sym_defs.size() && sym_defs[def_i].addr == code_addrs[i]) {
+  for (std::size_t i = 0; i < code.size(); ++i) {
+    auto ins_addr = code.addrs[i];
+    while (def_i < code.syms.size() && code.syms[def_i].addr < ins_addr)
+      ++def_i;
+    if (def_i < code.syms.size() && code.syms[def_i].addr == ins_addr) {
       if (!first)
         os << "\n";
-      os << "     0x0" << std::hex << code_addrs[i] << " <"
-         << sym_defs[def_i].name << ">:\n";
+      os << "     0x0" << std::hex << ins_addr << " <" << code.syms[def_i].name
+         << ">:\n";
       ++def_i;
     }
 
-    if (l.empty())
+    if (code.text[i].empty())
       continue;
 
     first = false;
 
-    if (code_addrs[i] == act_addr)
+    if (ins_addr == act_addr)
       os << "  ->  ";
     else
       os << "      ";
 
-    os << "0x" << std::hex << code_addrs[i] << ":    ";
-
-    while (ref_i < refs.size() && ref_pos[ref_i][0] == i) {
-      os << l.substr(off, ref_pos[ref_i][1] - off);
-      os << syms_infos[ref_i].name;
-      off = ref_pos[ref_i][2];
-      ++ref_i;
-    }
-
-    if (off < l.size())
-      os << l.substr(off);
-    os << "\n";
+    os << "0x" << std::hex << ins_addr << ":    " << code.resolved_text(i)
+       << "\n";
   }
   return os.str();
 }
@@ -733,8 +710,8 @@ std::string SimpleCLIClient::_cmd_state() {
 
   os << "0x" << std::hex << pos;
 
-  auto cs = _env.get_call_stack();
-  auto sub_addr = cs.back().caller_start_addr;
+  auto depth = _env.get_call_stack_depth();
+  auto sub_addr = _env.get_call_frames(depth - 1, depth)->caller_start_addr;
   std::vector<SymbolInfos> syms;
   _env.get_symbols_by_addr(sub_addr, 1, syms);
   if (syms.size() != 0) {
@@ -747,31 +724,25 @@ std::string SimpleCLIClient::_cmd_state() {
 }
 
 std::string SimpleCLIClient::_cmd_bt() {
-  auto cs = _env.get_call_stack();
   auto curr = _env.get_execution_point();
 
-  // Read symbols
-  std::vector<SymbolInfos> syms(cs.size());
-  for (std::size_t i = 0; i < cs.size(); ++i) {
-    std::vector<SymbolInfos> sym;
-    auto addr = cs[i].caller_start_addr;
-    _env.get_symbols_by_addr(addr, 1, sym);
-    if (sym.empty())
-      syms[i].idx = VM_SYM_NULL;
-    else
-      syms[i] = sym.front();
-  }
+  // Also gets the missing frames from the server
+  std::vector<SymbolInfos> syms;
+  _env.get_call_stack_syms(syms);
+  const auto &cs = _env.get_call_stack();
 
   std::ostringstream os;
   for (std::size_t i = cs.size() - 1; i < cs.size(); --i) {
     auto pos = i + 1 == cs.size() ? curr : cs[i].call_addr;
     auto beg_pos = cs[i].caller_start_addr;
-    auto off = pos - beg_pos;
     os << "0x" << std::hex << pos << " (";
     if (syms[i].idx == VM_SYM_NULL)
       os << "0x" << std::hex << beg_pos;
-    else
+    else {
       os << "<" << syms[i].name << ">";
+      beg_pos = syms[i].addr;
+    }
+    auto off = pos - beg_pos;
     os << " + 0x" << std::hex << off << ")\n";
   }
 
@@ -791,4 +762,12 @@ std::string SimpleCLIClient::_cmd_vm() {
   return os.str();
 }
 
+std::string SimpleCLIClient::_cmd_stats() {
+  ServerStats stats;
+  _env.get_server_stats(stats);
+  std::ostringstream os;
+  stats.dump(os);
+  return os.str();
+}
+
 } // namespace odb
@@ -2,12 +2,18 @@
 
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
+#include "odb/mess/compress.hh"
 #include "odb/mess/serial.hh"
 
+#include <algorithm>
 #include <chrono>
+#include <climits>
+#include <cstring>
 #include <iostream>
+#include <vector>
 
 namespace odb {
 
@@ -15,6 +21,34 @@ namespace {
 
 using msg_size_t = std::uint32_t;
 
+// Set in the header when the content is compressed
+constexpr msg_size_t FRAME_COMPRESSED = msg_size_t(1) << 31;
+static_assert(TCP_FRAME_MAX_SIZE == FRAME_COMPRESSED,
+              "Frame sizes must not use the compressed bit");
+
+// Compress the content of `os` into `out`
+// Output format: uncompressed size (msg_size_t) + compressed data
+// @returns false if compression doesn't reduce the size
+bool compress_frame(const SerialOutBuff &os, std::vector<char> &out) {
+  // Compression needs contiguous input
+  static thread_local std::vector<char> in;
+  in.clear();
+  os.for_each_segment([](const SerialOutBuff::Segment &seg) {
+    in.insert(in.end(), seg.data, seg.data + seg.size);
+  });
+
+  static thread_local std::vector<char> lz;
+  lz_compress(in.data(), in.size(), lz);
+  if (lz.size() + sizeof(msg_size_t) >= in.size())
+    return false;
+
+  msg_size_t raw_size = in.size();
+  out.resize(sizeof(raw_size));
+  std::memcpy(out.data(), &raw_size, sizeof(raw_size));
+  out.insert(out.end(), lz.begin(), lz.end());
+  return true;
+}
+
 bool read_mult(char *out_buf, std::size_t len, int fd) {
   while (len) {
     ssize_t sread = read(fd, out_buf, len);
@@ -28,17 +62,36 @@ bool read_mult(char *out_buf, std::size_t len, int fd) {
   return len == 0;
 }
 
-bool write_mult(const char *in_buf, std::size_t len, int fd) {
-  while (len) {
-    ssize_t swrote = send(fd, in_buf, len, MSG_NOSIGNAL);
+// Write all buffers in `iov` with as few syscalls as possible
+// `iov` content is modified
+// Increments `nsyscalls` for every syscall
+bool write_vec(struct iovec *iov, std::size_t iovcnt, int fd,
+               std::size_t &nsyscalls) {
+  while (iovcnt) {
+    struct msghdr msg;
+    std::memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = std::min<std::size_t>(iovcnt, IOV_MAX);
+
+    ++nsyscalls;
+    ssize_t swrote = sendmsg(fd, &msg, MSG_NOSIGNAL);
     if (swrote <= 0)
-      break;
+      return false;
+
+    // Skip all fully written buffers, and move into the partially written one
     std::size_t uwrote = static_cast<std::size_t>(swrote);
-    len -= uwrote;
-    in_buf += uwrote;
+    while (iovcnt && uwrote >= iov->iov_len) {
+      uwrote -= iov->iov_len;
+      ++iov;
+      --iovcnt;
+    }
+    if (iovcnt) {
+      iov->iov_base = static_cast<char *>(iov->iov_base) + uwrote;
+      iov->iov_len -= uwrote;
+    }
   }
 
-  return len == 0;
+  return true;
 }
 
 } // namespace
@@ -50,11 +103,32 @@ bool send_data_tcp(const SerialOutBuff &os, int fd) {
   // std::cout << "<< send_data_tcp(" << os.get_size() << ")" << std::endl;
 #endif
 
-  const char *ptr = os.get_data();
+  // Header and all segments are sent at once
+  // The iovec array is reused between calls to avoid allocations
+  static thread_local std::vector<struct iovec> iov;
+  static thread_local std::vector<char> compressed;
+  // Would be truncated, or read as compressed
+  if (os.get_size() >= TCP_FRAME_MAX_SIZE)
+    return false;
   msg_size_t size = os.get_size();
-  auto res =
-      write_mult(reinterpret_cast<const char *>(&size), sizeof(size), fd) &&
-      write_mult(ptr, size, fd);
+  iov.clear();
+  iov.push_back({&size, sizeof(size)});
+
+  bool is_compressed = os.should_compress() && compress_frame(os, compressed);
+  if (is_compressed) {
+    size = compressed.size() | FRAME_COMPRESSED;
+    iov.push_back({compressed.data(), compressed.size()});
+  } else
+    os.for_each_segment([](const SerialOutBuff::Segment &seg) {
+      iov.push_back({const_cast<char *>(seg.data), seg.size});
+    });
+
+#ifdef ODB_COMM_LOGS
+  auto tc = std::chrono::high_resolution_clock::now();
+#endif
+
+  std::size_t nsyscalls = 0;
+  auto res = write_vec(iov.data(), iov.size(), fd, nsyscalls);
 
 #ifdef ODB_COMM_LOGS
   auto t2 = std::chrono::high_resolution_clock::now();
@@ -68,7 +142,16 @@ bool send_data_tcp(const SerialOutBuff &os, int fd) {
   auto diff = ms2 - ms1;
 
   std::cout << "send_data_tcp(" << os.get_size() << ") >>" << ms1 << ", " << ms2
-            << ", " << diff << std::endl;
+            << ", " << diff << " (syscalls: " << nsyscalls
+            << ", copied: " << os.get_copied_size() << ")" << std::endl;
+  if (is_compressed) {
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>(tc - t1)
+                  .count();
+    std::cout << "  compressed " << os.get_size() << " -> " << compressed.size()
+              << " bytes (ratio "
+              << double(os.get_size()) / double(compressed.size()) << ") in "
+              << us << "us" << std::endl;
+  }
 #endif
   return res;
 }
@@ -83,8 +166,42 @@ bool recv_data_tcp(SerialInBuff &is, int fd) {
   if (!read_mult(reinterpret_cast<char *>(&size), sizeof(size), fd))
     return false;
 
-  is.reset(size);
-  auto res = read_mult(is.get_data(), size, fd);
+  bool res;
+  bool is_compressed = size & FRAME_COMPRESSED;
+  size &= ~FRAME_COMPRESSED;
+  msg_size_t raw_size = size;
+
+  if (is_compressed) {
+    static thread_local std::vector<char> compressed;
+    compressed.resize(size);
+    res = size >= sizeof(raw_size) && read_mult(compressed.data(), size, fd);
+    if (!res)
+      return false;
+#ifdef ODB_COMM_LOGS
+    auto td = std::chrono::high_resolution_clock::now();
+#endif
+
+    // Checked before allocating, the peer may lie about the size
+    std::memcpy(&raw_size, compressed.data(), sizeof(raw_size));
+    if (raw_size >= TCP_FRAME_MAX_SIZE ||
+        raw_size > lz_decompress_bound(size - sizeof(raw_size)))
+      return false;
+    is.reset(raw_size);
+    res = lz_decompress(compressed.data() + sizeof(raw_size),
+                        size - sizeof(raw_size), is.get_data(), raw_size);
+
+#ifdef ODB_COMM_LOGS
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>(
+                  std::chrono::high_resolution_clock::now() - td)
+                  .count();
+    std::cout << "  decompressed " << size << " -> " << raw_size
+              << " bytes (ratio " << double(raw_size) / double(size) << ") in "
+              << us << "us" << std::endl;
+#endif
+  } else {
+    is.reset(size);
+    res = read_mult(is.get_data(), size, fd);
+  }
 
 #ifdef ODB_COMM_LOGS
   auto t2 = std::chrono::high_resolution_clock::now();
@@ -97,7 +214,7 @@ bool recv_data_tcp(SerialInBuff &is, int fd) {
 
   auto diff = ms2 - ms1;
 
-  std::cout << "recv_data_tcp(" << size << ") >>" << ms1 << ", " << ms2 << ", "
+  std::cout << "recv_data_tcp(" << raw_size << ") >>" << ms1 << ", " << ms2 << ", "
             << diff << std::endl;
 #endif
   return res;
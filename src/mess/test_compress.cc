@@ -0,0 +1,136 @@
+#include <catch2/catch.hpp>
+
+#include "odb/mess/compress.hh"
+#include "odb/mess/serial.hh"
+#include "odb/mess/tcp-transfer.hh"
+
+#include <cstdint>
+#include <cstring>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+std::uint32_t xs32_next(std::uint32_t x) {
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return x;
+}
+
+std::size_t check_roundtrip(const std::vector<char> &data) {
+  std::vector<char> lz;
+  auto size = odb::lz_compress(data.data(), data.size(), lz);
+  REQUIRE(size == lz.size());
+  REQUIRE(size <= odb::lz_compress_bound(data.size()));
+
+  std::vector<char> out(data.size());
+  REQUIRE(odb::lz_decompress(lz.data(), lz.size(), out.data(), out.size()));
+  REQUIRE(out == data);
+  return size;
+}
+
+std::vector<char> make_random(std::size_t size, std::uint32_t seed) {
+  std::vector<char> res(size);
+  for (auto &c : res) {
+    seed = xs32_next(seed);
+    c = static_cast<char>(seed);
+  }
+  return res;
+}
+
+} // namespace
+
+TEST_CASE("lz_small", "") {
+  check_roundtrip({});
+  check_roundtrip({'a'});
+  check_roundtrip({'a', 'a', 'a', 'a', 'a', 'a', 'a', 'a', 'a', 'a', 'a', 'a',
+                   'a', 'a', 'a', 'a', 'a', 'a', 'a', 'a'});
+  std::string s = "abcdabcdabcdabcdabcdabcdabcdabcd";
+  check_roundtrip(std::vector<char>(s.begin(), s.end()));
+}
+
+TEST_CASE("lz_zeros", "") {
+  std::vector<char> data(1 << 20, 0);
+  auto size = check_roundtrip(data);
+  REQUIRE(size < data.size() / 200);
+  REQUIRE(data.size() <= odb::lz_decompress_bound(size));
+}
+
+TEST_CASE("lz_random", "") {
+  for (std::uint32_t seed = 1; seed < 20; ++seed) {
+    auto data = make_random(seed * 997, seed);
+    auto size = check_roundtrip(data);
+    REQUIRE(size <= data.size() + data.size() / 255 + 16);
+  }
+}
+
+TEST_CASE("lz_mixed", "") {
+  // Mostly static data with a few changes, and some long literal runs
+  std::vector<char> data(300000, 0);
+  auto rnd = make_random(5000, 12);
+  std::memcpy(&data[1000], rnd.data(), rnd.size());
+  std::memcpy(&data[50000], rnd.data(), rnd.size());
+  for (std::size_t i = 200000; i < 250000; ++i)
+    data[i] = static_cast<char>(i % 7);
+  auto size = check_roundtrip(data);
+  REQUIRE(size < 7000);
+}
+
+TEST_CASE("lz_invalid", "") {
+  std::vector<char> data(10000, 'x');
+  std::vector<char> lz;
+  odb::lz_compress(data.data(), data.size(), lz);
+  std::vector<char> out(data.size());
+
+  // Wrong sizes
+  REQUIRE(!odb::lz_decompress(lz.data(), lz.size(), out.data(), 9999));
+  REQUIRE(!odb::lz_decompress(lz.data(), lz.size() - 1, out.data(), 10000));
+
+  // Match before the start of the output
+  char bad[] = {0x10, 'a', 0x05, 0x00};
+  REQUIRE(!odb::lz_decompress(bad, sizeof(bad), out.data(), 5));
+}
+
+TEST_CASE("tcp_transfer_compressed", "") {
+  int fds[2];
+  REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+
+  std::vector<char> data(1 << 16, 0);
+  for (std::size_t i = 0; i < data.size(); i += 100)
+    data[i] = static_cast<char>(i);
+  odb::SerialOutBuff os;
+  os.set_compress_min(odb::COMPRESS_MIN_SIZE);
+  odb::SerialInBuff is;
+
+  for (bool compressible : {true, false}) {
+    os.reset();
+    os.set_compressible(compressible);
+    odb::sb_serial_raw<std::uint32_t>(os, 42);
+    os.write_ref(data.data(), data.size());
+    REQUIRE(os.should_compress() == compressible);
+
+    bool sent = false;
+    std::thread th([&]() { sent = odb::send_data_tcp(os, fds[0]); });
+    REQUIRE(odb::recv_data_tcp(is, fds[1]));
+    th.join();
+    REQUIRE(sent);
+
+    REQUIRE(is.get_size() == data.size() + 4);
+    REQUIRE(odb::sb_unserial_raw<std::uint32_t>(is) == 42);
+    REQUIRE(std::memcmp(is.read_ref(data.size()), data.data(),
+                        data.size()) == 0);
+    is.check_eof();
+  }
+
+  // Too small to be compressed
+  os.reset();
+  os.set_compressible(true);
+  os.write(data.data(), 100);
+  REQUIRE(!os.should_compress());
+
+  close(fds[0]);
+  close(fds[1]);
+}
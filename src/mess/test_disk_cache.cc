@@ -0,0 +1,103 @@
+#include <catch2/catch.hpp>
+
+#include "odb/mess/db-client.hh"
+#include "odb/mess/disk-cache.hh"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+// Temporary directory, removed with its cache files
+struct TmpDir {
+  std::string path;
+  std::vector<std::string> files;
+
+  TmpDir() {
+    char tpl[] = "/tmp/odb_disk_cache_XXXXXX";
+    REQUIRE(mkdtemp(tpl));
+    path = tpl;
+  }
+
+  ~TmpDir() {
+    for (const auto &f : files)
+      std::remove(f.c_str());
+    rmdir(path.c_str());
+  }
+};
+
+odb::SymbolsTable make_syms() {
+  odb::SymbolsTable res;
+  for (odb::vm_sym_t i = 0; i < 10; ++i) {
+    odb::SymbolInfos infos;
+    infos.idx = 10 - i;
+    infos.name = "sym_" + std::to_string(i);
+    infos.addr = 0x100 + 8 * i;
+    res.push_back(infos);
+  }
+  return res;
+}
+
+} // namespace
+
+TEST_CASE("disk_cache", "") {
+  TmpDir dir;
+  {
+    odb::DiskCache cache(dir.path, 0x1234);
+    dir.files.push_back(cache.path());
+    REQUIRE(!cache.loaded());
+    odb::SymbolsTable syms;
+    REQUIRE(!cache.get_symbols_table(syms));
+
+    auto ref = make_syms();
+    cache.save(&ref, {{0x100, "mov %r0, 1", 4, 0xa1}, {0x104, "ret", 2, 0xa2}});
+    REQUIRE(cache.loaded());
+  }
+
+  // Next session
+  odb::DiskCache cache(dir.path, 0x1234);
+  REQUIRE(cache.loaded());
+  odb::SymbolsTable syms;
+  REQUIRE(cache.get_symbols_table(syms));
+  auto ref = make_syms();
+  REQUIRE(syms.addrs == ref.addrs);
+  REQUIRE(syms.ids == ref.ids);
+  REQUIRE(syms.name(3) == "sym_3");
+
+  odb::DiskCache::CodeIns ins;
+  REQUIRE(cache.get_code_ins(0x104, ins));
+  REQUIRE(ins.text == "ret");
+  REQUIRE(ins.size == 2);
+  REQUIRE(ins.hash == 0xa2);
+  REQUIRE(!cache.get_code_ins(0x102, ins));
+
+  // Merged with the previous content, without changing the symbols
+  cache.save(nullptr, {{0x104, "nop", 2, 0xb1}, {0x106, "ret", 2, 0xb2}});
+  REQUIRE(cache.get_symbols_table(syms));
+  REQUIRE(syms.size() == 10);
+  REQUIRE(cache.get_code_ins(0x100, ins));
+  REQUIRE(ins.text == "mov %r0, 1");
+  REQUIRE(ins.hash == 0xa1);
+  REQUIRE(cache.get_code_ins(0x104, ins));
+  REQUIRE(ins.text == "nop");
+  REQUIRE(ins.hash == 0xb1);
+  REQUIRE(cache.get_code_ins(0x106, ins));
+
+  // Other programs don't see it
+  odb::DiskCache other(dir.path, 0x1235);
+  dir.files.push_back(other.path());
+  REQUIRE(!other.loaded());
+
+  // Invalid files are ignored
+  {
+    std::ofstream os(cache.path(), std::ios::binary | std::ios::app);
+    os << "garbage!";
+  }
+  odb::DiskCache bad(dir.path, 0x1234);
+  REQUIRE(!bad.loaded());
+  REQUIRE(!bad.get_code_ins(0x100, ins));
+}
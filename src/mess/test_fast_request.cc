@@ -0,0 +1,144 @@
+#include <catch2/catch.hpp>
+
+#include "odb/mess/fast-request.hh"
+#include "odb/mess/request-handler.hh"
+#include "odb/mess/request.hh"
+#include "odb/mess/serial.hh"
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+namespace {
+
+constexpr std::size_t BENCH_ITERS = 200000;
+constexpr odb::vm_size_t BENCH_READ_SIZE = 16;
+
+// Copy all data written to `os` into `is`
+void transfer(const odb::SerialOutBuff &os, odb::SerialInBuff &is) {
+  is.reset(os.get_size());
+  char *dst = is.get_data();
+  os.for_each_segment([&dst](const odb::SerialOutBuff::Segment &seg) {
+    std::memcpy(dst, seg.data, seg.size);
+    dst += seg.size;
+  });
+}
+
+template <class F> double bench_reqs_per_sec(F f) {
+  auto start = std::chrono::steady_clock::now();
+  for (std::size_t i = 0; i < BENCH_ITERS; ++i)
+    f(i);
+  std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
+  return BENCH_ITERS / time.count();
+}
+
+} // namespace
+
+TEST_CASE("message_view_as", "") {
+  odb::Message msg;
+  auto &req = msg.alloc_as<odb::FastResReadMem>(4);
+  req.size = 4;
+  std::memcpy(msg.extra_as<odb::FastResReadMem>(), "abcd", 4);
+  REQUIRE(msg.data_size() == odb::Message::HEADER_SIZE + 4 + 4);
+  REQUIRE(odb::fast_message_type(msg.data()) ==
+          static_cast<odb::Message::typeid_t>(odb::ReqType::READ_MEM));
+
+  std::size_t extra = 0;
+  auto res = odb::Message::view_as<odb::FastResReadMem>(
+      msg.data(), msg.data_size(), extra);
+  REQUIRE(res);
+  REQUIRE(res->size == 4);
+  REQUIRE(extra == 4);
+  REQUIRE(std::memcmp(res + 1, "abcd", 4) == 0);
+
+  // Wrong type, or truncated
+  REQUIRE(!odb::Message::view_as<odb::FastResGetReg>(msg.data(),
+                                                      msg.data_size(), extra));
+  REQUIRE(!odb::Message::view_as<odb::FastResReadMem>(
+      msg.data(), msg.data_size() - 1, extra));
+  REQUIRE(!odb::Message::view_as<odb::FastResReadMem>(msg.data(), 3, extra));
+
+  msg.reset();
+  msg.alloc_as<odb::FastReqResume>().type = 3;
+  REQUIRE(msg.get_as<odb::FastReqResume>().type == 3);
+}
+
+// Request + response of a single small memory read, without network
+TEST_CASE("bench_fast_request", "[.bench]") {
+  char mem[BENCH_READ_SIZE] = {};
+  char out[BENCH_READ_SIZE];
+
+  odb::RequestHandler cli(false);
+  odb::RequestHandler serv(true);
+  odb::SerialOutBuff os;
+  odb::SerialInBuff is;
+
+  auto generic = bench_reqs_per_sec([&](std::size_t i) {
+    odb::vm_ptr_t addr = i;
+    char *out_ptr = out;
+    odb::ReqReadMem req;
+    req.nbufs = 1;
+    req.buf_size = BENCH_READ_SIZE;
+    req.in_addrs = &addr;
+    req.out_bufs = &out_ptr;
+    os.reset();
+    os << req.REQ_TYPE;
+    cli.client_write_request(os, req);
+    transfer(os, is);
+
+    odb::ReqType ty;
+    is >> ty;
+    odb::ReqReadMem sreq;
+    serv.server_read_request(is, sreq);
+    std::memcpy(sreq.out_bufs[0], mem, sreq.buf_size);
+    os.reset();
+    os << ty;
+    serv.server_write_response(os, sreq);
+    transfer(os, is);
+
+    is >> ty;
+    cli.client_read_response(is, req);
+  });
+
+  odb::Message cli_msg;
+  odb::Message serv_msg;
+  auto fast = bench_reqs_per_sec([&](std::size_t i) {
+    std::size_t extra;
+    cli_msg.reset();
+    auto &req = cli_msg.alloc_as<odb::FastReqReadMem>();
+    req.addr = i;
+    req.size = BENCH_READ_SIZE;
+    os.reset();
+    os << odb::ReqType::FAST;
+    os.write(cli_msg.data(), cli_msg.data_size());
+    transfer(os, is);
+
+    odb::ReqType ty;
+    is >> ty;
+    auto size = is.remaining();
+    auto sreq = odb::Message::view_as<odb::FastReqReadMem>(is.read_ref(size),
+                                                           size, extra);
+    std::uint32_t len = sreq->size;
+    serv_msg.reset();
+    serv_msg.alloc_as<odb::FastResReadMem>(len).size = len;
+    std::memcpy(serv_msg.extra_as<odb::FastResReadMem>(), mem, len);
+    os.reset();
+    os << ty;
+    os.write_ref(serv_msg.data(), serv_msg.data_size());
+    transfer(os, is);
+
+    is >> ty;
+    size = is.remaining();
+    auto res = odb::Message::view_as<odb::FastResReadMem>(is.read_ref(size),
+                                                          size, extra);
+    std::memcpy(out, res + 1, res->size);
+  });
+
+  std::cout << "READ_MEM " << BENCH_READ_SIZE << " bytes:\n"
+            << "  generic: " << static_cast<std::size_t>(generic)
+            << " req/s\n"
+            << "     fast: " << static_cast<std::size_t>(fast) << " req/s\n";
+  REQUIRE(fast > 0);
+}
@@ -0,0 +1,638 @@
+#include <catch2/catch.hpp>
+
+#include "odb/mess/request-handler.hh"
+#include "odb/mess/request.hh"
+#include "odb/mess/serial.hh"
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Copy all data written to `os` into `is`, with the same format
+void transfer(const odb::SerialOutBuff &os, odb::SerialInBuff &is) {
+  std::string data;
+  os.for_each_segment([&data](const odb::SerialOutBuff::Segment &seg) {
+    data.append(seg.data, seg.size);
+  });
+  is.reset(data.data(), data.size());
+  is.set_compact(os.compact());
+}
+
+template <class T>
+std::size_t add_bkps_size(std::vector<odb::vm_ptr_t> addrs, bool compact) {
+  odb::RequestHandler cli(false);
+  odb::RequestHandler serv(true);
+  odb::SerialOutBuff os;
+  os.set_compact(compact);
+  odb::SerialInBuff is;
+
+  T req;
+  req.size = addrs.size();
+  req.in_addrs = addrs.data();
+  cli.client_write_request(os, req);
+  transfer(os, is);
+
+  T sreq;
+  serv.server_read_request(is, sreq);
+  is.check_eof();
+  REQUIRE(sreq.size == addrs.size());
+  for (std::size_t i = 0; i < addrs.size(); ++i)
+    REQUIRE(sreq.in_addrs[i] == addrs[i]);
+  return os.get_size();
+}
+
+constexpr std::size_t BENCH_ITERS = 100000;
+
+// Time the 4 steps of a request: client write, server read, server write,
+// client read
+// `make_req` returns a request ready to be sent by the client, and
+// `fill_res` fills the server request as if it was executed
+template <class T, class MakeReq, class FillRes>
+void bench_request(const char *name, MakeReq make_req, FillRes fill_res) {
+  using clock = std::chrono::steady_clock;
+  odb::RequestHandler cli(false);
+  odb::RequestHandler serv(true);
+  odb::SerialOutBuff os;
+  odb::SerialInBuff is;
+  os.set_compact(true);
+  clock::duration times[4] = {};
+
+  for (std::size_t i = 0; i < BENCH_ITERS; ++i) {
+    T req = make_req();
+    T sreq;
+    auto t0 = clock::now();
+    os.reset();
+    cli.client_write_request(os, req);
+    auto t1 = clock::now();
+    transfer(os, is);
+    auto t2 = clock::now();
+    serv.server_read_request(is, sreq);
+    auto t3 = clock::now();
+    fill_res(sreq);
+    auto t4 = clock::now();
+    os.reset();
+    serv.server_write_response(os, sreq);
+    auto t5 = clock::now();
+    transfer(os, is);
+    auto t6 = clock::now();
+    cli.client_read_response(is, req);
+    auto t7 = clock::now();
+    times[0] += t1 - t0;
+    times[1] += t3 - t2;
+    times[2] += t5 - t4;
+    times[3] += t7 - t6;
+  }
+
+  std::cout << name << ":";
+  for (auto t : times)
+    std::cout << " "
+              << std::chrono::duration_cast<std::chrono::nanoseconds>(t)
+                         .count() /
+                     BENCH_ITERS
+              << "ns";
+  std::cout << "\n";
+}
+
+} // namespace
+
+TEST_CASE("serial_varint", "") {
+  std::vector<std::uint64_t> vals{0,          1,           127,
+                                  128,        300,         (1ULL << 32) + 7,
+                                  ~0ULL - 12, ~0ULL};
+  odb::SerialOutBuff os;
+  for (auto x : vals)
+    odb::sb_serial_varint(os, x);
+  REQUIRE(os.get_size() == 1 + 1 + 1 + 2 + 2 + 5 + 10 + 10);
+
+  odb::SerialInBuff is;
+  transfer(os, is);
+  for (auto x : vals)
+    REQUIRE(odb::sb_unserial_varint(is) == x);
+  is.check_eof();
+}
+
+TEST_CASE("serial_delta", "") {
+  std::vector<std::uint64_t> vals{1024, 1030, 1001, 0, ~0ULL, 5, 5};
+  odb::SerialOutBuff os;
+  odb::SerialDeltaOut dout;
+  for (auto x : vals)
+    dout.write(os, x);
+
+  odb::SerialInBuff is;
+  transfer(os, is);
+  odb::SerialDeltaIn din;
+  for (auto x : vals)
+    REQUIRE(din.read(is) == x);
+  is.check_eof();
+}
+
+TEST_CASE("request_compact_addrs", "") {
+  std::vector<odb::vm_ptr_t> addrs{0x400000, 0x400010, 0x400024, 0x400008};
+  auto raw_size = add_bkps_size<odb::ReqAddBkps>(addrs, false);
+  auto compact_size = add_bkps_size<odb::ReqDelBkps>(addrs, true);
+  REQUIRE(raw_size == 2 + 4 * 8);
+  REQUIRE(compact_size == 1 + 4 + 1 + 1 + 1);
+}
+
+TEST_CASE("request_compact_udp", "") {
+  odb::ReqCheckStopped req;
+  auto &udp = req.out_udp;
+  udp.vm_state = odb::StoppedState::EXIT;
+  udp.stopped = true;
+  udp.addr = 1042;
+  udp.stack = {{1024, 1030}, {1026, 1028}, {1040, 1041}};
+  odb::ReqGetCodeText code;
+  code.out_text = {"mov", "add %r1, %r2"};
+  code.out_sizes = {4, 8};
+
+  for (bool compact : {false, true}) {
+    odb::RequestHandler cli(false);
+    odb::RequestHandler serv(true);
+    odb::SerialOutBuff os;
+    os.set_compact(compact);
+    serv.server_write_response(os, req);
+    serv.server_write_response(os, code);
+    odb::SerialInBuff is;
+    transfer(os, is);
+
+    odb::ReqCheckStopped req2;
+    odb::ReqGetCodeText code2;
+    cli.client_read_response(is, req2);
+    cli.client_read_response(is, code2);
+    is.check_eof();
+    const auto &udp2 = req2.out_udp;
+    REQUIRE(udp2.vm_state == udp.vm_state);
+    REQUIRE(udp2.stopped);
+    REQUIRE(udp2.addr == udp.addr);
+    REQUIRE(udp2.stack.size() == 3);
+    for (std::size_t i = 0; i < 3; ++i) {
+      REQUIRE(udp2.stack[i].caller_start_addr ==
+              udp.stack[i].caller_start_addr);
+      REQUIRE(udp2.stack[i].call_addr == udp.stack[i].call_addr);
+    }
+    REQUIRE(code2.out_text == code.out_text);
+    REQUIRE(code2.out_sizes == code.out_sizes);
+    REQUIRE(os.get_size() == (compact ? 34 : 129));
+  }
+}
+
+TEST_CASE("request_connect_old_client", "") {
+  odb::RequestHandler serv(true);
+  odb::SerialOutBuff os;
+  odb::SerialInBuff is;
+
+  // v1 client: no version sent, and expects a v1 response
+  is.reset(nullptr, 0);
+  odb::ReqConnect req;
+  serv.server_read_request(is, req);
+  REQUIRE(req.in_version == odb::PROTO_VERSION_1);
+  REQUIRE(req.in_caps == 0);
+
+  req.out_infos.name = "vm";
+  req.out_udp.stopped = false;
+  req.out_version = odb::PROTO_VERSION;
+  req.out_caps = 0;
+  serv.server_write_response(os, req);
+
+  odb::SerialOutBuff os_v1;
+  os_v1 << req.out_infos << req.out_udp;
+  REQUIRE(os.get_size() == os_v1.get_size());
+}
+
+TEST_CASE("request_connect_old_server", "") {
+  odb::RequestHandler cli(false);
+  odb::SerialOutBuff os;
+  odb::SerialInBuff is;
+
+  odb::ReqConnect req;
+  req.in_version = odb::PROTO_VERSION;
+  req.in_caps = odb::PROTO_CAPS_ALL;
+  cli.client_write_request(os, req);
+  odb::SerialOutBuff os_profile;
+  os_profile << req.in_prefetch;
+  REQUIRE(os.get_size() == 8 + os_profile.get_size());
+
+  // v1 server: ignore version, and only send infos and udp
+  odb::VMInfos infos;
+  infos.name = "vm";
+  odb::DBClientUpdate udp;
+  udp.stopped = false;
+  odb::SerialOutBuff res;
+  res << infos << udp;
+  transfer(res, is);
+  cli.client_read_response(is, req);
+  REQUIRE(req.out_infos.name == "vm");
+  REQUIRE(req.out_version == odb::PROTO_VERSION_1);
+  REQUIRE(req.out_caps == 0);
+}
+
+TEST_CASE("request_read_mem_diff", "") {
+  odb::ReqReadMemDiff req;
+  req.out_version = 12;
+  req.out_pages = {1, 2, 7};
+  req.out_data.resize(3 * 256);
+  for (std::size_t i = 0; i < req.out_data.size(); ++i)
+    req.out_data[i] = static_cast<char>(i * 7);
+
+  for (bool compact : {false, true}) {
+    odb::RequestHandler serv(true);
+    odb::RequestHandler cli(false);
+    odb::SerialOutBuff os;
+    os.set_compact(compact);
+    serv.server_write_response(os, req);
+    odb::SerialInBuff is;
+    transfer(os, is);
+
+    odb::ReqReadMemDiff req2;
+    cli.client_read_response(is, req2);
+    is.check_eof();
+    REQUIRE(req2.out_version == 12);
+    REQUIRE(req2.out_pages == req.out_pages);
+    REQUIRE(req2.out_data == req.out_data);
+  }
+}
+
+TEST_CASE("request_check_stopped_prefetch", "") {
+  odb::ReqCheckStopped req;
+  req.in_prefetch = 1;
+  auto &pf = req.out_udp.prefetch;
+  pf.reg_ids = {0, 4};
+  pf.reg_vals = {{1, 2, 3, 4}, {5, 6, 7, 8}};
+  pf.mem_addrs = {512};
+  pf.mem_data = {std::vector<char>(256, 9)};
+  pf.code_addr = 1030;
+  pf.code_text = {"mov", "add %r1, %r2"};
+  pf.code_sizes = {4, 8};
+  pf.sym_addrs = {1030};
+  pf.sym_sizes = {12};
+  pf.syms.resize(1);
+  pf.syms[0].name = "f";
+  pf.syms[0].addr = 1030;
+  pf.syms[0].idx = 3;
+
+  for (bool compact : {false, true}) {
+    odb::RequestHandler cli(false);
+    odb::RequestHandler serv(true);
+    odb::SerialOutBuff os;
+    os.set_compact(compact);
+    cli.client_write_request(os, req);
+    odb::SerialInBuff is;
+    transfer(os, is);
+    odb::ReqCheckStopped sreq;
+    serv.server_read_request(is, sreq);
+    is.check_eof();
+    REQUIRE(sreq.in_prefetch == 1);
+
+    os.reset();
+    serv.server_write_response(os, req);
+    transfer(os, is);
+    odb::ReqCheckStopped req2;
+    req2.in_prefetch = 1;
+    cli.client_read_response(is, req2);
+    is.check_eof();
+    const auto &pf2 = req2.out_udp.prefetch;
+    REQUIRE(pf2.reg_ids == pf.reg_ids);
+    REQUIRE(pf2.reg_vals == pf.reg_vals);
+    REQUIRE(pf2.mem_addrs == pf.mem_addrs);
+    REQUIRE(pf2.mem_data == pf.mem_data);
+    REQUIRE(pf2.code_addr == 1030);
+    REQUIRE(pf2.code_text == pf.code_text);
+    REQUIRE(pf2.code_sizes == pf.code_sizes);
+    REQUIRE(pf2.sym_addrs == pf.sym_addrs);
+    REQUIRE(pf2.sym_sizes == pf.sym_sizes);
+    REQUIRE(pf2.syms.size() == 1);
+    REQUIRE(pf2.syms[0].name == "f");
+  }
+
+  // Old client: no prefetch data
+  odb::RequestHandler serv(true);
+  odb::SerialOutBuff os;
+  req.in_prefetch = 0;
+  serv.server_write_response(os, req);
+  odb::SerialOutBuff os_udp;
+  os_udp << req.out_udp;
+  REQUIRE(os.get_size() == os_udp.get_size());
+}
+
+TEST_CASE("request_syms_table", "") {
+  odb::ReqGetSymsTable req;
+  for (odb::vm_sym_t i = 0; i < 1000; ++i) {
+    odb::SymbolInfos infos;
+    infos.idx = 1000 - i;
+    infos.name = "fun_" + std::to_string(i);
+    infos.addr = 0x1000 + 16 * i;
+    req.out_table.push_back(infos);
+  }
+
+  for (bool compact : {false, true}) {
+    odb::RequestHandler serv(true);
+    odb::RequestHandler cli(false);
+    odb::SerialOutBuff os;
+    os.set_compact(compact);
+    serv.server_write_response(os, req);
+    odb::SerialInBuff is;
+    transfer(os, is);
+
+    odb::ReqGetSymsTable req2;
+    cli.client_read_response(is, req2);
+    is.check_eof();
+    const auto &t = req2.out_table;
+    REQUIRE(t.size() == 1000);
+    REQUIRE(t.addrs == req.out_table.addrs);
+    REQUIRE(t.ids == req.out_table.ids);
+    REQUIRE(t.name(0) == "fun_0");
+    REQUIRE(t.name(999) == "fun_999");
+
+    // Addresses and names offsets are delta-encoded
+    if (compact)
+      REQUIRE(os.get_size() < t.names.size() + 4 * 1000);
+  }
+}
+
+TEST_CASE("request_code_annotated", "") {
+  odb::ReqGetCodeAnnotated req;
+  req.addr = 0x400;
+  req.nins = 3;
+  auto &code = req.out_code;
+  code.push_back(0x400, 1, "b {2}");
+  code.push_back(0x401, 2, "call {1} {x} {3");
+  code.push_back(0x403, 1, "mov {1} {2}");
+  code.add_sym(odb::SymbolInfos{2, "_start", 0x403});
+  code.add_sym(odb::SymbolInfos{1, "my_add", 0x401});
+  code.add_sym(odb::SymbolInfos{1, "my_add", 0x401});
+
+  REQUIRE(code.size() == 3);
+  REQUIRE(code.refs_ins == std::vector<odb::vm_size_t>{0, 1, 2, 2});
+  REQUIRE(code.refs_ids == std::vector<odb::vm_sym_t>{2, 1, 1, 2});
+  REQUIRE(code.syms.size() == 2);
+  REQUIRE(code.syms[0].name == "my_add");
+  REQUIRE(code.missing_syms().empty());
+  REQUIRE(code.resolved_text(1) == "call my_add {x} {3");
+  REQUIRE(code.resolved_text(2) == "mov my_add _start");
+
+  for (bool compact : {false, true}) {
+    odb::RequestHandler cli(false);
+    odb::RequestHandler serv(true);
+    odb::SerialOutBuff os;
+    os.set_compact(compact);
+    cli.client_write_request(os, req);
+    serv.server_write_response(os, req);
+    odb::SerialInBuff is;
+    transfer(os, is);
+
+    odb::ReqGetCodeAnnotated req2;
+    serv.server_read_request(is, req2);
+    REQUIRE(req2.addr == 0x400);
+    REQUIRE(req2.nins == 3);
+    cli.client_read_response(is, req2);
+    is.check_eof();
+    const auto &c = req2.out_code;
+    REQUIRE(c.addrs == code.addrs);
+    REQUIRE(c.sizes == code.sizes);
+    REQUIRE(c.refs_beg == code.refs_beg);
+    REQUIRE(c.refs_end == code.refs_end);
+    REQUIRE(c.syms.size() == 2);
+    REQUIRE(c.resolved_text(0) == "b _start");
+  }
+}
+
+TEST_CASE("request_stack_syms", "") {
+  odb::ReqGetStackSyms req;
+  req.out_stack = {{1024, 1043}, {1025, 1035}, {1025, 1035}};
+  req.out_frames_syms = {0, 1, 1};
+  req.out_syms = {{0, "_begin", 1024}, {1, "fact", 1025}};
+
+  for (bool compact : {false, true}) {
+    odb::RequestHandler serv(true);
+    odb::RequestHandler cli(false);
+    odb::SerialOutBuff os;
+    os.set_compact(compact);
+    serv.server_write_response(os, req);
+    odb::SerialInBuff is;
+    transfer(os, is);
+
+    odb::ReqGetStackSyms req2;
+    cli.client_read_response(is, req2);
+    is.check_eof();
+    REQUIRE(req2.out_stack.size() == 3);
+    REQUIRE(req2.out_stack[2].caller_start_addr == 1025);
+    REQUIRE(req2.out_stack[2].call_addr == 1035);
+    REQUIRE(req2.out_frames_syms == req.out_frames_syms);
+    REQUIRE(req2.out_syms.size() == 2);
+    REQUIRE(req2.out_syms[1].name == "fact");
+    REQUIRE(req2.out_syms[1].addr == 1025);
+  }
+}
+
+TEST_CASE("request_check_stopped_stack_delta", "") {
+  odb::ReqCheckStopped req;
+  req.in_stack_delta = 1;
+  req.out_udp.stopped = true;
+  req.out_udp.stack = {{1040, 1041}};
+  req.out_udp.stack_keep = 2;
+  req.out_udp.stack_depth = 4000;
+
+  for (bool compact : {false, true}) {
+    odb::RequestHandler cli(false);
+    odb::RequestHandler serv(true);
+    odb::SerialOutBuff os;
+    os.set_compact(compact);
+    cli.client_write_request(os, req);
+    odb::SerialInBuff is;
+    transfer(os, is);
+    odb::ReqCheckStopped sreq;
+    serv.server_read_request(is, sreq);
+    is.check_eof();
+    REQUIRE(sreq.in_stack_delta == 1);
+
+    os.reset();
+    serv.server_write_response(os, req);
+    transfer(os, is);
+    odb::ReqCheckStopped req2;
+    req2.in_stack_delta = 1;
+    cli.client_read_response(is, req2);
+    is.check_eof();
+    REQUIRE(req2.out_udp.stack.size() == 1);
+    REQUIRE(req2.out_udp.stack[0].call_addr == 1041);
+    REQUIRE(req2.out_udp.stack_keep == 2);
+    REQUIRE(req2.out_udp.stack_depth == 4000);
+  }
+
+  // Old client: only the stack
+  odb::RequestHandler serv(true);
+  odb::SerialOutBuff os;
+  req.in_stack_delta = 0;
+  serv.server_write_response(os, req);
+  odb::SerialOutBuff os_udp;
+  os_udp << req.out_udp;
+  REQUIRE(os.get_size() == os_udp.get_size());
+}
+
+TEST_CASE("request_stack_frames", "") {
+  odb::ReqGetStackFrames req;
+  req.beg = 3;
+  req.end = 5;
+  req.out_frames = {{1025, 1035}, {1025, 1035}};
+
+  odb::RequestHandler cli(false);
+  odb::RequestHandler serv(true);
+  odb::SerialOutBuff os;
+  cli.client_write_request(os, req);
+  odb::SerialInBuff is;
+  transfer(os, is);
+  odb::ReqGetStackFrames sreq;
+  serv.server_read_request(is, sreq);
+  is.check_eof();
+  REQUIRE(sreq.beg == 3);
+  REQUIRE(sreq.end == 5);
+
+  os.reset();
+  serv.server_write_response(os, req);
+  transfer(os, is);
+  odb::ReqGetStackFrames req2;
+  cli.client_read_response(is, req2);
+  is.check_eof();
+  REQUIRE(req2.out_frames.size() == 2);
+  REQUIRE(req2.out_frames[1].caller_start_addr == 1025);
+  REQUIRE(req2.out_frames[1].call_addr == 1035);
+}
+
+TEST_CASE("request_get_stats", "") {
+  odb::ReqGetStats req;
+  auto &rs = req.out_stats.request(odb::ReqType::READ_MEM);
+  rs.count = 2;
+  rs.bytes_in = 40;
+  rs.latency.add(1500);
+  rs.latency.add(30000);
+  req.out_stats.request(odb::ReqType::FAST).errors = 1;
+  req.out_stats.loop_calls = 1000;
+  req.out_stats.vm_ns = 12345;
+  req.out_stats.vm_calls = {0, 3, 7};
+  req.out_stats.vm_profile.resize(3);
+  req.out_stats.vm_profile[2].time.add(800);
+  req.out_stats.vm_profile[2].sizes.add(64);
+  req.out_stats.vm_profile[2].errors = 1;
+  req.out_stats.bkp_hits = {{1029, 4}, {1032, 1}};
+
+  for (bool compact : {false, true}) {
+    odb::RequestHandler cli(false);
+    odb::RequestHandler serv(true);
+    odb::SerialOutBuff os;
+    os.set_compact(compact);
+    serv.server_write_response(os, req);
+    odb::SerialInBuff is;
+    transfer(os, is);
+    odb::ReqGetStats req2;
+    cli.client_read_response(is, req2);
+    is.check_eof();
+
+    const auto &stats = req2.out_stats;
+    REQUIRE(stats.requests.size() == odb::REQ_COUNT + 1);
+    const auto &rs2 = stats.requests[int(odb::ReqType::READ_MEM)];
+    REQUIRE(rs2.count == 2);
+    REQUIRE(rs2.bytes_in == 40);
+    REQUIRE(rs2.latency.count == 2);
+    REQUIRE(rs2.latency.max == 30000);
+    REQUIRE(rs2.latency.buckets == rs.latency.buckets);
+    REQUIRE(stats.requests.back().errors == 1);
+    REQUIRE(stats.loop_calls == 1000);
+    REQUIRE(stats.vm_ns == 12345);
+    REQUIRE(stats.vm_calls == req.out_stats.vm_calls);
+    REQUIRE(stats.vm_profile.size() == 3);
+    REQUIRE(stats.vm_profile[0].time.count == 0);
+    REQUIRE(stats.vm_profile[2].time.sum == 800);
+    REQUIRE(stats.vm_profile[2].sizes.max == 64);
+    REQUIRE(stats.vm_profile[2].errors == 1);
+    REQUIRE(stats.bkp_hits == req.out_stats.bkp_hits);
+  }
+}
+
+TEST_CASE("request_get_bkps", "") {
+  odb::ReqGetBkps req;
+  req.out_addrs = {1025, 1029, 4096};
+
+  odb::RequestHandler cli(false);
+  odb::RequestHandler serv(true);
+  odb::SerialOutBuff os;
+  serv.server_write_response(os, req);
+  odb::SerialInBuff is;
+  transfer(os, is);
+  odb::ReqGetBkps req2;
+  cli.client_read_response(is, req2);
+  is.check_eof();
+  REQUIRE(req2.out_addrs == req.out_addrs);
+}
+
+// Serialization cost per request type, in ns per step:
+// client write, server read, server write, client read
+TEST_CASE("bench_request_serial", "[.bench]") {
+  odb::vm_reg_t ids[8] = {0, 1, 2, 3, 4, 5, 6, 7};
+  odb::vm_ptr_t addrs[8] = {1024, 1032, 1040, 1048, 2048, 2056, 4096, 4100};
+  odb::vm_size_t sizes[8] = {8, 8, 8, 8, 4, 4, 64, 64};
+  char out_data[8][64];
+  char *out_bufs[8];
+  for (std::size_t i = 0; i < 8; ++i)
+    out_bufs[i] = out_data[i];
+
+  std::cout << "request: cli write, serv read, serv write, cli read\n";
+
+  bench_request<odb::ReqCheckStopped>(
+      "CHECK_STOPPED", [] { return odb::ReqCheckStopped{}; },
+      [](odb::ReqCheckStopped &r) {
+        r.out_udp.stopped = true;
+        r.out_udp.vm_state = odb::StoppedState::READY;
+        r.out_udp.addr = 1042;
+        r.out_udp.stack = {{1024, 1030}, {1026, 1028}, {1040, 1041}};
+      });
+
+  bench_request<odb::ReqGetRegs>(
+      "GET_REGS x8",
+      [&] {
+        odb::ReqGetRegs r;
+        r.nregs = 8;
+        r.reg_size = 8;
+        r.ids = ids;
+        r.out_bufs = out_bufs;
+        return r;
+      },
+      [](odb::ReqGetRegs &) {});
+
+  bench_request<odb::ReqReadMemVar>(
+      "READ_MEM_VAR x8",
+      [&] {
+        odb::ReqReadMemVar r;
+        r.nbufs = 8;
+        r.in_addrs = addrs;
+        r.in_bufs_size = sizes;
+        r.out_bufs = out_bufs;
+        return r;
+      },
+      [](odb::ReqReadMemVar &) {});
+
+  bench_request<odb::ReqAddBkps>(
+      "ADD_BKPS x8",
+      [&] {
+        odb::ReqAddBkps r;
+        r.size = 8;
+        r.in_addrs = addrs;
+        return r;
+      },
+      [](odb::ReqAddBkps &) {});
+
+  bench_request<odb::ReqGetCodeText>(
+      "GET_CODE_TEXT x4",
+      [] {
+        odb::ReqGetCodeText r;
+        r.addr = 1024;
+        r.nins = 4;
+        return r;
+      },
+      [](odb::ReqGetCodeText &r) {
+        r.out_text = {"mov r0, r1", "add r0, 4", "call @foo", "ret"};
+        r.out_sizes = {4, 4, 8, 2};
+      });
+}
@@ -0,0 +1,172 @@
+#include <catch2/catch.hpp>
+
+#include "odb/mess/request-handler.hh"
+#include "odb/mess/request.hh"
+#include "odb/mess/serial.hh"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+
+// Count all heap allocations of the test binary
+namespace {
+std::atomic<std::size_t> g_heap_allocs{0};
+}
+
+void *operator new(std::size_t size) {
+  ++g_heap_allocs;
+  if (void *res = std::malloc(size ? size : 1))
+    return res;
+  throw std::bad_alloc{};
+}
+
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+
+void operator delete(void *ptr, std::size_t) noexcept { std::free(ptr); }
+
+void *operator new[](std::size_t size) { return operator new(size); }
+
+void operator delete[](void *ptr) noexcept { std::free(ptr); }
+
+void operator delete[](void *ptr, std::size_t) noexcept { std::free(ptr); }
+
+namespace {
+
+constexpr std::size_t WARMUP_ITERS = 4;
+constexpr std::size_t ITERS = 100;
+
+// Copy all data written to `os` into `is`, without allocation
+void transfer(const odb::SerialOutBuff &os, odb::SerialInBuff &is) {
+  is.reset(os.get_size());
+  char *dst = is.get_data();
+  os.for_each_segment([&dst](const odb::SerialOutBuff::Segment &seg) {
+    std::memcpy(dst, seg.data, seg.size);
+    dst += seg.size;
+  });
+  is.set_compact(os.compact());
+}
+
+struct Peers {
+  odb::RequestHandler cli{false};
+  odb::RequestHandler serv{true};
+  odb::SerialOutBuff os;
+  odb::SerialInBuff is;
+
+  // Complete round trip of `req`, with `sreq` the server-side object
+  template <class T, class F> void round_trip(T &req, T &sreq, F exec) {
+    os.reset();
+    cli.client_write_request(os, req);
+    transfer(os, is);
+    serv.server_read_request(is, sreq);
+    exec(sreq);
+    os.reset();
+    serv.server_write_response(os, sreq);
+    transfer(os, is);
+    cli.client_read_response(is, req);
+  }
+};
+
+// Heap allocations during ITERS round trips, after a few warmup ones
+template <class T, class F>
+std::size_t steady_allocs(Peers &p, T &req, T &sreq, F exec) {
+  for (std::size_t i = 0; i < WARMUP_ITERS; ++i)
+    p.round_trip(req, sreq, exec);
+
+  auto start = g_heap_allocs.load();
+  for (std::size_t i = 0; i < ITERS; ++i)
+    p.round_trip(req, sreq, exec);
+  return g_heap_allocs.load() - start;
+}
+
+} // namespace
+
+TEST_CASE("tmp_buff_arena", "") {
+  odb::TmpBuffHolder tb;
+  REQUIRE(tb.heap_allocs() == 0);
+
+  // First use: no chunk yet
+  auto a = tb.add_buff<char>(3);
+  auto b = tb.add_buff<std::uint64_t>(4);
+  REQUIRE(tb.heap_allocs() == 2);
+  REQUIRE(reinterpret_cast<std::uintptr_t>(b) % alignof(std::uint64_t) == 0);
+  for (std::size_t i = 0; i < 4; ++i)
+    REQUIRE(b[i] == 0);
+  std::memcpy(a, "ab", 3);
+
+  // Then everything fits in the chunk
+  tb.reset();
+  auto allocs = tb.heap_allocs();
+  for (int k = 0; k < 3; ++k) {
+    tb.add_buff<char>(3);
+    b = tb.add_buff<std::uint64_t>(4);
+    REQUIRE(reinterpret_cast<std::uintptr_t>(b) % alignof(std::uint64_t) ==
+            0);
+    tb.add_buff<std::string>(2)[1] = std::string(100, 'x');
+    tb.reset();
+  }
+  REQUIRE(tb.heap_allocs() == allocs);
+
+  // Outliers get their own buffer, and the chunk grows for the next time
+  tb.add_buff<char>(odb::TmpBuffHolder::MIN_CHUNK_SIZE * 4);
+  REQUIRE(tb.heap_allocs() == allocs + 1);
+  tb.reset();
+  REQUIRE(tb.heap_allocs() == allocs + 2);
+  tb.add_buff<char>(odb::TmpBuffHolder::MIN_CHUNK_SIZE * 4);
+  tb.reset();
+  REQUIRE(tb.heap_allocs() == allocs + 2);
+}
+
+TEST_CASE("request_steady_state_no_alloc", "") {
+  Peers p;
+  p.os.set_compact(true);
+
+  odb::vm_reg_t ids[4] = {0, 1, 2, 3};
+  odb::vm_ptr_t addrs[3] = {1024, 1040, 4096};
+  odb::vm_size_t sizes[3] = {4, 16, 600};
+  char out_data[4][600];
+  char *out_bufs[4] = {out_data[0], out_data[1], out_data[2], out_data[3]};
+
+  odb::ReqGetRegs regs;
+  regs.nregs = 4;
+  regs.reg_size = 8;
+  regs.ids = ids;
+  regs.out_bufs = out_bufs;
+  odb::ReqGetRegs sregs;
+  auto regs_allocs =
+      steady_allocs(p, regs, sregs, [](odb::ReqGetRegs &r) {
+        for (std::size_t i = 0; i < r.nregs; ++i)
+          std::memset(r.out_bufs[i], int(r.ids[i]), r.reg_size);
+      });
+  REQUIRE(regs_allocs == 0);
+  REQUIRE(out_data[3][0] == 3);
+
+  odb::ReqReadMemVar mem;
+  mem.nbufs = 3;
+  mem.in_addrs = addrs;
+  mem.in_bufs_size = sizes;
+  mem.out_bufs = out_bufs;
+  odb::ReqReadMemVar smem;
+  auto mem_allocs = steady_allocs(p, mem, smem, [](odb::ReqReadMemVar &r) {
+    for (std::size_t i = 0; i < r.nbufs; ++i)
+      std::memset(r.out_bufs[i], 7, r.in_bufs_size[i]);
+  });
+  REQUIRE(mem_allocs == 0);
+  REQUIRE(out_data[2][599] == 7);
+
+  odb::ReqCheckStopped check;
+  odb::ReqCheckStopped scheck;
+  auto check_allocs =
+      steady_allocs(p, check, scheck, [](odb::ReqCheckStopped &r) {
+        r.out_udp.stopped = true;
+        r.out_udp.vm_state = odb::StoppedState::READY;
+        r.out_udp.addr = 1042;
+        r.out_udp.stack.resize(3);
+        r.out_udp.stack[2] = {1040, 1041};
+      });
+  REQUIRE(check_allocs == 0);
+  REQUIRE(check.out_udp.stack.size() == 3);
+  REQUIRE(check.out_udp.stack[2].call_addr == 1041);
+}
@@ -0,0 +1,197 @@
+#include <catch2/catch.hpp>
+
+#include "odb/mess/request-handler.hh"
+#include "odb/mess/request.hh"
+#include "odb/mess/serial.hh"
+#include "odb/mess/tcp-transfer.hh"
+
+#include <cerrno>
+#include <cstdint>
+#include <string>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+std::string flatten(const odb::SerialOutBuff &os) {
+  std::string res;
+  os.for_each_segment([&res](const odb::SerialOutBuff::Segment &seg) {
+    res.append(seg.data, seg.size);
+  });
+  return res;
+}
+
+std::vector<char> make_bytes(std::size_t size) {
+  std::vector<char> res(size);
+  for (std::size_t i = 0; i < size; ++i)
+    res[i] = static_cast<char>(i * 7 + 3);
+  return res;
+}
+
+} // namespace
+
+TEST_CASE("serial_out_segments", "") {
+  odb::SerialOutBuff os;
+  auto big = make_bytes(2000);
+  os.write("ab", 2);
+  os.write_ref(big.data(), 1000);
+  os.write_ref(big.data() + 1000, 1000);
+  os.write("cd", 2);
+  os.write_ref("ef", 2);
+
+  REQUIRE(os.get_size() == 2006);
+  REQUIRE(os.get_copied_size() == 6);
+
+  std::size_t nsegs = 0;
+  os.for_each_segment([&nsegs](const odb::SerialOutBuff::Segment &) {
+    ++nsegs;
+  });
+  REQUIRE(nsegs == 3);
+  REQUIRE(flatten(os) ==
+          "ab" + std::string(big.begin(), big.end()) + "cdef");
+
+  os.reset();
+  REQUIRE(os.get_size() == 0);
+  REQUIRE(flatten(os).empty());
+}
+
+TEST_CASE("serial_in_reuse", "") {
+  odb::SerialInBuff is;
+  is.reset("abcdef", 6);
+  char *data = is.get_data();
+  REQUIRE(std::string(is.read_ref(2), 2) == "ab");
+  char buf[4];
+  is.read(buf, 4);
+  REQUIRE(std::string(buf, 4) == "cdef");
+  is.check_eof();
+
+  // Smaller messages reuse the same memory
+  is.reset(3);
+  REQUIRE(is.get_data() == data);
+  REQUIRE(is.get_size() == 3);
+}
+
+TEST_CASE("tcp_transfer_segments", "") {
+  int fds[2];
+  REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+
+  // Big enough to need several partial writes
+  auto big = make_bytes(1 << 20);
+  odb::SerialOutBuff os;
+  odb::sb_serial_raw<std::uint32_t>(os, 42);
+  os.write_ref(big.data(), big.size());
+  odb::sb_serial_raw<std::uint32_t>(os, 43);
+
+  bool sent = false;
+  std::thread th([&]() { sent = odb::send_data_tcp(os, fds[0]); });
+  odb::SerialInBuff is;
+  REQUIRE(odb::recv_data_tcp(is, fds[1]));
+  th.join();
+  REQUIRE(sent);
+
+  REQUIRE(is.get_size() == big.size() + 8);
+  REQUIRE(odb::sb_unserial_raw<std::uint32_t>(is) == 42);
+  REQUIRE(std::memcmp(is.read_ref(big.size()), big.data(), big.size()) == 0);
+  REQUIRE(odb::sb_unserial_raw<std::uint32_t>(is) == 43);
+  is.check_eof();
+
+  close(fds[0]);
+  close(fds[1]);
+}
+
+TEST_CASE("tcp_transfer_max_size", "") {
+  int fds[2];
+  REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+
+  // Never read: rejected before sending or compressing anything
+  auto big_size = odb::TCP_FRAME_MAX_SIZE - 4;
+  void *big = mmap(nullptr, big_size, PROT_NONE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  REQUIRE(big != MAP_FAILED);
+
+  odb::SerialOutBuff os;
+  os.set_compress_min(1);
+  os.set_compressible(true);
+  odb::sb_serial_raw<std::uint32_t>(os, 42);
+  os.write_ref(static_cast<const char *>(big), big_size);
+  REQUIRE(os.get_size() == odb::TCP_FRAME_MAX_SIZE);
+  REQUIRE(!odb::send_data_tcp(os, fds[0]));
+  char c;
+  REQUIRE(recv(fds[1], &c, 1, MSG_DONTWAIT) == -1);
+  REQUIRE(errno == EAGAIN);
+  munmap(big, big_size);
+
+  // The stream is still usable
+  os.reset();
+  odb::sb_serial_raw<std::uint32_t>(os, 43);
+  REQUIRE(odb::send_data_tcp(os, fds[0]));
+  odb::SerialInBuff is;
+  REQUIRE(odb::recv_data_tcp(is, fds[1]));
+  REQUIRE(odb::sb_unserial_raw<std::uint32_t>(is) == 43);
+  is.check_eof();
+
+  close(fds[0]);
+  close(fds[1]);
+}
+
+TEST_CASE("tcp_transfer_bad_raw_size", "") {
+  int fds[2];
+  REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+
+  // Compressed frames of 8 bytes: uncompressed size + 4 bytes of data
+  for (std::uint32_t raw_size : {0xFFFFFFF0u, 1u << 20}) {
+    std::uint32_t frame[3] = {(std::uint32_t(1) << 31) | 8, raw_size, 0};
+    REQUIRE(write(fds[0], frame, sizeof(frame)) == sizeof(frame));
+    odb::SerialInBuff is;
+    REQUIRE(!odb::recv_data_tcp(is, fds[1]));
+    REQUIRE(is.get_size() < raw_size);
+  }
+
+  close(fds[0]);
+  close(fds[1]);
+}
+
+TEST_CASE("request_read_mem_no_copy", "") {
+  odb::RequestHandler cli(false);
+  odb::RequestHandler serv(true);
+  odb::SerialOutBuff os;
+  odb::SerialInBuff is;
+
+  // Client request
+  std::vector<odb::vm_ptr_t> addrs{100, 5000};
+  std::vector<char> out0(4096);
+  std::vector<char> out1(4096);
+  char *cli_bufs[2] = {out0.data(), out1.data()};
+  odb::ReqReadMem creq;
+  creq.nbufs = 2;
+  creq.buf_size = 4096;
+  creq.in_addrs = addrs.data();
+  creq.out_bufs = cli_bufs;
+  cli.client_write_request(os, creq);
+  is.reset(os.get_data(), os.get_size());
+
+  // Server fills its buffers
+  odb::ReqReadMem sreq;
+  serv.server_read_request(is, sreq);
+  REQUIRE(sreq.nbufs == 2);
+  REQUIRE(sreq.in_addrs[1] == 5000);
+  auto data = make_bytes(8192);
+  std::memcpy(sreq.out_bufs[0], data.data(), 4096);
+  std::memcpy(sreq.out_bufs[1], data.data() + 4096, 4096);
+
+  // Memory is referenced, not copied
+  os.reset();
+  serv.server_write_response(os, sreq);
+  REQUIRE(os.get_size() == 8192);
+  REQUIRE(os.get_copied_size() == 0);
+
+  auto res = flatten(os);
+  is.reset(res.data(), res.size());
+  cli.client_read_response(is, creq);
+  is.check_eof();
+  REQUIRE(std::memcmp(out0.data(), data.data(), 4096) == 0);
+  REQUIRE(std::memcmp(out1.data(), data.data() + 4096, 4096) == 0);
+}
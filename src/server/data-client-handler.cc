@@ -4,7 +4,10 @@
 #include <cassert>
 #include <chrono>
 #include <thread>
+#include <tuple>
 
+#include "odb/mess/compress.hh"
+#include "odb/mess/fast-request.hh"
 #include "odb/mess/request-handler.hh"
 #include "odb/mess/request.hh"
 #include "odb/mess/serial.hh"
@@ -14,6 +17,12 @@
 
 namespace odb {
 
+// One object per request type, reused for every request of that type
+// Keeps the memory of their vectors and strings between requests
+#define ODB_REQ_TUPLE(Ty, Req) , Req
+using RequestObjects = std::tuple<ReqErr ODB_REQUESTS(ODB_REQ_TUPLE)>;
+#undef ODB_REQ_TUPLE
+
 class DataClientServerRunner {
 
 public:
@@ -60,6 +69,22 @@ public:
 
   RequestHandler &request_handler() { return _rh; }
 
+  // Called by main thread to write the response of a fast request
+  // Kept alive until the response is sent
+  Message &fast_res() { return _fast_res; }
+
+  RequestObjects &request_objects() { return _objs; }
+
+  // Prefetch profile of the connection
+  PrefetchProfile &prefetch() { return _prefetch; }
+
+  // Capabilities negotiated for the connection
+  std::uint32_t &caps() { return _caps; }
+
+  // Version of the call stack known by the client, see
+  // Debugger::call_stack_diff
+  std::uint64_t &stack_version() { return _stack_version; }
+
   // Called by main thread to signal thread that res is ready to be sent
   void signal_res() {
     assert(_state == State::HAS_REQ);
@@ -108,8 +133,363 @@ private:
   SerialInBuff _in;
   SerialOutBuff _out;
   RequestHandler _rh;
+  Message _fast_res;
+  RequestObjects _objs;
+  PrefetchProfile _prefetch;
+  std::uint32_t _caps = 0;
+  std::uint64_t _stack_version = 0;
 };
 
+namespace {
+
+template <class T> const T &view_fast_req(const char *data, std::size_t size) {
+  std::size_t extra;
+  auto req = Message::view_as<T>(data, size, extra);
+  if (!req || extra)
+    throw VMApi::Error("Invalid fast request");
+  return *req;
+}
+
+// Everything needed to answer one request
+struct RequestContext {
+  DBClientImplVMSide &dc;
+  RequestHandler &rh;
+  SerialInBuff &is;
+  SerialOutBuff &os;
+  Message &fast_res;
+  RequestObjects &objs;
+  PrefetchProfile &prefetch;
+  std::uint32_t &caps;
+  std::uint64_t &stack_version;
+  ServerStats &stats;
+  bool vm_running;
+};
+
+// Fill `req.out_udp`, with only the frames of the call stack the client
+// doesn't have if it takes incremental updates
+void check_stopped(RequestContext &ctx, ReqCheckStopped &req) {
+  auto &udp = req.out_udp;
+  udp.stack_version = req.in_stack_delta ? ctx.stack_version : 0;
+  ctx.dc.check_stopped(
+      udp, req.in_stack_delta ? ReqCheckStopped::STACK_MAX_FRAMES : 0);
+  if (udp.stopped && req.in_stack_delta)
+    ctx.stack_version = udp.stack_version;
+}
+
+// Answer the fast request following the ReqType in `is`
+// While the VM is running, only stop and check stopped are valid
+void run_fast_request(RequestContext &ctx) {
+  auto &dc = ctx.dc;
+  auto &is = ctx.is;
+  auto &os = ctx.os;
+  auto &res = ctx.fast_res;
+  bool vm_running = ctx.vm_running;
+  auto size = is.remaining();
+  if (size < Message::HEADER_SIZE)
+    throw VMApi::Error("Invalid fast request");
+  const char *data = is.read_ref(size);
+  auto ty = fast_message_type(data);
+  res.reset();
+
+  if (vm_running && ty != FastReqStop::MESSAGE_TYPEID &&
+      ty != FastReqCheckStopped::MESSAGE_TYPEID)
+    throw VMApi::Error(
+        "Only stop and check stopped request can be sent while VM running");
+
+  switch (ty) {
+  case FastReqStop::MESSAGE_TYPEID: {
+    view_fast_req<FastReqStop>(data, size);
+    if (!vm_running)
+      throw VMApi::Error("Cannot stop already stopped program\n");
+    dc.stop();
+    res.alloc_as<FastResStop>().tag = 0;
+    break;
+  }
+
+  case FastReqCheckStopped::MESSAGE_TYPEID: {
+    view_fast_req<FastReqCheckStopped>(data, size);
+    ReqCheckStopped req;
+    req.in_stack_delta = (ctx.caps & PROTO_CAP_STACK_DELTA) != 0;
+    check_stopped(ctx, req);
+    if (req.out_udp.stopped) {
+      // Call stack doesn't fit in a fixed layout
+      req.in_prefetch = !ctx.prefetch.empty();
+      if (req.in_prefetch)
+        dc.prefetch(ctx.prefetch, req.out_udp.prefetch);
+      os << ReqType::CHECK_STOPPED;
+      ctx.rh.server_write_response(os, req);
+      return;
+    }
+    res.alloc_as<FastResCheckStopped>().stopped = 0;
+    break;
+  }
+
+  case FastReqResume::MESSAGE_TYPEID: {
+    auto &req = view_fast_req<FastReqResume>(data, size);
+    dc.resume(static_cast<ResumeType>(req.type));
+    res.alloc_as<FastResResume>().tag = 0;
+    break;
+  }
+
+  case FastReqGetReg::MESSAGE_TYPEID: {
+    auto &req = view_fast_req<FastReqGetReg>(data, size);
+    vm_reg_t id = req.id;
+    vm_size_t regs_size[2] = {req.size, 0};
+    if (regs_size[0] > FAST_DATA_MAX_SIZE)
+      throw VMApi::Error("Invalid fast request");
+
+    res.alloc_as<FastResGetReg>(regs_size[0]).size = regs_size[0];
+    char *buf = res.extra_as<FastResGetReg>();
+    dc.get_regs(&id, &buf, regs_size, 1);
+    break;
+  }
+
+  case FastReqReadMem::MESSAGE_TYPEID: {
+    auto &req = view_fast_req<FastReqReadMem>(data, size);
+    vm_ptr_t addr = req.addr;
+    vm_size_t buf_size = req.size;
+    if (buf_size > FAST_DATA_MAX_SIZE)
+      throw VMApi::Error("Invalid fast request");
+
+    res.alloc_as<FastResReadMem>(buf_size).size = buf_size;
+    char *buf = res.extra_as<FastResReadMem>();
+    dc.read_mem(&addr, &buf_size, &buf, 1);
+    break;
+  }
+
+  default:
+    throw VMApi::Error("Bad fast API request");
+  }
+
+  os << ReqType::FAST;
+  os.write_ref(res.data(), res.data_size());
+}
+
+// Execute a request, once its input is read
+// One overload per request of ODB_REQUESTS (except CONNECT)
+
+void exec_request(RequestContext &ctx, ReqStop &) {
+  if (!ctx.vm_running)
+    throw VMApi::Error("Cannot stop already stopped program\n");
+  ctx.dc.stop();
+}
+
+void exec_request(RequestContext &ctx, ReqCheckStopped &req) {
+  check_stopped(ctx, req);
+  if (req.in_prefetch && req.out_udp.stopped)
+    ctx.dc.prefetch(ctx.prefetch, req.out_udp.prefetch);
+}
+
+void exec_request(RequestContext &ctx, ReqGetRegs &req) {
+  vm_size_t regs_sizes[2] = {req.reg_size, 0};
+  ctx.dc.get_regs(req.ids, req.out_bufs, regs_sizes, req.nregs);
+}
+
+void exec_request(RequestContext &ctx, ReqGetRegsVar &req) {
+  ctx.dc.get_regs(req.in_ids, req.out_bufs, req.in_regs_size, req.nregs);
+}
+
+void exec_request(RequestContext &ctx, ReqSetRegs &req) {
+  vm_size_t regs_sizes[2] = {req.reg_size, 0};
+  ctx.dc.set_regs(req.in_ids, (const char **)req.in_bufs, regs_sizes,
+                  req.nregs);
+}
+
+void exec_request(RequestContext &ctx, ReqSetRegsVar &req) {
+  ctx.dc.set_regs(req.in_ids, (const char **)req.in_bufs, req.in_regs_size,
+                  req.nregs);
+}
+
+void exec_request(RequestContext &ctx, ReqGetRegsInfos &req) {
+  ctx.dc.get_regs_infos(req.ids, req.out_infos, req.nregs);
+}
+
+void exec_request(RequestContext &ctx, ReqFindRegsIds &req) {
+  ctx.dc.find_regs_ids((const char **)req.in_bufs, req.out_ids, req.nregs);
+}
+
+void exec_request(RequestContext &ctx, ReqReadMem &req) {
+  vm_size_t bufs_size[2] = {req.buf_size, 0};
+  ctx.dc.read_mem(req.in_addrs, bufs_size, req.out_bufs, req.nbufs);
+}
+
+void exec_request(RequestContext &ctx, ReqReadMemVar &req) {
+  ctx.dc.read_mem(req.in_addrs, req.in_bufs_size, req.out_bufs, req.nbufs);
+}
+
+void exec_request(RequestContext &ctx, ReqWriteMem &req) {
+  vm_size_t bufs_size[2] = {req.buf_size, 0};
+  ctx.dc.write_mem(req.in_addrs, bufs_size, (const char **)req.in_bufs,
+                   req.nbufs);
+}
+
+void exec_request(RequestContext &ctx, ReqWriteMemVar &req) {
+  ctx.dc.write_mem(req.in_addrs, req.in_bufs_size, (const char **)req.in_bufs,
+                   req.nbufs);
+}
+
+void exec_request(RequestContext &ctx, ReqGetSymsByIds &req) {
+  ctx.dc.get_symbols_by_ids(req.in_ids, req.out_infos, req.nsyms);
+}
+
+void exec_request(RequestContext &ctx, ReqGetSymsByAddr &req) {
+  ctx.dc.get_symbols_by_addr(req.addr, req.size, req.out_infos);
+}
+
+void exec_request(RequestContext &ctx, ReqGetSymsByNames &req) {
+  ctx.dc.get_symbols_by_names((const char **)req.in_names, req.out_infos,
+                              req.nsyms);
+}
+
+void exec_request(RequestContext &ctx, ReqGetCodeText &req) {
+  ctx.dc.get_code_text(req.addr, req.nins, req.out_text, req.out_sizes);
+}
+
+void exec_request(RequestContext &ctx, ReqGetCodeAnnotated &req) {
+  ctx.dc.get_code_annotated(req.addr, req.nins, req.out_code);
+}
+
+void exec_request(RequestContext &ctx, ReqGetCodeAround &req) {
+  ctx.dc.get_code_around(req.addr, req.nbefore, req.nafter, req.out_code);
+}
+
+void exec_request(RequestContext &ctx, ReqGetStackSyms &req) {
+  ctx.dc.get_stack_syms(req.out_stack, req.out_frames_syms, req.out_syms);
+}
+
+void exec_request(RequestContext &ctx, ReqGetStackFrames &req) {
+  ctx.dc.get_stack_frames(req.beg, req.end, req.out_frames);
+}
+
+void exec_request(RequestContext &ctx, ReqAddBkps &req) {
+  ctx.dc.add_breakpoints(req.in_addrs, req.size);
+}
+
+void exec_request(RequestContext &ctx, ReqDelBkps &req) {
+  ctx.dc.del_breakpoints(req.in_addrs, req.size);
+}
+
+void exec_request(RequestContext &ctx, ReqResume &req) {
+  ctx.dc.resume(req.type);
+}
+
+void exec_request(RequestContext &ctx, ReqReadMemDiff &req) {
+  req.out_version = req.in_version;
+  ctx.dc.read_mem_diff(req.addr, req.size, req.out_version, req.out_pages,
+                       req.out_data);
+}
+
+void exec_request(RequestContext &ctx, ReqGetSymsTable &req) {
+  ctx.dc.get_symbols_table(req.out_table);
+}
+
+void exec_request(RequestContext &ctx, ReqSetPrefetch &req) {
+  ctx.prefetch = req.in_profile;
+}
+
+void exec_request(RequestContext &ctx, ReqGetStats &req) {
+  ctx.dc.get_stats(req.out_stats);
+}
+
+void exec_request(RequestContext &ctx, ReqGetBkps &req) {
+  ctx.dc.get_breakpoints(req.out_addrs);
+}
+
+// Read, execute and answer a request
+template <class Req> void run_request(RequestContext &ctx) {
+  auto &req = std::get<Req>(ctx.objs);
+  ctx.rh.server_read_request(ctx.is, req);
+  exec_request(ctx, req);
+  ctx.os << Req::REQ_TYPE;
+  ctx.rh.server_write_response(ctx.os, req);
+}
+
+// Connection also sets the protocol format
+template <> void run_request<ReqConnect>(RequestContext &ctx) {
+  // Always v1 format, the client may not know about newer ones
+  ctx.is.set_compact(false);
+  ctx.os.set_compact(false);
+
+  auto &req = std::get<ReqConnect>(ctx.objs);
+  ctx.rh.server_read_request(ctx.is, req);
+  req.out_udp.stack_version = 0;
+  ctx.dc.connect(req.out_infos, req.out_udp);
+  ctx.stack_version = req.out_udp.stack_version;
+  ctx.prefetch = req.in_prefetch;
+  if (req.out_udp.stopped && !ctx.prefetch.empty())
+    ctx.dc.prefetch(ctx.prefetch, req.out_udp.prefetch);
+  req.out_version = PROTO_VERSION;
+  req.out_caps = req.in_caps & PROTO_CAPS_ALL;
+  ctx.caps = req.out_caps;
+  ctx.os << ReqType::CONNECT;
+  ctx.rh.server_write_response(ctx.os, req);
+
+  // Next requests use the negotiated format
+  bool compact = req.out_caps & PROTO_CAP_COMPACT;
+  ctx.is.set_compact(compact);
+  ctx.os.set_compact(compact);
+  ctx.os.set_compress_min(req.out_caps & PROTO_CAP_COMPRESS ? COMPRESS_MIN_SIZE
+                                                             : 0);
+}
+
+using run_request_f = void (*)(RequestContext &);
+
+// Indexed by ReqType
+constexpr run_request_f REQUESTS_TABLE[] = {
+#define ODB_REQ_TABLE(Ty, Req) &run_request<Req>,
+    ODB_REQUESTS(ODB_REQ_TABLE)
+#undef ODB_REQ_TABLE
+};
+static_assert(sizeof(REQUESTS_TABLE) / sizeof(run_request_f) == REQ_COUNT,
+              "Missing requests in dispatch table");
+
+// Answer any request, or write an error response
+void dispatch_request(RequestContext &ctx) {
+  auto beg = std::chrono::steady_clock::now();
+  auto bytes_in = ctx.is.remaining();
+  ReqType ty;
+  ctx.is >> ty;
+  ctx.os.set_compressible(req_compressible(ty));
+  bool failed = false;
+
+  try {
+    if (ctx.vm_running && ty != ReqType::STOP &&
+        ty != ReqType::CHECK_STOPPED && ty != ReqType::SET_PREFETCH &&
+        ty != ReqType::GET_STATS && ty != ReqType::FAST)
+      throw VMApi::Error(
+          "Only stop and check stopped request can be sent while VM running");
+
+    auto idx = static_cast<std::size_t>(ty);
+    if (ty == ReqType::FAST)
+      run_fast_request(ctx);
+    else if (idx < REQ_COUNT)
+      REQUESTS_TABLE[idx](ctx);
+    else
+      throw VMApi::Error("Bad API request");
+
+  } catch (VMApi::Error &e) {
+    auto &err = std::get<ReqErr>(ctx.objs);
+    err.msg = e.what();
+    ctx.os << ReqType::ERR;
+    ctx.rh.server_write_response(ctx.os, err);
+    failed = true;
+  }
+
+  // Requests with an invalid type aren't counted
+  if (static_cast<std::size_t>(ty) >= REQ_COUNT && ty != ReqType::FAST)
+    return;
+  auto &stats = ctx.stats.request(ty);
+  ++stats.count;
+  stats.errors += failed;
+  stats.bytes_in += bytes_in;
+  stats.bytes_out += ctx.os.get_size();
+  stats.latency.add(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now() - beg)
+                        .count());
+}
+
+} // namespace
+
 DataClientHandler::DataClientHandler(Debugger &db, const ServerConfig &conf,
                                      Kind kind)
     : ClientHandler(db, conf), _kind(kind), _runner(nullptr) {}
@@ -147,221 +527,14 @@ void DataClientHandler::run_command() {
 
   DBClientImplVMSide dc(get_debugger());
   // @tip ok to create one at every call, just an interface without state
-  auto &rh = _runner->request_handler();
-  auto &is = _runner->get_req();
   auto &os = _runner->get_res();
   os.reset();
-
-  ReqType is_ty;
-  is >> is_ty;
-
-  try {
-    // @tip code duplication, could factorize with macros, but code wouldn't
-    // look much like valid C++.
-    switch (is_ty) {
-    case ReqType::CONNECT: {
-      ReqConnect req;
-      rh.server_read_request(is, req);
-      dc.connect(req.out_infos, req.out_udp);
-      os << is_ty;
-      rh.server_write_response(os, req);
-      break;
-    }
-
-    case ReqType::STOP: {
-      throw VMApi::Error("Cannot stop already stopped program\n");
-      /*
-    ReqStop req;
-    rh.server_read_request(is, req);
-    dc.stop();
-    os << is_ty;
-    rh.server_write_response(os, req);
-      */
-      break;
-    }
-
-    case ReqType::CHECK_STOPPED: {
-      ReqCheckStopped req;
-      rh.server_read_request(is, req);
-      dc.check_stopped(req.out_udp);
-      os << is_ty;
-      rh.server_write_response(os, req);
-      break;
-    };
-
-    case ReqType::GET_REGS: {
-      ReqGetRegs req;
-      rh.server_read_request(is, req);
-      vm_size_t regs_sizes[2] = {req.reg_size, 0};
-      dc.get_regs(req.ids, req.out_bufs, regs_sizes, req.nregs);
-      os << is_ty;
-      rh.server_write_response(os, req);
-      break;
-    };
-
-    case ReqType::GET_REGS_VAR: {
-      ReqGetRegsVar req;
-      rh.server_read_request(is, req);
-      dc.get_regs(req.in_ids, req.out_bufs, req.in_regs_size, req.nregs);
-      os << is_ty;
-      rh.server_write_response(os, req);
-      break;
-    };
-
-    case ReqType::SET_REGS: {
-      ReqSetRegs req;
-      rh.server_read_request(is, req);
-      vm_size_t regs_sizes[2] = {req.reg_size, 0};
-      dc.set_regs(req.in_ids, (const char **)req.in_bufs, regs_sizes,
-                  req.nregs);
-      os << is_ty;
-      rh.server_write_response(os, req);
-      break;
-    };
-
-    case ReqType::SET_REGS_VAR: {
-      ReqSetRegsVar req;
-      rh.server_read_request(is, req);
-      dc.set_regs(req.in_ids, (const char **)req.in_bufs, req.in_regs_size,
-                  req.nregs);
-      os << is_ty;
-      rh.server_write_response(os, req);
-      break;
-    };
-
-    case ReqType::GET_REGS_INFOS: {
-      ReqGetRegsInfos req;
-      rh.server_read_request(is, req);
-      dc.get_regs_infos(req.ids, req.out_infos, req.nregs);
-      os << is_ty;
-      rh.server_write_response(os, req);
-      break;
-    };
-
-    case ReqType::FIND_REGS_IDS: {
-      ReqFindRegsIds req;
-      rh.server_read_request(is, req);
-      dc.find_regs_ids((const char **)req.in_bufs, req.out_ids, req.nregs);
-      os << is_ty;
-      rh.server_write_response(os, req);
-      break;
-    };
-
-    case ReqType::READ_MEM: {
-      ReqReadMem req;
-      rh.server_read_request(is, req);
-      vm_size_t bufs_size[2] = {req.buf_size, 0};
-      dc.read_mem(req.in_addrs, bufs_size, req.out_bufs, req.nbufs);
-      os << is_ty;
-      rh.server_write_response(os, req);
-      break;
-    };
-
-    case ReqType::READ_MEM_VAR: {
-      ReqReadMemVar req;
-      rh.server_read_request(is, req);
-      dc.read_mem(req.in_addrs, req.in_bufs_size, req.out_bufs, req.nbufs);
-      os << is_ty;
-      rh.server_write_response(os, req);
-      break;
-    };
-
-    case ReqType::WRITE_MEM: {
-      ReqWriteMem req;
-      rh.server_read_request(is, req);
-      vm_size_t bufs_size[2] = {req.buf_size, 0};
-      dc.write_mem(req.in_addrs, bufs_size, (const char **)req.in_bufs,
-                   req.nbufs);
-      os << is_ty;
-      rh.server_write_response(os, req);
-      break;
-    };
-
-    case ReqType::WRITE_MEM_VAR: {
-      ReqWriteMemVar req;
-      rh.server_read_request(is, req);
-      dc.write_mem(req.in_addrs, req.in_bufs_size, (const char **)req.in_bufs,
-                   req.nbufs);
-      os << is_ty;
-      rh.server_write_response(os, req);
-      break;
-    };
-
-    case ReqType::GET_SYMS_BY_IDS: {
-      ReqGetSymsByIds req;
-      rh.server_read_request(is, req);
-      dc.get_symbols_by_ids(req.in_ids, req.out_infos, req.nsyms);
-      os << is_ty;
-      rh.server_write_response(os, req);
-      break;
-    };
-
-    case ReqType::GET_SYMS_BY_ADDR: {
-      ReqGetSymsByAddr req;
-      rh.server_read_request(is, req);
-      dc.get_symbols_by_addr(req.addr, req.size, req.out_infos);
-      os << is_ty;
-      rh.server_write_response(os, req);
-      break;
-    };
-
-    case ReqType::GET_SYMS_BY_NAMES: {
-      ReqGetSymsByNames req;
-      rh.server_read_request(is, req);
-      dc.get_symbols_by_names((const char **)req.in_names, req.out_infos,
-                              req.nsyms);
-      os << is_ty;
-      rh.server_write_response(os, req);
-      break;
-    };
-
-    case ReqType::GET_CODE_TEXT: {
-      ReqGetCodeText req;
-      rh.server_read_request(is, req);
-      dc.get_code_text(req.addr, req.nins, req.out_text, req.out_sizes);
-      os << is_ty;
-      rh.server_write_response(os, req);
-      break;
-    };
-
-    case ReqType::ADD_BKPS: {
-      ReqAddBkps req;
-      rh.server_read_request(is, req);
-      dc.add_breakpoints(req.in_addrs, req.size);
-      os << is_ty;
-      rh.server_write_response(os, req);
-      break;
-    };
-
-    case ReqType::DEL_BKPS: {
-      ReqDelBkps req;
-      rh.server_read_request(is, req);
-      dc.del_breakpoints(req.in_addrs, req.size);
-      os << is_ty;
-      rh.server_write_response(os, req);
-      break;
-    };
-
-    case ReqType::RESUME: {
-      ReqResume req;
-      rh.server_read_request(is, req);
-      dc.resume(req.type);
-      os << is_ty;
-      rh.server_write_response(os, req);
-      break;
-    };
-
-    default:
-      throw VMApi::Error("Bad API request");
-    }
-
-  } catch (VMApi::Error &e) {
-    ReqErr err;
-    err.msg = e.what();
-    os << ReqType::ERR;
-    rh.server_write_response(os, err);
-  }
-
+  RequestContext ctx{dc, _runner->request_handler(), _runner->get_req(), os,
+                     _runner->fast_res(), _runner->request_objects(),
+                     _runner->prefetch(), _runner->caps(),
+                     _runner->stack_version(), get_debugger().stats(),
+                     false};
+  dispatch_request(ctx);
   _runner->signal_res();
 }
 
@@ -378,48 +551,14 @@ void DataClientHandler::check_stopped() {
 
   DBClientImplVMSide dc(get_debugger());
   // @tip ok to create one at every call, just an interface without state
-  auto &rh = _runner->request_handler();
-  auto &is = _runner->get_req();
   auto &os = _runner->get_res();
   os.reset();
-
-  ReqType is_ty;
-  is >> is_ty;
-
-  try {
-    // Only stop command is valid
-    switch (is_ty) {
-
-    case ReqType::STOP: {
-      ReqStop req;
-      rh.server_read_request(is, req);
-      dc.stop();
-      os << is_ty;
-      rh.server_write_response(os, req);
-      break;
-    }
-
-    case ReqType::CHECK_STOPPED: {
-      ReqCheckStopped req;
-      rh.server_read_request(is, req);
-      dc.check_stopped(req.out_udp);
-      os << is_ty;
-      rh.server_write_response(os, req);
-      break;
-    };
-
-    default:
-      throw VMApi::Error(
-          "Only stop and check stopped request can be sent while VM running");
-    }
-
-  } catch (VMApi::Error &e) {
-    ReqErr err;
-    err.msg = e.what();
-    os << ReqType::ERR;
-    rh.server_write_response(os, err);
-  }
-
+  RequestContext ctx{dc, _runner->request_handler(), _runner->get_req(), os,
+                     _runner->fast_res(), _runner->request_objects(),
+                     _runner->prefetch(), _runner->caps(),
+                     _runner->stack_version(), get_debugger().stats(),
+                     true};
+  dispatch_request(ctx);
   _runner->signal_res();
 }
 
@@ -1,5 +1,6 @@
 #include "odb/server/db-client-impl-vmside.hh"
 
+#include <algorithm>
 #include <cassert>
 
 #include "odb/mess/db-client.hh"
@@ -20,10 +21,40 @@ bool is_running(const Debugger &db) {
     return false;
   }
 }
+
+// Register value, read as a little-endian integer
+vm_ptr_t read_reg_val(Debugger &db, vm_reg_t id) {
+  auto infos = db.get_reg_infos(id);
+  std::vector<std::uint8_t> buf(infos.size);
+  db.get_reg(id, buf.data());
+
+  vm_ptr_t res = 0;
+  for (std::size_t i = std::min<std::size_t>(buf.size(), sizeof(res)); i > 0;
+       --i)
+    res = (res << 8) | buf[i - 1];
+  return res;
+}
+
+// Add all symbols in [addr, addr + size[
+void prefetch_syms(DBClientImplVMSide &dc, StopPrefetch &out, vm_ptr_t addr,
+                   vm_size_t size) {
+  std::vector<SymbolInfos> syms;
+  try {
+    dc.get_symbols_by_addr(addr, size, syms);
+  } catch (VMApi::Error &) {
+    return;
+  }
+  out.sym_addrs.push_back(addr);
+  out.sym_sizes.push_back(size);
+  out.syms.insert(out.syms.end(), syms.begin(), syms.end());
+}
+
 } // namespace
 
 DBClientImplVMSide::DBClientImplVMSide(Debugger &db) : _db(db) {}
 
+DBClientImplVMSide::~DBClientImplVMSide() = default;
+
 void DBClientImplVMSide::connect(VMInfos &infos, DBClientUpdate &udp) {
   infos = _db.get_vm_infos();
   check_stopped(udp);
@@ -32,6 +63,12 @@ void DBClientImplVMSide::connect(VMInfos &infos, DBClientUpdate &udp) {
 void DBClientImplVMSide::stop() { _db.stop(); }
 
 void DBClientImplVMSide::check_stopped(DBClientUpdate &udp) {
+  check_stopped(udp, 0);
+}
+
+void DBClientImplVMSide::check_stopped(DBClientUpdate &udp,
+                                       std::size_t max_frames) {
+  udp.prefetch = StopPrefetch{};
   if (is_running(_db)) {
     udp.stopped = false;
     return;
@@ -54,7 +91,15 @@ void DBClientImplVMSide::check_stopped(DBClientUpdate &udp) {
 
   udp.stopped = true;
   udp.addr = _db.get_execution_point();
-  udp.stack = _db.get_call_stack();
+  const auto &stack = _db.get_call_stack();
+  udp.stack_keep = _db.call_stack_diff(udp.stack_version);
+  udp.stack_depth = stack.size();
+  auto beg = udp.stack_keep;
+  if (max_frames && stack.size() - beg > max_frames)
+    beg = stack.size() - max_frames;
+  udp.stack.assign(stack.begin() + beg, stack.end());
+  if (_prefetch)
+    prefetch(*_prefetch, udp.prefetch);
 }
 
 void DBClientImplVMSide::get_regs(const vm_reg_t *ids, char **out_bufs,
@@ -116,6 +161,13 @@ void DBClientImplVMSide::write_mem(const vm_ptr_t *dst_addrs,
   }
 }
 
+void DBClientImplVMSide::read_mem_diff(vm_ptr_t addr, vm_size_t size,
+                                       std::uint64_t &version,
+                                       std::vector<vm_size_t> &out_pages,
+                                       std::vector<char> &out_data) {
+  _db.read_mem_diff(addr, size, version, out_pages, out_data);
+}
+
 void DBClientImplVMSide::get_symbols_by_ids(const vm_sym_t *ids,
                                             SymbolInfos *out_infos,
                                             std::size_t nsyms) {
@@ -141,6 +193,14 @@ void DBClientImplVMSide::get_symbols_by_names(const char **names,
   }
 }
 
+void DBClientImplVMSide::get_symbols_table(SymbolsTable &out_table) {
+  out_table = SymbolsTable{};
+  // Sorted by address
+  auto ids = _db.get_symbols(0, _db.get_vm_infos().memory_size);
+  for (auto id : ids)
+    out_table.push_back(_db.get_symbol_infos(id));
+}
+
 void DBClientImplVMSide::get_code_text(vm_ptr_t addr, std::size_t nins,
                                        std::vector<std::string> &out_text,
 				       std::vector<vm_size_t>& out_sizes) {
@@ -155,6 +215,60 @@ void DBClientImplVMSide::get_code_text(vm_ptr_t addr, std::size_t nins,
   }
 }
 
+void DBClientImplVMSide::get_code_annotated(vm_ptr_t addr, std::size_t nins,
+                                            CodeAnnotated &out_code) {
+  out_code = CodeAnnotated{};
+  for (std::size_t i = 0; i < nins; ++i) {
+    vm_size_t dist;
+    out_code.push_back(addr, 0, _db.get_code_text(addr, dist));
+    out_code.sizes.back() = dist;
+    addr += dist;
+  }
+  if (!nins)
+    return;
+
+  auto first = out_code.addrs.front();
+  for (auto id : _db.get_symbols(first, out_code.addrs.back() - first + 1))
+    out_code.add_sym(_db.get_symbol_infos(id));
+  for (auto id : out_code.missing_syms())
+    out_code.add_sym(_db.get_symbol_infos(id));
+}
+
+void DBClientImplVMSide::get_code_around(vm_ptr_t addr, std::size_t nbefore,
+                                         std::size_t nafter,
+                                         CodeAnnotated &out_code) {
+  vm_size_t nfound;
+  auto start = _db.find_code_before(addr, nbefore, nfound);
+  get_code_annotated(start, nfound + nafter, out_code);
+}
+
+void DBClientImplVMSide::get_stack_syms(
+    CallStack &out_stack, std::vector<vm_sym_t> &out_frames_syms,
+    std::vector<SymbolInfos> &out_syms) {
+  out_stack = _db.get_call_stack();
+  out_frames_syms.clear();
+  out_syms.clear();
+  for (const auto &frame : out_stack) {
+    vm_size_t off;
+    auto id = _db.get_symbol_containing(frame.caller_start_addr, off);
+    out_frames_syms.push_back(id);
+    // Recursive calls: same symbol for many frames
+    if (id != VM_SYM_NULL &&
+        std::find_if(out_syms.begin(), out_syms.end(), [id](const auto &s) {
+          return s.idx == id;
+        }) == out_syms.end())
+      out_syms.push_back(_db.get_symbol_infos(id));
+  }
+}
+
+void DBClientImplVMSide::get_stack_frames(std::size_t beg, std::size_t end,
+                                          CallStack &out_frames) {
+  const auto &stack = _db.get_call_stack();
+  if (beg > end || end > stack.size())
+    throw VMApi::Error("get_stack_frames: invalid range");
+  out_frames.assign(stack.begin() + beg, stack.begin() + end);
+}
+
 void DBClientImplVMSide::add_breakpoints(const vm_ptr_t *addrs,
                                          std::size_t size) {
   for (std::size_t i = 0; i < size; ++i)
@@ -170,4 +284,83 @@ void DBClientImplVMSide::del_breakpoints(const vm_ptr_t *addrs,
 
 void DBClientImplVMSide::resume(ResumeType type) { _db.resume(type); }
 
+void DBClientImplVMSide::set_prefetch(const PrefetchProfile &profile) {
+  if (profile.empty())
+    _prefetch.reset();
+  else
+    _prefetch = std::make_unique<PrefetchProfile>(profile);
+}
+
+void DBClientImplVMSide::get_breakpoints(std::vector<vm_ptr_t> &out_addrs) {
+  const auto &bkps = _db.breakpoints();
+  out_addrs.assign(bkps.begin(), bkps.end());
+}
+
+bool DBClientImplVMSide::has_cap(std::uint32_t) const { return true; }
+
+void DBClientImplVMSide::get_stats(ServerStats &out_stats) {
+  out_stats = _db.stats();
+}
+
+void DBClientImplVMSide::prefetch(const PrefetchProfile &profile,
+                                  StopPrefetch &out) {
+  out = StopPrefetch{};
+  vm_size_t mem_size = _db.get_vm_infos().memory_size;
+
+  for (auto id : profile.regs) {
+    try {
+      auto infos = _db.get_reg_infos(id);
+      std::vector<char> val(infos.size);
+      _db.get_reg(id, reinterpret_cast<std::uint8_t *>(val.data()));
+      out.reg_ids.push_back(id);
+      out.reg_vals.push_back(std::move(val));
+    } catch (VMApi::Error &) {
+    }
+  }
+
+  // Windows are clipped to the memory, then extended to the alignment
+  vm_size_t align = std::max<vm_size_t>(profile.mem_align, 1);
+  for (const auto &w : profile.mems) {
+    try {
+      auto base = static_cast<vm_ssize_t>(read_reg_val(_db, w.base_reg));
+      auto beg = std::max<vm_ssize_t>(base + w.offset, 0);
+      auto end = std::min<vm_ssize_t>(base + w.offset + w.size, mem_size);
+      if (beg >= end)
+        continue;
+      beg = beg / align * align;
+      end = std::min<vm_ssize_t>((end + align - 1) / align * align, mem_size);
+
+      std::vector<char> data(end - beg);
+      _db.read_mem(beg, data.size(),
+                   reinterpret_cast<std::uint8_t *>(data.data()));
+      out.mem_addrs.push_back(beg);
+      out.mem_data.push_back(std::move(data));
+    } catch (VMApi::Error &) {
+    }
+  }
+
+  if (profile.code_nins) {
+    try {
+      vm_size_t nfound;
+      out.code_addr = _db.find_code_before(_db.get_execution_point(),
+                                           profile.code_before, nfound);
+      get_code_text(out.code_addr, profile.code_nins, out.code_text,
+                    out.code_sizes);
+    } catch (VMApi::Error &) {
+      out.code_text.clear();
+      out.code_sizes.clear();
+    }
+
+    vm_size_t size = 0;
+    for (auto ins_size : out.code_sizes)
+      size += ins_size;
+    if (size)
+      prefetch_syms(*this, out, out.code_addr, size);
+  }
+
+  if (profile.stack_syms)
+    for (const auto &frame : _db.get_call_stack())
+      prefetch_syms(*this, out, frame.caller_start_addr, 1);
+}
+
 } // namespace odb
@@ -2,126 +2,59 @@
 
 #include <algorithm>
 #include <cassert>
+#include <iterator>
 
-#include <iostream>
+#include "odb/server/event-log.hh"
+#include "odb/server/instrumented-vm-api.hh"
 
-#ifdef ODB_SERVER_DB_LOG
-#include <fstream>
-#endif
+// Only evaluates the arguments when the event is logged
+#define DB_LOG(Ev, ...)                                                        \
+  do {                                                                         \
+    if (_log && _log->enabled(LogEvent::Ev))                                   \
+      _log->log(LogEvent::Ev, __VA_ARGS__);                                    \
+  } while (0)
 
-#ifdef ODB_SERVER_DB_LOG
-
-#define CASE_PRINT_ENUM(Enum, Val)                                             \
-  case Enum::Val:                                                              \
-    os << #Val;                                                                \
-    break
+namespace odb {
 
 namespace {
 
-std::ostream &log_os() {
-  static std::ofstream os("./odb_server_db.logs");
-  return os;
-}
-
-std::ostream &operator<<(std::ostream &os, const odb::Debugger::State &st) {
-  switch (st) {
-    CASE_PRINT_ENUM(odb::Debugger::State, NOT_STARTED);
-    CASE_PRINT_ENUM(odb::Debugger::State, STOPPED);
-    CASE_PRINT_ENUM(odb::Debugger::State, RUNNING_TOFINISH);
-    CASE_PRINT_ENUM(odb::Debugger::State, RUNNING_BKP);
-    CASE_PRINT_ENUM(odb::Debugger::State, RUNNING_STEP);
-    CASE_PRINT_ENUM(odb::Debugger::State, RUNNING_STEP_OVER);
-    CASE_PRINT_ENUM(odb::Debugger::State, RUNNING_STEP_OUT);
-    CASE_PRINT_ENUM(odb::Debugger::State, ERROR);
-    CASE_PRINT_ENUM(odb::Debugger::State, EXIT);
-  }
-  return os;
-}
-
-std::ostream &operator<<(std::ostream &os, const odb::ResumeType &t) {
-  switch (t) {
-    CASE_PRINT_ENUM(odb::ResumeType, ToFinish);
-    CASE_PRINT_ENUM(odb::ResumeType, Continue);
-    CASE_PRINT_ENUM(odb::ResumeType, Step);
-    CASE_PRINT_ENUM(odb::ResumeType, StepOver);
-    CASE_PRINT_ENUM(odb::ResumeType, StepOut);
+// FNV-1a, only used to detect changes
+std::uint64_t hash_bytes(const std::uint8_t *data, std::size_t size) {
+  std::uint64_t res = 14695981039346656037ULL;
+  for (std::size_t i = 0; i < size; ++i) {
+    res ^= data[i];
+    res *= 1099511628211ULL;
   }
-  return os;
+  return res;
 }
 
-void dump_regs_list(std::ostream &os, const char *name,
-                    const std::vector<odb::vm_reg_t> &regs) {
-  if (regs.empty())
-    return;
-  os << "    " << name << ": ";
-
-  for (std::size_t i = 0; i < regs.size(); ++i) {
-    if (i > 0)
-      os << ", ";
-    os << regs[i];
-  }
-  os << "\n";
-}
-
-std::ostream &operator<<(std::ostream &os, const odb::VMInfos &infos) {
-  os << "\n<======= VM INFOS:\n";
-  os << "  name: " << infos.name << "\n";
-  os << "  registers count: " << infos.regs_count << "\n";
-  dump_regs_list(os, "general", infos.regs_general);
-  dump_regs_list(os, "program counter", infos.regs_program_counter);
-  dump_regs_list(os, "stack pointer", infos.regs_stack_pointer);
-  dump_regs_list(os, "base pointer", infos.regs_base_pointer);
-  dump_regs_list(os, "flags", infos.regs_flags);
-  os << "  memory size: " << infos.memory_size << "\n";
-  os << "  symbols count: " << infos.symbols_count << "\n";
-  os << "  pointer size: " << infos.pointer_size << "\n";
-  os << "  integer size: " << infos.integer_size << "\n";
-  os << "  use opcode: " << infos.use_opcode << "\n";
-
-  os << " VM INFOS =======>\n\n";
-  return os;
-}
-
-std::ostream &operator<<(std::ostream &os, const odb::VMApi::UpdateState &st) {
-  switch (st) {
-    CASE_PRINT_ENUM(odb::VMApi::UpdateState, ERROR);
-    CASE_PRINT_ENUM(odb::VMApi::UpdateState, EXIT);
-    CASE_PRINT_ENUM(odb::VMApi::UpdateState, CALL_SUB);
-    CASE_PRINT_ENUM(odb::VMApi::UpdateState, RET_SUB);
-    CASE_PRINT_ENUM(odb::VMApi::UpdateState, OK);
+// Erase all items of `map` overlapping [addr, addr + size[
+// Items are {start address, V}, with a size given by `item_size(V)`, at most
+// `max_size`
+template <class V, class F>
+void erase_overlapping(std::map<vm_ptr_t, V> &map, vm_size_t max_size,
+                       vm_ptr_t addr, vm_size_t size, F item_size) {
+  auto first = addr < max_size ? 0 : addr - max_size;
+  auto it = map.lower_bound(first);
+  while (it != map.end() && it->first < addr + size) {
+    if (it->first + item_size(it->second) > addr)
+      it = map.erase(it);
+    else
+      ++it;
   }
-  return os;
-}
-
-std::ostream &operator<<(std::ostream &os, const odb::VMApi::UpdateInfos &udp) {
-  return os << "update: " << udp.state << ", addr: " << udp.act_addr;
 }
 
 } // namespace
 
-#define DB_LOG(Mes) (log_os() << Mes << std::endl)
-#define DB_LOG_UPDATE(Mess)                                                    \
-  DB_LOG("on_update(): " << Mess << ": " << udp << ", old_state: "             \
-                         << __log_old_state << ", new_state: " << _state)
-
-#else
-
-#define DB_LOG(Mes)
-#define DB_LOG_UPDATE(Mess)
-
-#endif
-
-namespace odb {
-
-namespace {
-
-constexpr vm_ptr_t SYM_LOAD_SIZE = 256;
-
-}
-
 Debugger::Debugger(std::unique_ptr<VMApi> &&vm)
     : _vm(std::move(vm)), _state(State::NOT_STARTED) {
   assert(_vm.get());
+  _stats.vm_calls.resize(VM_API_CALLS_COUNT);
+}
+
+void Debugger::enable_vm_profile() {
+  assert(_state == State::NOT_STARTED);
+  _vm = std::make_unique<InstrumentedVMApi>(std::move(_vm), _stats.vm_profile);
 }
 
 void Debugger::on_init() {
@@ -129,18 +62,28 @@ void Debugger::on_init() {
 
   // 1) get general VM infos
   _state = State::RUNNING_TOFINISH;
-  DB_LOG("vm.get_vm_infos()");
-  _infos = _vm->get_vm_infos();
-  DB_LOG(_infos);
+  _infos = _vm_call(VMApiCall::GET_VM_INFOS).get_vm_infos();
+  DB_LOG(VM_INFOS, _infos.regs_count, _infos.memory_size,
+         _infos.symbols_count);
   _syms_ranges = std::make_unique<RangeMap<int>>(0, _infos.memory_size - 1, 0);
 
   // 2) Get extra usefull informations
-  // @EXTRA get all registers if count below a threshold
-  // @EXTRA get all symbols if count below a threshold
+  if (_infos.symbols_count <= SYMS_PRELOAD_MAX) {
+    DB_LOG(VM_GET_SYMBOLS, 0, 0, _infos.memory_size);
+    ++_syms_stats.vm_get_symbols;
+    auto syms =
+        _vm_call(VMApiCall::GET_SYMBOLS).get_symbols(0, _infos.memory_size);
+    _syms.reserve(syms.size());
+    for (auto id : syms)
+      _load_symbol(id);
+    _syms_ranges->set(0, _infos.memory_size - 1, 1);
+  }
+  if (_infos.regs_count <= REGS_PRELOAD_MAX)
+    for (vm_reg_t i = 0; i < _infos.regs_count; ++i)
+      _load_reg(i);
 
   // 3) Get entry point and init stack frame
-  DB_LOG("vm.get_update_infos()");
-  auto upd = _vm->get_update_infos();
+  auto upd = _vm_call(VMApiCall::GET_UPDATE_INFOS).get_update_infos();
   assert(upd.state == VMApi::UpdateState::OK);
   _ins_addr = upd.act_addr;
 
@@ -148,26 +91,22 @@ void Debugger::on_init() {
   start.caller_start_addr = _ins_addr;
   _call_stack.push_back(start);
 
-  DB_LOG("on_init(): addr = " << _ins_addr << ", state = " << _state);
+  DB_LOG(INIT, static_cast<std::uint32_t>(_state), _ins_addr);
 }
 
 void Debugger::on_update() {
   assert(_state != State::NOT_STARTED && _state != State::STOPPED &&
          _state != State::ERROR && _state != State::EXIT);
-#ifdef ODB_SERVER_DB_LOG
-  auto __log_old_state = _state;
-#endif
-
-  DB_LOG("vm.get_update_infos()");
-  auto udp = _vm->get_update_infos();
+  ++_regs_gen;
+  auto udp = _vm_call(VMApiCall::GET_UPDATE_INFOS).get_update_infos();
   if (udp.state == VMApi::UpdateState::ERROR) {
     _state = State::ERROR;
-    DB_LOG_UPDATE("VM Error");
+    DB_LOG(VM_ERROR, 0, udp.act_addr);
     return;
   }
   if (udp.state == VMApi::UpdateState::EXIT) {
     _state = State::EXIT;
-    DB_LOG("on_update(): addr = " << _ins_addr << ", state = " << _state);
+    DB_LOG(EXIT, 0, _ins_addr);
     return;
   }
 
@@ -175,6 +114,7 @@ void Debugger::on_update() {
   _ins_addr = udp.act_addr;
 
   if (udp.state == VMApi::UpdateState::CALL_SUB) {
+    _call_stack_low = std::min(_call_stack_low, _call_stack.size() - 1);
     _call_stack.back().call_addr = old_addr;
     CallInfos new_call;
     new_call.caller_start_addr = _ins_addr;
@@ -182,58 +122,68 @@ void Debugger::on_update() {
   } else if (udp.state == VMApi::UpdateState::RET_SUB) {
     assert(!_call_stack.empty());
     _call_stack.pop_back();
+    _call_stack_low = std::min(_call_stack_low, _call_stack.size());
   }
 
-  if (_state == State::RUNNING_TOFINISH) {
-    DB_LOG_UPDATE("nostop");
+  DB_LOG(UPDATE, static_cast<std::uint32_t>(udp.state), _ins_addr,
+         static_cast<std::uint64_t>(_state));
+  if (_state == State::RUNNING_TOFINISH)
     return;
-  }
 
   if (_state == State::RUNNING_STEP) {
     _state = State::STOPPED;
-    DB_LOG_UPDATE("step stop");
+    DB_LOG(STOP, static_cast<std::uint32_t>(LogStopReason::STEP),
+           _ins_addr);
     return;
   }
 
   if (_state == State::RUNNING_STEP_OVER &&
       _step_over_depth >= _call_stack.size()) {
     _state = State::STOPPED;
-    DB_LOG_UPDATE("step_over stop");
+    DB_LOG(STOP, static_cast<std::uint32_t>(LogStopReason::STEP_OVER),
+           _ins_addr);
     return;
   }
 
   if (_state == State::RUNNING_STEP_OUT &&
       udp.state == VMApi::UpdateState::RET_SUB) {
     _state = State::STOPPED;
-    DB_LOG_UPDATE("step_out stop");
+    DB_LOG(STOP, static_cast<std::uint32_t>(LogStopReason::STEP_OUT),
+           _ins_addr);
     return;
   }
 
   if (_breakpts.find(_ins_addr) != _breakpts.end()) {
-    DB_LOG("trigger breakpoint " << _ins_addr);
     _state = State::STOPPED;
+    ++_stats.bkp_hits[_ins_addr];
+    DB_LOG(STOP, static_cast<std::uint32_t>(LogStopReason::BREAKPOINT),
+           _ins_addr);
   }
-
-  DB_LOG_UPDATE("_");
 }
 
 void Debugger::get_reg(vm_reg_t idx, std::uint8_t *val) {
-  // @EXTRA add caching system to avoid reloading the register every time
-  _load_reg(idx);
-  auto &infos = _map_regs.find(idx)->second;
-  DB_LOG("vm.get_reg(" << idx << ", infos, true)");
-  _vm->get_reg(idx, infos, true);
+  auto &reg = _load_reg(idx);
+  auto &infos = reg.infos;
+  if (!_regs_cache || reg.val_gen != _regs_gen) {
+    DB_LOG(VM_GET_REG, idx);
+    reg.val_gen = 0;
+    _vm_call(VMApiCall::GET_REG).get_reg(idx, infos, true);
+    reg.val_gen = _regs_gen;
+  }
   std::copy_n(&infos.val[0], infos.size, val);
 }
 
 void Debugger::set_reg(vm_reg_t idx, const std::uint8_t *new_val) {
-  DB_LOG("vm.set_reg(" << idx << ", " << (void *)new_val << ")");
-  _vm->set_reg(idx, new_val);
+  DB_LOG(VM_SET_REG, idx);
+  // The VM may not store the value as is (eg: read-only bits)
+  auto it = _map_regs.find(idx);
+  if (it != _map_regs.end())
+    it->second.val_gen = 0;
+  _vm_call(VMApiCall::SET_REG).set_reg(idx, new_val);
 }
 
 RegInfos Debugger::get_reg_infos(vm_reg_t idx) {
-  _load_reg(idx);
-  return _map_regs.find(idx)->second;
+  return _load_reg(idx).infos;
 }
 
 vm_reg_t Debugger::find_reg_id(const std::string &name) {
@@ -241,8 +191,8 @@ vm_reg_t Debugger::find_reg_id(const std::string &name) {
   if (it != _smap_regs.end())
     return it->second;
 
-  DB_LOG("vm.find_reg_id(" << name << ")");
-  auto id = _vm->find_reg_id(name);
+  auto id = _vm_call(VMApiCall::FIND_REG_ID).find_reg_id(name);
+  DB_LOG(VM_FIND_REG, id);
   _load_reg(id);
   return id;
 }
@@ -265,60 +215,164 @@ const std::vector<vm_reg_t> &Debugger::list_regs(RegKind kind) const {
 }
 
 void Debugger::read_mem(vm_ptr_t addr, vm_size_t size, std::uint8_t *out_buf) {
-  DB_LOG("vm.read_mem(" << addr << ", " << size << ", " << (void *)out_buf
-                        << ")");
-  _vm->read_mem(addr, size, out_buf);
+  DB_LOG(VM_READ_MEM, 0, addr, size);
+  _vm_call(VMApiCall::READ_MEM).read_mem(addr, size, out_buf);
 }
 
 void Debugger::write_mem(vm_ptr_t addr, vm_size_t size,
                          const std::uint8_t *buf) {
-  DB_LOG("vm.write_mem(" << addr << ", " << size << ", " << (void *)buf << ")");
-  _vm->write_mem(addr, size, buf);
+  DB_LOG(VM_WRITE_MEM, 0, addr, size);
+
+  // Drop all instructions overlapping the write, even if it fails
+  erase_overlapping(_code_cache, _code_cache_max_ins, addr, size,
+                    [](const CodeCacheIns &ins) { return ins.size; });
+  erase_overlapping(_ins_index, _ins_index_max, addr, size,
+                    [](vm_size_t ins_size) { return ins_size; });
+
+  _vm_call(VMApiCall::WRITE_MEM).write_mem(addr, size, buf);
+}
+
+void Debugger::read_mem_diff(vm_ptr_t addr, vm_size_t size,
+                             std::uint64_t &version,
+                             std::vector<vm_size_t> &out_pages,
+                             std::vector<char> &out_data) {
+  out_pages.clear();
+  out_data.clear();
+  _mem_diff_buf.resize(size);
+  read_mem(addr, size, _mem_diff_buf.data());
+
+  auto key = std::make_pair(addr, size);
+  auto it = _mem_diff_regions.find(key);
+  if (it == _mem_diff_regions.end()) {
+    if (_mem_diff_regions.size() == MEM_DIFF_MAX_REGIONS) {
+      auto lru = std::min_element(
+          _mem_diff_regions.begin(), _mem_diff_regions.end(),
+          [](const auto &a, const auto &b) {
+            return a.second.last_use < b.second.last_use;
+          });
+      _mem_diff_regions.erase(lru);
+    }
+    it = _mem_diff_regions.emplace(key, MemDiffRegion{0, 0, {}}).first;
+  }
+
+  auto &reg = it->second;
+  reg.last_use = ++_mem_diff_tick;
+  vm_size_t npages = (size + MEM_DIFF_PAGE_SIZE - 1) / MEM_DIFF_PAGE_SIZE;
+  bool full = version == 0 || version != reg.version;
+  reg.hashes.resize(npages);
+
+  for (vm_size_t i = 0; i < npages; ++i) {
+    auto page = &_mem_diff_buf[i * MEM_DIFF_PAGE_SIZE];
+    auto page_size = std::min(MEM_DIFF_PAGE_SIZE, size - i * MEM_DIFF_PAGE_SIZE);
+    auto hash = hash_bytes(page, page_size);
+    if (!full && hash == reg.hashes[i])
+      continue;
+
+    reg.hashes[i] = hash;
+    out_pages.push_back(i);
+    out_data.insert(out_data.end(), page, page + page_size);
+  }
+
+  if (!out_pages.empty() || full)
+    reg.version = ++_mem_diff_version;
+  version = reg.version;
 }
 
 vm_size_t Debugger::get_memory_size() { return _infos.memory_size; }
 
 vm_sym_t Debugger::get_symbol_at(vm_ptr_t addr) {
+  ++_syms_stats.queries;
   _preload_symbols(addr);
-  auto it = _syms_pos.find(addr);
-  return it == _syms_pos.end() ? VM_SYM_NULL : it->second;
+  auto idx = _syms.lower_bound(addr);
+  return idx == SymbolStore::npos || _syms.addr(idx) != addr ? VM_SYM_NULL
+                                                              : _syms.id(idx);
 }
 
-std::vector<vm_sym_t> Debugger::get_symbols(vm_ptr_t addr, vm_size_t size) {
-  _preload_symbols(addr, size);
-  auto end = addr + size;
-  std::vector<vm_sym_t> res;
+vm_sym_t Debugger::get_symbol_containing(vm_ptr_t addr, vm_size_t &out_off) {
+  ++_syms_stats.queries;
+  if (addr >= _infos.memory_size)
+    return VM_SYM_NULL;
+  _preload_symbols(addr);
 
-  auto it = _syms_pos.lower_bound(addr);
-  while (it != _syms_pos.end() && it->first < end) {
-    res.push_back(it->second);
-    ++it;
+  // Load bigger windows before `addr` until the closest symbol is in the
+  // loaded range around `addr`
+  auto min_addr =
+      addr < SYM_CONTAINING_MAX_DIST ? 0 : addr - SYM_CONTAINING_MAX_DIST;
+  auto size = SYM_WINDOW_MIN;
+  for (;;) {
+    auto loaded_low = _syms_ranges->range_of(addr).low;
+    auto idx = _syms.find_before(addr + 1);
+    if (idx != SymbolStore::npos && _syms.addr(idx) >= loaded_low) {
+      if (_syms.addr(idx) < min_addr)
+        return VM_SYM_NULL;
+      out_off = addr - _syms.addr(idx);
+      return _syms.id(idx);
+    }
+    if (loaded_low <= min_addr)
+      return VM_SYM_NULL;
+
+    auto low = loaded_low - std::min(size, loaded_low - min_addr);
+    _preload_symbols(low, loaded_low - low);
+    size *= 2;
   }
+}
 
+std::vector<vm_sym_t> Debugger::get_symbols(vm_ptr_t addr, vm_size_t size) {
+  ++_syms_stats.queries;
+  _preload_symbols(addr, size);
+  std::vector<vm_sym_t> res;
+  _syms.find_range(addr, size, res);
   return res;
 }
 
 SymbolInfos Debugger::get_symbol_infos(vm_sym_t idx) {
-  _load_symbol(idx);
-  auto it = _map_syms.find(idx);
-  assert(it != _map_syms.end());
-  return it->second;
+  ++_syms_stats.queries;
+  return _syms.infos(_load_symbol(idx));
 }
 
 vm_sym_t Debugger::symbols_count() { return _infos.symbols_count; }
 
 vm_sym_t Debugger::find_sym_id(const std::string &name) {
-  DB_LOG("vm.find_sym_id(" << name << ")");
-  auto id = _vm->find_sym_id(name);
+  ++_syms_stats.queries;
+  auto idx = _syms.find_name(name);
+  if (idx != SymbolStore::npos)
+    return _syms.id(idx);
+
+  ++_syms_stats.vm_find_sym_id;
+  auto id = _vm_call(VMApiCall::FIND_SYM_ID).find_sym_id(name);
+  DB_LOG(VM_FIND_SYM, 0, id);
   _load_symbol(id);
   return id;
 }
 
 std::string Debugger::get_code_text(vm_ptr_t addr, vm_size_t &addr_dist) {
-  // @EXTRA: cache result and/or be able to load more than one at once
-  DB_LOG("vm.get_code_text(" << addr << ", "
-                             << "addr_dist)");
-  return _vm->get_code_text(addr, addr_dist);
+  auto it = _code_cache.find(addr);
+  if (it != _code_cache.end()) {
+    addr_dist = it->second.size;
+    return it->second.text;
+  }
+
+  DB_LOG(VM_GET_CODE_TEXT, 0, addr);
+  auto text =
+      _vm_call(VMApiCall::GET_CODE_TEXT).get_code_text(addr, addr_dist);
+  if (_code_cache.size() == CODE_CACHE_MAX_SIZE) {
+    _code_cache.clear();
+    _code_cache_max_ins = 0;
+  }
+  _code_cache.emplace(addr, CodeCacheIns{text, addr_dist});
+  _code_cache_max_ins = std::max(_code_cache_max_ins, addr_dist);
+  return text;
+}
+
+vm_ptr_t Debugger::find_code_before(vm_ptr_t addr, vm_size_t nins,
+                                    vm_size_t &out_nins) {
+  out_nins = 0;
+  vm_ptr_t start;
+  while (out_nins < nins && _find_ins_before(addr, start)) {
+    addr = start;
+    ++out_nins;
+  }
+  return addr;
 }
 
 vm_ptr_t Debugger::get_execution_point() { return _ins_addr; }
@@ -330,7 +384,7 @@ vm_size_t Debugger::integer_size() { return _infos.integer_size; }
 bool Debugger::use_opcode() { return _infos.use_opcode; }
 
 void Debugger::add_breakpoint(vm_ptr_t addr) {
-  DB_LOG("add breakpoint(" << addr << ")");
+  DB_LOG(ADD_BKP, 0, addr);
   if (addr >= _infos.memory_size)
     throw VMApi::Error(
         "cannot add breakpoint: address outside of memory range");
@@ -347,7 +401,7 @@ bool Debugger::has_breakpoint(vm_ptr_t addr) {
 }
 
 void Debugger::del_breakpoint(vm_ptr_t addr) {
-  DB_LOG("del breakpoint(" << addr << ")");
+  DB_LOG(DEL_BKP, 0, addr);
   if (addr >= _infos.memory_size)
     throw VMApi::Error(
         "cannot delete breakpoint: address outside of memory range");
@@ -357,7 +411,7 @@ void Debugger::del_breakpoint(vm_ptr_t addr) {
 }
 
 void Debugger::resume(ResumeType type) {
-  DB_LOG("resume(" << type << ")");
+  DB_LOG(RESUME, static_cast<std::uint32_t>(type));
   if (_state == State::EXIT || _state == State::ERROR)
     throw VMApi::Error("cannot resume execution: program already finished");
 
@@ -374,8 +428,17 @@ void Debugger::resume(ResumeType type) {
     _state = State::RUNNING_STEP_OUT;
 }
 
+std::size_t Debugger::call_stack_diff(std::uint64_t &version) {
+  std::size_t keep = 0;
+  if (version && version == _call_stack_version)
+    keep = std::min(_call_stack_low, _call_stack.size());
+  version = ++_call_stack_version;
+  _call_stack_low = _call_stack.size();
+  return keep;
+}
+
 void Debugger::stop() {
-  DB_LOG("stop()");
+  DB_LOG(STOP_REQUEST, 0);
   assert(_state != State::NOT_STARTED);
   if (_state == State::EXIT || _state == State::ERROR)
     throw VMApi::Error("cannot stop execution: program already finished");
@@ -384,61 +447,177 @@ void Debugger::stop() {
   _state = State::STOPPED;
 }
 
-void Debugger::_load_reg(vm_reg_t id) {
-
-  if (_map_regs.find(id) != _map_regs.end())
-    return;
+Debugger::RegEntry &Debugger::_load_reg(vm_reg_t id) {
+  auto it = _map_regs.find(id);
+  if (it != _map_regs.end())
+    return it->second;
 
   RegInfos infos;
-  DB_LOG("vm.get_ret(" << id << ", infos, false)");
-  _vm->get_reg(id, infos, false);
+  DB_LOG(VM_GET_REG, id);
+  _vm_call(VMApiCall::GET_REG).get_reg(id, infos, false);
   infos.val.resize(infos.size);
-  _map_regs.emplace(id, infos);
   _smap_regs.emplace(infos.name, id);
+  return _map_regs.emplace(id, RegEntry{infos, 0}).first->second;
 }
 
-void Debugger::_preload_symbols(vm_ptr_t addr, vm_size_t size) {
-  size = std::max(size, SYM_LOAD_SIZE);
+std::size_t Debugger::_preload_symbols(vm_ptr_t addr, vm_size_t size) {
+  if (addr >= _infos.memory_size)
+    return 0;
+  size = std::max(size, SYM_WINDOW_MIN);
   auto end = addr + size - 1;
   end = std::min(end, _infos.memory_size - 1);
 
-  auto low_range = _syms_ranges->range_of(addr);
-  if (low_range.val == 1) {
-    addr = low_range.high + 1;
-    if (!addr || addr > end) // everything already loaded
-      return;
+  // Only ask the VM for the holes between the loaded ranges
+  std::vector<std::pair<vm_ptr_t, vm_ptr_t>> holes;
+  _syms_ranges->for_each(addr, end, [&](const RangeMap<int>::Range &r) {
+    if (!r.val)
+      holes.emplace_back(std::max<vm_ptr_t>(r.low, addr),
+                         std::min<vm_ptr_t>(r.high, end));
+  });
+
+  std::size_t count = 0;
+  for (auto [low, high] : holes) {
+    DB_LOG(VM_GET_SYMBOLS, 0, low, high - low + 1);
+    ++_syms_stats.vm_get_symbols;
+    auto syms =
+        _vm_call(VMApiCall::GET_SYMBOLS).get_symbols(low, high - low + 1);
+    _syms_ranges->set(low, high, 1);
+    for (const auto &s : syms)
+      _load_symbol(s);
+    count += syms.size();
   }
+  return count;
+}
 
-  auto high_range = _syms_ranges->range_of(end);
-  if (high_range.val == 1) {
-    end = high_range.low - 1;
-    if (!high_range.low || end < addr)
-      return;
+void Debugger::_preload_symbols(vm_ptr_t addr) {
+  if (addr >= _infos.memory_size)
+    return;
+  auto low = addr - std::min(addr, SYM_WINDOW_MIN / 2);
+  auto mem_max = _infos.memory_size - 1;
+  auto range = _syms_ranges->range_of(low);
+  if (range.val && range.high >= std::min(low + SYM_WINDOW_MIN - 1, mem_max))
+    return;
+
+  // Missing symbols: grow the window if the lookups follow the last window,
+  // and shrink it otherwise
+  if (_syms_adaptive) {
+    bool seq = addr >= _syms_last_low && addr <= _syms_last_high + _syms_window;
+    if (seq && _syms_last_count * 2 <= SYM_WINDOW_BUDGET)
+      _syms_window = std::min(_syms_window * 2, SYM_WINDOW_MAX);
+    else if (!seq || _syms_last_count > SYM_WINDOW_BUDGET)
+      _syms_window = std::max(_syms_window / 2, SYM_WINDOW_MIN);
   }
 
-  size = end - addr + 1;
-  DB_LOG("vm.get_symbols(" << addr << ", " << size << ")");
-  auto syms = _vm->get_symbols(addr, size);
-  _syms_ranges->set(addr, end, 1);
-  for (const auto &s : syms)
-    _load_symbol(s);
-}
+  _syms_last_low = low;
+  _syms_last_high = std::min(low + _syms_window - 1, mem_max);
+  _syms_last_count = _preload_symbols(low, _syms_last_high - low + 1);
+}
+
+bool Debugger::_find_ins_before(vm_ptr_t addr, vm_ptr_t &out_start) {
+  if (!addr || addr > _infos.memory_size)
+    return false;
+
+  // Already in the index
+  auto first = addr < _ins_index_max ? 0 : addr - _ins_index_max;
+  for (auto it = _ins_index.lower_bound(first);
+       it != _ins_index.end() && it->first < addr; ++it)
+    if (it->first + it->second == addr) {
+      out_start = it->first;
+      return true;
+    }
+
+  // Decode from the closest boundary, and index everything until `addr`
+  vm_ptr_t pos;
+  if (_find_code_anchor(addr, pos)) {
+    if (_ins_index.size() >= CODE_CACHE_MAX_SIZE) {
+      _ins_index.clear();
+      _ins_index_max = 0;
+    }
+
+    vm_ptr_t prev = pos;
+    while (pos < addr) {
+      vm_size_t dist = 0;
+      try {
+        get_code_text(pos, dist);
+      } catch (VMApi::Error &) {
+      }
+      if (!dist)
+        break;
+      _ins_index[pos] = dist;
+      _ins_index_max = std::max(_ins_index_max, dist);
+      prev = pos;
+      pos += dist;
+    }
+    if (pos == addr) {
+      out_start = prev;
+      return true;
+    }
+  }
 
-void Debugger::_preload_symbols(vm_ptr_t addr) {
-  auto size = SYM_LOAD_SIZE;
-  addr = addr < size / 2 ? 0 : addr - size / 2;
-  _preload_symbols(addr, size);
+  // Not aligned with any known boundary: smallest instruction ending there
+  // Not indexed, this is only a guess
+  for (vm_size_t size = 1; size <= CODE_PROBE_MAX_SIZE && size <= addr;
+       ++size) {
+    vm_size_t dist;
+    try {
+      get_code_text(addr - size, dist);
+    } catch (VMApi::Error &) {
+      // Not an instruction start
+      continue;
+    }
+    if (dist == size) {
+      out_start = addr - size;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool Debugger::_find_code_anchor(vm_ptr_t addr, vm_ptr_t &out_anchor) {
+  auto min_addr = addr < CODE_INDEX_MAX_SCAN ? 0 : addr - CODE_INDEX_MAX_SCAN;
+  bool found = false;
+  auto add = [&](vm_ptr_t anchor) {
+    if (anchor >= min_addr && anchor < addr &&
+        (!found || anchor > out_anchor)) {
+      out_anchor = anchor;
+      found = true;
+    }
+  };
+
+  // End of the last indexed instruction, if it doesn't overlap `addr`
+  auto it = _ins_index.lower_bound(addr);
+  if (it != _ins_index.begin()) {
+    --it;
+    if (it->first + it->second <= addr)
+      add(it->first + it->second);
+  }
+
+  // Closest symbol
+  _preload_symbols(addr);
+  auto sym_idx = _syms.find_before(addr);
+  if (sym_idx != SymbolStore::npos)
+    add(_syms.addr(sym_idx));
+
+  // Execution point and call stack
+  if (_state != State::NOT_STARTED)
+    add(_ins_addr);
+  for (std::size_t i = 0; i < _call_stack.size(); ++i) {
+    add(_call_stack[i].caller_start_addr);
+    if (i + 1 < _call_stack.size())
+      add(_call_stack[i].call_addr);
+  }
+  return found;
 }
 
-void Debugger::_load_symbol(vm_sym_t id) {
-  if (_map_syms.find(id) != _map_syms.end())
-    return;
+std::size_t Debugger::_load_symbol(vm_sym_t id) {
+  auto idx = _syms.find_id(id);
+  if (idx != SymbolStore::npos)
+    return idx;
 
-  DB_LOG("vm.get_symb_infos(" << id << ")");
-  auto infos = _vm->get_symb_infos(id);
-  _map_syms.emplace(id, infos);
-  _smap_syms.emplace(infos.name, id);
-  _syms_pos.emplace(infos.addr, id);
+  DB_LOG(VM_GET_SYMB_INFOS, 0, id);
+  ++_syms_stats.vm_get_symb_infos;
+  _syms.insert(_vm_call(VMApiCall::GET_SYMB_INFOS).get_symb_infos(id));
+  return _syms.size() - 1;
 }
 
 } // namespace odb
@@ -0,0 +1,321 @@
+#include "odb/server/event-log.hh"
+
+#include <cctype>
+#include <cstring>
+#include <iomanip>
+#include <istream>
+#include <ostream>
+#include <vector>
+
+#include "odb/server/debugger.hh"
+#include "odb/server/vm-api.hh"
+
+namespace odb {
+
+namespace {
+
+// File header, the last byte is the format version
+constexpr char FILE_MAGIC[8] = {'O', 'D', 'B', 'L', 'O', 'G', '\0', '\1'};
+
+// Records written at once by the writer thread
+constexpr std::size_t WRITE_BATCH = 1024;
+
+constexpr std::size_t EVENTS_COUNT = 0
+#define ODB_LOG_COUNT(Ev, Level) +1
+    ODB_LOG_EVENTS(ODB_LOG_COUNT)
+#undef ODB_LOG_COUNT
+    ;
+static_assert(EVENTS_COUNT <= 64, "Events must fit in a 64-bits mask");
+static_assert(sizeof(EventLog::Record) == 32, "Records must be packed");
+
+constexpr LogLevel EVENTS_LEVEL[] = {
+#define ODB_LOG_LEVEL(Ev, Level) LogLevel::Level,
+    ODB_LOG_EVENTS(ODB_LOG_LEVEL)
+#undef ODB_LOG_LEVEL
+};
+
+constexpr const char *EVENTS_NAME[] = {
+#define ODB_LOG_NAME(Ev, Level) #Ev,
+    ODB_LOG_EVENTS(ODB_LOG_NAME)
+#undef ODB_LOG_NAME
+};
+
+const char *state_name(std::uint64_t st) {
+  using State = Debugger::State;
+  switch (static_cast<State>(st)) {
+  case State::NOT_STARTED:
+    return "NOT_STARTED";
+  case State::STOPPED:
+    return "STOPPED";
+  case State::RUNNING_TOFINISH:
+    return "RUNNING_TOFINISH";
+  case State::RUNNING_BKP:
+    return "RUNNING_BKP";
+  case State::RUNNING_STEP:
+    return "RUNNING_STEP";
+  case State::RUNNING_STEP_OVER:
+    return "RUNNING_STEP_OVER";
+  case State::RUNNING_STEP_OUT:
+    return "RUNNING_STEP_OUT";
+  case State::ERROR:
+    return "ERROR";
+  case State::EXIT:
+    return "EXIT";
+  }
+  return "?";
+}
+
+const char *resume_name(std::uint64_t type) {
+  switch (static_cast<ResumeType>(type)) {
+  case ResumeType::ToFinish:
+    return "ToFinish";
+  case ResumeType::Continue:
+    return "Continue";
+  case ResumeType::Step:
+    return "Step";
+  case ResumeType::StepOver:
+    return "StepOver";
+  case ResumeType::StepOut:
+    return "StepOut";
+  }
+  return "?";
+}
+
+const char *update_name(std::uint64_t st) {
+  switch (static_cast<VMApi::UpdateState>(st)) {
+  case VMApi::UpdateState::OK:
+    return "OK";
+  case VMApi::UpdateState::ERROR:
+    return "ERROR";
+  case VMApi::UpdateState::EXIT:
+    return "EXIT";
+  case VMApi::UpdateState::CALL_SUB:
+    return "CALL_SUB";
+  case VMApi::UpdateState::RET_SUB:
+    return "RET_SUB";
+  }
+  return "?";
+}
+
+const char *stop_reason_name(std::uint64_t reason) {
+  switch (static_cast<LogStopReason>(reason)) {
+  case LogStopReason::STEP:
+    return "STEP";
+  case LogStopReason::STEP_OVER:
+    return "STEP_OVER";
+  case LogStopReason::STEP_OUT:
+    return "STEP_OUT";
+  case LogStopReason::BREAKPOINT:
+    return "BREAKPOINT";
+  }
+  return "?";
+}
+
+struct Hex {
+  std::uint64_t val;
+};
+
+std::ostream &operator<<(std::ostream &os, Hex h) {
+  return os << "0x" << std::hex << h.val << std::dec;
+}
+
+} // namespace
+
+EventLog::EventLog(const std::string &path, LogLevel level,
+                   std::uint64_t events, std::size_t capacity)
+    : _events(level_events(level) | events),
+      _start(std::chrono::steady_clock::now()), _ring(capacity),
+      _os(path, std::ios::binary) {
+  if (!_os)
+    throw VMApi::Error("EventLog: cannot create " + path);
+  _os.write(FILE_MAGIC, sizeof(FILE_MAGIC));
+  _th = std::thread(&EventLog::_run, this);
+}
+
+EventLog::~EventLog() {
+  _stop.store(true, std::memory_order_release);
+  _th.join();
+}
+
+void EventLog::log(LogEvent ev, std::uint32_t arg0, std::uint64_t arg1,
+                   std::uint64_t arg2) {
+  if (_ndropped) {
+    if (!_push(LogEvent::DROPPED, 0, _ndropped, 0)) {
+      ++_ndropped;
+      ++_dropped_total;
+      return;
+    }
+    _ndropped = 0;
+  }
+
+  if (!_push(ev, arg0, arg1, arg2)) {
+    ++_ndropped;
+    ++_dropped_total;
+  }
+}
+
+void EventLog::flush() {
+  while (_nflushed.load(std::memory_order_acquire) != _nlogged)
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+}
+
+LogLevel EventLog::event_level(LogEvent ev) {
+  return EVENTS_LEVEL[static_cast<std::size_t>(ev)];
+}
+
+const char *EventLog::event_name(LogEvent ev) {
+  auto idx = static_cast<std::size_t>(ev);
+  return idx < EVENTS_COUNT ? EVENTS_NAME[idx] : "?";
+}
+
+std::uint64_t EventLog::level_events(LogLevel level) {
+  std::uint64_t res = 0;
+  for (std::size_t i = 0; i < EVENTS_COUNT; ++i)
+    if (EVENTS_LEVEL[i] <= level)
+      res |= std::uint64_t(1) << i;
+  // Not really an event: always there to know events are missing
+  if (res)
+    res |= std::uint64_t(1) << static_cast<unsigned>(LogEvent::DROPPED);
+  return res;
+}
+
+std::uint64_t EventLog::parse_events(const std::string &names) {
+  std::uint64_t res = 0;
+  std::size_t beg = 0;
+  while (beg < names.size()) {
+    auto end = names.find(',', beg);
+    if (end == std::string::npos)
+      end = names.size();
+    auto name = names.substr(beg, end - beg);
+    beg = end + 1;
+    if (name.empty())
+      continue;
+
+    std::size_t i = 0;
+    while (i < EVENTS_COUNT && (std::strlen(EVENTS_NAME[i]) != name.size() ||
+                                !std::equal(name.begin(), name.end(),
+                                            EVENTS_NAME[i], [](char a, char b) {
+                                              return std::toupper(a) == b;
+                                            })))
+      ++i;
+    if (i == EVENTS_COUNT)
+      throw VMApi::Error("EventLog: unknown event `" + name + "'");
+    res |= std::uint64_t(1) << i;
+  }
+  return res;
+}
+
+void EventLog::print(std::ostream &os, const Record &rec) {
+  auto flags = os.flags();
+  os << "[" << std::setw(12) << std::fixed << std::setprecision(6)
+     << rec.time / 1e9 << "] ";
+  os.flags(flags);
+  os << event_name(rec.event);
+
+  switch (rec.event) {
+  case LogEvent::DROPPED:
+    os << " count=" << rec.arg1;
+    break;
+  case LogEvent::VM_ERROR:
+  case LogEvent::EXIT:
+  case LogEvent::ADD_BKP:
+  case LogEvent::DEL_BKP:
+  case LogEvent::VM_GET_CODE_TEXT:
+    os << " addr=" << Hex{rec.arg1};
+    break;
+  case LogEvent::INIT:
+    os << " addr=" << Hex{rec.arg1} << " state=" << state_name(rec.arg0);
+    break;
+  case LogEvent::VM_INFOS:
+    os << " regs=" << rec.arg0 << " memory_size=" << rec.arg1
+       << " symbols=" << rec.arg2;
+    break;
+  case LogEvent::STOP:
+    os << " addr=" << Hex{rec.arg1} << " reason=" << stop_reason_name(rec.arg0);
+    break;
+  case LogEvent::RESUME:
+    os << " type=" << resume_name(rec.arg0);
+    break;
+  case LogEvent::STOP_REQUEST:
+    break;
+  case LogEvent::VM_GET_REG:
+  case LogEvent::VM_SET_REG:
+  case LogEvent::VM_FIND_REG:
+    os << " reg=" << rec.arg0;
+    break;
+  case LogEvent::VM_READ_MEM:
+  case LogEvent::VM_WRITE_MEM:
+  case LogEvent::VM_GET_SYMBOLS:
+    os << " addr=" << Hex{rec.arg1} << " size=" << rec.arg2;
+    break;
+  case LogEvent::VM_GET_SYMB_INFOS:
+  case LogEvent::VM_FIND_SYM:
+    os << " sym=" << rec.arg1;
+    break;
+  case LogEvent::UPDATE:
+    os << " addr=" << Hex{rec.arg1} << " vm=" << update_name(rec.arg0)
+       << " state=" << state_name(rec.arg2);
+    break;
+  default:
+    os << " " << rec.arg0 << " " << rec.arg1 << " " << rec.arg2;
+    break;
+  }
+}
+
+void EventLog::dump(std::istream &is, std::ostream &os) {
+  char magic[sizeof(FILE_MAGIC)];
+  if (!is.read(magic, sizeof(magic)) ||
+      std::memcmp(magic, FILE_MAGIC, sizeof(magic)) != 0)
+    throw VMApi::Error("EventLog: not a log file");
+
+  std::vector<Record> recs(WRITE_BATCH);
+  for (;;) {
+    is.read(reinterpret_cast<char *>(recs.data()),
+            recs.size() * sizeof(Record));
+    auto size = static_cast<std::size_t>(is.gcount());
+    for (std::size_t i = 0; i < size / sizeof(Record); ++i) {
+      print(os, recs[i]);
+      os << "\n";
+    }
+    if (size % sizeof(Record))
+      throw VMApi::Error("EventLog: truncated log file");
+    if (!is)
+      break;
+  }
+}
+
+bool EventLog::_push(LogEvent ev, std::uint32_t arg0, std::uint64_t arg1,
+                     std::uint64_t arg2) {
+  auto time = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                  std::chrono::steady_clock::now() - _start)
+                  .count();
+  if (!_ring.push(Record{static_cast<std::uint64_t>(time), ev, arg0, arg1,
+                         arg2}))
+    return false;
+  ++_nlogged;
+  return true;
+}
+
+void EventLog::_run() {
+  std::vector<Record> recs(WRITE_BATCH);
+  std::uint64_t nwritten = 0;
+  for (;;) {
+    // Read before draining: all events logged before the stop are written
+    bool stop = _stop.load(std::memory_order_acquire);
+    auto n = _ring.pop(recs.data(), recs.size());
+    if (n) {
+      _os.write(reinterpret_cast<const char *>(recs.data()),
+                n * sizeof(Record));
+      nwritten += n;
+      continue;
+    }
+
+    _os.flush();
+    _nflushed.store(nwritten, std::memory_order_release);
+    if (stop)
+      break;
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
+
+} // namespace odb
@@ -0,0 +1,119 @@
+#include "odb/server/instrumented-vm-api.hh"
+
+#include <cassert>
+#include <chrono>
+#include <exception>
+
+namespace odb {
+
+namespace {
+
+// Record one call when destroyed, also if it threw
+class CallScope {
+public:
+  CallScope(ServerStats::VMCall &prof)
+      : _prof(prof), _nexcs(std::uncaught_exceptions()),
+        _beg(std::chrono::steady_clock::now()) {}
+
+  ~CallScope() {
+    auto end = std::chrono::steady_clock::now();
+    _prof.time.add(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(end - _beg)
+            .count());
+    if (std::uncaught_exceptions() > _nexcs)
+      ++_prof.errors;
+    else if (_has_size)
+      _prof.sizes.add(_size);
+  }
+
+  void set_size(std::uint64_t size) {
+    _size = size;
+    _has_size = true;
+  }
+
+private:
+  ServerStats::VMCall &_prof;
+  int _nexcs;
+  std::chrono::steady_clock::time_point _beg;
+  std::uint64_t _size = 0;
+  bool _has_size = false;
+};
+
+} // namespace
+
+InstrumentedVMApi::InstrumentedVMApi(std::unique_ptr<VMApi> &&vm,
+                                     std::vector<ServerStats::VMCall> &out)
+    : _vm(std::move(vm)), _out(out) {
+  assert(_vm.get());
+  _out.resize(VM_API_CALLS_COUNT);
+}
+
+VMInfos InstrumentedVMApi::get_vm_infos() {
+  CallScope scope(_prof(VMApiCall::GET_VM_INFOS));
+  return _vm->get_vm_infos();
+}
+
+VMApi::UpdateInfos InstrumentedVMApi::get_update_infos() {
+  CallScope scope(_prof(VMApiCall::GET_UPDATE_INFOS));
+  return _vm->get_update_infos();
+}
+
+void InstrumentedVMApi::get_reg(vm_reg_t idx, RegInfos &infos,
+                                bool val_only) {
+  CallScope scope(_prof(VMApiCall::GET_REG));
+  _vm->get_reg(idx, infos, val_only);
+  scope.set_size(infos.size);
+}
+
+void InstrumentedVMApi::set_reg(vm_reg_t idx, const std::uint8_t *new_val) {
+  CallScope scope(_prof(VMApiCall::SET_REG));
+  _vm->set_reg(idx, new_val);
+}
+
+vm_reg_t InstrumentedVMApi::find_reg_id(const std::string &name) {
+  CallScope scope(_prof(VMApiCall::FIND_REG_ID));
+  scope.set_size(name.size());
+  return _vm->find_reg_id(name);
+}
+
+void InstrumentedVMApi::read_mem(vm_ptr_t addr, vm_size_t size,
+                                 std::uint8_t *out_buf) {
+  CallScope scope(_prof(VMApiCall::READ_MEM));
+  scope.set_size(size);
+  _vm->read_mem(addr, size, out_buf);
+}
+
+void InstrumentedVMApi::write_mem(vm_ptr_t addr, vm_size_t size,
+                                  const std::uint8_t *buf) {
+  CallScope scope(_prof(VMApiCall::WRITE_MEM));
+  scope.set_size(size);
+  _vm->write_mem(addr, size, buf);
+}
+
+std::vector<vm_sym_t> InstrumentedVMApi::get_symbols(vm_ptr_t addr,
+                                                     vm_size_t size) {
+  CallScope scope(_prof(VMApiCall::GET_SYMBOLS));
+  scope.set_size(size);
+  return _vm->get_symbols(addr, size);
+}
+
+SymbolInfos InstrumentedVMApi::get_symb_infos(vm_sym_t idx) {
+  CallScope scope(_prof(VMApiCall::GET_SYMB_INFOS));
+  return _vm->get_symb_infos(idx);
+}
+
+vm_sym_t InstrumentedVMApi::find_sym_id(const std::string &name) {
+  CallScope scope(_prof(VMApiCall::FIND_SYM_ID));
+  scope.set_size(name.size());
+  return _vm->find_sym_id(name);
+}
+
+std::string InstrumentedVMApi::get_code_text(vm_ptr_t addr,
+                                             vm_size_t &addr_dist) {
+  CallScope scope(_prof(VMApiCall::GET_CODE_TEXT));
+  auto res = _vm->get_code_text(addr, addr_dist);
+  scope.set_size(addr_dist);
+  return res;
+}
+
+} // namespace odb
@@ -1,8 +1,10 @@
 #include "odb/server/server-app.hh"
 
+#include <algorithm>
 #include <cassert>
 #include <cstdlib>
 #include <cstring>
+#include <fstream>
 #include <thread>
 
 #include "odb/server/client-handler.hh"
@@ -20,6 +22,12 @@ const ServerConfig g_conf_default = {
     .server_cli_sighandler = true,
     .mode_tcp = false,
     .tcp_port = 12644,
+    .regs_cache = true,
+    .log_level = 0,
+    .log_events = "",
+    .log_path = "./odb_server_db.logs",
+    .stats_path = "",
+    .vm_profile = false,
 };
 
 constexpr const char *ENV_CONF_ENABLED = "ODB_CONF_ENABLED";
@@ -29,6 +37,16 @@ constexpr const char *ENV_CONF_SERVER_CLI_SIGHANDLER =
     "ODB_CONF_SERVER_CLI_SIGHANDLER";
 constexpr const char *ENV_CONF_MODE_TCP = "ODB_CONF_MODE_TCP";
 constexpr const char *ENV_CONF_TCP_PORT = "ODB_CONF_TCP_PORT";
+constexpr const char *ENV_CONF_REGS_CACHE = "ODB_CONF_REGS_CACHE";
+constexpr const char *ENV_CONF_LOG_LEVEL = "ODB_CONF_LOG_LEVEL";
+constexpr const char *ENV_CONF_LOG_EVENTS = "ODB_CONF_LOG_EVENTS";
+constexpr const char *ENV_CONF_LOG_PATH = "ODB_CONF_LOG_PATH";
+constexpr const char *ENV_CONF_STATS_PATH = "ODB_CONF_STATS_PATH";
+constexpr const char *ENV_CONF_VM_PROFILE = "ODB_CONF_VM_PROFILE";
+
+std::uint64_t duration_ns(std::chrono::steady_clock::duration d) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(d).count();
+}
 } // namespace
 
 ServerApp::ServerApp(const ServerConfig &conf, const api_builder_f &api_builder)
@@ -60,21 +78,77 @@ ServerApp::ServerApp(const ServerConfig &conf, const api_builder_f &api_builder)
   auto env_tcp_port = std::getenv(ENV_CONF_TCP_PORT);
   if (env_tcp_port)
     _conf.tcp_port = std::atoi(env_tcp_port);
+
+  auto env_regs_cache = std::getenv(ENV_CONF_REGS_CACHE);
+  if (env_regs_cache)
+    _conf.regs_cache = std::strcmp(env_regs_cache, "1") == 0;
+
+  auto env_log_level = std::getenv(ENV_CONF_LOG_LEVEL);
+  if (env_log_level)
+    _conf.log_level = std::atoi(env_log_level);
+
+  auto env_log_events = std::getenv(ENV_CONF_LOG_EVENTS);
+  if (env_log_events)
+    _conf.log_events = env_log_events;
+
+  auto env_log_path = std::getenv(ENV_CONF_LOG_PATH);
+  if (env_log_path)
+    _conf.log_path = env_log_path;
+
+  auto env_stats_path = std::getenv(ENV_CONF_STATS_PATH);
+  if (env_stats_path)
+    _conf.stats_path = env_stats_path;
+
+  auto env_vm_profile = std::getenv(ENV_CONF_VM_PROFILE);
+  if (env_vm_profile)
+    _conf.vm_profile = std::strcmp(env_vm_profile, "1") == 0;
 }
 
 ServerApp::ServerApp(const api_builder_f &api_builder)
     : ServerApp(g_conf_default, api_builder) {}
 
+ServerApp::~ServerApp() {
+  if (!_db || _conf.stats_path.empty())
+    return;
+  std::ofstream os(_conf.stats_path);
+  _db->stats().dump(os);
+}
+
 void ServerApp::loop() {
   // Does nothing if debugger disabled
   if (!_conf.enabled)
     return;
 
+  // The time of the VM is between the end of the call before a timed one and
+  // the start of the timed one
+  using clock = std::chrono::steady_clock;
+  auto call = _loop_calls++;
+  bool timed = call % STATS_SAMPLE_RATE == 0;
+  bool timed_end = timed || (call + 1) % STATS_SAMPLE_RATE == 0;
+  auto beg = timed ? clock::now() : clock::time_point{};
+
+  bool stopped = _loop();
+  if (!_db)
+    return;
+
+  auto &stats = _db->stats();
+  ++stats.loop_calls;
+  if (!timed_end)
+    return;
+  auto end = clock::now();
+  if (timed && call > 0)
+    stats.vm_ns += duration_ns(beg - _loop_end) * STATS_SAMPLE_RATE;
+  if (timed && !stopped) // time stopped is measured by _loop()
+    stats.loop_ns += duration_ns(end - beg) * STATS_SAMPLE_RATE;
+  _loop_end = end;
+}
+
+bool ServerApp::_loop() {
   if (_db.get() == nullptr) {
     _init();
     if (!_conf.enabled) // other options read with `_init()` may disable
                         // debugger
-      return;
+      return false;
   } else
     _db->on_update();
 
@@ -85,6 +159,8 @@ void ServerApp::loop() {
       _stop_db();
   }
 
+  std::chrono::steady_clock::time_point stop_beg;
+  bool stopped = false;
   for (;;) {
     // Returns direcly if client disconnected
     if (_client->get_state() == ClientHandler::State::DISCONNECTED)
@@ -98,6 +174,10 @@ void ServerApp::loop() {
     // Returns direcly if VM still running
     if (!_db_is_stopped())
       break;
+    if (!stopped) {
+      stopped = true;
+      stop_beg = std::chrono::steady_clock::now();
+    }
 
     // Block until the client is connected
     _connect();
@@ -112,13 +192,30 @@ void ServerApp::loop() {
   if (_client->get_state() == ClientHandler::State::DISCONNECTED &&
       _db->get_state() == Debugger::State::STOPPED)
     _db->resume(ResumeType::ToFinish);
+
+  if (stopped)
+    _db->stats().stopped_ns +=
+        duration_ns(std::chrono::steady_clock::now() - stop_beg);
+  return stopped;
 }
 
 void ServerApp::_init() {
 
+  // Create the event log, before the debugger to also log its init
+  auto log_level = std::clamp(_conf.log_level, 0,
+                              static_cast<int>(LogLevel::TRACE));
+  auto log_events = EventLog::parse_events(_conf.log_events);
+  if (log_level > 0 || log_events)
+    _log = std::make_unique<EventLog>(
+        _conf.log_path, static_cast<LogLevel>(log_level), log_events);
+
   // Create and setup debugger
   _db = std::make_unique<Debugger>(_api_builder());
   auto &db = *_db;
+  if (_conf.vm_profile)
+    db.enable_vm_profile();
+  db.set_regs_cache(_conf.regs_cache);
+  db.set_event_log(_log.get());
   db.on_init();
   if (_conf.nostart)
     _stop_db();
@@ -135,6 +232,7 @@ void ServerApp::_init() {
 void ServerApp::_shutdown() {
   _client.reset();
   _db.reset();
+  _log.reset();
   _conf.enabled = false;
 }
 
@@ -0,0 +1,200 @@
+#include "odb/server/symbol-store.hh"
+
+#include <algorithm>
+#include <cassert>
+
+namespace odb {
+
+namespace {
+
+constexpr std::size_t TABLE_MIN_SIZE = 16;
+
+std::size_t hash_id(vm_sym_t id) {
+  return static_cast<std::size_t>(id * 0x9E3779B97F4A7C15ULL >> 17);
+}
+
+// FNV-1a
+std::size_t hash_name(std::string_view name) {
+  std::uint64_t res = 14695981039346656037ULL;
+  for (auto c : name) {
+    res ^= static_cast<std::uint8_t>(c);
+    res *= 1099511628211ULL;
+  }
+  return static_cast<std::size_t>(res);
+}
+
+} // namespace
+
+void SymbolStore::reserve(std::size_t nsyms) {
+  _entries.reserve(nsyms);
+  _addrs.reserve(nsyms);
+  _grow_tables(nsyms);
+}
+
+bool SymbolStore::insert(const SymbolInfos &infos) {
+  if (find_id(infos.idx) != npos)
+    return false;
+  assert(_entries.size() < UINT32_MAX);
+  auto idx = static_cast<std::uint32_t>(_entries.size());
+  _grow_tables(_entries.size() + 1);
+
+  Entry e;
+  e.addr = infos.addr;
+  e.id = infos.idx;
+  e.name_len = static_cast<std::uint32_t>(infos.name.size());
+  auto same_name = find_name(infos.name);
+  if (same_name == npos) {
+    e.name_off = _names.size();
+    _names.insert(_names.end(), infos.name.begin(), infos.name.end());
+  } else
+    e.name_off = _entries[same_name].name_off;
+  _entries.push_back(e);
+
+  _addrs.push_back(AddrPos{e.addr, idx});
+  _insert_id(idx);
+  if (same_name == npos)
+    _insert_name(idx);
+  return true;
+}
+
+std::size_t SymbolStore::find_id(vm_sym_t id) const {
+  if (_ids_table.empty())
+    return npos;
+  auto mask = _ids_table.size() - 1;
+  for (auto i = hash_id(id) & mask; _ids_table[i]; i = (i + 1) & mask)
+    if (_entries[_ids_table[i] - 1].id == id)
+      return _ids_table[i] - 1;
+  return npos;
+}
+
+std::size_t SymbolStore::find_name(std::string_view name) const {
+  if (_names_table.empty())
+    return npos;
+  auto mask = _names_table.size() - 1;
+  for (auto i = hash_name(name) & mask; _names_table[i]; i = (i + 1) & mask)
+    if (this->name(_names_table[i] - 1) == name)
+      return _names_table[i] - 1;
+  return npos;
+}
+
+template <class F> void SymbolStore::_addrs_lower_bound(vm_ptr_t addr, F f) {
+  _sort_addrs();
+  AddrPos key{addr, 0};
+  const AddrPos *beg = _addrs.data();
+  for (auto run_end : _addrs_runs) {
+    const AddrPos *end = _addrs.data() + run_end;
+    f(std::lower_bound(beg, end, key), end);
+    beg = end;
+  }
+}
+
+std::size_t SymbolStore::lower_bound(vm_ptr_t addr) {
+  const AddrPos *res = nullptr;
+  _addrs_lower_bound(addr, [&](const AddrPos *it, const AddrPos *end) {
+    if (it != end && (!res || *it < *res))
+      res = it;
+  });
+  return res ? res->idx : npos;
+}
+
+std::size_t SymbolStore::find_before(vm_ptr_t addr) {
+  const AddrPos *res = nullptr;
+  std::size_t run_beg = 0;
+  _addrs_lower_bound(addr, [&](const AddrPos *it, const AddrPos *end) {
+    if (it != _addrs.data() + run_beg && (!res || *res < it[-1]))
+      res = it - 1;
+    run_beg = end - _addrs.data();
+  });
+  return res ? res->idx : npos;
+}
+
+void SymbolStore::find_range(vm_ptr_t addr, vm_size_t size,
+                             std::vector<vm_sym_t> &out) {
+  _range_buf.clear();
+  std::size_t nruns = 0;
+  _addrs_lower_bound(addr, [&](const AddrPos *it, const AddrPos *end) {
+    if (it != end && it->addr - addr < size)
+      ++nruns;
+    for (; it != end && it->addr - addr < size; ++it)
+      _range_buf.push_back(*it);
+  });
+  if (nruns > 1)
+    std::sort(_range_buf.begin(), _range_buf.end());
+  for (const auto &pos : _range_buf)
+    out.push_back(_entries[pos.idx].id);
+}
+
+std::string_view SymbolStore::name(std::size_t idx) const {
+  const auto &e = _entries[idx];
+  return std::string_view(_names.data() + e.name_off, e.name_len);
+}
+
+SymbolInfos SymbolStore::infos(std::size_t idx) const {
+  return SymbolInfos{id(idx), std::string(name(idx)), addr(idx)};
+}
+
+std::size_t SymbolStore::memory_usage() const {
+  return _entries.capacity() * sizeof(Entry) + _names.capacity() +
+         _addrs.capacity() * sizeof(AddrPos) +
+         (_ids_table.capacity() + _names_table.capacity()) *
+             sizeof(std::uint32_t);
+}
+
+void SymbolStore::_sort_addrs() {
+  if (_addrs_sorted == _addrs.size())
+    return;
+  std::sort(_addrs.begin() + _addrs_sorted, _addrs.end());
+  _addrs_runs.push_back(_addrs.size());
+  _addrs_sorted = _addrs.size();
+
+  // Merge the last 2 runs until sizes are decreasing by at least half
+  // There is O(log n) runs, and each symbol is moved O(log n) times
+  auto &runs = _addrs_runs;
+  while (runs.size() > 1) {
+    auto n = runs.size();
+    auto beg1 = n > 2 ? runs[n - 3] : 0;
+    auto beg2 = runs[n - 2];
+    auto end = runs[n - 1];
+    if ((end - beg2) * 2 <= beg2 - beg1)
+      break;
+    std::inplace_merge(_addrs.begin() + beg1, _addrs.begin() + beg2,
+                       _addrs.begin() + end);
+    runs.pop_back();
+    runs.back() = end;
+  }
+}
+
+void SymbolStore::_grow_tables(std::size_t nsyms) {
+  if (nsyms * 2 <= _ids_table.size())
+    return;
+  auto new_size = std::max(TABLE_MIN_SIZE, _ids_table.size());
+  while (new_size < nsyms * 2)
+    new_size *= 2;
+
+  _ids_table.assign(new_size, 0);
+  _names_table.assign(new_size, 0);
+  for (std::uint32_t i = 0; i < _entries.size(); ++i) {
+    _insert_id(i);
+    // Only the first symbol with a name owns it
+    if (find_name(name(i)) == npos)
+      _insert_name(i);
+  }
+}
+
+void SymbolStore::_insert_id(std::uint32_t idx) {
+  auto mask = _ids_table.size() - 1;
+  auto i = hash_id(_entries[idx].id) & mask;
+  while (_ids_table[i])
+    i = (i + 1) & mask;
+  _ids_table[i] = idx + 1;
+}
+
+void SymbolStore::_insert_name(std::uint32_t idx) {
+  auto mask = _names_table.size() - 1;
+  auto i = hash_name(name(idx)) & mask;
+  while (_names_table[i])
+    i = (i + 1) & mask;
+  _names_table[i] = idx + 1;
+}
+
+} // namespace odb
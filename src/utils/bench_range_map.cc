@@ -0,0 +1,77 @@
+#include <catch2/catch.hpp>
+
+#include "odb/utils/range-map.hh"
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+
+namespace {
+
+std::uint32_t xs32_next(std::uint32_t x) {
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return x;
+}
+
+// Average time of `f(i)` for i in [0, n[, in ns
+template <class F> double time_ns(std::size_t n, F f) {
+  auto start = std::chrono::steady_clock::now();
+  for (std::size_t i = 0; i < n; ++i)
+    f(i);
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(end - start).count() / n;
+}
+
+} // namespace
+
+// Symbols preloading pattern: windows of 256 keys marked as loaded at random
+// addresses of a big address space, until the map has `nranges` ranges
+// Then lookups and updates on the fragmented map
+TEST_CASE("bench_range_map", "[.bench]") {
+  constexpr std::size_t MAX_KEY = (std::size_t(1) << 40) - 1;
+  constexpr std::size_t WIN = 256;
+  constexpr std::size_t NOPS = 100000;
+
+  std::cout << "ranges: set (build), get, range_of, set (toggle), "
+               "for_each 1M keys (ns)\n";
+  for (std::size_t nranges : {1000, 10000, 100000}) {
+    odb::RangeMap<int> map(0, MAX_KEY, 0);
+    std::uint32_t rng = 42;
+    auto rand_key = [&] {
+      rng = xs32_next(rng);
+      return (std::size_t(rng) << 8) % (MAX_KEY - WIN);
+    };
+
+    std::size_t nsets = 0;
+    auto start = std::chrono::steady_clock::now();
+    while (map.size() < nranges) {
+      auto key = rand_key();
+      map.set(key, key + WIN - 1, 1);
+      ++nsets;
+    }
+    auto end = std::chrono::steady_clock::now();
+    auto t_build =
+        std::chrono::duration<double, std::nano>(end - start).count() / nsets;
+
+    std::size_t sum = 0;
+    auto t_get =
+        time_ns(NOPS, [&](std::size_t) { sum += map.get(rand_key()); });
+    auto t_range = time_ns(
+        NOPS, [&](std::size_t) { sum += map.range_of(rand_key()).high; });
+    auto t_toggle = time_ns(NOPS, [&](std::size_t i) {
+      auto key = rand_key();
+      map.set(key, key + WIN * 4 - 1, i % 2);
+    });
+    auto t_each = time_ns(NOPS, [&](std::size_t) {
+      auto key = rand_key();
+      map.for_each(key, key + (1 << 20),
+                   [&](const odb::RangeMap<int>::Range &r) { sum += r.val; });
+    });
+
+    std::cout << nranges << ": " << t_build << ", " << t_get << ", "
+              << t_range << ", " << t_toggle << ", " << t_each << " (checksum "
+              << sum << ")\n";
+  }
+}
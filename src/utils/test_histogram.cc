@@ -0,0 +1,58 @@
+#include <catch2/catch.hpp>
+
+#include "odb/utils/histogram.hh"
+
+#include <cstdint>
+
+TEST_CASE("histogram_buckets", "") {
+  using odb::Histogram;
+  for (std::uint64_t v = 0; v < 8; ++v)
+    REQUIRE(Histogram::bucket(v) == v);
+
+  // Every bucket is right after the previous one
+  std::uint64_t next = 0;
+  for (std::size_t i = 0; i < 400; ++i) {
+    REQUIRE(Histogram::bucket_low(i) == next);
+    REQUIRE(Histogram::bucket(Histogram::bucket_low(i)) == i);
+    REQUIRE(Histogram::bucket(Histogram::bucket_high(i)) == i);
+    next = Histogram::bucket_high(i) + 1;
+  }
+
+  // Relative error under 1 / SUB_BUCKETS
+  for (std::uint64_t v = 8; v < (std::uint64_t(1) << 40); v = v * 3 + 1) {
+    auto idx = Histogram::bucket(v);
+    auto size = Histogram::bucket_high(idx) - Histogram::bucket_low(idx) + 1;
+    REQUIRE(size * Histogram::SUB_BUCKETS <= v);
+  }
+  REQUIRE(Histogram::bucket_high(Histogram::bucket(~std::uint64_t(0))) ==
+          ~std::uint64_t(0));
+}
+
+TEST_CASE("histogram_percentiles", "") {
+  odb::Histogram h;
+  REQUIRE(h.percentile(50) == 0);
+
+  for (std::uint64_t v = 1; v <= 1000; ++v)
+    h.add(v);
+  REQUIRE(h.count == 1000);
+  REQUIRE(h.sum == 500500);
+  REQUIRE(h.max == 1000);
+  REQUIRE(h.mean() == 500);
+
+  auto p50 = h.percentile(50);
+  REQUIRE(p50 >= 500);
+  REQUIRE(p50 < 500 + 500 / odb::Histogram::SUB_BUCKETS);
+  auto p99 = h.percentile(99);
+  REQUIRE(p99 >= 990);
+  REQUIRE(p99 <= 1000);
+  REQUIRE(h.percentile(100) == 1000);
+  REQUIRE(h.percentile(0) == 1);
+
+  odb::Histogram h2;
+  h2.add(1 << 20);
+  h.merge(h2);
+  REQUIRE(h.count == 1001);
+  REQUIRE(h.max == 1 << 20);
+  REQUIRE(h.percentile(100) == 1 << 20);
+  REQUIRE(h.percentile(50) == p50);
+}
@@ -290,3 +290,50 @@ TEST_CASE("range_map_rand_vect_sorted", "") {
   REQUIRE(r.val == start_val);
   REQUIRE(nr == m.size());
 }
+
+TEST_CASE("range_map_rand_ranges", "") {
+  std::uint32_t rng = 917;
+  constexpr std::size_t len = 600;
+  std::vector<int> vals(len, 0);
+  map_t m(0, len - 1, 0);
+  for (std::size_t k = 0; k < 2000; ++k) {
+    rng = xs32_next(rng);
+    std::size_t low = rng % len;
+    rng = xs32_next(rng);
+    std::size_t high = std::min(len - 1, low + rng % 40);
+    int val = k % 3;
+    std::fill(vals.begin() + low, vals.begin() + high + 1, val);
+    m.set(low, high, val);
+  }
+
+  for (std::size_t i = 0; i < len; ++i)
+    REQUIRE(m.get(i) == vals[i]);
+  for (std::size_t i = 0; i + 1 < m.size(); ++i) {
+    REQUIRE(m[i].high + 1 == m[i + 1].low);
+    REQUIRE(m[i].val != m[i + 1].val);
+  }
+}
+
+TEST_CASE("range_map_for_each", "") {
+  map_t m(0, 100, 0);
+  m.set(10, 19, 1);
+  m.set(30, 39, 2);
+
+  std::vector<std::size_t> lows;
+  std::vector<int> vals;
+  auto collect = [&](const map_t::Range &r) {
+    lows.push_back(r.low);
+    vals.push_back(r.val);
+  };
+
+  m.for_each(15, 30, collect);
+  REQUIRE(lows == std::vector<std::size_t>{10, 20, 30});
+  REQUIRE(vals == std::vector<int>{1, 0, 2});
+
+  lows.clear();
+  vals.clear();
+  m.for_each(0, 0, collect);
+  m.for_each(40, 100, collect);
+  REQUIRE(lows == std::vector<std::size_t>{0, 40});
+  REQUIRE(vals == std::vector<int>{0, 0});
+}
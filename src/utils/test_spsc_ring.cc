@@ -0,0 +1,61 @@
+#include <catch2/catch.hpp>
+
+#include "odb/utils/spsc-ring.hh"
+
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+TEST_CASE("spsc_ring_basic", "") {
+  odb::SPSCRing<int> ring(4);
+  REQUIRE(ring.capacity() == 4);
+  REQUIRE(ring.size() == 0);
+
+  int out[8];
+  REQUIRE(ring.pop(out, 8) == 0);
+  for (int i = 0; i < 4; ++i)
+    REQUIRE(ring.push(i));
+  REQUIRE(!ring.push(4));
+  REQUIRE(ring.size() == 4);
+
+  REQUIRE(ring.pop(out, 3) == 3);
+  REQUIRE(out[0] == 0);
+  REQUIRE(out[2] == 2);
+
+  // Wraps around
+  for (int i = 4; i < 7; ++i)
+    REQUIRE(ring.push(i));
+  REQUIRE(!ring.push(7));
+  REQUIRE(ring.pop(out, 8) == 4);
+  for (int i = 0; i < 4; ++i)
+    REQUIRE(out[i] == i + 3);
+  REQUIRE(ring.size() == 0);
+}
+
+TEST_CASE("spsc_ring_threads", "") {
+  constexpr std::uint64_t NITEMS = 1000000;
+  odb::SPSCRing<std::uint64_t> ring(256);
+
+  std::thread producer([&] {
+    for (std::uint64_t i = 0; i < NITEMS; ++i)
+      while (!ring.push(i))
+        std::this_thread::yield();
+  });
+
+  // Items are received once, in order
+  std::uint64_t next = 0;
+  bool ordered = true;
+  std::vector<std::uint64_t> buf(100);
+  while (next < NITEMS) {
+    auto n = ring.pop(buf.data(), buf.size());
+    if (n == 0)
+      std::this_thread::yield();
+    for (std::size_t i = 0; i < n; ++i)
+      ordered = ordered && buf[i] == next++;
+  }
+  producer.join();
+
+  REQUIRE(ordered);
+  REQUIRE(next == NITEMS);
+  REQUIRE(ring.size() == 0);
+}
@@ -19,6 +19,25 @@ constexpr const char *reg_names[] = {"r0",  "r1",  "r2",  "r3", "r4",  "r5",
                                      "r6",  "r7",  "r8",  "r9", "r10", "r11",
                                      "r12", "r13", "r14", "sp", "pc",  "zf"};
 
+// FNV-1a hash of the instructions and symbols
+std::uint64_t rom_hash(const ROM &rom) {
+  std::uint64_t res = 0xcbf29ce484222325;
+  auto add = [&res](const std::string &s) {
+    for (unsigned char c : s + '\n')
+      res = (res ^ c) * 0x100000001b3;
+  };
+  for (const auto &ins : rom.ins) {
+    std::ostringstream os;
+    os << ins.name << " " << ins.def_sym << " " << ins.use_sym;
+    for (auto arg : ins.args)
+      os << " " << arg;
+    add(os.str());
+  }
+  for (const auto &sym : rom.syms)
+    add(sym);
+  return res;
+}
+
 } // namespace
 
 VMApi::VMApi(CPU &cpu) : _cpu(cpu) {}
@@ -36,6 +55,7 @@ odb::VMInfos VMApi::get_vm_infos() {
   infos.pointer_size = 4;
   infos.integer_size = 4;
   infos.use_opcode = false;
+  infos.program_hash = rom_hash(_cpu._rom);
 
   return infos;
 }
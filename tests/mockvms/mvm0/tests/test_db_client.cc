@@ -0,0 +1,1007 @@
+#include "utils.hh"
+
+#include <odb/mess/db-client.hh>
+#include <odb/mess/disk-cache.hh>
+#include <odb/mess/request.hh>
+#include <odb/mess/simple-cli-client.hh>
+#include <odb/server/db-client-impl-vmside.hh>
+
+#include <cstdio>
+#include <unistd.h>
+
+namespace {
+
+std::vector<char> db_read_buf(odb::Debugger &db, odb::vm_ptr_t addr,
+                              odb::vm_size_t size) {
+  std::vector<char> res(size);
+  db.read_mem(addr, size, reinterpret_cast<std::uint8_t *>(res.data()));
+  return res;
+}
+
+// Server without some capabilities, or with failing requests
+class CapsImpl : public odb::DBClientImplVMSide {
+public:
+  using odb::DBClientImplVMSide::DBClientImplVMSide;
+
+  std::uint32_t caps = odb::PROTO_CAPS_ALL;
+  int table_errors = 0; // number of next get_symbols_table that fail
+
+  bool has_cap(std::uint32_t c) const override { return (caps & c) == c; }
+
+  void get_symbols_table(odb::SymbolsTable &out_table) override {
+    if (table_errors) {
+      --table_errors;
+      throw odb::VMApi::Error("connection lost");
+    }
+    odb::DBClientImplVMSide::get_symbols_table(out_table);
+  }
+};
+
+// VM with 1-byte instructions decoded from the memory, that can be patched
+// BAD_OP bytes can't be decoded
+class OpcodeVM : public odb::VMApi {
+public:
+  static constexpr std::uint8_t BAD_OP = 0xFF;
+
+  std::vector<std::uint8_t> mem = std::vector<std::uint8_t>(256, 7);
+  odb::vm_ptr_t pc = 0;
+  std::vector<odb::SymbolInfos> syms; // id is the index
+  std::size_t code_calls = 0;
+
+  odb::VMInfos get_vm_infos() override {
+    odb::VMInfos infos;
+    infos.name = "opcode";
+    infos.regs_count = 0;
+    infos.memory_size = mem.size();
+    infos.symbols_count = syms.size();
+    infos.pointer_size = 8;
+    infos.integer_size = 8;
+    infos.use_opcode = true;
+    infos.program_hash = 0x42;
+    return infos;
+  }
+
+  UpdateInfos get_update_infos() override {
+    return UpdateInfos{UpdateState::OK, pc};
+  }
+
+  void get_reg(odb::vm_reg_t, odb::RegInfos &, bool) override {
+    throw odb::VMApi::Error("no registers");
+  }
+  void set_reg(odb::vm_reg_t, const std::uint8_t *) override {
+    throw odb::VMApi::Error("no registers");
+  }
+  odb::vm_reg_t find_reg_id(const std::string &) override {
+    throw odb::VMApi::Error("no registers");
+  }
+
+  void read_mem(odb::vm_ptr_t addr, odb::vm_size_t size,
+                std::uint8_t *out_buf) override {
+    std::copy(&mem[addr], &mem[addr] + size, out_buf);
+  }
+  void write_mem(odb::vm_ptr_t addr, odb::vm_size_t size,
+                 const std::uint8_t *buf) override {
+    std::copy(buf, buf + size, &mem[addr]);
+  }
+
+  std::vector<odb::vm_sym_t> get_symbols(odb::vm_ptr_t addr,
+                                         odb::vm_size_t size) override {
+    std::vector<odb::vm_sym_t> res;
+    for (const auto &s : syms)
+      if (s.addr >= addr && s.addr - addr < size)
+        res.push_back(s.idx);
+    return res;
+  }
+  odb::SymbolInfos get_symb_infos(odb::vm_sym_t idx) override {
+    if (idx >= syms.size())
+      throw odb::VMApi::Error("invalid symbol index");
+    return syms[idx];
+  }
+  odb::vm_sym_t find_sym_id(const std::string &name) override {
+    for (const auto &s : syms)
+      if (s.name == name)
+        return s.idx;
+    throw odb::VMApi::Error("unknown symbol");
+  }
+
+  std::string get_code_text(odb::vm_ptr_t addr,
+                            odb::vm_size_t &addr_dist) override {
+    ++code_calls;
+    if (mem[addr] == BAD_OP)
+      throw odb::VMApi::Error("invalid opcode");
+    addr_dist = 1;
+    return "op" + std::to_string(mem[addr]);
+  }
+};
+
+} // namespace
+
+TEST_CASE("db_client read_mem_diff", "") {
+  using namespace mvm0;
+  auto rom = parse_file(PATH_CALL_ADD);
+  CPU cpu(rom);
+  cpu.init();
+  odb::Debugger db(std::make_unique<VMApi>(cpu));
+  db.on_init();
+  db.stop();
+
+  odb::DBClient client(std::make_unique<odb::DBClientImplVMSide>(db));
+  client.connect();
+  REQUIRE(client.state() == odb::DBClient::State::VM_STOPPED);
+
+  std::vector<char> buf(2048);
+  REQUIRE(client.read_mem_diff(0, 2048, buf.data()) == 8);
+  REQUIRE(buf == db_read_buf(db, 0, 2048));
+
+  // Nothing changed
+  REQUIRE(client.read_mem_diff(0, 2048, buf.data()) == 0);
+  REQUIRE(buf == db_read_buf(db, 0, 2048));
+
+  // Only the page with the change is sent
+  db_write_u32(db, 1020, 0xDEADBEEF);
+  REQUIRE(client.read_mem_diff(0, 2048, buf.data()) == 1);
+  REQUIRE(buf == db_read_buf(db, 0, 2048));
+
+  // Changes in two pages, the last one being partial
+  std::vector<char> small(300);
+  REQUIRE(client.read_mem_diff(100, 300, small.data()) == 2);
+  REQUIRE(small == db_read_buf(db, 100, 300));
+  db_write_u32(db, 120, 17);
+  db_write_u32(db, 398, 42);
+  REQUIRE(client.read_mem_diff(100, 300, small.data()) == 2);
+  REQUIRE(small == db_read_buf(db, 100, 300));
+  REQUIRE(client.read_mem_diff(0, 2048, buf.data()) == 2);
+  REQUIRE(buf == db_read_buf(db, 0, 2048));
+
+  // Another client doesn't know the region version
+  odb::DBClient client2(std::make_unique<odb::DBClientImplVMSide>(db));
+  client2.connect();
+  std::vector<char> buf2(2048);
+  REQUIRE(client2.read_mem_diff(0, 2048, buf2.data()) == 8);
+  REQUIRE(buf2 == buf);
+}
+
+TEST_CASE("debugger read_mem_diff evict", "") {
+  using namespace mvm0;
+  auto rom = parse_file(PATH_CALL_ADD);
+  CPU cpu(rom);
+  cpu.init();
+  odb::Debugger db(std::make_unique<VMApi>(cpu));
+  db.on_init();
+
+  std::vector<odb::vm_size_t> pages;
+  std::vector<char> data;
+  std::uint64_t v0 = 0;
+  db.read_mem_diff(0, 16, v0, pages, data);
+  REQUIRE(pages.size() == 1);
+  REQUIRE(data.size() == 16);
+
+  auto v = v0;
+  db.read_mem_diff(0, 16, v, pages, data);
+  REQUIRE(v == v0);
+  REQUIRE(pages.empty());
+  REQUIRE(data.empty());
+
+  // Read enough other regions to evict the first one
+  for (std::size_t i = 1; i <= odb::Debugger::MEM_DIFF_MAX_REGIONS; ++i) {
+    std::uint64_t vi = 0;
+    db.read_mem_diff(i * 16, 16, vi, pages, data);
+  }
+
+  v = v0;
+  db.read_mem_diff(0, 16, v, pages, data);
+  REQUIRE(v != v0);
+  REQUIRE(pages.size() == 1);
+  REQUIRE(data == db_read_buf(db, 0, 16));
+}
+
+TEST_CASE("db_client mem_stream", "") {
+  using namespace mvm0;
+  auto rom = parse_file(PATH_CALL_ADD);
+  CPU cpu(rom);
+  cpu.init();
+  odb::Debugger db(std::make_unique<VMApi>(cpu));
+  db.on_init();
+  db.stop();
+
+  odb::DBClient client(std::make_unique<odb::DBClientImplVMSide>(db));
+  client.connect();
+
+  // Write 900 bytes in chunks of 300
+  std::vector<odb::vm_ptr_t> addrs;
+  auto written = client.write_mem_stream(
+      100, 900,
+      [&addrs](odb::vm_ptr_t addr, char *data, odb::vm_size_t size) {
+        addrs.push_back(addr);
+        for (odb::vm_size_t i = 0; i < size; ++i)
+          data[i] = static_cast<char>(addr + i);
+        return true;
+      },
+      300);
+  REQUIRE(written == 900);
+  REQUIRE(addrs == std::vector<odb::vm_ptr_t>{100, 400, 700});
+
+  // Read them back
+  std::vector<char> res;
+  auto read = client.read_mem_stream(
+      100, 900,
+      [&res](odb::vm_ptr_t, const char *data, odb::vm_size_t size) {
+        REQUIRE(size <= 256);
+        res.insert(res.end(), data, data + size);
+        return true;
+      },
+      256);
+  REQUIRE(read == 900);
+  REQUIRE(res == db_read_buf(db, 100, 900));
+  for (std::size_t i = 0; i < res.size(); ++i)
+    REQUIRE(res[i] == static_cast<char>(100 + i));
+
+  // Cancel after the second chunk
+  std::size_t nchunks = 0;
+  read = client.read_mem_stream(
+      0, 2048,
+      [&nchunks](odb::vm_ptr_t, const char *, odb::vm_size_t) {
+        return ++nchunks < 2;
+      },
+      512);
+  REQUIRE(nchunks == 2);
+  REQUIRE(read == 1024);
+
+  written = client.write_mem_stream(
+      0, 2048, [](odb::vm_ptr_t, char *, odb::vm_size_t) { return false; });
+  REQUIRE(written == 0);
+}
+
+TEST_CASE("simplecli dump", "") {
+  using namespace mvm0;
+  auto rom = parse_file(PATH_CALL_ADD);
+  CPU cpu(rom);
+  cpu.init();
+  odb::Debugger db(std::make_unique<VMApi>(cpu));
+  db.on_init();
+  db.stop();
+
+  odb::DBClient client(std::make_unique<odb::DBClientImplVMSide>(db));
+  client.connect();
+  odb::SimpleCLIClient cli(client);
+
+  std::string path = "./utest_mvm0_dump.bin";
+  REQUIRE(cli.exec("dump 1000 48 " + path) ==
+          "48 bytes written to " + path);
+
+  std::ifstream ifs(path, std::ios::binary);
+  std::vector<char> data((std::istreambuf_iterator<char>(ifs)),
+                         std::istreambuf_iterator<char>());
+  REQUIRE(data == db_read_buf(db, 1000, 48));
+  std::remove(path.c_str());
+
+  REQUIRE(cli.exec("dump 1000") == "Error: dump: missing arguments");
+}
+
+TEST_CASE("db_client cache", "") {
+  using namespace mvm0;
+  auto rom = parse_file(PATH_CALL_ADD);
+  CPU cpu(rom);
+  cpu.init();
+  odb::Debugger db(std::make_unique<VMApi>(cpu));
+  db.on_init();
+  db.stop();
+
+  odb::DBClient client(std::make_unique<odb::DBClientImplVMSide>(db));
+  client.connect();
+  odb::SimpleCLIClient cli(client);
+  const auto &stats = client.cache_stats();
+
+  REQUIRE(cli.exec("b @my_add") == "Inserted breakpoint at `0x401'\n");
+  REQUIRE(client.has_breakpoint(0x401));
+  REQUIRE(!client.has_breakpoint(0x400));
+  cli.exec("continue");
+  while (client.state() == odb::DBClient::State::VM_RUNNING) {
+    REQUIRE(cpu.step() == 0);
+    db.on_update();
+    client.check_stopped();
+  }
+
+  // First time: everything is fetched
+  auto code = cli.exec("code");
+  auto bt = cli.exec("bt");
+  auto pmem = cli.exec("pmem u32 600 2");
+  REQUIRE(bt == "0x401 (<my_add> + 0x0)\n0x405 (<_begin> + 0x5)\n");
+  REQUIRE(stats.requests > 0);
+
+  // Then nothing
+  client.reset_cache_stats();
+  for (int i = 0; i < 10; ++i) {
+    REQUIRE(cli.exec("code") == code);
+    REQUIRE(cli.exec("bt") == bt);
+    REQUIRE(cli.exec("pmem u32 600 2") == pmem);
+  }
+  REQUIRE(stats.requests == 0);
+  REQUIRE(stats.mem.misses == 0);
+  REQUIRE(stats.mem.hits == 10);
+  REQUIRE(stats.code.hits > 0);
+  REQUIRE(stats.syms.misses == 0);
+
+  // Writes update the cached pages
+  REQUIRE(cli.exec("smem u32 600 7 8") == "");
+  REQUIRE(cli.exec("pmem u32 600 2") == "7 8 ");
+  REQUIRE(stats.requests == 1);
+  REQUIRE(db_read_buf(db, 600, 8) == std::vector<char>{7, 0, 0, 0, 8, 0, 0, 0});
+
+  // A new stop epoch only invalidates VM state
+  auto epoch = client.stop_epoch();
+  cli.exec("finish");
+  while (client.state() == odb::DBClient::State::VM_RUNNING) {
+    REQUIRE(cpu.step() == 0);
+    db.on_update();
+    client.check_stopped();
+  }
+  REQUIRE(client.stop_epoch() > epoch);
+  client.reset_cache_stats();
+  db_write_u32(db, 604, 9);
+  REQUIRE(cli.exec("pmem u32 600 2") == "7 9 ");
+  REQUIRE(stats.mem.misses == 1);
+  REQUIRE(cli.exec("bt") == "0x406 (<_begin> + 0x6)\n");
+  REQUIRE(stats.syms.misses == 0);
+
+  client.invalidate_static_cache();
+  client.reset_cache_stats();
+  cli.exec("bt");
+  REQUIRE(stats.syms.misses == 1);
+}
+
+TEST_CASE("db_client write_back", "") {
+  using namespace mvm0;
+  auto rom = parse_file(PATH_CALL_ADD);
+  CPU cpu(rom);
+  cpu.init();
+  odb::Debugger db(std::make_unique<VMApi>(cpu));
+  db.on_init();
+  db.stop();
+
+  odb::DBClient client(std::make_unique<odb::DBClientImplVMSide>(db));
+  client.connect();
+  client.set_write_back(true);
+  const auto &stats = client.cache_stats();
+
+  // Warm up register infos
+  odb::vm_reg_t regs[2] = {3, 4};
+  odb::vm_size_t regs_size[2] = {4, 4};
+  std::uint32_t reg_vals[2];
+  char *reg_outs[2] = {reinterpret_cast<char *>(&reg_vals[0]),
+                       reinterpret_cast<char *>(&reg_vals[1])};
+  client.get_regs(regs, reg_outs, regs_size, 2);
+  client.reset_cache_stats();
+
+  // Many small writes, nothing sent
+  for (std::uint32_t i = 0; i < 20; ++i) {
+    std::uint32_t val = 100 + i;
+    const char *in = reinterpret_cast<const char *>(&val);
+    odb::vm_ptr_t addr = 600 + 4 * (i % 10);
+    odb::vm_size_t size = 4;
+    client.write_mem(&addr, &size, &in, 1);
+    client.set_regs(&regs[i % 2], &in, &size, 1);
+  }
+  odb::vm_ptr_t far_addr = 900;
+  odb::vm_size_t far_size = 2;
+  const char *far_data = "ab";
+  client.write_mem(&far_addr, &far_size, &far_data, 1);
+  REQUIRE(stats.requests == 0);
+  REQUIRE(client.has_pending_writes());
+  REQUIRE(db_read_u32(db, 600) == 0);
+
+  // Local reads see the writes
+  client.get_regs(regs, reg_outs, regs_size, 2);
+  REQUIRE(reg_vals[0] == 118);
+  REQUIRE(reg_vals[1] == 119);
+  REQUIRE(stats.requests == 0);
+
+  // Overlapping read: one request per kind, then the read
+  std::vector<char> buf(8);
+  char *buf_ptr = buf.data();
+  odb::vm_ptr_t addr = 636;
+  odb::vm_size_t size = 8;
+  client.read_mem(&addr, &size, &buf_ptr, 1);
+  REQUIRE(stats.requests == 3);
+  REQUIRE(!client.has_pending_writes());
+  REQUIRE(db_read_u32(db, 600) == 110);
+  REQUIRE(db_read_u32(db, 636) == 119);
+  REQUIRE(db_read_buf(db, 900, 2) == std::vector<char>{'a', 'b'});
+  REQUIRE(db_get_reg(db, 3) == 118);
+  REQUIRE(db_get_reg(db, 4) == 119);
+  REQUIRE(buf == db_read_buf(db, 636, 8));
+
+  // The failing write is identified
+  std::uint32_t val = 7;
+  const char *in = reinterpret_cast<const char *>(&val);
+  odb::vm_ptr_t addrs[3] = {100, 4000, 200};
+  odb::vm_size_t sizes[3] = {4, 4, 4};
+  const char *ins[3] = {in, in, in};
+  client.write_mem(addrs, sizes, ins, 3);
+  REQUIRE_THROWS_WITH(client.flush(),
+                      "flush: write_mem of 4 bytes at 4000 failed: Memory "
+                      "address out of range (0-2048)");
+  REQUIRE(!client.has_pending_writes());
+  REQUIRE(db_read_u32(db, 100) == 7);
+
+  // Flushed before resume
+  client.write_mem(&addrs[2], &sizes[2], &ins[2], 1);
+  client.resume(odb::ResumeType::Step);
+  REQUIRE(db_read_u32(db, 200) == 7);
+}
+
+TEST_CASE("db_client async", "") {
+  using namespace mvm0;
+  auto rom = parse_file(PATH_CALL_ADD);
+  CPU cpu(rom);
+  cpu.init();
+  odb::Debugger db(std::make_unique<VMApi>(cpu));
+  db.on_init();
+  db.stop();
+
+  odb::DBClient client(std::make_unique<odb::DBClientImplVMSide>(db));
+  client.connect();
+  REQUIRE(client.poll() == 0);
+
+  std::vector<int> order;
+  std::vector<char> bufs[3];
+  char *ptrs[3];
+  odb::vm_ptr_t addrs[3] = {600, 700, 800};
+  odb::vm_size_t size = 16;
+  for (int i = 0; i < 3; ++i) {
+    db_write_u32(db, addrs[i], 10 + i);
+    bufs[i].resize(size);
+    ptrs[i] = bufs[i].data();
+  }
+
+  std::vector<std::string> text;
+  std::vector<odb::vm_size_t> text_sizes;
+  client.read_mem_async(&addrs[0], &size, &ptrs[0], 1,
+                        [&](const std::string &err) {
+                          REQUIRE(err.empty());
+                          order.push_back(0);
+                        });
+  auto cancelled = client.read_mem_async(
+      &addrs[1], &size, &ptrs[1], 1,
+      [&](const std::string &) { order.push_back(1); });
+  client.get_code_text_async(0x400, 3, text, text_sizes,
+                             [&](const std::string &err) {
+                               REQUIRE(err.empty());
+                               order.push_back(2);
+                             });
+  odb::vm_ptr_t bad_addr = 4000;
+  client.read_mem_async(&bad_addr, &size, &ptrs[2], 1,
+                        [&](const std::string &err) {
+                          REQUIRE(!err.empty());
+                          order.push_back(3);
+                        });
+  client.read_mem_async(&addrs[2], &size, &ptrs[2], 1,
+                        [&](const std::string &err) {
+                          REQUIRE(err.empty());
+                          order.push_back(4);
+                        });
+  REQUIRE(client.cancel(cancelled));
+  REQUIRE(!client.cancel(cancelled));
+
+  client.wait_async();
+  REQUIRE(client.async_pending() == 0);
+  REQUIRE(order == std::vector<int>{0, 2, 3, 4});
+  REQUIRE(bufs[0] == db_read_buf(db, 600, 16));
+  REQUIRE(bufs[2] == db_read_buf(db, 800, 16));
+  REQUIRE(text.size() == 3);
+
+  // The code text was added to the cache
+  client.reset_cache_stats();
+  std::vector<std::string> text2;
+  client.get_code_text(0x400, 3, text2, text_sizes);
+  REQUIRE(text2 == text);
+  REQUIRE(client.cache_stats().requests == 0);
+
+  // Blocking calls deliver pending requests first
+  order.clear();
+  std::vector<odb::SymbolInfos> syms;
+  client.get_symbols_by_addr_async(0x400, 1, syms, [&](const std::string &) {
+    order.push_back(5);
+  });
+  std::uint32_t val = 0;
+  char *val_ptr = reinterpret_cast<char *>(&val);
+  odb::vm_size_t val_size = 4;
+  client.read_mem(&addrs[1], &val_size, &val_ptr, 1);
+  REQUIRE(order == std::vector<int>{5});
+  REQUIRE(val == 11);
+  REQUIRE(syms.size() == 1);
+  REQUIRE(syms[0].name == "_begin");
+
+  // Async reads see the pending register writes
+  client.set_write_back(true);
+  odb::vm_reg_t reg = 3;
+  std::uint32_t reg_old;
+  std::uint32_t reg_val = 42;
+  char *reg_ptr = reinterpret_cast<char *>(&reg_old);
+  const char *reg_in = reinterpret_cast<const char *>(&reg_val);
+  client.get_regs(&reg, &reg_ptr, &val_size, 1);
+  client.set_regs(&reg, &reg_in, &val_size, 1);
+  std::uint32_t reg_out = 0;
+  reg_ptr = reinterpret_cast<char *>(&reg_out);
+  client.get_regs_async(&reg, &reg_ptr, &val_size, 1,
+                        [&](const std::string &err) { REQUIRE(err.empty()); });
+  client.wait_async();
+  REQUIRE(reg_out == 42);
+  reg_out = 0;
+  client.get_regs(&reg, &reg_ptr, &val_size, 1);
+  REQUIRE(reg_out == 42);
+  reg_in = reinterpret_cast<const char *>(&reg_old);
+  client.set_regs(&reg, &reg_in, &val_size, 1);
+  client.set_write_back(false);
+
+  // Wait for the VM to stop
+  client.resume(odb::ResumeType::Step);
+  bool stopped = false;
+  while (!stopped) {
+    REQUIRE(cpu.step() == 0);
+    db.on_update();
+    client.check_stopped_async([&](const std::string &err) {
+      REQUIRE(err.empty());
+      stopped = client.state() == odb::DBClient::State::VM_STOPPED;
+    });
+    while (client.async_pending())
+      client.poll();
+  }
+  REQUIRE(client.get_execution_point() == 0x403);
+
+  // stop() after a pending check_stopped_async already saw the stop
+  client.resume(odb::ResumeType::Step);
+  REQUIRE(cpu.step() == 0);
+  db.on_update();
+  client.check_stopped_async([&](const std::string &err) {
+    REQUIRE(err.empty());
+  });
+  client.stop();
+  REQUIRE(client.state() == odb::DBClient::State::VM_STOPPED);
+  REQUIRE(client.get_execution_point() == 0x404);
+}
+
+TEST_CASE("db_client prefetch", "") {
+  using namespace mvm0;
+  auto rom = parse_file(PATH_CALL_ADD);
+  CPU cpu(rom);
+  cpu.init();
+  odb::Debugger db(std::make_unique<VMApi>(cpu));
+  db.on_init();
+  db.stop();
+
+  odb::DBClient client(std::make_unique<odb::DBClientImplVMSide>(db));
+  client.connect();
+  odb::SimpleCLIClient cli(client);
+  const auto &stats = client.cache_stats();
+
+  // Same windows than the CLI commands below
+  const auto &infos = client.get_vm_infos();
+  odb::PrefetchProfile pf;
+  pf.regs = {infos.regs_program_counter[0], infos.regs_stack_pointer[0]};
+  pf.mems.push_back({infos.regs_stack_pointer[0], -192, 196});
+  pf.code_before = 3;
+  pf.code_nins = 7;
+  pf.stack_syms = true;
+  client.set_prefetch_profile(pf);
+
+  cli.exec("b @my_add");
+  cli.exec("continue");
+  while (client.state() == odb::DBClient::State::VM_RUNNING) {
+    REQUIRE(cpu.step() == 0);
+    db.on_update();
+    client.check_stopped();
+  }
+  // Static data: referenced symbols and registers names
+  cli.exec("code");
+  REQUIRE(cli.exec("preg u32 %sp") == "%sp: 1020\n");
+
+  // Only the check_stopped request for each step
+  for (int i = 0; i < 2; ++i) {
+    cli.exec("step");
+    client.reset_cache_stats();
+    std::size_t nchecks = 0;
+    while (client.state() == odb::DBClient::State::VM_RUNNING) {
+      REQUIRE(cpu.step() == 0);
+      db.on_update();
+      client.check_stopped();
+      ++nchecks;
+    }
+
+    auto code = cli.exec("code");
+    auto bt = cli.exec("bt");
+    auto state = cli.exec("state");
+    auto regs = cli.exec("preg u32 %pc %sp");
+    auto pmem = cli.exec("pmem u32 1016 2");
+    REQUIRE(stats.requests == nchecks);
+    REQUIRE(stats.mem.misses == 0);
+    REQUIRE(stats.regs.misses == 0);
+    REQUIRE(stats.code.misses == 0);
+    REQUIRE(stats.syms.misses == 0);
+
+    // Same output without prefetch
+    odb::DBClient ref(std::make_unique<odb::DBClientImplVMSide>(db));
+    ref.connect();
+    odb::SimpleCLIClient ref_cli(ref);
+    REQUIRE(ref_cli.exec("code") == code);
+    REQUIRE(ref_cli.exec("bt") == bt);
+    REQUIRE(ref_cli.exec("state") == state);
+    REQUIRE(ref_cli.exec("preg u32 %pc %sp") == regs);
+    REQUIRE(ref_cli.exec("pmem u32 1016 2") == pmem);
+  }
+}
+
+TEST_CASE("db_client server caps", "") {
+  using namespace mvm0;
+  auto rom = parse_file(PATH_CALL_ADD);
+  CPU cpu(rom);
+  cpu.init();
+  odb::Debugger db(std::make_unique<VMApi>(cpu));
+  db.on_init();
+  db.stop();
+
+  auto impl = std::make_unique<CapsImpl>(db);
+  impl->caps &= ~odb::PROTO_CAP_GET_BKPS;
+  impl->table_errors = 1;
+  odb::DBClient client(std::move(impl));
+  client.connect();
+
+  // Breakpoints of other clients are unknown without GET_BKPS
+  db.add_breakpoint(0x406);
+  REQUIRE(!client.has_breakpoint(0x406));
+
+  // A failed table request is tried again by the next lookup
+  std::vector<odb::SymbolInfos> syms;
+  REQUIRE_THROWS_AS(client.get_symbols_by_addr(0x400, 1, syms),
+                    odb::VMApi::Error);
+  client.reset_cache_stats();
+  client.get_symbols_by_addr(0x400, 1, syms);
+  REQUIRE(syms.size() == 1);
+  client.get_symbols_by_addr(0x401, 1, syms);
+  REQUIRE(syms.size() == 1);
+  REQUIRE(client.cache_stats().requests == 1);
+}
+
+TEST_CASE("db_client prefetch stack symbols", "") {
+  using namespace mvm0;
+  auto rom = parse_file(PATH_CALL_ADD);
+  CPU cpu(rom);
+  cpu.init();
+  odb::Debugger db(std::make_unique<VMApi>(cpu));
+  db.on_init();
+  db.stop();
+
+  // Only the stack symbols
+  odb::PrefetchProfile pf;
+  pf.stack_syms = true;
+  REQUIRE(!pf.empty());
+  odb::DBClientImplVMSide impl(db);
+  impl.set_prefetch(pf);
+  odb::DBClientUpdate udp;
+  impl.check_stopped(udp);
+  REQUIRE(udp.stopped);
+  REQUIRE(udp.prefetch.syms.size() == 1);
+  REQUIRE(udp.prefetch.syms[0].name == "_begin");
+}
+
+TEST_CASE("db_client prefetch code errors", "") {
+  auto vm = std::make_unique<OpcodeVM>();
+  auto &ovm = *vm;
+  ovm.pc = 0x20;
+  std::fill(&ovm.mem[0], &ovm.mem[ovm.pc + 1], OpcodeVM::BAD_OP);
+  odb::Debugger db(std::move(vm));
+  db.on_init();
+  db.stop();
+
+  // Best-effort: the code is left out when it cannot be decoded
+  odb::DBClientImplVMSide impl(db);
+  odb::PrefetchProfile pf;
+  pf.code_before = 2;
+  pf.code_nins = 4;
+  odb::StopPrefetch out;
+  REQUIRE_NOTHROW(impl.prefetch(pf, out));
+  REQUIRE(out.code_text.empty());
+}
+
+TEST_CASE("debugger find_code_before bad opcode", "") {
+  auto vm = std::make_unique<OpcodeVM>();
+  auto &ovm = *vm;
+  ovm.pc = 0x20;
+  ovm.mem[0x1F] = OpcodeVM::BAD_OP;
+  odb::Debugger db(std::move(vm));
+  db.on_init();
+  db.stop();
+
+  // Probing stops at the undecodable byte, but doesn't throw
+  odb::vm_size_t n;
+  REQUIRE(db.find_code_before(0x20, 2, n) == 0x20);
+  REQUIRE(n == 0);
+  REQUIRE(db.find_code_before(0x1F, 2, n) == 0x1D);
+  REQUIRE(n == 2);
+}
+
+TEST_CASE("db_client symbols table", "") {
+  using namespace mvm0;
+  auto rom = parse_file(PATH_CALL_ADD);
+  CPU cpu(rom);
+  cpu.init();
+  odb::Debugger db(std::make_unique<VMApi>(cpu));
+  db.on_init();
+  db.stop();
+
+  odb::DBClientImplVMSide impl(db);
+  odb::SymbolsTable table;
+  impl.get_symbols_table(table);
+  REQUIRE(table.size() == rom.syms.size());
+  for (std::size_t i = 1; i < table.size(); ++i)
+    REQUIRE(table.addrs[i - 1] <= table.addrs[i]);
+
+  odb::DBClient client(std::make_unique<odb::DBClientImplVMSide>(db));
+  client.connect();
+  client.reset_cache_stats();
+  const auto &stats = client.cache_stats();
+
+  // Only one request for the whole table
+  for (std::size_t i = 0; i < table.size(); ++i) {
+    auto ref = db.get_symbol_infos(table.ids[i]);
+    REQUIRE(table.name(i) == ref.name);
+    REQUIRE(table.addrs[i] == ref.addr);
+
+    odb::SymbolInfos infos;
+    client.get_symbols_by_ids(&ref.idx, &infos, 1);
+    REQUIRE(infos.name == ref.name);
+    const char *name = ref.name.c_str();
+    client.get_symbols_by_names(&name, &infos, 1);
+    REQUIRE(infos.idx == ref.idx);
+    std::vector<odb::SymbolInfos> syms;
+    client.get_symbols_by_addr(ref.addr, 1, syms);
+    REQUIRE(syms.size() == 1);
+    REQUIRE(syms[0].idx == ref.idx);
+  }
+  std::vector<odb::SymbolInfos> syms;
+  client.get_symbols_by_addr(0, client.memory_size(), syms);
+  REQUIRE(syms.size() == table.size());
+  REQUIRE(stats.requests == 1);
+
+  // Unknown names still reach the server
+  odb::SymbolInfos infos;
+  const char *bad_name = "not_a_symbol";
+  REQUIRE_THROWS_AS(client.get_symbols_by_names(&bad_name, &infos, 1),
+                    odb::VMApi::Error);
+  REQUIRE(stats.requests == 2);
+}
+
+TEST_CASE("db_client symbols table loaded later", "") {
+  auto vm = std::make_unique<OpcodeVM>();
+  auto &ovm = *vm;
+  ovm.syms.push_back(odb::SymbolInfos{0, "start", 0x10});
+  odb::Debugger db(std::move(vm));
+  db.on_init();
+  db.stop();
+
+  odb::DBClient client(std::make_unique<odb::DBClientImplVMSide>(db));
+  client.connect();
+  std::vector<odb::SymbolInfos> syms;
+  client.get_symbols_by_addr(0x10, 1, syms);
+  REQUIRE(syms.size() == 1);
+
+  // Loaded by the VM after the client fetched the symbols table
+  ovm.syms.push_back(odb::SymbolInfos{1, "plugin", 0x40});
+  odb::SymbolInfos infos;
+  const char *name = "plugin";
+  client.get_symbols_by_names(&name, &infos, 1);
+  REQUIRE(infos.idx == 1);
+
+  // The outdated table is fetched again, with both symbols
+  client.reset_cache_stats();
+  client.get_symbols_by_addr(0, 0x80, syms);
+  REQUIRE(syms.size() == 2);
+  REQUIRE(syms[0].name == "start");
+  REQUIRE(syms[1].name == "plugin");
+  client.get_symbols_by_addr(0x40, 1, syms);
+  REQUIRE(syms.size() == 1);
+  REQUIRE(client.cache_stats().requests == 1);
+}
+
+TEST_CASE("db_client disk cache", "") {
+  using namespace mvm0;
+  auto rom = parse_file(PATH_CALL_ADD);
+  CPU cpu(rom);
+  cpu.init();
+  odb::Debugger db(std::make_unique<VMApi>(cpu));
+  db.on_init();
+  db.stop();
+
+  char dir_tpl[] = "/tmp/odb_disk_cache_XXXXXX";
+  REQUIRE(mkdtemp(dir_tpl));
+  std::string dir = dir_tpl;
+  REQUIRE(db.get_vm_infos().program_hash != 0);
+
+  std::string code;
+  std::string bt;
+  for (int session = 0; session < 2; ++session) {
+    odb::DBClient client(std::make_unique<odb::DBClientImplVMSide>(db));
+    client.set_disk_cache_dir(dir);
+    client.connect();
+    client.reset_cache_stats();
+    odb::SimpleCLIClient cli(client);
+
+    if (session == 0) {
+      code = cli.exec("code 5");
+      bt = cli.exec("bt");
+      REQUIRE(client.cache_stats().requests > 0);
+      client.save_disk_cache();
+    } else {
+      // Everything comes from the disk
+      REQUIRE(cli.exec("code 5") == code);
+      REQUIRE(cli.exec("bt") == bt);
+      REQUIRE(client.cache_stats().requests == 0);
+    }
+  }
+
+  odb::DiskCache cache(dir, db.get_vm_infos().program_hash);
+  REQUIRE(cache.loaded());
+  std::remove(cache.path().c_str());
+  rmdir(dir.c_str());
+}
+
+TEST_CASE("db_client disk cache patched code", "") {
+  auto vm = std::make_unique<OpcodeVM>();
+  auto &ovm = *vm;
+  odb::Debugger db(std::move(vm));
+  db.on_init();
+  db.stop();
+
+  char dir_tpl[] = "/tmp/odb_disk_cache_XXXXXX";
+  REQUIRE(mkdtemp(dir_tpl));
+  std::string dir = dir_tpl;
+  std::vector<std::string> text;
+  std::vector<odb::vm_size_t> sizes;
+
+  {
+    odb::DBClient client(std::make_unique<odb::DBClientImplVMSide>(db));
+    client.set_disk_cache_dir(dir);
+    client.connect();
+    client.get_code_text(0, 4, text, sizes);
+    client.get_code_text(0x80, 2, text, sizes);
+    client.save_disk_cache();
+  }
+
+  // Patched between the sessions: only these ones are fetched again
+  std::uint8_t patch = 9;
+  db.write_mem(2, 1, &patch);
+  patch = 5;
+  db.write_mem(0x81, 1, &patch);
+  odb::DBClient client(std::make_unique<odb::DBClientImplVMSide>(db));
+  client.set_disk_cache_dir(dir);
+  client.connect();
+  ovm.code_calls = 0;
+  client.get_code_text(0, 4, text, sizes);
+  REQUIRE(text == std::vector<std::string>{"op7", "op7", "op9", "op7"});
+  REQUIRE(ovm.code_calls == 1); // the next one is in the server cache
+  ovm.code_calls = 0;
+  client.get_code_text(0x80, 2, text, sizes);
+  REQUIRE(text == std::vector<std::string>{"op7", "op5"});
+  REQUIRE(ovm.code_calls == 1);
+
+  // The disk cache is still used after dropping the static data
+  client.invalidate_static_cache();
+  ovm.code_calls = 0;
+  client.get_code_text(0, 2, text, sizes);
+  REQUIRE(text == std::vector<std::string>{"op7", "op7"});
+  REQUIRE(ovm.code_calls == 0);
+
+  odb::DiskCache cache(dir, 0x42);
+  REQUIRE(cache.loaded());
+  std::remove(cache.path().c_str());
+  rmdir(dir.c_str());
+}
+
+TEST_CASE("db_client code annotated", "") {
+  using namespace mvm0;
+  auto rom = parse_file(PATH_CALL_ADD);
+  CPU cpu(rom);
+  cpu.init();
+  odb::Debugger db(std::make_unique<VMApi>(cpu));
+  db.on_init();
+  db.stop();
+
+  odb::DBClient ref(std::make_unique<odb::DBClientImplVMSide>(db));
+  ref.connect();
+  std::vector<std::string> text;
+  std::vector<odb::vm_size_t> sizes;
+  ref.get_code_text(0x400, 9, text, sizes);
+
+  odb::DBClient client(std::make_unique<odb::DBClientImplVMSide>(db));
+  client.connect();
+  client.reset_cache_stats();
+  const auto &stats = client.cache_stats();
+
+  // Code and symbols in one request
+  odb::CodeAnnotated code;
+  client.get_code_annotated(0x400, 9, code);
+  REQUIRE(stats.requests == 1);
+  REQUIRE(code.text == text);
+  REQUIRE(code.sizes == sizes);
+  REQUIRE(code.addrs[0] == 0x400);
+  REQUIRE(code.addrs[1] == 0x400 + sizes[0]);
+  REQUIRE(code.missing_syms().empty());
+  for (const auto &name : {"_begin", "my_add", "_start"}) {
+    auto id = db.find_sym_id(name);
+    REQUIRE(code.find_sym(id));
+    REQUIRE(code.find_sym(id)->addr == db.get_symbol_infos(id).addr);
+  }
+  REQUIRE(code.resolved_text(0) == "b _start");
+  for (std::size_t i = 1; i < code.syms.size(); ++i)
+    REQUIRE(code.syms[i - 1].addr <= code.syms[i].addr);
+
+  // Then cached, with the same output than before
+  // The first cached lookup also loads the symbols table
+  auto out = odb::SimpleCLIClient(client).exec("code 4");
+  REQUIRE(out == odb::SimpleCLIClient(ref).exec("code 4"));
+  client.get_code_annotated(0x400, 9, code);
+  client.reset_cache_stats();
+  for (int i = 0; i < 10; ++i) {
+    odb::CodeAnnotated code2;
+    client.get_code_annotated(0x400, 9, code2);
+    REQUIRE(code2.text == code.text);
+    REQUIRE(code2.syms.size() == code.syms.size());
+    REQUIRE(odb::SimpleCLIClient(client).exec("code 4") == out);
+  }
+  REQUIRE(stats.requests == 0);
+  REQUIRE(stats.code.misses == 0);
+
+  // Instructions before an address, found by the server
+  odb::DBClient client2(std::make_unique<odb::DBClientImplVMSide>(db));
+  client2.connect();
+  client2.reset_cache_stats();
+  const auto &stats2 = client2.cache_stats();
+  client2.get_code_around(0x404, 4, 3, code);
+  REQUIRE(stats2.requests == 1);
+  REQUIRE(code.size() == 7);
+  REQUIRE(code.addrs.front() == 0x400);
+  REQUIRE(code.text[0] == text[0]);
+  client2.get_code_around(0x403, 3, 2, code);
+  REQUIRE(stats2.requests <= 2); // symbols table
+  REQUIRE(code.addrs.front() == 0x400);
+  REQUIRE(code.size() == 5);
+  client2.get_code_around(0x402, 1, 5, code);
+  client2.get_code_around(0x404, 4, 3, code);
+  REQUIRE(stats2.requests <= 2);
+}
+
+TEST_CASE("db_client breakpoints of other clients", "") {
+  using namespace mvm0;
+  auto rom = parse_file(PATH_CALL_ADD);
+  CPU cpu(rom);
+  cpu.init();
+  odb::Debugger db(std::make_unique<VMApi>(cpu));
+  db.on_init();
+  db.stop();
+  db.add_breakpoint(0x401);
+
+  odb::DBClient client(std::make_unique<odb::DBClientImplVMSide>(db));
+  client.connect();
+  REQUIRE(client.has_breakpoint(0x401));
+  REQUIRE(!client.has_breakpoint(0x406));
+
+  // Fetched once per stop
+  auto requests = client.cache_stats().requests;
+  db.add_breakpoint(0x406);
+  REQUIRE(!client.has_breakpoint(0x406));
+  REQUIRE(client.cache_stats().requests == requests);
+
+  client.resume(odb::ResumeType::Continue);
+  while (client.state() == odb::DBClient::State::VM_RUNNING) {
+    REQUIRE(cpu.step() == 0);
+    db.on_update();
+    client.check_stopped();
+  }
+  REQUIRE(client.get_execution_point() == 0x401);
+  REQUIRE(client.has_breakpoint(0x406));
+
+  odb::vm_ptr_t addr = 0x406;
+  client.del_breakpoints(&addr, 1);
+  REQUIRE(!client.has_breakpoint(0x406));
+  REQUIRE(!db.has_breakpoint(0x406));
+}
@@ -1,5 +1,9 @@
 #include "utils.hh"
 
+#include <cstring>
+
+#include <odb/server/event-log.hh>
+
 namespace {
 
 std::uint32_t read_u32(const mvm0::CPU &cpu, std::size_t addr) {
@@ -15,8 +19,204 @@ void db_step(odb::Debugger &db, mvm0::CPU &cpu) {
   REQUIRE(db.get_state() == odb::Debugger::State::STOPPED);
 }
 
+// Code only VM, instruction #i has size i % 3 + 1
+// Symbols are defined at instructions #0 and #50
+class VarCodeVM : public odb::VMApi {
+public:
+  static constexpr std::size_t NINS = 100;
+
+  std::vector<odb::vm_ptr_t> starts;
+  std::size_t code_calls = 0;
+
+  VarCodeVM() {
+    odb::vm_ptr_t addr = 0;
+    for (std::size_t i = 0; i < NINS; ++i) {
+      starts.push_back(addr);
+      addr += i % 3 + 1;
+    }
+  }
+
+  odb::VMInfos get_vm_infos() override {
+    odb::VMInfos infos;
+    infos.name = "varcode";
+    infos.regs_count = 0;
+    infos.memory_size = 512;
+    infos.symbols_count = 2;
+    infos.pointer_size = 8;
+    infos.integer_size = 8;
+    infos.use_opcode = true;
+    return infos;
+  }
+
+  UpdateInfos get_update_infos() override {
+    return UpdateInfos{UpdateState::OK, 0};
+  }
+
+  void get_reg(odb::vm_reg_t, odb::RegInfos &, bool) override {
+    throw odb::VMApi::Error("no registers");
+  }
+  void set_reg(odb::vm_reg_t, const std::uint8_t *) override {
+    throw odb::VMApi::Error("no registers");
+  }
+  odb::vm_reg_t find_reg_id(const std::string &) override {
+    throw odb::VMApi::Error("no registers");
+  }
+
+  void read_mem(odb::vm_ptr_t, odb::vm_size_t size,
+                std::uint8_t *out_buf) override {
+    std::fill(out_buf, out_buf + size, 0);
+  }
+  void write_mem(odb::vm_ptr_t, odb::vm_size_t, const std::uint8_t *) override {
+  }
+
+  std::vector<odb::vm_sym_t> get_symbols(odb::vm_ptr_t addr,
+                                         odb::vm_size_t size) override {
+    std::vector<odb::vm_sym_t> res;
+    for (odb::vm_sym_t i = 0; i < 2; ++i)
+      if (sym_addr(i) >= addr && sym_addr(i) - addr < size)
+        res.push_back(i);
+    return res;
+  }
+  odb::SymbolInfos get_symb_infos(odb::vm_sym_t idx) override {
+    return odb::SymbolInfos{idx, "sym" + std::to_string(idx), sym_addr(idx)};
+  }
+  odb::vm_sym_t find_sym_id(const std::string &) override {
+    throw odb::VMApi::Error("not implemented");
+  }
+
+  std::string get_code_text(odb::vm_ptr_t addr,
+                            odb::vm_size_t &addr_dist) override {
+    ++code_calls;
+    auto it = std::find(starts.begin(), starts.end(), addr);
+    if (it == starts.end()) {
+      addr_dist = 1;
+      return ""; // middle of an instruction
+    }
+    auto i = it - starts.begin();
+    addr_dist = i % 3 + 1;
+    return "ins" + std::to_string(i);
+  }
+
+private:
+  odb::vm_ptr_t sym_addr(odb::vm_sym_t idx) const {
+    return starts[idx * 50];
+  }
+};
+
+// VarCodeVM with 4 registers of 4 bytes, that count the values read
+class RegsVM : public VarCodeVM {
+public:
+  std::uint32_t regs[4] = {10, 11, 12, 13};
+  std::size_t reg_reads = 0;
+
+  odb::VMInfos get_vm_infos() override {
+    auto infos = VarCodeVM::get_vm_infos();
+    infos.regs_count = 4;
+    return infos;
+  }
+
+  void get_reg(odb::vm_reg_t idx, odb::RegInfos &infos,
+               bool val_only) override {
+    if (idx >= 4)
+      throw odb::VMApi::Error("invalid register");
+    if (!val_only) {
+      infos.idx = idx;
+      infos.name = "r" + std::to_string(idx);
+      infos.size = 4;
+      infos.kind = odb::RegKind::general;
+      return;
+    }
+    ++reg_reads;
+    std::memcpy(infos.val.data(), &regs[idx], 4);
+  }
+
+  void set_reg(odb::vm_reg_t idx, const std::uint8_t *new_val) override {
+    std::memcpy(&regs[idx], new_val, 4);
+  }
+};
+
+std::uint32_t db_reg(odb::Debugger &db, odb::vm_reg_t idx) {
+  std::uint32_t res;
+  db.get_reg(idx, reinterpret_cast<std::uint8_t *>(&res));
+  return res;
+}
+
 } // namespace
 
+TEST_CASE("debugger regs cache", "") {
+  auto vm = std::make_unique<RegsVM>();
+  auto &regs = *vm;
+  odb::Debugger db(std::move(vm));
+  db.on_init();
+  db.stop();
+
+  // Infos loaded by on_init
+  REQUIRE(db.find_reg_id("r2") == 2);
+
+  // Values read once per instruction
+  REQUIRE(db_reg(db, 1) == 11);
+  regs.regs[1] = 21;
+  REQUIRE(db_reg(db, 1) == 11);
+  REQUIRE(regs.reg_reads == 1);
+
+  db.resume(odb::ResumeType::Step);
+  db.on_update();
+  REQUIRE(db_reg(db, 1) == 21);
+  REQUIRE(db_reg(db, 1) == 21);
+  REQUIRE(regs.reg_reads == 2);
+
+  // Read again after set_reg
+  std::uint32_t val = 31;
+  db.set_reg(1, reinterpret_cast<std::uint8_t *>(&val));
+  REQUIRE(db_reg(db, 1) == 31);
+  REQUIRE(regs.reg_reads == 3);
+
+  // Always read without the cache
+  db.set_regs_cache(false);
+  regs.regs[1] = 41;
+  REQUIRE(db_reg(db, 1) == 41);
+  REQUIRE(db_reg(db, 1) == 41);
+  REQUIRE(regs.reg_reads == 5);
+}
+
+TEST_CASE("debugger find_code_before", "") {
+  auto vm = std::make_unique<VarCodeVM>();
+  auto &code = *vm;
+  odb::Debugger db(std::move(vm));
+  db.on_init();
+  db.stop();
+
+  // Decoded from the symbol at #50
+  odb::vm_size_t n;
+  REQUIRE(db.find_code_before(code.starts[60], 5, n) == code.starts[55]);
+  REQUIRE(n == 5);
+
+  // Then found in the index
+  auto calls = code.code_calls;
+  REQUIRE(db.find_code_before(code.starts[60], 8, n) == code.starts[52]);
+  REQUIRE(n == 8);
+  REQUIRE(code.code_calls == calls);
+
+  // Across a symbol, and up to the start of the memory
+  REQUIRE(db.find_code_before(code.starts[52], 4, n) == code.starts[48]);
+  REQUIRE(n == 4);
+  REQUIRE(db.find_code_before(code.starts[2], 5, n) == 0);
+  REQUIRE(n == 2);
+  REQUIRE(db.find_code_before(0, 5, n) == 0);
+  REQUIRE(n == 0);
+
+  // Writes drop the code
+  std::uint8_t byte = 0;
+  db.write_mem(code.starts[58], 1, &byte);
+  calls = code.code_calls;
+  REQUIRE(db.find_code_before(code.starts[60], 5, n) == code.starts[55]);
+  REQUIRE(code.code_calls > calls);
+  calls = code.code_calls;
+  odb::vm_size_t dist;
+  REQUIRE(db.get_code_text(code.starts[57], dist) == "ins57");
+  REQUIRE(code.code_calls == calls);
+}
+
 TEST_CASE("rom call_add", "") {
   auto rom = mvm0::parse_file(PATH_CALL_ADD);
   REQUIRE(rom.ins.size() == 9);
@@ -714,3 +914,92 @@ TEST_CASE("debug call_add run_direct change ret addr", "") {
   REQUIRE(db_get_reg(db, 1) == 45);
   REQUIRE(db_get_reg(db, 10) == 102);
 }
+
+TEST_CASE("debug call_add event log", "") {
+  using namespace mvm0;
+  auto rom = parse_file(PATH_CALL_ADD);
+  auto path = std::string(BUILD_DIR "test_event_log.logs");
+  CPU cpu(rom);
+  cpu.init();
+  odb::EventLog log(path, odb::LogLevel::INFO,
+                    odb::EventLog::parse_events("vm_read_mem"));
+  REQUIRE(log.enabled(odb::LogEvent::STOP));
+  REQUIRE(log.enabled(odb::LogEvent::VM_READ_MEM));
+  REQUIRE(!log.enabled(odb::LogEvent::VM_GET_REG));
+  REQUIRE(!log.enabled(odb::LogEvent::UPDATE));
+
+  odb::Debugger db(std::make_unique<VMApi>(cpu));
+  db.set_event_log(&log);
+  db.on_init();
+  db.add_breakpoint(1029);
+  db_resume(db, cpu, odb::ResumeType::Continue);
+  REQUIRE(db_get_reg(db, 0) == 12);
+  db_read_u32(db, 1020);
+  db_resume(db, cpu, odb::ResumeType::ToFinish);
+  REQUIRE(db.get_state() == odb::Debugger::State::EXIT);
+  log.flush();
+  REQUIRE(log.dropped() == 0);
+
+  std::ifstream is(path, std::ios::binary);
+  std::ostringstream os;
+  odb::EventLog::dump(is, os);
+  std::vector<std::string> events;
+  std::istringstream lines(os.str());
+  for (std::string line; std::getline(lines, line);)
+    events.push_back(line.substr(line.find("] ") + 2));
+
+  REQUIRE(events.size() == 8);
+  REQUIRE(events[0].rfind("VM_INFOS regs=", 0) == 0);
+  REQUIRE(events[1] == "INIT addr=0x400 state=RUNNING_TOFINISH");
+  REQUIRE(events[2] == "ADD_BKP addr=0x405");
+  REQUIRE(events[3] == "RESUME type=Continue");
+  REQUIRE(events[4] == "STOP addr=0x405 reason=BREAKPOINT");
+  REQUIRE(events[5] == "VM_READ_MEM addr=0x3fc size=4");
+  REQUIRE(events[6] == "RESUME type=ToFinish");
+  REQUIRE(events[7] == "EXIT addr=0x408");
+
+  std::istringstream bad("not a log file");
+  REQUIRE_THROWS_AS(odb::EventLog::dump(bad, os), odb::VMApi::Error);
+  REQUIRE_THROWS_AS(odb::EventLog::parse_events("stop,foo"),
+                    odb::VMApi::Error);
+}
+
+TEST_CASE("debug call_add vm profile", "") {
+  using namespace mvm0;
+  auto rom = parse_file(PATH_CALL_ADD);
+  CPU cpu(rom);
+  cpu.init();
+  odb::Debugger db(std::make_unique<VMApi>(cpu));
+  db.enable_vm_profile();
+  db.on_init();
+  db.add_breakpoint(1029);
+  db_resume(db, cpu, odb::ResumeType::Continue);
+  db_read_u32(db, 1020);
+  db_write_u32(db, 1020, 5);
+  REQUIRE_THROWS(db.find_reg_id("lol"));
+  db_resume(db, cpu, odb::ResumeType::ToFinish);
+  REQUIRE(db.get_state() == odb::Debugger::State::EXIT);
+
+  const auto &stats = db.stats();
+  REQUIRE(stats.vm_profile.size() == odb::VM_API_CALLS_COUNT);
+  // One timing for every call counted by the debugger
+  for (std::size_t i = 0; i < odb::VM_API_CALLS_COUNT; ++i)
+    REQUIRE(stats.vm_profile[i].time.count == stats.vm_calls[i]);
+
+  auto prof = [&](odb::VMApiCall call) -> const odb::ServerStats::VMCall & {
+    return stats.vm_profile[static_cast<std::size_t>(call)];
+  };
+  REQUIRE(prof(odb::VMApiCall::GET_UPDATE_INFOS).sizes.count == 0);
+  REQUIRE(prof(odb::VMApiCall::READ_MEM).sizes.sum == 4);
+  REQUIRE(prof(odb::VMApiCall::WRITE_MEM).sizes.max == 4);
+  REQUIRE(prof(odb::VMApiCall::FIND_REG_ID).errors == 1);
+  REQUIRE(prof(odb::VMApiCall::FIND_REG_ID).sizes.count == 0);
+
+  // The timings are next to the counts
+  std::ostringstream os;
+  stats.dump(os);
+  auto out = os.str();
+  REQUIRE(out.find("VM profile:\n") == std::string::npos);
+  REQUIRE(out.find("  read_mem: 1, errors: 0, total: ") != std::string::npos);
+  REQUIRE(out.find("  find_reg_id: 1, errors: 1, ") != std::string::npos);
+}
@@ -1,8 +1,25 @@
 #include "utils.hh"
 
+#include <odb/mess/db-client.hh>
+#include <odb/mess/simple-cli-client.hh>
+#include <odb/server/db-client-impl-vmside.hh>
+
 #define PATH_CALL_FACT (MVM0_EXS_DIR + std::string("call_fact.vv"))
 
-namespace {}
+namespace {
+
+// Sends at most 2 new frames at every stop, like a remote server with a
+// deeper call stack
+class StackLimitImpl : public odb::DBClientImplVMSide {
+public:
+  using odb::DBClientImplVMSide::DBClientImplVMSide;
+
+  void check_stopped(odb::DBClientUpdate &udp) override {
+    odb::DBClientImplVMSide::check_stopped(udp, 2);
+  }
+};
+
+} // namespace
 
 TEST_CASE("debug call_fact exec", "") {
   using namespace mvm0;
@@ -153,3 +170,116 @@ TEST_CASE("debug call_fact infos", "") {
 
   REQUIRE(db.get_execution_point() == 1024);
 }
+
+TEST_CASE("debug call_fact stack syms", "") {
+  using namespace mvm0;
+  auto rom = parse_file(PATH_CALL_FACT);
+  CPU cpu(rom);
+  cpu.init();
+  odb::Debugger db(std::make_unique<VMApi>(cpu));
+  db.on_init();
+
+  odb::vm_size_t off;
+  REQUIRE(db.get_symbol_containing(1025, off) == 1);
+  REQUIRE(off == 0);
+  REQUIRE(db.get_symbol_containing(1029, off) == 1);
+  REQUIRE(off == 4);
+  REQUIRE(db.get_symbol_containing(1023, off) == odb::VM_SYM_NULL);
+
+  db.add_breakpoint(1041);
+  db_resume(db, cpu, odb::ResumeType::Continue);
+  REQUIRE(db.get_execution_point() == 1041);
+
+  odb::DBClientImplVMSide impl(db);
+  odb::CallStack cs;
+  std::vector<odb::vm_sym_t> frames_syms;
+  std::vector<odb::SymbolInfos> syms;
+  impl.get_stack_syms(cs, frames_syms, syms);
+  REQUIRE(cs.size() == 5);
+  REQUIRE(frames_syms == std::vector<odb::vm_sym_t>{0, 1, 1, 1, 1});
+  REQUIRE(syms.size() == 2);
+  REQUIRE(syms[0].name == "_begin");
+  REQUIRE(syms[1].name == "fact");
+
+  // One request for all frames
+  odb::DBClient client(std::make_unique<odb::DBClientImplVMSide>(db));
+  client.connect();
+  odb::SimpleCLIClient cli(client);
+  client.reset_cache_stats();
+  REQUIRE(cli.exec("bt") == "0x411 (<fact> + 0x10)\n"
+                            "0x40b (<fact> + 0xa)\n"
+                            "0x40b (<fact> + 0xa)\n"
+                            "0x40b (<fact> + 0xa)\n"
+                            "0x413 (<_begin> + 0x13)\n");
+  REQUIRE(client.cache_stats().requests == 1);
+}
+
+TEST_CASE("debug call_fact stack delta", "") {
+  using namespace mvm0;
+  auto rom = parse_file(PATH_CALL_FACT);
+  CPU cpu(rom);
+  cpu.init();
+  odb::Debugger db(std::make_unique<VMApi>(cpu));
+  db.on_init();
+
+  std::uint64_t version = 0;
+  REQUIRE(db.call_stack_diff(version) == 0);
+  db.add_breakpoint(1041);
+  db_resume(db, cpu, odb::ResumeType::Continue);
+  REQUIRE(db.get_call_stack().size() == 5);
+  // The entry frame call_addr was set
+  REQUIRE(db.call_stack_diff(version) == 0);
+  auto old_version = version;
+  db_resume(db, cpu, odb::ResumeType::Step);
+  REQUIRE(db.get_call_stack().size() == 4);
+  REQUIRE(db.call_stack_diff(version) == 4);
+  REQUIRE(db.call_stack_diff(old_version) == 0);
+  db.del_breakpoint(1041);
+
+  // Client with missing frames
+  CPU cpu2(rom);
+  cpu2.init();
+  odb::Debugger db2(std::make_unique<VMApi>(cpu2));
+  db2.on_init();
+  db2.stop();
+  odb::DBClient client(std::make_unique<StackLimitImpl>(db2));
+  client.connect();
+  odb::SimpleCLIClient cli(client);
+  const auto &stats = client.cache_stats();
+  cli.exec("b 1041");
+  cli.exec("continue");
+  client.reset_cache_stats();
+  while (client.state() == odb::DBClient::State::VM_RUNNING) {
+    REQUIRE(cpu2.step() == 0);
+    db2.on_update();
+    client.check_stopped();
+  }
+  auto nchecks = stats.requests;
+  REQUIRE(client.get_call_stack_depth() == 5);
+  REQUIRE(client.get_call_frames(3, 5)[1].caller_start_addr == 1025);
+  REQUIRE(stats.requests == nchecks);
+
+  const auto &cs = client.get_call_stack();
+  REQUIRE(stats.requests == nchecks + 1);
+  REQUIRE(stats.stack.misses == 3);
+  const auto &ref = db2.get_call_stack();
+  REQUIRE(cs.size() == ref.size());
+  for (std::size_t i = 0; i < cs.size(); ++i) {
+    REQUIRE(cs[i].caller_start_addr == ref[i].caller_start_addr);
+    REQUIRE(cs[i].call_addr == ref[i].call_addr);
+  }
+
+  // Return: no new frame
+  cli.exec("step");
+  client.reset_cache_stats();
+  while (client.state() == odb::DBClient::State::VM_RUNNING) {
+    REQUIRE(cpu2.step() == 0);
+    db2.on_update();
+    client.check_stopped();
+  }
+  nchecks = stats.requests;
+  REQUIRE(client.get_call_stack().size() == 4);
+  REQUIRE(client.get_call_stack()[3].caller_start_addr == 1025);
+  REQUIRE(stats.requests == nchecks);
+  REQUIRE(stats.stack.misses == 0);
+}
@@ -430,6 +430,21 @@ void test_call_add_bt(SimpleCLIMode mode) {
   REQUIRE(vals[9] == "0x408 (<_begin> + 0x8)");
 }
 
+void test_call_add_stats(SimpleCLIMode mode) {
+  const char *cmds = ""
+                     "b @my_add\n"
+                     "continue\n"
+                     "stats\n";
+  auto out = run_simplecli(mode, PATH_CALL_ADD, cmds);
+  REQUIRE(out.find("\nLoop: ") != std::string::npos);
+  REQUIRE(out.find("\nVM calls:\n") != std::string::npos);
+  REQUIRE(out.find("\n  get_update_infos: ") != std::string::npos);
+  REQUIRE(out.find("\nBreakpoints hits:\n  0x401: 1\n") != std::string::npos);
+  // Only requests from remote clients are counted
+  if (mode == SimpleCLIMode::WITH_TCP)
+    REQUIRE(out.find("\n  ADD_BKPS ") != std::string::npos);
+}
+
 } // namespace
 
 TEST_CASE("simplecli_on_server call_add preg", "") {
@@ -500,6 +515,10 @@ TEST_CASE("simplecli_on_server call_add bt", "") {
   test_call_add_bt(SimpleCLIMode::ON_SERVER);
 }
 
+TEST_CASE("simplecli_on_server call_add stats", "") {
+  test_call_add_stats(SimpleCLIMode::ON_SERVER);
+}
+
 TEST_CASE("simplecli_with_tcp call_add preg", "") {
   test_call_add_preg(SimpleCLIMode::WITH_TCP);
 }
@@ -567,3 +586,7 @@ TEST_CASE("simplecli_with_tcp call_add state", "") {
 TEST_CASE("simplecli_with_tcp call_add bt", "") {
   test_call_add_bt(SimpleCLIMode::WITH_TCP);
 }
+
+TEST_CASE("simplecli_with_tcp call_add stats", "") {
+  test_call_add_stats(SimpleCLIMode::WITH_TCP);
+}
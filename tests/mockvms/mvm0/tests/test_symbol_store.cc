@@ -0,0 +1,426 @@
+#include "utils.hh"
+
+#include <chrono>
+#include <map>
+
+#include <odb/server/symbol-store.hh>
+
+namespace {
+
+// Code-less VM, symbol #i is "module_function_<i>", at address i * dist
+class SymsVM : public odb::VMApi {
+public:
+  static constexpr odb::vm_size_t SYM_DIST = 16;
+
+  odb::vm_sym_t nsyms;
+  odb::vm_size_t dist;
+  std::size_t infos_calls = 0;
+  std::size_t find_calls = 0;
+
+  SymsVM(odb::vm_sym_t nsyms, odb::vm_size_t dist = SYM_DIST)
+      : nsyms(nsyms), dist(dist) {}
+
+  static std::string sym_name(odb::vm_sym_t idx) {
+    return "module_function_" + std::to_string(idx);
+  }
+
+  odb::VMInfos get_vm_infos() override {
+    odb::VMInfos infos;
+    infos.name = "syms";
+    infos.regs_count = 0;
+    infos.memory_size = nsyms * dist;
+    infos.symbols_count = nsyms;
+    infos.pointer_size = 8;
+    infos.integer_size = 8;
+    infos.use_opcode = true;
+    return infos;
+  }
+
+  UpdateInfos get_update_infos() override {
+    return UpdateInfos{UpdateState::OK, 0};
+  }
+
+  void get_reg(odb::vm_reg_t, odb::RegInfos &, bool) override {
+    throw odb::VMApi::Error("no registers");
+  }
+  void set_reg(odb::vm_reg_t, const std::uint8_t *) override {
+    throw odb::VMApi::Error("no registers");
+  }
+  odb::vm_reg_t find_reg_id(const std::string &) override {
+    throw odb::VMApi::Error("no registers");
+  }
+
+  void read_mem(odb::vm_ptr_t, odb::vm_size_t size,
+                std::uint8_t *out_buf) override {
+    std::fill(out_buf, out_buf + size, 0);
+  }
+  void write_mem(odb::vm_ptr_t, odb::vm_size_t, const std::uint8_t *) override {
+  }
+
+  std::vector<odb::vm_sym_t> get_symbols(odb::vm_ptr_t addr,
+                                         odb::vm_size_t size) override {
+    std::vector<odb::vm_sym_t> res;
+    for (auto i = (addr + dist - 1) / dist; i < nsyms && i * dist - addr < size;
+         ++i)
+      res.push_back(i);
+    return res;
+  }
+  odb::SymbolInfos get_symb_infos(odb::vm_sym_t idx) override {
+    ++infos_calls;
+    return odb::SymbolInfos{idx, sym_name(idx), idx * dist};
+  }
+  odb::vm_sym_t find_sym_id(const std::string &name) override {
+    ++find_calls;
+    auto idx = std::stoul(name.substr(name.rfind('_') + 1));
+    if (idx >= nsyms)
+      throw odb::VMApi::Error("unknown symbol");
+    return idx;
+  }
+
+  std::string get_code_text(odb::vm_ptr_t, odb::vm_size_t &addr_dist) override {
+    addr_dist = 1;
+    return "nop";
+  }
+};
+
+// Allocator counting all bytes in use, for the std::map baseline
+std::size_t g_alloc_bytes = 0;
+
+template <class T> struct CountAlloc {
+  using value_type = T;
+
+  CountAlloc() = default;
+  template <class U> CountAlloc(const CountAlloc<U> &) {}
+
+  T *allocate(std::size_t n) {
+    g_alloc_bytes += n * sizeof(T);
+    return std::allocator<T>().allocate(n);
+  }
+  void deallocate(T *p, std::size_t n) {
+    g_alloc_bytes -= n * sizeof(T);
+    std::allocator<T>().deallocate(p, n);
+  }
+
+  template <class U> bool operator==(const CountAlloc<U> &) const {
+    return true;
+  }
+  template <class U> bool operator!=(const CountAlloc<U> &) const {
+    return false;
+  }
+};
+
+template <class K, class V>
+using CountMap =
+    std::map<K, V, std::less<K>, CountAlloc<std::pair<const K, V>>>;
+using CountString =
+    std::basic_string<char, std::char_traits<char>, CountAlloc<char>>;
+
+// Symbol storage of the Debugger before SymbolStore
+struct MapsSymbols {
+  struct Infos {
+    odb::vm_sym_t idx;
+    CountString name;
+    odb::vm_ptr_t addr;
+  };
+  CountMap<odb::vm_sym_t, Infos> map_syms;
+  CountMap<CountString, odb::vm_sym_t> smap_syms;
+  CountMap<odb::vm_ptr_t, odb::vm_sym_t> syms_pos;
+
+  void insert(const odb::SymbolInfos &infos) {
+    CountString name(infos.name.begin(), infos.name.end());
+    map_syms.emplace(infos.idx, Infos{infos.idx, name, infos.addr});
+    smap_syms.emplace(name, infos.idx);
+    syms_pos.emplace(infos.addr, infos.idx);
+  }
+};
+
+// Average time of `f(i)` for i in [0, n[, in ns
+template <class F> double time_ns(std::size_t n, F f) {
+  auto start = std::chrono::steady_clock::now();
+  for (std::size_t i = 0; i < n; ++i)
+    f(i);
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(end - start).count() / n;
+}
+
+} // namespace
+
+TEST_CASE("symbol_store", "") {
+  odb::SymbolStore store;
+  REQUIRE(store.find_id(0) == odb::SymbolStore::npos);
+  REQUIRE(store.find_name("a") == odb::SymbolStore::npos);
+  REQUIRE(store.lower_bound(0) == odb::SymbolStore::npos);
+
+  REQUIRE(store.insert(odb::SymbolInfos{7, "main", 0x420}));
+  REQUIRE(store.insert(odb::SymbolInfos{3, "_start", 0x400}));
+  REQUIRE(store.insert(odb::SymbolInfos{9, "alias", 0x420}));
+  REQUIRE(!store.insert(odb::SymbolInfos{7, "other", 0x500}));
+  REQUIRE(store.size() == 3);
+
+  auto idx = store.find_id(7);
+  REQUIRE(idx != odb::SymbolStore::npos);
+  REQUIRE(store.name(idx) == "main");
+  REQUIRE(store.addr(idx) == 0x420);
+  REQUIRE(store.find_name("_start") == store.find_id(3));
+  REQUIRE(store.find_name("other") == odb::SymbolStore::npos);
+  auto infos = store.infos(store.find_id(9));
+  REQUIRE(infos.idx == 9);
+  REQUIRE(infos.name == "alias");
+
+  REQUIRE(store.id(store.lower_bound(0x401)) == 7);
+  REQUIRE(store.id(store.find_before(0x420)) == 3);
+  REQUIRE(store.find_before(0x400) == odb::SymbolStore::npos);
+  REQUIRE(store.lower_bound(0x421) == odb::SymbolStore::npos);
+
+  std::vector<odb::vm_sym_t> ids;
+  store.find_range(0x400, 0x21, ids);
+  REQUIRE(ids == std::vector<odb::vm_sym_t>{3, 7, 9});
+  ids.clear();
+  store.find_range(0x401, 0x1f, ids);
+  REQUIRE(ids.empty());
+
+  // Interned name, the first symbol keeps it
+  REQUIRE(store.insert(odb::SymbolInfos{4, "main", 0x300}));
+  REQUIRE(store.name(store.find_id(4)) == "main");
+  REQUIRE(store.id(store.find_name("main")) == 7);
+  REQUIRE(store.id(store.lower_bound(0)) == 4);
+
+  // Tables growth
+  for (odb::vm_sym_t i = 100; i < 5000; ++i)
+    REQUIRE(store.insert(
+        odb::SymbolInfos{i, "s" + std::to_string(i), 0x10000 - i}));
+  for (odb::vm_sym_t i = 100; i < 5000; ++i) {
+    REQUIRE(store.addr(store.find_id(i)) == 0x10000 - i);
+    REQUIRE(store.id(store.find_name("s" + std::to_string(i))) == i);
+  }
+  REQUIRE(store.id(store.find_name("main")) == 7);
+  ids.clear();
+  store.find_range(0x10000 - 4999, 4900, ids);
+  REQUIRE(ids.size() == 4900);
+  REQUIRE(ids.front() == 4999);
+  REQUIRE(ids.back() == 100);
+}
+
+TEST_CASE("symbol_store interleaved", "") {
+  // Lookups between insertions, with many sorted runs of addresses
+  odb::SymbolStore store;
+  std::map<odb::vm_ptr_t, odb::vm_sym_t> ref;
+  std::uint32_t rng = 3;
+  for (odb::vm_sym_t i = 0; i < 3000; ++i) {
+    rng = rng * 1103515245 + 12345;
+    odb::vm_ptr_t addr = (rng >> 8) % 100000 * 2;
+    if (ref.count(addr))
+      continue;
+    store.insert(odb::SymbolInfos{i, "s" + std::to_string(i), addr});
+    ref.emplace(addr, i);
+
+    auto it = ref.lower_bound(addr / 2);
+    REQUIRE(store.id(store.lower_bound(addr / 2)) == it->second);
+    auto before = store.find_before(addr + 1);
+    REQUIRE(store.id(before) == i);
+    std::vector<odb::vm_sym_t> ids;
+    store.find_range(addr / 2, 2000, ids);
+    std::vector<odb::vm_sym_t> ref_ids;
+    for (; it != ref.end() && it->first < addr / 2 + 2000; ++it)
+      ref_ids.push_back(it->second);
+    REQUIRE(ids == ref_ids);
+  }
+}
+
+TEST_CASE("debugger symbols preload", "") {
+  auto vm = std::make_unique<SymsVM>(100);
+  auto &api = *vm;
+  odb::Debugger db(std::move(vm));
+  db.on_init();
+  REQUIRE(api.infos_calls == 100);
+
+  REQUIRE(db.get_symbols(0, 100 * SymsVM::SYM_DIST).size() == 100);
+  REQUIRE(db.get_symbol_at(42 * SymsVM::SYM_DIST) == 42);
+  REQUIRE(db.get_symbol_at(42 * SymsVM::SYM_DIST + 1) == odb::VM_SYM_NULL);
+  REQUIRE(db.find_sym_id(SymsVM::sym_name(42)) == 42);
+  REQUIRE(db.get_symbol_infos(42).name == SymsVM::sym_name(42));
+  REQUIRE(api.infos_calls == 100);
+  REQUIRE(api.find_calls == 0);
+}
+
+TEST_CASE("debugger symbols lazy", "") {
+  auto vm = std::make_unique<SymsVM>(odb::Debugger::SYMS_PRELOAD_MAX + 1);
+  auto &api = *vm;
+  odb::Debugger db(std::move(vm));
+  db.on_init();
+  REQUIRE(api.infos_calls == 0);
+
+  // Only the window around the address
+  REQUIRE(db.get_symbol_at(1000 * SymsVM::SYM_DIST) == 1000);
+  auto loaded = api.infos_calls;
+  REQUIRE(loaded > 0);
+  REQUIRE(loaded < 100);
+  REQUIRE(db.get_symbol_infos(1001).addr == 1001 * SymsVM::SYM_DIST);
+  REQUIRE(db.find_sym_id(SymsVM::sym_name(1001)) == 1001);
+  REQUIRE(api.infos_calls == loaded);
+  REQUIRE(api.find_calls == 0);
+
+  REQUIRE(db.find_sym_id(SymsVM::sym_name(50000)) == 50000);
+  REQUIRE(api.find_calls == 1);
+  REQUIRE(api.infos_calls == loaded + 1);
+  REQUIRE(db.get_symbol_infos(50000).addr == 50000 * SymsVM::SYM_DIST);
+  REQUIRE(api.infos_calls == loaded + 1);
+}
+
+TEST_CASE("debugger symbols window", "") {
+  constexpr odb::vm_ptr_t SCAN_SIZE = 1 << 19;
+  auto make_db = [] {
+    auto vm = std::make_unique<SymsVM>(odb::Debugger::SYMS_PRELOAD_MAX + 1);
+    auto db = std::make_unique<odb::Debugger>(std::move(vm));
+    db->on_init();
+    return db;
+  };
+
+  // Sequential scan: the window grows, until it reaches the budget
+  auto db = make_db();
+  for (odb::vm_ptr_t addr = 0; addr < SCAN_SIZE; addr += 4)
+    REQUIRE(db->get_symbol_at(addr) ==
+            (addr % SymsVM::SYM_DIST ? odb::VM_SYM_NULL
+                                     : addr / SymsVM::SYM_DIST));
+  REQUIRE(db->syms_stats().vm_get_symbols < 32);
+  // Every symbol loaded once, the last window goes past the scan
+  REQUIRE(db->syms_stats().vm_get_symb_infos <=
+          SCAN_SIZE / SymsVM::SYM_DIST + odb::Debugger::SYM_WINDOW_BUDGET);
+  REQUIRE(db->syms_window() > odb::Debugger::SYM_WINDOW_MIN);
+  REQUIRE(db->syms_window() <=
+          SymsVM::SYM_DIST * odb::Debugger::SYM_WINDOW_BUDGET);
+
+  // Random lookups: back to the smallest window
+  for (odb::vm_ptr_t i = 1; i <= 16; ++i)
+    db->get_symbol_at(SCAN_SIZE + i * 7919 * 4096 % SCAN_SIZE);
+  REQUIRE(db->syms_window() == odb::Debugger::SYM_WINDOW_MIN);
+
+  // Fixed window
+  db = make_db();
+  db->set_syms_window_adaptive(false);
+  for (odb::vm_ptr_t addr = 0; addr < SCAN_SIZE; addr += 4)
+    db->get_symbol_at(addr);
+  REQUIRE(db->syms_stats().vm_get_symbols >=
+          SCAN_SIZE / odb::Debugger::SYM_WINDOW_MIN);
+  REQUIRE(db->syms_window() == odb::Debugger::SYM_WINDOW_MIN);
+}
+
+TEST_CASE("debugger symbol containing", "") {
+  // Symbols far apart, only loaded around the lookups
+  constexpr odb::vm_size_t DIST = 1 << 16;
+  auto vm = std::make_unique<SymsVM>(odb::Debugger::SYMS_PRELOAD_MAX + 1, DIST);
+  odb::Debugger db(std::move(vm));
+  db.on_init();
+
+  odb::vm_size_t off;
+  REQUIRE(db.get_symbol_containing(10 * DIST, off) == 10);
+  REQUIRE(off == 0);
+  REQUIRE(db.get_symbol_containing(20 * DIST + 5000, off) == 20);
+  REQUIRE(off == 5000);
+  REQUIRE(db.get_symbol_containing(30 * DIST - 1, off) == 29);
+  REQUIRE(off == DIST - 1);
+  // Windows doubling back to the symbol
+  // The window around 30 * DIST - 1 also loads #30
+  REQUIRE(db.syms_stats().vm_get_symbols < 40);
+  REQUIRE(db.syms_stats().vm_get_symb_infos == 4);
+
+  // Too far
+  auto far_vm = std::make_unique<SymsVM>(
+      odb::Debugger::SYMS_PRELOAD_MAX + 1,
+      odb::Debugger::SYM_CONTAINING_MAX_DIST * 2);
+  odb::Debugger far_db(std::move(far_vm));
+  far_db.on_init();
+  auto far_addr = odb::Debugger::SYM_CONTAINING_MAX_DIST * 2;
+  REQUIRE(far_db.get_symbol_containing(far_addr + 7, off) == 1);
+  REQUIRE(off == 7);
+  REQUIRE(far_db.get_symbol_containing(
+              far_addr + odb::Debugger::SYM_CONTAINING_MAX_DIST + 1, off) ==
+          odb::VM_SYM_NULL);
+}
+
+// Memory and lookup time of the symbol storage of the Debugger, compared to
+// the std::map based one, for a VM with a million symbols
+TEST_CASE("bench_symbol_store", "[.bench]") {
+  constexpr odb::vm_sym_t NSYMS = 1000000;
+  constexpr std::size_t NLOOKUPS = 1000000;
+  SymsVM vm(NSYMS);
+  std::vector<odb::SymbolInfos> syms;
+  for (auto id : vm.get_symbols(0, NSYMS * SymsVM::SYM_DIST))
+    syms.push_back(vm.get_symb_infos(id));
+  auto rand_id = [](std::size_t i) {
+    return static_cast<odb::vm_sym_t>(i * 2654435761ULL % NSYMS);
+  };
+  std::vector<std::string> names;
+  for (std::size_t i = 0; i < NLOOKUPS; ++i)
+    names.push_back(SymsVM::sym_name(rand_id(i)));
+
+  std::size_t sum = 0;
+  odb::SymbolStore store;
+  auto store_load = time_ns(NSYMS, [&](std::size_t i) {
+    store.insert(syms[NSYMS - 1 - i]); // worst order for the address array
+  });
+  auto store_id = time_ns(NLOOKUPS, [&](std::size_t i) {
+    sum += store.addr(store.find_id(rand_id(i)));
+  });
+  auto store_name = time_ns(NLOOKUPS, [&](std::size_t i) {
+    sum += store.find_name(names[i]);
+  });
+  auto store_addr = time_ns(NLOOKUPS, [&](std::size_t i) {
+    sum += store.lower_bound(rand_id(i) * SymsVM::SYM_DIST);
+  });
+
+  MapsSymbols maps;
+  auto maps_load =
+      time_ns(NSYMS, [&](std::size_t i) { maps.insert(syms[NSYMS - 1 - i]); });
+  auto maps_id = time_ns(NLOOKUPS, [&](std::size_t i) {
+    sum += maps.map_syms.find(rand_id(i))->second.addr;
+  });
+  auto maps_name = time_ns(NLOOKUPS, [&](std::size_t i) {
+    CountString name(names[i].begin(), names[i].end());
+    sum += maps.smap_syms.find(name)->second;
+  });
+  auto maps_addr = time_ns(NLOOKUPS, [&](std::size_t i) {
+    sum += maps.syms_pos.lower_bound(rand_id(i) * SymsVM::SYM_DIST)->second;
+  });
+
+  std::cout << "symbols: " << NSYMS << " (checksum " << sum << ")\n"
+            << "storage: memory (MB), load, by id, by name, by addr (ns)\n"
+            << "SymbolStore: " << store.memory_usage() / (1 << 20) << ", "
+            << store_load << ", " << store_id << ", " << store_name << ", "
+            << store_addr << "\n"
+            << "std::map: " << g_alloc_bytes / (1 << 20) << ", " << maps_load
+            << ", " << maps_id << ", " << maps_name << ", " << maps_addr
+            << "\n";
+}
+
+// VM calls needed for symbols lookups, with a fixed or adaptive window, for a
+// VM with a million symbols
+TEST_CASE("bench_symbols_window", "[.bench]") {
+  constexpr odb::vm_sym_t NSYMS = 1000000;
+  constexpr std::size_t NLOOKUPS = 100000;
+  constexpr odb::vm_size_t MEM_SIZE = NSYMS * SymsVM::SYM_DIST;
+
+  std::cout << "lookups: VM get_symbols / 1000 queries, VM calls / query, "
+               "ns / query\n";
+  for (bool adaptive : {false, true}) {
+    for (bool seq : {true, false}) {
+      auto vm = std::make_unique<SymsVM>(NSYMS);
+      odb::Debugger db(std::move(vm));
+      db.on_init();
+      db.set_syms_window_adaptive(adaptive);
+
+      std::size_t sum = 0;
+      auto t = time_ns(NLOOKUPS, [&](std::size_t i) {
+        auto addr = seq ? i * 8 : i * 2654435761ULL % MEM_SIZE;
+        sum += db.get_symbol_at(addr);
+      });
+      const auto &st = db.syms_stats();
+      auto calls = st.vm_get_symbols + st.vm_get_symb_infos;
+      std::cout << (adaptive ? "adaptive" : "fixed") << " "
+                << (seq ? "sequential" : "random") << ": "
+                << 1000.0 * st.vm_get_symbols / st.queries << ", "
+                << double(calls) / st.queries << ", " << t << " (checksum "
+                << sum << ")\n";
+    }
+  }
+}
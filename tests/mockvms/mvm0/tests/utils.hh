@@ -136,7 +136,7 @@ inline std::string run_simplecli_withtcp(const std::string &rom_path,
   SystemAsync serv(serv_cmd);
   serv.start();
   // server must start before client
-  std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
 
   REQUIRE(std::system(cli_cmd.c_str()) == 0);
   REQUIRE(serv.wait() == 0);